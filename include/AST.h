@@ -10,15 +10,18 @@ enum class NodeType {
     Number,
     Variable,
     Function,
-    Operator
+    Operator,
+    Array // Literal [a, b, ...]; the elements are its children
 };
 
 struct ASTNode {
     std::vector<std::unique_ptr<ASTNode>> m_children;
     std::variant<std::string, OperatorType, double> m_value;
     NodeType m_type;
+    // Offset of the node's token in the source text
+    size_t m_position{};
 
-    static constexpr std::array<std::string_view, 4> sm_nodeTypeNames = { "Number", "Variable", "Function", "Operator" };
+    static constexpr std::array<std::string_view, 5> sm_nodeTypeNames = { "Number", "Variable", "Function", "Operator", "Array" };
 
     explicit ASTNode(double value)
         : m_type{ NodeType::Number }
@@ -35,6 +38,12 @@ struct ASTNode {
         : m_type{ NodeType::Operator }
         , m_value{ op } {
     }
+    explicit ASTNode(NodeType type)
+        : m_type{ type } {
+        if (type != NodeType::Array) {
+            throw std::invalid_argument("Only Array nodes carry no value");
+        }
+    }
 
     void appendChild(std::unique_ptr<ASTNode> child) {
         m_children.push_back(std::move(child));
@@ -61,6 +70,10 @@ struct ASTNode {
         else if (m_type == NodeType::Operator) {
             node = std::make_unique<ASTNode>(getValue<OperatorType>());
         }
+        else {
+            node = std::make_unique<ASTNode>(NodeType::Array);
+        }
+        node->m_position = m_position;
         for (const auto& child : m_children) {
             node->appendChild(child->clone());
         }
@@ -77,6 +90,7 @@ struct ASTNode {
         case NodeType::Variable:
         case NodeType::Function: cout << node.getValue<std::string>(); break;
         case NodeType::Operator: cout << node.getValue<OperatorType>(); break;
+        case NodeType::Array: cout << "[]"; break;
         }
         cout << '\n';
 
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <span>
+
+// Immutable array of doubles. The storage is reference-counted: copying an Array
+// (into a variable, a function argument, a Value) shares the buffer instead of
+// copying the elements.
+class Array {
+    std::shared_ptr<double[]> m_data;
+    size_t m_size{};
+
+public:
+    // Elementwise results, linspace and literals are capped at 2^27 elements (1 GiB)
+    static constexpr size_t s_maxSize = size_t{ 1 } << 27;
+
+    Array() = default;
+    // Uninitialised storage for `size` elements, written through mutableData() before the array is shared
+    explicit Array(size_t size);
+    explicit Array(std::span<const double> values);
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    const double* data() const { return m_data.get(); }
+    double* mutableData() { return m_data.get(); }
+    std::span<const double> values() const { return { m_data.get(), m_size }; }
+    double operator[](size_t i) const { return m_data[i]; }
+    // Arrays sharing this one's storage, itself included
+    long useCount() const { return m_data.use_count(); }
+};
+
+// Reductions over contiguous doubles. Each keeps s_lanes independent accumulators,
+// so the loops vectorise without reassociating a single running total; results do
+// not depend on alignment, only on the number of elements.
+namespace kernel {
+    inline constexpr size_t s_lanes = 8;
+
+    // Compensated (Kahan) in every lane
+    double sum(std::span<const double> values);
+    double product(std::span<const double> values);
+    double dot(std::span<const double> lhs, std::span<const double> rhs);
+    // Euclidean norm, rescaled when the squares would overflow or underflow
+    double norm(std::span<const double> values);
+    // NaN when the first element is NaN, otherwise NaNs are skipped: the same
+    // answer as std::min_element / std::max_element. Values must not be empty.
+    double minimum(std::span<const double> values);
+    double maximum(std::span<const double> values);
+}
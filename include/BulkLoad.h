@@ -0,0 +1,48 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "Program.h"
+
+class Evaluator;
+class ThreadPool;
+
+struct BulkLoadOptions {
+    // Lexing, parsing and compiling are spread over the pool; nullptr runs them on the caller
+    ThreadPool* pool{};
+    // Also compile every one-parameter function f(x) into a Program with x as its input
+    bool compile{};
+    // Prefix for error messages, "source:line: message"
+    std::string source{ "input" };
+};
+
+struct BulkLoadTimings {
+    std::chrono::nanoseconds parse{};    // Splitting into lines, lexing and parsing (parallel)
+    std::chrono::nanoseconds merge{};    // Keeping the last definition of each function and registering them
+    std::chrono::nanoseconds evaluate{}; // Variable assignments, in file order
+    std::chrono::nanoseconds compile{};  // Optional, parallel
+};
+
+struct BulkLoadResult {
+    size_t definitions{};         // Non-blank, non-comment lines
+    size_t functions{};           // Distinct functions registered
+    size_t replacedFunctions{};   // Definitions overridden by a later one of the same name
+    size_t variables{};           // Assignments evaluated
+    std::unordered_map<std::string, Program> programs; // With BulkLoadOptions::compile
+    std::unordered_map<std::string, std::string> uncompiled; // Functions the compiler rejected, with why
+    BulkLoadTimings timings;
+};
+
+// Loads a text of definitions, one per line ("f(x) = x * rate", "rate = 0.05"; blank lines
+// and lines starting with '#' are skipped) into `evaluator`.
+//
+// Lines are lexed and parsed in parallel chunks. Then, whatever the thread count:
+// - every function is registered, the last definition of a name winning;
+// - variable assignments are evaluated in file order, after all functions, so they
+//   see each function's final definition;
+// - errors report the first failing line.
+// Syntax errors leave `evaluator` untouched; an assignment that fails to evaluate
+// leaves the functions and the variables assigned before it.
+BulkLoadResult loadDefinitions(Evaluator& evaluator, std::string_view text, const BulkLoadOptions& options = {});
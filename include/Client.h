@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Protocol.h"
+#include "Server.h"
+
+// Blocking client for Server, one request at a time. Error responses are thrown
+// as std::runtime_error carrying the server's message.
+class Client {
+    int m_fd{ -1 };
+
+public:
+    // Same address syntax as Server: "unix:/path" or "tcp:PORT"
+    explicit Client(const std::string& address);
+    ~Client();
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    double define(std::string_view assignment);
+    double evaluate(std::string_view expression);
+    // Evaluates each formula over rows of the named input columns; returns one column per formula
+    std::vector<std::vector<double>> batch(const std::vector<std::string>& inputs,
+        const std::vector<std::string>& formulas, std::span<const std::vector<double>> columns);
+    LatencySummary stats();
+
+    // Sends one request payload and returns the Ok response body
+    std::string request(std::string_view payload);
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <iosfwd>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Program.h"
+
+class Evaluator;
+
+// A function of a generated header: name(inputs...) returns the only output of `program`,
+// which reads `inputs` in order
+struct CppFunction {
+    std::string name;
+    std::vector<std::string> inputs;
+    Program program;
+};
+
+// Every function defined by a formula in `evaluator`, compiled with its parameters as
+// inputs: callees are inlined and variables folded in as constants. Throws, naming the
+// function, if one can't be compiled.
+std::vector<CppFunction> userCppFunctions(const Evaluator& evaluator);
+
+// An expression exported with inputs of its own, from "name(x, y, ...) = expr": unlike
+// user functions it may have several. Other names resolve as in evaluator.compile.
+CppFunction cppExpression(const Evaluator& evaluator, std::string_view definition);
+
+// Writes a self-contained C++ header (the standard library only) with, in namespace `ns`,
+// for every function
+//   double name(double input...);
+//   void name_batch(const double* input..., double* out, std::size_t rows);
+// Both follow the program instruction by instruction and embed mathcore's special-function
+// kernels, so they give the interpreter's results bit for bit (only integers beyond 2^53,
+// which the interpreter keeps exact, round as in every compiled program) and throw
+// std::runtime_error with the same message where it would fail, including NaN instead of
+// a failure in rows an if() or && / || excludes. The batch form works a block of rows at a
+// time with one loop per instruction, which compilers vectorise. Programs must be compiled
+// with the default rounding (Accuracy::Strict, no contractFma, expandPowers or polynomials)
+// and call no native functions, rand or randn.
+void emitCpp(std::ostream& out, std::span<const CppFunction> functions, std::string_view ns = "formulas");
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Program;
+class ThreadPool;
+
+// Binary columnar files for batch evaluation. All fields are little-endian:
+//   "MCCOLS01", uint64 row count, uint32 column count, uint32 0,
+//   per column: uint64 data offset, uint32 name offset, uint16 name length, uint8 type, uint8 0,
+//   the names (UTF-8, back to back), then each column's rows as float64 or int64,
+//   starting at a multiple of 64 bytes.
+// Offsets are from the start of the file.
+enum class ColumnType : uint8_t { Float64, Int64 };
+
+struct ColumnSpec {
+    std::string name;
+    ColumnType type{ ColumnType::Float64 };
+};
+
+// A columnar file mapped read-only into memory (read into it where mmap is missing).
+// Column data is used in place, so float64 columns become program inputs without a copy.
+class ColumnFile {
+    struct Mapping;
+
+    std::unique_ptr<Mapping> m_mapping;
+    size_t m_rows{};
+    std::vector<ColumnSpec> m_columns;
+    std::vector<const std::byte*> m_data;
+
+public:
+    // Throws if the file can't be opened or isn't a well-formed columnar file
+    explicit ColumnFile(const std::string& path);
+    ~ColumnFile();
+    ColumnFile(ColumnFile&&) noexcept;
+    ColumnFile& operator=(ColumnFile&&) noexcept;
+
+    size_t rows() const { return m_rows; }
+    const std::vector<ColumnSpec>& columns() const { return m_columns; }
+    std::optional<size_t> find(std::string_view name) const;
+    // The rows of a float64 or int64 column; throws if the column has the other type
+    std::span<const double> doubles(size_t column) const;
+    std::span<const int64_t> integers(size_t column) const;
+};
+
+// Writes a columnar file with a fixed number of rows. Each write goes straight to the
+// column's place in the file, so nothing is buffered: rows can be written in any order,
+// and from several threads at once as long as they are different rows.
+class ColumnWriter {
+    struct File;
+
+    std::unique_ptr<File> m_file;
+    std::vector<ColumnSpec> m_columns;
+    std::vector<uint64_t> m_offsets;
+    size_t m_rows{};
+
+public:
+    ColumnWriter(const std::string& path, std::vector<ColumnSpec> columns, size_t rows);
+    ~ColumnWriter();
+
+    const std::vector<ColumnSpec>& columns() const { return m_columns; }
+    size_t rows() const { return m_rows; }
+
+    // Rows [first, first + values.size()) of a column of the matching type
+    void write(size_t column, size_t first, std::span<const double> values);
+    void write(size_t column, size_t first, std::span<const int64_t> values);
+    // Flushes and closes the file, throwing on failure; the destructor closes silently
+    void close();
+
+private:
+    void writeAt(uint64_t offset, const void* data, size_t size);
+};
+
+// Runs program over every row of `input` and streams output k into column k of `output`.
+// Input i is the column named inputNames[i]: float64 columns are read in place, int64
+// ones converted a block at a time. Blocks run on `pool` when the program is pure.
+void evaluateColumns(const Program& program, std::span<const std::string> inputNames, const ColumnFile& input,
+    ColumnWriter& output, ThreadPool* pool = nullptr);
+
+// CSV with a header row of column names, to and from columnar files. Columns whose
+// fields are all integers become int64 and the rest float64; doubles are written back
+// in their shortest round-trip form.
+void csvToColumns(std::istream& csv, const std::string& path);
+void columnsToCsv(const ColumnFile& file, std::ostream& csv);
@@ -0,0 +1,90 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "AST.h"
+#include "Program.h"
+
+class Evaluator;
+
+// Lowers an AST into a Program. Names listed as inputs become per-row columns;
+// every other variable is resolved once, at compile time, the same way
+// Evaluator::evaluate would resolve it. User functions are inlined.
+// Identical operations are emitted once (value numbering), also across the
+// roots of a multi-output compile, so formulas sharing subexpressions share work.
+// Arithmetic on constants is strength-reduced as it is emitted (see CompileOptions),
+// and instructions those rewrites leave unused are dropped before register allocation.
+// if(), && and || evaluate every operand for every row and select the results with
+// masks, so batches run without branches; rows the interpreter would skip can't fail.
+class Compiler {
+    using Bindings = std::unordered_map<std::string, uint32_t>;
+
+    const Evaluator& m_evaluator;
+    std::vector<std::string> m_inputNames;
+    const std::unordered_map<std::string, double>* m_localVars;
+    Program m_program;
+    std::vector<uint32_t> m_inputRegisters;
+    std::unordered_map<uint64_t, uint32_t> m_constantRegisters;
+    std::map<std::tuple<OpCode, uint32_t, uint32_t, uint32_t, uint32_t>, uint32_t> m_valueNumbers;
+    std::map<std::tuple<const NativeFunction*, std::vector<uint32_t>, uint32_t>, uint32_t> m_callNumbers; // Pure calls only
+    uint32_t m_nextRegister{};
+    size_t m_inlineDepth{};
+    size_t m_position{}; // Source offset recorded for emitted instructions
+    uint32_t m_scope{};  // Index of the function being inlined in Program::m_functionNames
+    std::vector<std::string> m_inlining; // User functions being inlined, outermost first
+    // Mask of the rows the interpreter would evaluate the current node for, inside if()
+    // branches and the later operands of && and ||; see Instruction::m_guard
+    uint32_t m_guard{ Instruction::s_unguarded };
+
+    static constexpr size_t s_maxInlineDepth = 64;
+    // Larger integer powers stay calls to std::pow: the error of a multiplication chain grows with n
+    static constexpr int s_maxExpandedPower = 16;
+    // Smaller polynomials (x^2 + 1) are cheaper as separate instructions
+    static constexpr size_t s_minPolynomialOperators = 3;
+
+public:
+    Compiler(const Evaluator& evaluator, std::vector<std::string> inputNames,
+        const std::unordered_map<std::string, double>* localVars = nullptr);
+
+    Program compile(const ASTNode& root);
+    // One program with an output per root, in order
+    Program compile(const std::vector<const ASTNode*>& roots);
+
+private:
+    uint32_t compileNode(const ASTNode& node, const Bindings* params);
+    uint32_t lowerNode(const ASTNode& node, const Bindings* params);
+    uint32_t compileVariable(const std::string& name, const Bindings* params);
+    uint32_t compileFunction(const ASTNode& node, const Bindings* params);
+    // Compiles node for the rows where `mask` (and the enclosing guard) is nonzero
+    uint32_t compileGuarded(const ASTNode& node, const Bindings* params, uint32_t mask);
+    uint32_t compileLogical(const ASTNode& node, const Bindings* params);
+    uint32_t compileIf(const ASTNode& node, const Bindings* params);
+    // rand() and randn(), with or without a range / mean and deviation; each call is a site
+    uint32_t compileRandom(const ASTNode& node, const Bindings* params);
+    uint32_t compileNative(const std::string& name, const std::shared_ptr<const NativeFunction>& native,
+        const ASTNode& node, const Bindings* params);
+    // Until eliminateDeadCode runs, virtual register r is defined by m_program.m_code[r]
+    uint32_t emit(OpCode op, uint32_t lhs = 0, uint32_t rhs = 0, uint32_t addend = 0);
+    uint32_t emitUnary(OpCode op, uint32_t arg) { return emit(op, arg, arg); }
+    uint32_t emitConstant(double value);
+    // Emits lhs op rhs for the arithmetic operators, applying strength reductions
+    uint32_t emitArithmetic(OpCode op, uint32_t lhs, uint32_t rhs);
+    uint32_t emitPower(uint32_t base, int exponent);
+    // Emits node as Horner/Estrin instructions if it is a polynomial (or ratio of two)
+    // in one variable that is worth collapsing
+    std::optional<uint32_t> compilePolynomial(const ASTNode& node, const Bindings* params);
+    // Coefficients of node as a polynomial in `variable` (set by the first non-constant
+    // variable met), counting operator nodes in `operators`; nullopt if it isn't one
+    std::optional<std::vector<double>> collectPolynomial(const ASTNode& node, const Bindings* params,
+        uint32_t& variable, size_t& operators);
+    uint32_t emitPolynomial(uint32_t variable, const std::vector<double>& coefficients);
+    std::optional<double> constantValue(uint32_t reg) const;
+    // Registers read by an instruction; unary instructions list their argument repeatedly
+    std::vector<uint32_t> operands(const Instruction& ins) const;
+    void eliminateDeadCode();
+    void allocateRegisters();
+};
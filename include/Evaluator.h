@@ -1,19 +1,173 @@
 #pragma once
 #include "AST.h"
+#include "Array.h"
+#include "MemoCache.h"
+#include "NativeFunction.h"
+#include "Program.h"
+#include "Profiler.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <stop_token>
 #include <unordered_map>
+#include <unordered_set>
+#include <variant>
 #include <vector>
 #include <memory>
 
 struct FunctionInfo {
     std::vector<std::string> argNames;
     std::unique_ptr<ASTNode> body;
+
+    // Purity analysis, filled lazily while memoization is on and dropped
+    // whenever this function or one of its callees is redefined
+    std::optional<bool> pure{};
+    bool readsGlobals{};
+    std::unordered_set<std::string> callees{};
+    MemoCache memo{};
+    uint64_t memoGlobalsVersion{};
+};
+
+// Limits on one evaluation; members left at their defaults don't limit anything.
+// A step is one AST node evaluated, or one compiled instruction applied to one row
+// of a reduction. The deadline and the token are checked every few hundred steps.
+struct EvaluationBudget {
+    uint64_t maxSteps{};
+    std::optional<std::chrono::steady_clock::time_point> deadline{};
+    std::stop_token cancellation{};
 };
 
+// Thrown when an evaluation runs out of its EvaluationBudget. Definitions made
+// before that point stay in place; memoized results are never partial.
+class BudgetExceeded : public std::runtime_error {
+public:
+    enum class Limit { Steps, Deadline, Cancelled };
+
+    explicit BudgetExceeded(Limit limit);
+    Limit limit() const { return m_limit; }
+
+private:
+    Limit m_limit;
+};
+
+// Result of Evaluator::evaluateValue: arrays come from literals ([1, 2, 3]), linspace,
+// range and array variables, and spread through operators and built-ins elementwise
+using Value = std::variant<double, Array>;
+
 class Evaluator {
+    // Budget of the evaluation in progress. Reduction blocks running on the
+    // thread pool charge it too, hence the atomic counter.
+    struct BudgetState {
+        EvaluationBudget limits;
+        std::atomic<uint64_t> steps{};
+
+        static constexpr uint64_t s_checkInterval = 256;
+
+        void charge(uint64_t count);
+        void check() const;
+    };
+
     std::unordered_map<std::string, double> variables;
     std::unordered_map<std::string, FunctionInfo> functions;
+    std::unordered_map<std::string, Array> arrays; // Disjoint from `variables`
+    // Shared with the programs compiled from calls to them
+    std::unordered_map<std::string, std::shared_ptr<const NativeFunction>> natives;
+    bool memoize{};
+    size_t memoCapacity{ MemoCache::s_defaultCapacity };
+    uint64_t globalsVersion{};
+    Profiler* profiler{};
+    CompileOptions options;
+    // Row index of the next value rand() and randn() draw outside compiled programs, and
+    // the first row of the next compiled reduction or sheet wave that draws any; reset
+    // when the seed changes, so the same seed replays the same session
+    uint64_t randomRow{};
+    BudgetState* budget{};
+
+    // Arithmetic operators pass values to each other as exact int64 while they are
+    // integers that fit, and as double otherwise (see evaluateArithmetic)
+    using ExactNumber = std::variant<int64_t, double>;
+
+    friend class Compiler;
+    friend class Sheet;
 
 public:
     Evaluator();
     double evaluate(const ASTNode& node, std::unordered_map<std::string, double>* localVars = nullptr);
+    // Evaluates within `limits`, throwing BudgetExceeded when they run out. Without a
+    // budget the only cost to ordinary evaluation is one branch per node.
+    double evaluate(const ASTNode& node, const EvaluationBudget& limits, std::unordered_map<std::string, double>* localVars = nullptr);
+    // Evaluates expressions that may produce arrays. Numbers combine with arrays by
+    // repeating across every element; two arrays must have the same size. Array
+    // storage is shared, so assigning or passing an array copies no elements.
+    // Expressions without arrays are evaluated exactly as by evaluate(), which
+    // rejects array values.
+    Value evaluateValue(const ASTNode& node, std::unordered_map<std::string, double>* localVars = nullptr);
+    // Same as evaluating "name = value"
+    void setVariable(const std::string& name, double value);
+    void setVariable(const std::string& name, Array value);
+    // Compiles node against the current variables and functions; `inputs` become per-row columns.
+    // Programs compute in floating point only: integer intermediates beyond 2^53 round, where
+    // evaluate() keeps them exact in int64. ProgramWorkspace::checkIntegers detects the rows
+    // this affects; sheets and reductions interpret those formulas instead.
+    Program compile(const ASTNode& node, std::vector<std::string> inputs = {}) const;
+    // Fuses several formulas over the same inputs into one program with an output each;
+    // shared subexpressions are computed once per row
+    Program compile(const std::vector<const ASTNode*>& nodes, std::vector<std::string> inputs = {}) const;
+
+    // Same as defining each function in order, with "f(x) = ...", but caches of the
+    // functions calling them are invalidated in one pass for the whole batch
+    void defineFunctions(std::vector<std::pair<std::string, FunctionInfo>> definitions);
+
+    // Name and parameters of every function defined by a formula, sorted by name
+    std::vector<std::pair<std::string, std::vector<std::string>>> userFunctions() const;
+
+    // Makes `function` callable from formulas as `name`, replacing an earlier registration.
+    // Throws if name is a built-in or a function defined by a formula, or if `function`
+    // has no scalar implementation. Defining a formula function with the name of a native
+    // one fails too.
+    void registerFunction(const std::string& name, NativeFunction function);
+
+    // Opt-in caching of user function results. Only functions proven pure (no
+    // assignments, only pure callees) are cached, keyed on the exact argument bits.
+    void setMemoization(bool enabled, size_t capacity = MemoCache::s_defaultCapacity);
+    bool memoization() const { return memoize; }
+    // Per-function cache statistics; throws for unknown functions
+    MemoStats memoStats(const std::string& name) const;
+    std::vector<std::pair<std::string, MemoStats>> memoStats() const;
+
+    // While set, every node evaluated is timed into `p`; compiled reduction bodies
+    // run serially and report per-instruction times. Pass nullptr to stop profiling.
+    void setProfiler(Profiler* p) { profiler = p; }
+
+    // Lowering options for every program compiled from now on, including reduction bodies.
+    // Their accuracy also applies to everything evaluated from now on; changing it drops
+    // memoized results. Changing the seed restarts the rows rand() and randn() draw from.
+    void setCompileOptions(const CompileOptions& o);
+    const CompileOptions& compileOptions() const { return options; }
+    // Sets the seed of rand() and randn() and restarts their rows, even if it is unchanged
+    void setSeed(uint64_t seed);
+
+private:
+    double evaluateNode(const ASTNode& node, std::unordered_map<std::string, double>* localVars);
+    // Operators whose operands are all integers are evaluated in checked int64, so integer
+    // formulas stay exact past 2^53 and are rounded only when their result leaves the
+    // operator tree. An operation that overflows, or a quotient that isn't whole, is done
+    // in double on the operands instead, like any operation with a non-integer operand.
+    ExactNumber evaluateArithmetic(const ASTNode& node, std::unordered_map<std::string, double>* localVars);
+    ExactNumber evaluateOperand(const ASTNode& node, std::unordered_map<std::string, double>* localVars);
+    bool isArrayExpression(const ASTNode& node, const std::unordered_map<std::string, double>* localVars) const;
+    Array evaluateArrayNode(const ASTNode& node, std::unordered_map<std::string, double>* localVars);
+    // sum, prod, mean and norm of one array, dot of two
+    double evaluateArrayReduction(const std::string& name, const ASTNode& node, std::unordered_map<std::string, double>* localVars);
+    double evaluateReduction(const std::string& name, const ASTNode& node, std::unordered_map<std::string, double>* localVars);
+    double evaluateRandom(const std::string& name, const ASTNode& node, std::unordered_map<std::string, double>* localVars);
+    double invoke(const std::string& name, FunctionInfo& func, std::span<const double> args);
+    double callFunction(const std::string& name, FunctionInfo& func, const ASTNode& node, std::unordered_map<std::string, double>* localVars);
+    double callNative(const std::string& name, const NativeFunction& native, const ASTNode& node, std::unordered_map<std::string, double>* localVars);
+    bool isPure(const std::string& name, FunctionInfo& func);
+    bool analysePurity(const std::string& name, FunctionInfo& func, std::unordered_set<std::string>& analysing, bool& provisional);
+    void defineFunction(const std::string& name, FunctionInfo info);
 };
\ No newline at end of file
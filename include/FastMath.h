@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+
+// How closely sin, cos, tan, exp, log and log10 follow the exact result; the other
+// built-ins always call the C library. Errors are measured against a long double
+// reference by tests/test_fast_math.cpp over the whole domain.
+enum class Accuracy : uint8_t {
+    Strict, // The C library (std::sin, ...)
+    // In-house kernels within 1 ulp (log10 2 ulp, tan 2.5 ulp). Branch-free, so batches
+    // vectorise; sin, cos and tan of |x| > 2^20 fall back to the C library.
+    Ulp,
+    // The same reductions with shorter polynomials: relative error below 1e-8 (for exp,
+    // where the result is not subnormal)
+    Fast
+};
+
+// Minimax polynomial kernels behind Accuracy::Ulp and Accuracy::Fast
+namespace fastmath {
+    enum class Function : uint8_t { Sin, Cos, Tan, Exp, Log, Log10 };
+
+    // out[i] = function(x[i]) for every element of x; out may be x.data(). Arguments are
+    // not checked: callers reject those outside the domain, as for the C library.
+    void apply(Function function, Accuracy accuracy, std::span<const double> x, double* out);
+    double apply(Function function, Accuracy accuracy, double x);
+
+    // The kernel of a built-in, if it has one
+    std::optional<Function> find(std::string_view name);
+    std::string_view accuracyName(Accuracy accuracy);
+    std::optional<Accuracy> parseAccuracy(std::string_view name);
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Evaluator.h"
+
+// One immutable version of a library file. Readers only compile against
+// `definitions` (which never modifies it) and run the precompiled programs,
+// so any number of threads can use a snapshot at once.
+struct LibrarySnapshot {
+    uint64_t version{};
+    Evaluator definitions;
+    std::unordered_map<std::string, Program> functions; // f(x) compiled with x as the input
+    std::unordered_map<std::string, std::string> uncompiled; // Functions the compiler rejected, with why
+
+    double call(const std::string& name, double argument) const;
+    Program compile(const ASTNode& expression, std::vector<std::string> inputs = {}) const {
+        return definitions.compile(expression, std::move(inputs));
+    }
+};
+
+// A file of definitions ("rate = 0.05", "f(x) = x * rate", '#' starts a comment line)
+// that can be reloaded while other threads evaluate against it. Files are parsed and
+// compiled in parallel by loadDefinitions, with its last-definition-wins rules.
+//
+// Each load builds a new snapshot off to the side and publishes it with one atomic
+// pointer swap. Readers never lock: read() announces the current epoch in a free
+// reader slot and loads the pointer; evaluations in flight keep the snapshot they
+// started with, later reads see the new one. A replaced snapshot is deleted once
+// every announced epoch is newer than its replacement, so no reader can still
+// hold it. A failed reload leaves the current snapshot in place.
+class FormulaLibrary {
+    struct alignas(64) ReaderSlot {
+        std::atomic<bool> used{};
+        std::atomic<uint64_t> epoch{}; // 0 while not reading
+    };
+
+    struct Retired {
+        const LibrarySnapshot* snapshot;
+        uint64_t epoch; // Safe to delete once no reader announces an older epoch
+    };
+
+    static constexpr size_t s_readerSlots = 128;
+
+    std::string m_path;
+    std::atomic<const LibrarySnapshot*> m_current{};
+    std::atomic<uint64_t> m_epoch{ 1 };
+    mutable std::array<ReaderSlot, s_readerSlots> m_slots;
+
+    // Writer side only; readers never touch these
+    mutable std::mutex m_writerMutex;
+    std::vector<Retired> m_retired;
+    std::string m_lastError;
+    uint64_t m_nextVersion{ 1 };
+
+    std::thread m_watcher;
+    int m_stopEvent{ -1 };
+
+    std::unique_ptr<LibrarySnapshot> load() const;
+    void publish(std::unique_ptr<LibrarySnapshot> snapshot);
+    void collect();
+    void watchLoop(int inotify);
+
+public:
+    class ReadGuard {
+        ReaderSlot* m_slot;
+        const LibrarySnapshot* m_snapshot;
+
+    public:
+        ReadGuard(ReaderSlot* slot, const LibrarySnapshot* snapshot)
+            : m_slot{ slot }
+            , m_snapshot{ snapshot } {
+        }
+        ReadGuard(ReadGuard&& other) noexcept
+            : m_slot{ std::exchange(other.m_slot, nullptr) }
+            , m_snapshot{ other.m_snapshot } {
+        }
+        ReadGuard& operator=(ReadGuard&&) = delete;
+        ~ReadGuard() {
+            if (m_slot) {
+                m_slot->epoch.store(0);
+                m_slot->used.store(false, std::memory_order_release);
+            }
+        }
+
+        const LibrarySnapshot& operator*() const { return *m_snapshot; }
+        const LibrarySnapshot* operator->() const { return m_snapshot; }
+    };
+
+    // Loads the file; throws if it can't be read or a definition fails
+    explicit FormulaLibrary(std::string path);
+    // Readers must have released their guards
+    ~FormulaLibrary();
+
+    FormulaLibrary(const FormulaLibrary&) = delete;
+    FormulaLibrary& operator=(const FormulaLibrary&) = delete;
+
+    // Pins the current snapshot until the guard is destroyed. Lock-free.
+    ReadGuard read() const;
+    double call(const std::string& name, double argument) const { return read()->call(name, argument); }
+    uint64_t version() const { return read()->version; }
+
+    // Rebuilds from the file now. On failure keeps serving the old snapshot,
+    // records the message (see lastError) and returns false.
+    bool reload();
+    // Reloads in a background thread whenever the file is written or replaced (Linux, inotify)
+    void watch();
+    std::string lastError() const;
+    // Replaced snapshots still waiting for readers to move on
+    size_t retiredCount() const;
+};
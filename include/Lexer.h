@@ -12,13 +12,18 @@
 
 class Lexer {
     std::string m_input{};
+    // Offset in the original text of each character kept in m_input
+    std::vector<size_t> m_offsets{};
 public:
-    Lexer(std::string_view str)
-        :m_input{str} {
-        m_input.erase(
-            std::remove_if(m_input.begin(), m_input.end(), 
-                [](char c) { return std::isspace(c); }), 
-            m_input.end());
+    Lexer(std::string_view str) {
+        m_input.reserve(str.size());
+        m_offsets.reserve(str.size());
+        for (size_t i = 0; i < str.size(); ++i) {
+            if (!std::isspace(static_cast<unsigned char>(str[i]))) {
+                m_input += str[i];
+                m_offsets.push_back(i);
+            }
+        }
     }
     [[nodiscard]] std::vector<Token> tokenize();
 };
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct MemoStats {
+    uint64_t hits{};
+    uint64_t misses{};
+    uint64_t evictions{};
+    size_t entries{};
+
+    double hitRate() const {
+        uint64_t calls = hits + misses;
+        return calls ? static_cast<double>(hits) / static_cast<double>(calls) : 0.0;
+    }
+};
+
+// Fixed-capacity open-addressing cache from argument bit patterns to results.
+// Probing is limited to a short window; when the window is full the home slot
+// is overwritten, so memory stays bounded and lookups stay O(1).
+class MemoCache {
+    std::vector<uint64_t> m_keys;
+    std::vector<double> m_values;
+    std::vector<uint8_t> m_used;
+    size_t m_arity{};
+    size_t m_capacity{};
+    MemoStats m_stats;
+
+    static constexpr size_t s_probeWindow = 8;
+
+public:
+    static constexpr size_t s_defaultCapacity = 1024;
+
+    // Sets the key width and capacity (rounded up to a power of two) and empties the cache
+    void reset(size_t arity, size_t capacity = s_defaultCapacity);
+    // Drops all entries; statistics are kept
+    void clear();
+
+    bool lookup(std::span<const double> args, double& result);
+    void insert(std::span<const double> args, double result);
+
+    bool empty() const { return m_capacity == 0; }
+    MemoStats stats() const;
+
+private:
+    size_t homeSlot(std::span<const double> args) const;
+    bool matches(size_t slot, std::span<const double> args) const;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <span>
+#include <string>
+
+// A function implemented in C++ and registered with Evaluator::registerFunction. Formulas
+// call it like a built-in: interpreted, compiled into programs, and elementwise over arrays.
+// Compiled programs may run it on several threads at once (parallel range reductions,
+// FormulaLibrary readers), so it must be safe to call concurrently.
+struct NativeFunction {
+    static constexpr size_t s_variadic = std::numeric_limits<size_t>::max();
+
+    using Scalar = std::function<double(std::span<const double> args)>;
+    // Computes `rows` results at once; args[i] points at the rows of argument i
+    using Batch = std::function<void(std::span<const double* const> args, double* out, size_t rows)>;
+
+    Scalar scalar;
+    // Optional. Compiled programs and array arguments use it for whole blocks of rows
+    // instead of calling `scalar` once per row.
+    Batch batch;
+    size_t minArity{ 1 };
+    size_t maxArity{ 1 }; // s_variadic for no upper bound
+    // Same arguments, same result, no side effects. Pure functions of constants are folded
+    // when compiling, identical calls in a program share one result, and user functions
+    // calling them can be memoized. Impure functions run once per call in the formula,
+    // and compiled reductions over them run serially, in row order.
+    bool pure{ true };
+
+    void checkArity(const std::string& name, size_t given) const;
+};
@@ -1,21 +1,60 @@
 #pragma once
 #include <array>
+#include <span>
+#include <vector>
 #include "Token.h"
 #include "AST.h"
 
 class Parser {
-    std::vector<Token> m_tokens;
-    inline static constexpr std::array<int, 11> s_bindingPower = { 1, 2, 3, 3, 3, 4, 3, 5, 0, 4, 4 };
+    std::vector<Token> m_ownedTokens;
+    std::span<const Token> m_tokens;
+    // Assignment < || < && < == != < comparisons < + - < * / \\ % < ^ and unary signs < !
+    inline static constexpr std::array<int, 19> s_bindingPower = { 5, 5, 6, 6, 6, 7, 6, 8, 0, 7, 7, 4, 4, 4, 4, 3, 3, 2, 1 };
     size_t m_pos{};
+    size_t m_maxDepth{};
 
 public:
-    Parser(const std::vector<Token>& tokens);
-    std::unique_ptr<ASTNode> parseExpression(int minBP = 0);
+    static constexpr size_t s_defaultMaxDepth = 1000;
+
+    // Parses a view of tokens owned by the caller, which must outlive the Parser
+    Parser(std::span<const Token> tokens, size_t maxDepth = s_defaultMaxDepth);
+    // Takes ownership of a temporary token list, e.g. Parser(lexer.tokenize())
+    Parser(std::vector<Token>&& tokens, size_t maxDepth = s_defaultMaxDepth);
+
+    Parser(const Parser&) = delete;
+    Parser& operator=(const Parser&) = delete;
+
+    // Parses the whole token list as one expression. Chains of the same left-associative
+    // operator become a single n-ary node (folded left to right when evaluated), and
+    // subtractions continuing a sum are stored as added negations, so the tree depth does
+    // not grow with the number of terms. Trees deeper than maxDepth are rejected.
+    std::unique_ptr<ASTNode> parseExpression();
+
 private:
+    struct Operand {
+        std::unique_ptr<ASTNode> node;
+        size_t depth;
+    };
+
+    enum class FrameKind { Binary, Prefix, Group, Call, Array };
+
+    // Pending work on the explicit parser stack
+    struct Frame {
+        FrameKind kind;
+        OperatorType op{};
+        int rightBP{};
+        size_t operandBase{};
+        size_t position{}; // Source offset of the operator or opening token
+        std::unique_ptr<ASTNode> call{}; // Function or array literal collecting the arguments
+    };
+
+    std::vector<Operand> m_operands;
+    std::vector<Frame> m_frames;
+
     const Token& peek() const {
         return m_tokens[m_pos];
     }
-    Token& next() {
+    const Token& next() {
         return m_tokens[m_pos++];
     }
     bool atEnd() const {
@@ -24,7 +63,21 @@ private:
     int getBindingPower(OperatorType op) const {
         return s_bindingPower[static_cast<size_t>(op)];
     }
+    static bool isRightAssociative(OperatorType op) {
+        return op == OperatorType::Power || op == OperatorType::Assignment;
+    }
+
+    template<typename... Args>
+    static std::unique_ptr<ASTNode> makeNode(size_t position, Args&&... args) {
+        auto node = std::make_unique<ASTNode>(std::forward<Args>(args)...);
+        node->m_position = position;
+        return node;
+    }
 
-    std::unique_ptr<ASTNode> parseTerm();
-    std::vector<std::unique_ptr<ASTNode>> parseFunctionArgs();
+    void pushFrame(Frame frame);
+    void pushOperand(std::unique_ptr<ASTNode> node, size_t depth);
+    void reduceWhile(int leftBP);
+    void reduceTop();
+    // Closes the innermost group, call or array literal with `bracket`, ')' or ']'
+    void closeGroup(size_t position, char bracket);
 };
\ No newline at end of file
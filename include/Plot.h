@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "Reduction.h"
+
+class Evaluator;
+struct ASTNode;
+
+struct SampledCurve {
+    std::vector<double> x; // Increasing
+    std::vector<double> y; // NaN where the function is undefined
+    size_t rounds{};
+};
+
+struct SamplingOptions {
+    size_t maxPoints = 1000;       // Evaluation budget, initial grid included
+    size_t initialPoints = 33;     // Uniform grid refinement starts from
+    // Largest tolerated gap between the curve and the straight segments drawn through
+    // the samples, as a fraction of the curve's visible height
+    double tolerance = 1e-3;
+    double minWidth = 1e-9;        // Intervals narrower than this fraction of [a, b] aren't split
+};
+
+// Samples f on [a, b], starting from a uniform grid and repeatedly bisecting the
+// intervals where a sample strays from the line through its neighbours: high
+// curvature, jumps and the edges of f's domain. Each round evaluates all new points
+// with one call to f, worst intervals first, until none strays or the budget is spent.
+SampledCurve sampleAdaptive(const BatchFunction& f, double a, double b, const SamplingOptions& options = {});
+
+// Compiles expression over `variable` (interpreting it when it can't be compiled) and
+// samples it; points where it fails, such as sqrt of a negative, become NaN
+SampledCurve plot(Evaluator& eval, const ASTNode& expression, const std::string& variable,
+    double a, double b, const SamplingOptions& options = {});
+
+// "x,y" header and one row per point
+void writeCsv(std::ostream& out, const SampledCurve& curve);
+// "MCPLOT01", the point count as uint64, then all x and all y as doubles, in host byte order
+void writeBinary(std::ostream& out, const SampledCurve& curve);
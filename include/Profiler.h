@@ -0,0 +1,63 @@
+#pragma once
+#include "AST.h"
+#include "Program.h"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+struct ProfileEntry {
+    std::string label;
+    uint64_t calls{};
+    uint64_t inclusiveNanos{};
+    uint64_t exclusiveNanos{};
+};
+
+// Call tree of timed AST nodes. Evaluator enters a frame per node it evaluates;
+// frames are labelled "name@offset", where offset is the node's position in the
+// source text, and nodes inside user function bodies are prefixed "f:" since
+// their offsets refer to the function's definition.
+class Profiler {
+    using Clock = std::chrono::steady_clock;
+
+    struct Frame {
+        std::string label;
+        size_t parent{};
+        uint64_t calls{};
+        uint64_t inclusiveNanos{};
+        std::map<std::string, size_t> children{};
+    };
+
+    std::vector<Frame> m_frames; // m_frames[0] is the root and is never timed
+    std::vector<std::pair<size_t, Clock::time_point>> m_open;
+    std::vector<std::string> m_scopes;
+    size_t m_current{};
+
+    size_t child(std::string label);
+    uint64_t exclusive(size_t frame) const;
+
+public:
+    Profiler();
+
+    void enter(const ASTNode& node);
+    void leave();
+    // Labels of nodes entered until the matching popScope are prefixed with "function:"
+    void pushScope(const std::string& function);
+    void popScope();
+    // Adds time measured elsewhere as a child of the current frame
+    void record(std::string label, uint64_t calls, uint64_t nanos);
+    // Records per-instruction times from Program::profileBatch, grouped by opcode and source offset
+    void record(const Program& program, std::span<const uint64_t> instructionNanos, uint64_t rows);
+
+    // One entry per label, summed over all call paths and sorted by exclusive time.
+    // Inclusive time of recursive labels is only counted at the outermost frame.
+    std::vector<ProfileEntry> entries() const;
+    // Folded stacks ("outer;inner <exclusive ns>"), the input format of flamegraph.pl and speedscope
+    void writeCollapsed(std::ostream& out) const;
+    void clear();
+
+    static std::string label(const ASTNode& node);
+};
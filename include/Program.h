@@ -0,0 +1,208 @@
+#pragma once
+#include "FastMath.h"
+#include "NativeFunction.h"
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+enum class OpCode : uint8_t {
+    Const, Input,
+    Negate, Add, Subtract, Multiply, Divide, IntDivide, Power, Mod, Factorial,
+    Sin, Cos, Tan, Asin, Acos, Atan, Atan2,
+    Exp, Sqrt, Log, Log10,
+    Abs, Floor, Ceil, Round, Min, Max,
+    // Masks of 1 and 0. Select is m_lhs != 0 ? m_rhs : m_addend, blended without branching.
+    Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual, And, Or, Select,
+    Gamma, Lgamma, Lfact, NCr, NPr,
+    // Only produced by Compiler's lowering: 1/x and x^0.5 without domain errors, m_lhs * m_rhs + m_addend
+    Reciprocal, PowHalf, Fma,
+    // Polynomial in register m_lhs with the m_addend + 1 coefficients starting at constant m_rhs, lowest first
+    Horner, Estrin,
+    // Native function call m_lhs of the program's call table
+    Call,
+    // rand() and randn() of call site m_lhs: values in [0, 1) and standard normal ones,
+    // drawn for the row's absolute index (see ProgramWorkspace::firstRow and Random.h)
+    Random, RandomNormal
+};
+
+// One register-machine step. For Const/Input, m_lhs indexes the constant pool / input list.
+struct Instruction {
+    static constexpr uint32_t s_unguarded = UINT32_MAX;
+
+    OpCode m_op;
+    uint32_t m_dst;
+    uint32_t m_lhs;
+    uint32_t m_rhs;
+    uint32_t m_addend{}; // Third operand of Fma and Select
+    // Mask register of the if() branch or && / || operand this instruction was compiled
+    // from. Rows where it is 0 would not have been evaluated by the interpreter, so a
+    // domain error there gives NaN instead of failing the program.
+    uint32_t m_guard{ s_unguarded };
+};
+
+// Lowerings not requested through CompileOptions give the interpreter's results bit for
+// bit: x^0 and x^1 are exact, and division by a power of two is a multiplication by its
+// exact reciprocal.
+enum class PolynomialScheme : uint8_t { None, Horner, Estrin };
+
+// A native function called by a program, with the registers holding its arguments
+struct NativeCall {
+    std::shared_ptr<const NativeFunction> function;
+    std::vector<uint32_t> args;
+};
+
+struct CompileOptions {
+    // Contract a*b + c into one fused multiply-add. Rounds once instead of twice, so
+    // results may differ from the interpreter in the last bit; fast only on CPUs with FMA.
+    bool contractFma{};
+    // Lower x^n for integer n in [-1, 16] to multiplications (square and multiply) and x^0.5
+    // to a square root. x^2, x^-1 and x^0.5 round correctly, where std::pow is only within
+    // an ulp of that, and the chains for larger n stay within n ulp, so results may differ
+    // from the interpreter in the last bits.
+    bool expandPowers{};
+    // Collapse polynomial subtrees in one variable, and ratios of two such polynomials, into
+    // one instruction per polynomial. Terms are collected algebraically (x - x is 0 even for
+    // infinite x) and evaluated in a different order, so low bits may change. Horner is
+    // vectorised across the rows of a block and suits batches; Estrin's shorter dependency
+    // chain gives lower latency for single-row runs.
+    PolynomialScheme polynomials{ PolynomialScheme::None };
+    // Kernels for sin, cos, tan, exp, log and log10 (see FastMath.h). Programs keep the
+    // accuracy they were compiled with; long double ones always use the C library.
+    // Evaluator applies it to the formulas it interprets as well.
+    Accuracy accuracy{ Accuracy::Strict };
+    // Key of the values rand() and randn() draw, in programs and in the interpreter
+    uint64_t seed{};
+};
+
+struct OptimizationStats {
+    size_t powersExpanded{};      // x^n with small integer n turned into multiplications
+    size_t squareRoots{};         // x^0.5
+    size_t divisionsByConstant{}; // x/c turned into x * (1/c)
+    size_t fmaContractions{};
+    size_t polynomials{};         // Horner/Estrin instructions; a rational function has two
+    size_t deadInstructions{};    // Unused results that cannot fail, dropped
+    size_t foldedCalls{};         // Pure native functions of constants, called while compiling
+};
+
+// Scratch memory for running a Program on one thread. Passing the same workspace
+// to every call keeps run/runBatch free of allocations.
+template<typename T>
+struct ProgramWorkspace {
+    std::vector<T> constants;
+    std::vector<T> registers;
+    std::vector<const T*> columns;
+    size_t stride{};
+    // Row index the next run/runBatch starts at, as far as rand() and randn() are
+    // concerned: row i of a batch draws the values of row firstRow + i, so a job split
+    // into pieces gives the same numbers as in one piece, on any number of threads
+    uint64_t firstRow{};
+    // When set, runs of a double program record in roundedIntegers whether some row computed
+    // an integer of magnitude 2^53 to 2^63 from integer operands. Evaluator keeps those exact
+    // in int64, so only then may the interpreter's result differ. Off by default: it costs a
+    // pass over each arithmetic result. Runs never clear roundedIntegers.
+    bool checkIntegers{};
+    bool roundedIntegers{};
+};
+
+// Flat, straight-line form of an expression produced by Compiler.
+// Every instruction works on a block of rows at once, so the same code serves
+// single evaluations and column-wise batch evaluation.
+//
+// Execution is templated on the numeric type: float halves memory traffic and
+// doubles SIMD width for batch jobs, long double gives extended precision where
+// the platform has it. Constants are converted once per call (or once per workspace); inputs and outputs
+// are in the requested type. float, double and long double are instantiated.
+class Program {
+    std::vector<Instruction> m_code;
+    std::vector<double> m_constants;
+    uint32_t m_registerCount{};
+    uint32_t m_inputCount{};
+    std::vector<uint32_t> m_outputs;
+    std::vector<size_t> m_positions;
+    // Per instruction, the user function it was inlined from as an index into
+    // m_functionNames, whose first entry ("") stands for the formula itself
+    std::vector<uint32_t> m_scopes;
+    std::vector<std::string> m_functionNames{ std::string{} };
+    std::vector<NativeCall> m_calls;
+    bool m_pure{ true };
+    CompileOptions m_options;
+    uint32_t m_randomSites{};
+    OptimizationStats m_stats;
+
+    friend class Compiler;
+
+public:
+    static constexpr size_t s_blockSize = 256;
+    static constexpr size_t s_maxPolynomialDegree = 64;
+
+    size_t inputCount() const { return m_inputCount; }
+    size_t outputCount() const { return m_outputs.size(); }
+    size_t registerCount() const { return m_registerCount; }
+    const std::vector<Instruction>& code() const { return m_code; }
+    // Values of Const instructions (and polynomial coefficients), and the register of each output
+    const std::vector<double>& constants() const { return m_constants; }
+    const std::vector<uint32_t>& outputs() const { return m_outputs; }
+    // Source offset of the AST node each instruction was compiled from
+    const std::vector<size_t>& positions() const { return m_positions; }
+    // Name of the user function an instruction was inlined from; empty for the formula's own nodes
+    const std::string& function(size_t instruction) const { return m_functionNames[m_scopes[instruction]]; }
+    static std::string_view opName(OpCode op);
+    // False if the program calls impure native functions: its rows must then be run
+    // once each, in order
+    bool pure() const { return m_pure; }
+    // The options this program was compiled with
+    const CompileOptions& compileOptions() const { return m_options; }
+    Accuracy accuracy() const { return m_options.accuracy; }
+    // The seed of rand() and randn(), and how many calls of them the program has. Each
+    // row's values depend only on the seed, the row index and the call, never on the
+    // blocks or threads a batch is split across.
+    uint64_t seed() const { return m_options.seed; }
+    size_t randomSites() const { return m_randomSites; }
+    // What Compiler's lowering pass rewrote while building this program
+    const OptimizationStats& optimizationStats() const { return m_stats; }
+
+    // Workspace for this program; batches are processed maxRows rows (at most s_blockSize) at a time
+    template<typename T = double>
+    ProgramWorkspace<T> workspace(size_t maxRows = s_blockSize) const;
+
+    // Evaluates a single row of a single-output program; inputs are in the order given to Compiler
+    template<typename T = double>
+    T run(std::span<const std::type_identity_t<T>> inputs) const;
+    // Evaluates a single row, writing one value per output
+    template<typename T = double>
+    void run(std::span<const std::type_identity_t<T>> inputs, std::span<std::type_identity_t<T>> outputs) const;
+    template<typename T>
+    void run(std::span<const std::type_identity_t<T>> inputs, std::span<std::type_identity_t<T>> outputs,
+        ProgramWorkspace<T>& workspace) const;
+
+    // Evaluates rows [0, rows) of a single-output program, reading one column per input
+    template<typename T = double>
+    void runBatch(std::span<const std::type_identity_t<T>* const> inputs, std::type_identity_t<T>* output, size_t rows) const;
+    // Fused form: every block of rows is read once and all output columns are written from it
+    template<typename T = double>
+    void runBatch(std::span<const std::type_identity_t<T>* const> inputs, std::span<std::type_identity_t<T>* const> outputs, size_t rows) const;
+    template<typename T>
+    void runBatch(std::span<const std::type_identity_t<T>* const> inputs, std::span<std::type_identity_t<T>* const> outputs, size_t rows,
+        ProgramWorkspace<T>& workspace) const;
+
+    // runBatch that also adds the nanoseconds spent in each instruction to instructionNanos.
+    // Checks integers as ProgramWorkspace::checkIntegers does and returns roundedIntegers.
+    bool profileBatch(std::span<const double* const> inputs, std::span<double* const> outputs, size_t rows,
+        std::span<uint64_t> instructionNanos, uint64_t firstRow = 0) const;
+
+private:
+    // Registers are laid out register-major with `stride` lanes each; rows offset.. of the
+    // inputs are rows firstRow + offset.. for rand() and randn(). roundedIntegers, when given,
+    // is set as ProgramWorkspace::roundedIntegers describes.
+    template<typename T>
+    void runBlock(std::span<const T* const> inputs, std::span<const T> constants, uint64_t firstRow,
+        size_t offset, size_t count, T* registers, size_t stride, bool* roundedIntegers,
+        uint64_t* instructionNanos = nullptr) const;
+    // Applies one instruction (not Const or Input) to `count` rows of the registers, starting at row `lane`
+    template<typename T>
+    void execute(const Instruction& ins, std::span<const T> constants, T* registers, size_t stride, size_t lane, size_t count) const;
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Wire format of the evaluation server. Every message is a frame: a 4-byte
+// little-endian payload length, then the payload. A request payload starts with a
+// RequestType byte, a response payload with a ResponseStatus byte. Numbers are
+// little-endian; doubles travel as their IEEE bit pattern.
+//
+//   Define    text "name = expr" or "f(x) = expr"       -> f64 value
+//   Evaluate  text expression                           -> f64 value
+//   Batch     u32 rows, u32 inputs, inputs x str,        -> formulas x rows f64,
+//             u32 formulas, formulas x str,                 one column per formula
+//             inputs x rows f64, one column per input
+//   Stats     (empty)                                    -> u64 requests, f64 p50 us, f64 p99 us
+//
+// str is a u32 length followed by that many bytes. An Error response carries the message text.
+// Payloads in either direction are at most s_maxPayload bytes, so a batch is refused when its
+// results (1 + formulas x rows x 8 bytes) would not fit.
+namespace protocol {
+    enum class RequestType : uint8_t { Define = 'D', Evaluate = 'E', Batch = 'B', Stats = 'S' };
+    enum class ResponseStatus : uint8_t { Ok = 0, Error = 1 };
+
+    constexpr size_t s_headerSize = 4;
+    constexpr size_t s_maxPayload = 64 << 20;
+
+    inline void putU32(std::string& out, uint32_t value) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            out.push_back(static_cast<char>((value >> shift) & 0xFF));
+        }
+    }
+
+    inline void putU64(std::string& out, uint64_t value) {
+        putU32(out, static_cast<uint32_t>(value));
+        putU32(out, static_cast<uint32_t>(value >> 32));
+    }
+
+    inline void putF64(std::string& out, double value) {
+        putU64(out, std::bit_cast<uint64_t>(value));
+    }
+
+    inline void putString(std::string& out, std::string_view text) {
+        putU32(out, static_cast<uint32_t>(text.size()));
+        out.append(text);
+    }
+
+    // Prepends the length header to a payload
+    inline std::string frame(std::string_view payload) {
+        std::string out;
+        out.reserve(s_headerSize + payload.size());
+        putU32(out, static_cast<uint32_t>(payload.size()));
+        out.append(payload);
+        return out;
+    }
+
+    // Sequential reads from a payload; throws when it runs out
+    class Reader {
+        std::string_view m_data;
+        size_t m_pos{};
+
+    public:
+        explicit Reader(std::string_view data)
+            : m_data{ data } {
+        }
+
+        size_t remaining() const { return m_data.size() - m_pos; }
+
+        std::string_view bytes(size_t count) {
+            if (count > remaining()) {
+                throw std::runtime_error("Truncated message");
+            }
+            auto result = m_data.substr(m_pos, count);
+            m_pos += count;
+            return result;
+        }
+
+        uint8_t u8() {
+            return static_cast<uint8_t>(bytes(1)[0]);
+        }
+
+        uint32_t u32() {
+            auto raw = bytes(4);
+            uint32_t value = 0;
+            for (int i = 3; i >= 0; --i) {
+                value = (value << 8) | static_cast<uint8_t>(raw[i]);
+            }
+            return value;
+        }
+
+        uint64_t u64() {
+            uint64_t low = u32();
+            return low | (static_cast<uint64_t>(u32()) << 32);
+        }
+
+        double f64() {
+            return std::bit_cast<double>(u64());
+        }
+
+        std::string_view string() {
+            return bytes(u32());
+        }
+
+        std::string_view rest() {
+            return bytes(remaining());
+        }
+    };
+}
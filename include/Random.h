@@ -0,0 +1,26 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Counter-based random numbers for rand() and randn(). Every value is Philox4x32-10
+// (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3") of the counter
+// (row, call site) under the seed: a pure function of the three, so rows can be
+// generated in any order, on any thread, with no state shared between them.
+namespace rng {
+    enum class Distribution : uint8_t {
+        Uniform, // [0, 1) with 52 random bits
+        Normal   // Mean 0, standard deviation 1 (Box-Muller on the four words of one block)
+    };
+
+    // Call site of the values the interpreter draws; compiled programs number theirs from 0
+    inline constexpr uint32_t s_interpreterSite = UINT32_MAX;
+
+    // The raw block for a counter and key, for checking against published test vectors
+    std::array<uint32_t, 4> philox(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key);
+
+    // out[i] = the value for row firstRow + i; generated a block of rows at a time with
+    // loops that vectorise. draw() gives the same bits for a single row.
+    void fill(Distribution distribution, uint64_t seed, uint64_t firstRow, uint32_t site, double* out, size_t count);
+    double draw(Distribution distribution, uint64_t seed, uint64_t row, uint32_t site);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+
+class ThreadPool;
+
+// Evaluates a function at many points at once: results[i] = f(points[i])
+using BatchFunction = std::function<void(std::span<const double> points, std::span<double> results)>;
+
+enum class ReductionKind { Sum, Product };
+
+// Reduces f(first), f(first + 1), ..., f(last). The range is cut into fixed-size
+// blocks, each block is reduced in order (compensated for sums) and the block
+// results are combined pairwise, so the result does not depend on the thread count.
+// Blocks run on `pool` when given; f must then be safe to call concurrently.
+double reduceRange(ReductionKind kind, int64_t first, int64_t last, const BatchFunction& f, ThreadPool* pool = nullptr);
+
+struct QuadratureResult {
+    double value{};
+    double error{};
+    size_t evaluations{};
+    bool converged{};
+};
+
+// Adaptive Gauss-Kronrod (7/15 point) quadrature of f over [a, b].
+// Stops once the estimated error is below max(absTolerance, relTolerance * |value|).
+QuadratureResult integrate(const BatchFunction& f, double a, double b,
+    double absTolerance = 1e-10, double relTolerance = 1e-10, size_t maxIntervals = 1000);
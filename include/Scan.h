@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+#include "AST.h"
+#include "Program.h"
+
+class ColumnFile;
+class ColumnWriter;
+class Evaluator;
+class ThreadPool;
+
+// A recurrence over columns, evaluated in one pass: row i of the output is the formula
+// with every input at row i, prev(y) the output at row i - 1 (the initial value before
+// row 0) and lag(x, k) input x at row i - k (NaN before row 0). "a*x + (1 - a)*prev(y)"
+// is an exponential moving average of x.
+//
+// A formula of the form A*prev(y) + B, with A and B free of prev(y) (and of rand), is
+// run as a linear recurrence: A and B are computed for every row in parallel, and the
+// rows are combined by a parallel prefix over the affine maps y -> A*y + B. The series
+// is cut into fixed-size chunks whatever the thread count, so results don't depend on
+// it, but distributing A over B's terms may change low bits compared to the formula as
+// written. Other formulas run their parts free of prev(y) a block at a time and the
+// rest row by row, with the previous output carried from one row to the next.
+class Scan {
+    // Program input columns.size() + i is input m_lags[i].column delayed by m_lags[i].rows
+    struct Lag {
+        size_t column;
+        size_t rows;
+    };
+
+    // Rows [first, first + count) of input `column`, read in place or converted into a new
+    // entry of `buffers`
+    using Gather = std::function<const double*(size_t column, size_t first, size_t count,
+        std::vector<std::vector<double>>& buffers)>;
+    // Takes the final outputs of rows [first, first + values.size()), from any thread
+    using Emit = std::function<void(size_t first, std::span<const double> values)>;
+
+    std::vector<std::string> m_inputs;
+    std::string m_output;
+    std::vector<Lag> m_lags;
+    // Per input and lag, whether a program reads it; the others are never gathered
+    std::vector<bool> m_reads;
+    bool m_linear{};
+    // Linear: outputs A and B, or only B if the formula doesn't use prev(y). Otherwise: one output per subexpression free of prev(y),
+    // which m_step reads as inputs after the lags, followed by prev(y).
+    Program m_block;
+    Program m_step;
+
+public:
+    // `output` is the name prev() refers to; `inputs` name the columns of run(), in order.
+    // Throws if the formula can't be compiled.
+    Scan(const Evaluator& evaluator, const ASTNode& formula, std::vector<std::string> inputs, std::string output);
+
+    bool linear() const { return m_linear; }
+
+    // Evaluates rows [0, rows), reading one column per input; output must not overlap
+    // them. Chunks of a linear recurrence run on `pool` when given; other formulas are
+    // sequential by nature. rand() draws the values of each row's index, as in runBatch.
+    void run(std::span<const double* const> inputs, double* output, size_t rows, double initial = 0,
+        ThreadPool* pool = nullptr) const;
+    // The same over the columns of `input` named like the scan's inputs, writing each chunk
+    // of results to float64 column `column` of `output` as soon as it is final. float64
+    // columns are read in place; int64 ones are converted a block at a time, and only if
+    // the formula reads them.
+    void run(const ColumnFile& input, ColumnWriter& output, size_t column, double initial = 0,
+        ThreadPool* pool = nullptr) const;
+
+private:
+    // Replaces prev(output) and lag(x, k) with variables named after them, registering lags
+    void substitute(std::unique_ptr<ASTNode>& node);
+    // The columns program inputs read for rows [first, first + count), null for those no
+    // program reads; lags reaching before row 0 are copied into `buffers`
+    std::vector<const double*> columns(const Gather& gather, size_t first, size_t count,
+        std::vector<std::vector<double>>& buffers) const;
+    void run(const Gather& gather, const Emit& emit, size_t rows, double initial, ThreadPool* pool) const;
+    void runLinear(const Gather& gather, const Emit& emit, size_t rows, double initial, ThreadPool* pool) const;
+    void runSteps(const Gather& gather, const Emit& emit, size_t rows, double initial) const;
+};
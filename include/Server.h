@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "ThreadPool.h"
+
+struct LatencySummary {
+    uint64_t requests{};
+    double p50Micros{};
+    double p99Micros{};
+};
+
+// Request latencies over a sliding window of the most recent samples
+class LatencyRecorder {
+    mutable std::mutex m_mutex;
+    std::vector<double> m_samples;
+    size_t m_next{};
+    uint64_t m_total{};
+
+public:
+    static constexpr size_t s_window = 1 << 16;
+
+    void record(std::chrono::nanoseconds latency);
+    LatencySummary summary() const;
+};
+
+// Evaluation server (Linux only). One epoll thread owns every socket and parses
+// frames (see Protocol.h); requests run on a worker pool. Each client connection
+// is a session with its own Evaluator, so definitions don't leak between clients,
+// and a session's requests are handled one at a time, in arrival order.
+class Server {
+    struct Session;
+    struct Connection;
+    struct Completion;
+
+    // Owning file descriptor, closed on destruction
+    class Descriptor {
+        int m_fd{ -1 };
+
+    public:
+        Descriptor() = default;
+        explicit Descriptor(int fd)
+            : m_fd{ fd } {
+        }
+        ~Descriptor();
+        Descriptor(const Descriptor&) = delete;
+        Descriptor& operator=(const Descriptor&) = delete;
+
+        int get() const { return m_fd; }
+        void reset(int fd);
+    };
+
+    Descriptor m_listen;
+    Descriptor m_epoll;
+    Descriptor m_wake;
+    std::atomic<bool> m_stopping{};
+    std::string m_socketPath;
+    uint16_t m_port{};
+    uint64_t m_nextConnection{ 1 };
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> m_connections;
+    std::mutex m_completedMutex;
+    std::vector<Completion> m_completed;
+    LatencyRecorder m_latency;
+    uint64_t m_maxSteps{};
+    std::chrono::milliseconds m_timeout{};
+    // Declared last so queued work finishes before the members it uses go away
+    ThreadPool m_workers;
+
+public:
+    // address is "unix:/path/to/socket" or "tcp:PORT" (127.0.0.1 only; port 0 picks a free one)
+    explicit Server(const std::string& address, size_t workers = std::thread::hardware_concurrency());
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Serves clients until stop() is called
+    void run();
+    // Safe to call from any thread and from signal handlers
+    void stop();
+
+    // Limits for each define, evaluate and batch request (see EvaluationBudget); zero means
+    // unlimited. Requests over budget get an error response. Call before run().
+    void setRequestLimits(uint64_t maxSteps, std::chrono::milliseconds timeout) {
+        m_maxSteps = maxSteps;
+        m_timeout = timeout;
+    }
+
+    uint16_t port() const { return m_port; }
+    LatencySummary latency() const { return m_latency.summary(); }
+
+private:
+    void watch(int fd, uint64_t tag, uint32_t events, bool modify = false);
+    void accept();
+    // Both return false once the connection has been closed
+    bool read(Connection& connection);
+    bool flush(Connection& connection);
+    void dispatch(Connection& connection);
+    void complete();
+    void close(uint64_t id);
+    std::string handle(Session& session, std::string_view request);
+};
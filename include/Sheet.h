@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AST.h"
+
+class Evaluator;
+class ThreadPool;
+
+// A set of assignments ("a = b * 2 + c") recalculated as a unit. Cells are ordered by
+// the variables they reference rather than by line, grouped into waves whose cells
+// only depend on earlier waves, and each wave is evaluated in parallel. The result is
+// the same as evaluating the cells one at a time in dependency order.
+class Sheet {
+    struct Cell {
+        std::string name;
+        std::unique_ptr<ASTNode> expression;
+    };
+
+    std::vector<Cell> m_cells;
+    std::unordered_map<std::string, size_t> m_cellIndex;
+    std::vector<std::unique_ptr<ASTNode>> m_definitions;
+
+public:
+    // Adds one line. "name = expr" becomes a cell; "f(x) = expr" is a function
+    // definition, applied before any cell is evaluated. Blank lines are ignored.
+    void add(const std::string& line);
+
+    size_t size() const { return m_cells.size(); }
+    const std::string& name(size_t cell) const { return m_cells[cell].name; }
+
+    // Cell indices grouped into waves, against eval's current functions.
+    // Throws on circular references.
+    std::vector<std::vector<size_t>> schedule(const Evaluator& eval) const;
+
+    // Evaluates every cell and stores the results as variables of eval; also returns
+    // them by cell index. Waves run on `pool` when given. Cells the compiler can't
+    // handle, and compiled ones that came to integers past 2^53, which only the
+    // interpreter keeps exact, are interpreted on the calling thread.
+    std::vector<double> evaluate(Evaluator& eval, ThreadPool* pool = nullptr) const;
+};
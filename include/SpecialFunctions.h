@@ -0,0 +1,17 @@
+#pragma once
+
+namespace special {
+    // Throws std::runtime_error unless n is a non-negative integer; inf above 170, the
+    // largest n with a finite n! in double precision
+    double factorial(double n);
+    // Lanczos approximation, exact table values at positive integers
+    double gamma(double x);
+    // log|gamma(x)|, Stirling series for large x
+    double lgamma(double x);
+    // log(n!) for any non-negative n, without overflow
+    double lfact(double n);
+    // Binomial coefficient and permutations, exact integers up to 2^53 and computed in log
+    // space once n! overflows
+    double nCr(double n, double k);
+    double nPr(double n, double k);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    bool m_stopping{};
+
+public:
+    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads taking part in parallelFor, including the caller
+    size_t concurrency() const {
+        return m_workers.size() + 1;
+    }
+
+    // Runs fn(0) .. fn(count - 1) across the pool and the calling thread, then returns.
+    // If any call throws, calls not yet started are skipped and the exception of the
+    // lowest failing index is rethrown.
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+    // Queues task to run on a worker thread and returns immediately. Pools without
+    // workers run it on the caller. The task must not throw.
+    void post(std::function<void()> task);
+
+    static ThreadPool& shared();
+
+private:
+    void workerLoop();
+};
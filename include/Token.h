@@ -7,15 +7,26 @@
 #define PRINT_SYMBOL
 
 enum class TokenType :int { Number, Operator, Variable, Function, Parenthesis, Comma };
-enum class OperatorType :int { Add, Subtract, Multiply, Divide, Int_divide, Power, Mod, Factorial, Assignment, UnaryMinus, UnaryPlus };
+enum class OperatorType :int { Add, Subtract, Multiply, Divide, Int_divide, Power, Mod, Factorial, Assignment, UnaryMinus, UnaryPlus,
+    Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual, And, Or };
+
+// Comparisons and logical operators yield 1 for true and 0 for false; any nonzero operand (NaN included) is true
+inline bool isComparison(OperatorType op) {
+    return op >= OperatorType::Less && op <= OperatorType::NotEqual;
+}
+inline bool isLogical(OperatorType op) {
+    return op == OperatorType::And || op == OperatorType::Or;
+}
 
 
 inline std::ostream& operator<<(std::ostream& out, OperatorType op) {
 #ifndef PRINT_SYMBOL
-    constexpr std::array<std::string_view, 11> s_opNames = { "Add", "Subtract", "Multiply", "Divide", "IntDivide", "Power", "Mod", "Factorial", "Assignment","UnaryMinus","UnaryPlus"};
+    constexpr std::array<std::string_view, 19> s_opNames = { "Add", "Subtract", "Multiply", "Divide", "IntDivide", "Power", "Mod", "Factorial", "Assignment","UnaryMinus","UnaryPlus",
+        "Less", "LessEqual", "Greater", "GreaterEqual", "Equal", "NotEqual", "And", "Or"};
     out << s_opNames[static_cast<size_t>(op)];
 #else
-    constexpr std::array<std::string_view, 11> s_opSymbols = { "+", "-", "*", "/", "\\", "^", "%", "!", "=","u-","u+"};
+    constexpr std::array<std::string_view, 19> s_opSymbols = { "+", "-", "*", "/", "\\", "^", "%", "!", "=","u-","u+",
+        "<", "<=", ">", ">=", "==", "!=", "&&", "||"};
     out << s_opSymbols[static_cast<size_t>(op)];
 #endif
     return out;
@@ -26,6 +37,7 @@ struct Token {
 
     TokenType m_tType{};
     std::variant<std::string, OperatorType, double, char> m_value{};
+    // Offset of the token's first character in the text given to Lexer
     size_t m_position{};
     // Number
     explicit Token(double value)
@@ -0,0 +1,79 @@
+/*
+ * C interface to mathcore, for embedding the interpreter in other languages.
+ *
+ * A context holds variables and user functions. Formulas compiled against a
+ * context become programs: self-contained handles that capture the context's
+ * variables at compile time and evaluate rows of inputs. Programs own their
+ * scratch memory, so evaluation does not allocate; a program handle must only
+ * be used by one thread at a time (compile one per thread to go parallel).
+ *
+ * Functions report failures through mathcore_status and never throw. The text
+ * of the most recent error is kept on the handle involved.
+ */
+#ifndef MATHCORE_H
+#define MATHCORE_H
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#  if defined(MATHCORE_BUILDING_LIBRARY)
+#    define MATHCORE_API __declspec(dllexport)
+#  else
+#    define MATHCORE_API __declspec(dllimport)
+#  endif
+#else
+#  define MATHCORE_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum mathcore_status {
+    MATHCORE_OK = 0,
+    MATHCORE_INVALID_ARGUMENT = 1,  /* null handle or pointer, wrong count */
+    MATHCORE_SYNTAX_ERROR = 2,      /* formula text could not be parsed */
+    MATHCORE_COMPILE_ERROR = 3,     /* undefined names, unsupported constructs */
+    MATHCORE_EVALUATION_ERROR = 4,  /* domain errors such as sqrt(-1) or division by zero */
+    MATHCORE_OUT_OF_MEMORY = 5,
+    MATHCORE_INTERNAL_ERROR = 6
+} mathcore_status;
+
+typedef struct mathcore_context mathcore_context;
+typedef struct mathcore_program mathcore_program;
+
+MATHCORE_API mathcore_context* mathcore_context_create(void);
+MATHCORE_API void mathcore_context_free(mathcore_context* context);
+
+/* Interprets one line: an expression, "name = expr" or "f(x) = expr". result may be NULL. */
+MATHCORE_API mathcore_status mathcore_context_evaluate(mathcore_context* context, const char* text, double* result);
+MATHCORE_API mathcore_status mathcore_context_set_variable(mathcore_context* context, const char* name, double value);
+/* Message of the last failed call on this context; empty if none failed yet */
+MATHCORE_API const char* mathcore_context_error(const mathcore_context* context);
+
+/*
+ * Compiles formula_count formulas over input_count named inputs into one program
+ * with an output per formula. Shared subexpressions are evaluated once.
+ * On failure *program is set to NULL and the error is kept on the context.
+ */
+MATHCORE_API mathcore_status mathcore_compile(mathcore_context* context,
+    const char* const* formulas, size_t formula_count,
+    const char* const* inputs, size_t input_count,
+    mathcore_program** program);
+MATHCORE_API void mathcore_program_free(mathcore_program* program);
+
+MATHCORE_API size_t mathcore_program_input_count(const mathcore_program* program);
+MATHCORE_API size_t mathcore_program_output_count(const mathcore_program* program);
+
+/* One row: inputs[input_count] in, outputs[output_count] out */
+MATHCORE_API mathcore_status mathcore_program_evaluate(mathcore_program* program, const double* inputs, double* outputs);
+/* rows rows: inputs[i] is the column of input i, outputs[j] receives the column of formula j */
+MATHCORE_API mathcore_status mathcore_program_evaluate_batch(mathcore_program* program,
+    const double* const* inputs, double* const* outputs, size_t rows);
+MATHCORE_API const char* mathcore_program_error(const mathcore_program* program);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,8 +2,28 @@
 #include "Parser.h"
 #include "Evaluator.h"
 #include "AST.h"
+#include "BulkLoad.h"
+#include "CodeGen.h"
+#include "Columnar.h"
+#include "Plot.h"
+#include "Profiler.h"
+#include "Scan.h"
+#include "Sheet.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <vector>
+#ifdef MATHCORE_SERVER
+#include "Server.h"
+#include <charconv>
+#include <csignal>
+#include <cstring>
+#include <optional>
+#include <string>
+#endif
 
 static std::string promptInput() {
 	std::cout << ">> ";
@@ -18,6 +38,345 @@ static void printTokens(const std::vector<Token>& tokens) {
 	}
 }
 
+static void memoCommand(Evaluator& e, const std::string& arg) {
+	if (arg == "on" || arg == "off") {
+		e.setMemoization(arg == "on");
+		std::cout << "Memoization " << arg << '\n';
+		return;
+	}
+	std::cout << "Memoization is " << (e.memoization() ? "on" : "off") << '\n';
+	for (const auto& [name, stats] : e.memoStats()) {
+		std::cout << "  " << name << ": " << stats.hits << " hits, " << stats.misses << " misses ("
+			<< stats.hitRate() * 100 << "%), " << stats.entries << " cached\n";
+	}
+}
+
+static void sheetCommand(Evaluator& e, const std::string& path) {
+	std::ifstream file(path);
+	if (!file) {
+		std::cout << "Error: \"Cannot open " << path << "\"\n";
+		return;
+	}
+	Sheet sheet;
+	std::string line;
+	std::vector<double> values;
+	try {
+		while (std::getline(file, line)) {
+			sheet.add(line);
+		}
+		values = sheet.evaluate(e, &ThreadPool::shared());
+	}
+	catch (std::exception& ex) {
+		std::cout << "Error: \"" << ex.what() << "\"\n";
+		return;
+	}
+	for (size_t cell = 0; cell < sheet.size(); ++cell) {
+		std::cout << sheet.name(cell) << " = " << values[cell] << '\n';
+	}
+}
+
+// Long arrays show their first and last elements
+static void printValue(const Value& value) {
+	if (const double* number = std::get_if<double>(&value)) {
+		std::cout << *number << '\n';
+		return;
+	}
+	const auto& array = std::get<Array>(value);
+	constexpr size_t shown = 8;
+	std::cout << '[';
+	for (size_t i = 0; i < array.size(); ++i) {
+		if (array.size() > 2 * shown && i == shown) {
+			std::cout << ", ... (" << array.size() << " elements)";
+			i = array.size() - shown - 1;
+			continue;
+		}
+		std::cout << (i ? ", " : "") << array[i];
+	}
+	std::cout << "]\n";
+}
+
+static void profileCommand(Evaluator& e, const std::string& text) {
+	const char* foldedPath = "profile.folded";
+	Profiler profiler;
+	try {
+		Lexer lex{ text };
+		Parser parser{ lex.tokenize() };
+		auto astroot = parser.parseExpression();
+		e.setProfiler(&profiler);
+		double value = e.evaluate(*astroot);
+		e.setProfiler(nullptr);
+		std::cout << value << '\n';
+	}
+	catch (std::exception& ex) {
+		e.setProfiler(nullptr);
+		std::cout << "Error: \"" << ex.what() << "\"\n";
+		return;
+	}
+	auto entries = profiler.entries();
+	std::cout << std::setw(12) << "self us" << std::setw(12) << "total us" << std::setw(10) << "calls" << "  node@offset\n";
+	for (size_t i = 0; i < std::min<size_t>(entries.size(), 15); ++i) {
+		std::cout << std::setw(12) << entries[i].exclusiveNanos / 1000.0 << std::setw(12) << entries[i].inclusiveNanos / 1000.0
+			<< std::setw(10) << entries[i].calls << "  " << entries[i].label << '\n';
+	}
+	std::ofstream folded(foldedPath);
+	profiler.writeCollapsed(folded);
+	std::cout << "Collapsed stacks written to " << foldedPath << '\n';
+}
+
+// plot EXPR, VAR, A, B [, POINTS] [-> FILE]; .bin files get the binary format, anything else CSV
+static void plotCommand(Evaluator& e, std::string args) {
+	std::string path = "plot.csv";
+	if (auto arrow = args.rfind("->"); arrow != std::string::npos) {
+		path = args.substr(arrow + 2);
+		path.erase(0, path.find_first_not_of(' '));
+		path.erase(path.find_last_not_of(' ') + 1);
+		args.erase(arrow);
+	}
+	try {
+		// Parsed as a call so commas inside the expression nest properly
+		Lexer lex{ "plot(" + args + ")" };
+		Parser parser{ lex.tokenize() };
+		auto call = parser.parseExpression();
+		const auto& parts = call->m_children;
+		if (call->m_type != NodeType::Function || parts.size() < 4 || parts.size() > 5 || parts[1]->m_type != NodeType::Variable) {
+			throw std::runtime_error("usage: plot expr, x, a, b [, points] [-> file.csv|file.bin]");
+		}
+		SamplingOptions options;
+		if (parts.size() == 5) {
+			options.maxPoints = static_cast<size_t>(e.evaluate(*parts[4]));
+		}
+		auto curve = plot(e, *parts[0], parts[1]->getValue<std::string>(), e.evaluate(*parts[2]), e.evaluate(*parts[3]), options);
+		bool binary = path.ends_with(".bin");
+		std::ofstream file(path, binary ? std::ios::binary : std::ios::out);
+		if (!file) {
+			throw std::runtime_error("Cannot open " + path);
+		}
+		binary ? writeBinary(file, curve) : writeCsv(file, curve);
+		std::cout << curve.x.size() << " points in " << curve.rounds + 1 << " batches written to " << path << '\n';
+	}
+	catch (std::exception& ex) {
+		std::cout << "Error: \"" << ex.what() << "\"\n";
+	}
+}
+
+// NAME=EXPR names an output column; a bare EXPR is named by its own text
+static std::pair<std::string, std::string> splitOutput(const std::string& arg) {
+	size_t eq = arg.find('=');
+	if (eq != std::string::npos && eq > 0 && eq + 1 < arg.size() && arg[eq + 1] != '='
+		&& std::all_of(arg.begin(), arg.begin() + eq, [](unsigned char c) { return std::isalnum(c) || c == '_'; })
+		&& !std::isdigit(static_cast<unsigned char>(arg[0]))) {
+		return { arg.substr(0, eq), arg.substr(eq + 1) };
+	}
+	return { arg, arg };
+}
+
+// --scan IN OUT NAME=EXPR [INITIAL]: EXPR may use prev(NAME), the row before's result
+// (INITIAL at the first row), and lag(column, k)
+static int scanCommand(Evaluator& e, const ColumnFile& input, const std::string& path, const std::string& definition, double initial) {
+	auto [name, text] = splitOutput(definition);
+	std::vector<std::string> names;
+	for (const auto& column : input.columns()) {
+		names.push_back(column.name);
+	}
+	Lexer lex{ text };
+	Parser parser{ lex.tokenize() };
+	Scan scan(e, *parser.parseExpression(), names, name);
+	ColumnWriter output(path, { { name, ColumnType::Float64 } }, input.rows());
+	scan.run(input, output, 0, initial, &ThreadPool::shared());
+	output.close();
+	std::cout << input.rows() << " rows written to " << path << (scan.linear() ? " (linear recurrence)" : "") << '\n';
+	return 0;
+}
+
+// --eval-columns IN OUT NAME=EXPR...: every column of IN is an input, OUT gets one float64 column per EXPR.
+// --to-columns IN.csv OUT and --to-csv IN OUT.csv convert between CSV and columnar files.
+static int columnsCommand(int argc, char* argv[]) {
+	std::string command = argv[1];
+	if (argc < 4 || ((command == "--eval-columns" || command == "--scan") && argc < 5) || (command == "--scan" && argc > 6)) {
+		std::cerr << "usage: cmdCalc --eval-columns IN OUT NAME=EXPR... | --scan IN OUT NAME=EXPR [INITIAL]\n"
+			<< "       | --to-columns IN.csv OUT | --to-csv IN OUT.csv\n";
+		return 1;
+	}
+	try {
+		if (command == "--to-columns") {
+			std::ifstream csv(argv[2]);
+			if (!csv) {
+				throw std::runtime_error(std::string("Cannot open ") + argv[2]);
+			}
+			csvToColumns(csv, argv[3]);
+			return 0;
+		}
+		if (command == "--to-csv") {
+			ColumnFile file(argv[2]);
+			std::ofstream csv(argv[3]);
+			if (!csv) {
+				throw std::runtime_error(std::string("Cannot open ") + argv[3]);
+			}
+			columnsToCsv(file, csv);
+			return 0;
+		}
+		ColumnFile input(argv[2]);
+		std::vector<std::string> inputs;
+		for (const auto& column : input.columns()) {
+			inputs.push_back(column.name);
+		}
+		Evaluator e;
+		if (command == "--scan") {
+			return scanCommand(e, input, argv[3], argv[4], argc > 5 ? std::stod(argv[5]) : 0.0);
+		}
+		std::vector<std::unique_ptr<ASTNode>> formulas;
+		std::vector<const ASTNode*> roots;
+		std::vector<ColumnSpec> outputs;
+		for (int i = 4; i < argc; ++i) {
+			auto [name, text] = splitOutput(argv[i]);
+			Lexer lex{ text };
+			Parser parser{ lex.tokenize() };
+			formulas.push_back(parser.parseExpression());
+			roots.push_back(formulas.back().get());
+			outputs.push_back({ name, ColumnType::Float64 });
+		}
+		auto program = e.compile(roots, inputs);
+		ColumnWriter output(argv[3], std::move(outputs), input.rows());
+		evaluateColumns(program, inputs, input, output, &ThreadPool::shared());
+		output.close();
+		std::cout << input.rows() << " rows written to " << argv[3] << '\n';
+	}
+	catch (std::exception& ex) {
+		std::cerr << "Error: \"" << ex.what() << "\"\n";
+		return 1;
+	}
+	return 0;
+}
+
+// --emit-cpp OUT.h [--namespace NS] [--expr 'f(x, y) = ...']... SOURCE...: each SOURCE is a file of
+// definitions, or one definition if it contains '='. Every function defined, and every --expr,
+// is written to OUT.h as C++.
+static int emitCppCommand(int argc, char* argv[]) {
+	if (argc < 4) {
+		std::cerr << "usage: cmdCalc --emit-cpp OUT.h [--namespace NS] [--expr 'f(x, y) = ...']... DEFINITIONS|'f(x) = ...'...\n";
+		return 1;
+	}
+	std::string ns = "formulas";
+	try {
+		Evaluator e;
+		std::vector<std::string> expressions;
+		for (int i = 3; i < argc; ++i) {
+			std::string source = argv[i];
+			if (source == "--namespace" && i + 1 < argc) {
+				ns = argv[++i];
+				continue;
+			}
+			if (source == "--expr" && i + 1 < argc) {
+				expressions.push_back(argv[++i]);
+				continue;
+			}
+			if (source.find('=') != std::string::npos) {
+				loadDefinitions(e, source, { .source = "argument " + std::to_string(i) });
+				continue;
+			}
+			std::ifstream file(source);
+			if (!file) {
+				throw std::runtime_error("Cannot open " + source);
+			}
+			std::string text{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+			loadDefinitions(e, text, { .source = source });
+		}
+		// Expressions see every definition, wherever they appear on the command line
+		auto functions = userCppFunctions(e);
+		for (const auto& expression : expressions) {
+			functions.push_back(cppExpression(e, expression));
+		}
+		if (functions.empty()) {
+			throw std::runtime_error("No functions defined");
+		}
+		std::ofstream out(argv[2]);
+		if (!out) {
+			throw std::runtime_error(std::string("Cannot open ") + argv[2]);
+		}
+		emitCpp(out, functions, ns);
+		std::cout << functions.size() << " functions written to " << argv[2] << '\n';
+	}
+	catch (std::exception& ex) {
+		std::cerr << "Error: \"" << ex.what() << "\"\n";
+		return 1;
+	}
+	return 0;
+}
+
+#ifdef MATHCORE_SERVER
+static Server* s_server = nullptr;
+
+// The whole of `text` as a non-negative integer, or nothing
+static std::optional<uint64_t> parseCount(const char* text) {
+	uint64_t value{};
+	const char* end = text + std::strlen(text);
+	auto [last, error] = std::from_chars(text, end, value);
+	if (error != std::errc{} || last != end || last == text) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+static int serve(int argc, char* argv[]) {
+	const char* usage = "usage: cmdCalc --serve unix:PATH|tcp:PORT [--workers N] [--max-steps N] [--timeout MS]\n";
+	if (argc < 3) {
+		std::cerr << usage;
+		return 1;
+	}
+	size_t workers = std::thread::hardware_concurrency();
+	uint64_t maxSteps = 0;
+	std::chrono::milliseconds timeout{};
+	for (int i = 3; i < argc; i += 2) {
+		std::string option = argv[i];
+		bool known = option == "--workers" || option == "--max-steps" || option == "--timeout";
+		auto value = known && i + 1 < argc ? parseCount(argv[i + 1]) : std::nullopt;
+		if (!value) {
+			if (!known) {
+				std::cerr << "Error: unknown option \"" << option << "\"\n";
+			}
+			else if (i + 1 < argc) {
+				std::cerr << "Error: " << option << " needs a non-negative integer, not \"" << argv[i + 1] << "\"\n";
+			}
+			else {
+				std::cerr << "Error: " << option << " needs a value\n";
+			}
+			std::cerr << usage;
+			return 1;
+		}
+		if (option == "--workers") {
+			workers = static_cast<size_t>(*value);
+		}
+		else if (option == "--max-steps") {
+			maxSteps = *value;
+		}
+		else {
+			timeout = std::chrono::milliseconds(*value);
+		}
+	}
+	try {
+		Server server(argv[2], workers);
+		server.setRequestLimits(maxSteps, timeout);
+		s_server = &server;
+		std::signal(SIGINT, [](int) { s_server->stop(); });
+		std::signal(SIGTERM, [](int) { s_server->stop(); });
+		std::cout << "Listening on " << argv[2];
+		if (server.port()) {
+			std::cout << " (port " << server.port() << ")";
+		}
+		std::cout << " with " << workers << " workers" << std::endl;
+		server.run();
+		auto latency = server.latency();
+		std::cout << latency.requests << " requests, p50 " << latency.p50Micros << " us, p99 "
+			<< latency.p99Micros << " us\n";
+	}
+	catch (std::exception& ex) {
+		std::cerr << "Error: \"" << ex.what() << "\"\n";
+		return 1;
+	}
+	return 0;
+}
+#endif
+
 void printWelcome() {
 	std::cout << "====================================\n";
 	std::cout << " Welcome to the Math Expression CLI \n";
@@ -26,27 +385,56 @@ void printWelcome() {
 	std::cout << "You can perform algebraic operations:\n";
 	std::cout << "  Addition (+), Subtraction (-), Multiplication (*), Division (/)\n";
 	std::cout << "  Integer Division (\\), Power (^), Modulus (%), Factorial (!)\n";
-	std::cout << "  Unary plus (+), Unary minus (-), and variable assignment (x = 5)\n\n";
+	std::cout << "  Unary plus (+), Unary minus (-), and variable assignment (x = 5)\n";
+	std::cout << "  Comparisons (< <= > >= == !=), logical && and || (short-circuit), if(cond, a, b)\n\n";
 
 	std::cout << "Built-in functions supported:\n";
 	std::cout << "  Trigonometry: sin, cos, tan, asin, acos, atan, atan2\n";
 	std::cout << "  Exponential & logs: exp (e^x), sqrt (x), log (ln), log10\n";
 	std::cout << "  Rounding & absolute: abs, floor, ceil, round\n";
-	std::cout << "  Aggregates: min, max, factorial\n\n";
+	std::cout << "  Aggregates: min, max (also over arrays)\n";
+	std::cout << "  Arrays: [1, 2, 3], linspace(a, b, n), range(a, b [, step]); operators and functions\n";
+	std::cout << "          apply elementwise, sum(v), prod(v), mean(v), dot(u, v), norm(v) reduce\n";
+	std::cout << "  Factorials & combinatorics: factorial, gamma, lgamma, lfact, nCr, nPr\n";
+	std::cout << "  Ranges: sum(i, a, b, expr), prod(i, a, b, expr), integrate(x, a, b, expr)\n";
+	std::cout << "  Random: rand() in [0, 1), rand(a, b), randn() standard normal, randn(mu, sigma)\n\n";
 
 	std::cout << "Constants available: pi, e\n\n";
+	std::cout << "Commands:\n";
+	std::cout << "  :memo on|off  cache results of pure user functions, :memo shows hit rates\n";
+	std::cout << "  :fma on|off   fuse a*b+c in compiled range bodies (one rounding instead of two)\n";
+	std::cout << "  :powers on|off  multiply out x^n for small n in compiled range bodies (within n ulp)\n";
+	std::cout << "  :poly horner|estrin|off  evaluate polynomials in compiled range bodies as one step\n";
+	std::cout << "  :accuracy strict|ulp|fast  sin, cos, tan, exp, log, log10: C library, 1 ulp or 1e-8 kernels\n";
+	std::cout << "  :seed n       restart rand() and randn() from seed n; results repeat on any thread count\n";
+	std::cout << "  :sheet file   recalculate a file of assignments in dependency order, in parallel\n";
+	std::cout << "  :profile expr evaluate with per-node timings, saving flamegraph stacks to profile.folded\n";
+	std::cout << "  plot f(x), x, a, b [, points] [-> file.csv|file.bin]  adaptively sample f for plotting\n\n";
 	std::cout << "Usage examples:\n";
 	std::cout << "  x = 5\n";
 	std::cout << "  y = 3\n";
 	std::cout << "  f(x) = x^2 + 2\n";
 	std::cout << "  f(3) -> 11\n";
-	std::cout << "  max(1, 5, 2) -> 5\n\n";
+	std::cout << "  max(1, 5, 2) -> 5\n";
+	std::cout << "  sum(i, 1, 100, i^2) -> 338350\n\n";
 
 	std::cout << "Type your expressions below. Press Ctrl+C or \"exit\" to exit.\n";
 	std::cout << "------------------------------------\n";
 }
 
-int main(){
+int main(int argc, char* argv[]){
+	if (argc > 1 && (std::string(argv[1]) == "--eval-columns" || std::string(argv[1]) == "--scan"
+		|| std::string(argv[1]) == "--to-columns" || std::string(argv[1]) == "--to-csv")) {
+		return columnsCommand(argc, argv);
+	}
+	if (argc > 1 && std::string(argv[1]) == "--emit-cpp") {
+		return emitCppCommand(argc, argv);
+	}
+#ifdef MATHCORE_SERVER
+	if (argc > 1 && std::string(argv[1]) == "--serve") {
+		return serve(argc, argv);
+	}
+#endif
 	printWelcome();
 	std::string input{};
 	std::vector<Token> tokens;
@@ -65,13 +453,77 @@ int main(){
 			
 		if (input.empty())
 			continue;
+		if (input.starts_with(":memo")) {
+			memoCommand(e, input.size() > 6 ? input.substr(6) : "");
+			continue;
+		}
+		if (input == ":fma on" || input == ":fma off") {
+			auto options = e.compileOptions();
+			options.contractFma = input == ":fma on";
+			e.setCompileOptions(options);
+			std::cout << "Fused multiply-add " << input.substr(5) << '\n';
+			continue;
+		}
+		if (input == ":powers on" || input == ":powers off") {
+			auto options = e.compileOptions();
+			options.expandPowers = input == ":powers on";
+			e.setCompileOptions(options);
+			std::cout << "Power expansion " << input.substr(8) << '\n';
+			continue;
+		}
+		if (input == ":poly horner" || input == ":poly estrin" || input == ":poly off") {
+			auto options = e.compileOptions();
+			options.polynomials = input == ":poly horner" ? PolynomialScheme::Horner
+				: input == ":poly estrin" ? PolynomialScheme::Estrin : PolynomialScheme::None;
+			e.setCompileOptions(options);
+			std::cout << "Polynomial evaluation: " << input.substr(6) << '\n';
+			continue;
+		}
+		if (input.starts_with(":accuracy ")) {
+			if (auto accuracy = fastmath::parseAccuracy(input.substr(10))) {
+				auto options = e.compileOptions();
+				options.accuracy = *accuracy;
+				e.setCompileOptions(options);
+				std::cout << "Accuracy: " << input.substr(10) << '\n';
+			}
+			else {
+				std::cout << "Error: \"Expected :accuracy strict, ulp or fast\"\n";
+			}
+			continue;
+		}
+		if (input.starts_with(":seed ")) {
+			try {
+				size_t used = 0;
+				uint64_t seed = std::stoull(input.substr(6), &used);
+				if (used != input.size() - 6 || input[6] == '-') {
+					throw std::invalid_argument("seed");
+				}
+				e.setSeed(seed);
+				std::cout << "Seed: " << seed << '\n';
+			}
+			catch (const std::exception&) {
+				std::cout << "Error: \"Expected :seed followed by a non-negative integer\"\n";
+			}
+			continue;
+		}
+		if (input.starts_with(":sheet ")) {
+			sheetCommand(e, input.substr(7));
+			continue;
+		}
+		if (input.starts_with("plot ")) {
+			plotCommand(e, input.substr(5));
+			continue;
+		}
+		if (input.starts_with(":profile ")) {
+			profileCommand(e, input.substr(9));
+			continue;
+		}
 		Lexer lex{input};
 		try {
 			tokens = lex.tokenize();
 			Parser parser{ tokens };
 			auto astroot = parser.parseExpression();
-			double value = e.evaluate(*astroot);
-			std::cout << value<<'\n';
+			printValue(e.evaluateValue(*astroot));
 		}
 		catch (std::exception& e) {
 			std::cout << "Error: \"" << e.what() << "\"\n";
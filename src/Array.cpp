@@ -0,0 +1,145 @@
+#include "Array.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+Array::Array(size_t size)
+    : m_size{ size } {
+    if (size > s_maxSize) {
+        throw std::runtime_error("Array of " + std::to_string(size) + " elements exceeds the limit of "
+            + std::to_string(s_maxSize));
+    }
+    m_data = std::make_shared_for_overwrite<double[]>(size);
+}
+
+Array::Array(std::span<const double> values)
+    : Array(values.size()) {
+    std::copy(values.begin(), values.end(), m_data.get());
+}
+
+namespace kernel {
+    namespace {
+        using Lanes = std::array<double, s_lanes>;
+
+        // Folds the lanes pairwise, and then the tail that didn't fill a whole row of lanes
+        template<typename Combine>
+        double combine(Lanes lanes, std::span<const double> tail, Combine op) {
+            for (size_t width = s_lanes / 2; width > 0; width /= 2) {
+                for (size_t l = 0; l < width; ++l) {
+                    lanes[l] = op(lanes[l], lanes[l + width]);
+                }
+            }
+            double result = lanes[0];
+            for (double v : tail) {
+                result = op(result, v);
+            }
+            return result;
+        }
+
+        // Min/max in the order std::min_element visits elements: a candidate replaces
+        // the current one only if it compares strictly better
+        template<typename Better>
+        double select(std::span<const double> values, Better better) {
+            if (values.empty()) {
+                throw std::runtime_error("Reduction of an empty array");
+            }
+            Lanes lanes;
+            lanes.fill(values[0]);
+            size_t whole = values.size() / s_lanes * s_lanes;
+            for (size_t i = 0; i < whole; i += s_lanes) {
+                for (size_t l = 0; l < s_lanes; ++l) {
+                    lanes[l] = better(values[i + l], lanes[l]) ? values[i + l] : lanes[l];
+                }
+            }
+            return combine(lanes, values.subspan(whole), [&](double a, double b) { return better(b, a) ? b : a; });
+        }
+    }
+
+    double sum(std::span<const double> values) {
+        Lanes sums{};
+        Lanes compensations{};
+        size_t whole = values.size() / s_lanes * s_lanes;
+        for (size_t i = 0; i < whole; i += s_lanes) {
+            for (size_t l = 0; l < s_lanes; ++l) {
+                double y = values[i + l] - compensations[l];
+                double t = sums[l] + y;
+                compensations[l] = (t - sums[l]) - y;
+                sums[l] = t;
+            }
+        }
+        for (size_t l = 0; l < s_lanes; ++l) {
+            sums[l] -= compensations[l];
+        }
+        return combine(sums, values.subspan(whole), [](double a, double b) { return a + b; });
+    }
+
+    double product(std::span<const double> values) {
+        Lanes products;
+        products.fill(1.0);
+        size_t whole = values.size() / s_lanes * s_lanes;
+        for (size_t i = 0; i < whole; i += s_lanes) {
+            for (size_t l = 0; l < s_lanes; ++l) {
+                products[l] *= values[i + l];
+            }
+        }
+        return combine(products, values.subspan(whole), [](double a, double b) { return a * b; });
+    }
+
+    double dot(std::span<const double> lhs, std::span<const double> rhs) {
+        if (lhs.size() != rhs.size()) {
+            throw std::runtime_error("dot needs arrays of the same size, got " + std::to_string(lhs.size())
+                + " and " + std::to_string(rhs.size()));
+        }
+        Lanes sums{};
+        size_t whole = lhs.size() / s_lanes * s_lanes;
+        for (size_t i = 0; i < whole; i += s_lanes) {
+            for (size_t l = 0; l < s_lanes; ++l) {
+                sums[l] += lhs[i + l] * rhs[i + l];
+            }
+        }
+        double result = combine(sums, {}, [](double a, double b) { return a + b; });
+        for (size_t i = whole; i < lhs.size(); ++i) {
+            result += lhs[i] * rhs[i];
+        }
+        return result;
+    }
+
+    double norm(std::span<const double> values) {
+        double squares = dot(values, values);
+        if (std::isfinite(squares) && squares >= std::numeric_limits<double>::min()) {
+            return std::sqrt(squares);
+        }
+        // Overflowed, underflowed or NaN: scale by the largest magnitude and redo
+        double scale = 0.0;
+        for (double v : values) {
+            scale = std::max(scale, std::abs(v));
+        }
+        if (scale == 0.0 || !std::isfinite(scale)) {
+            return std::isnan(squares) ? squares : scale;
+        }
+        Lanes sums{};
+        size_t whole = values.size() / s_lanes * s_lanes;
+        for (size_t i = 0; i < whole; i += s_lanes) {
+            for (size_t l = 0; l < s_lanes; ++l) {
+                double scaled = values[i + l] / scale;
+                sums[l] += scaled * scaled;
+            }
+        }
+        double result = combine(sums, {}, [](double a, double b) { return a + b; });
+        for (size_t i = whole; i < values.size(); ++i) {
+            double scaled = values[i] / scale;
+            result += scaled * scaled;
+        }
+        return scale * std::sqrt(result);
+    }
+
+    double minimum(std::span<const double> values) {
+        return select(values, [](double candidate, double current) { return candidate < current; });
+    }
+
+    double maximum(std::span<const double> values) {
+        return select(values, [](double candidate, double current) { return current < candidate; });
+    }
+}
@@ -0,0 +1,189 @@
+#include "BulkLoad.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Line {
+        size_t number;
+        std::string_view text;
+    };
+
+    struct Definition {
+        size_t line;
+        std::unique_ptr<ASTNode> ast;
+        bool isFunction;
+    };
+
+    struct ParseError {
+        size_t line;
+        std::string message;
+    };
+
+    // Every chunk parses independently; results are concatenated in chunk order
+    struct Chunk {
+        std::vector<Definition> definitions;
+        std::optional<ParseError> error;
+    };
+
+    std::vector<Line> splitLines(std::string_view text) {
+        std::vector<Line> lines;
+        size_t number = 0;
+        while (!text.empty()) {
+            ++number;
+            size_t end = text.find('\n');
+            std::string_view line = text.substr(0, end);
+            text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+            auto first = std::find_if_not(line.begin(), line.end(), [](unsigned char c) { return std::isspace(c); });
+            if (first != line.end() && *first != '#') {
+                lines.push_back({ number, line });
+            }
+        }
+        return lines;
+    }
+
+    Definition parseDefinition(const Line& line) {
+        Lexer lexer(line.text);
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        if (ast->m_type != NodeType::Operator || ast->getValue<OperatorType>() != OperatorType::Assignment) {
+            throw std::runtime_error("expected a definition");
+        }
+        const auto& target = *ast->m_children[0];
+        bool isFunction = target.m_type == NodeType::Function;
+        if (isFunction && (target.m_children.size() != 1 || target.m_children[0]->m_type != NodeType::Variable)) {
+            throw std::runtime_error("Function assignment requires one variable argument");
+        }
+        if (!isFunction && target.m_type != NodeType::Variable) {
+            throw std::runtime_error("Assignment target must be a variable");
+        }
+        return { line.number, std::move(ast), isFunction };
+    }
+
+    std::runtime_error lineError(const BulkLoadOptions& options, size_t line, const std::string& message) {
+        return std::runtime_error(options.source + ":" + std::to_string(line) + ": " + message);
+    }
+
+    template<typename Fn>
+    void forEach(ThreadPool* pool, size_t count, Fn&& fn) {
+        if (pool) {
+            pool->parallelFor(count, fn);
+        }
+        else {
+            for (size_t i = 0; i < count; ++i) {
+                fn(i);
+            }
+        }
+    }
+}
+
+BulkLoadResult loadDefinitions(Evaluator& evaluator, std::string_view text, const BulkLoadOptions& options) {
+    BulkLoadResult result;
+    auto start = Clock::now();
+
+    auto lines = splitLines(text);
+    result.definitions = lines.size();
+    // Several chunks per thread so uneven lines still balance
+    size_t chunkCount = std::max<size_t>(1, std::min(lines.size(), (options.pool ? options.pool->concurrency() : 1) * 8));
+    std::vector<Chunk> chunks(chunkCount);
+    forEach(options.pool, chunkCount, [&](size_t c) {
+        size_t begin = lines.size() * c / chunkCount;
+        size_t end = lines.size() * (c + 1) / chunkCount;
+        auto& chunk = chunks[c];
+        chunk.definitions.reserve(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            try {
+                chunk.definitions.push_back(parseDefinition(lines[i]));
+            }
+            catch (const std::exception& e) {
+                chunk.error = ParseError{ lines[i].number, e.what() };
+                return;
+            }
+        }
+    });
+    // Chunks are in line order, so the first one with an error holds the first failing line
+    for (const auto& chunk : chunks) {
+        if (chunk.error) {
+            throw lineError(options, chunk.error->line, chunk.error->message);
+        }
+    }
+    auto parsed = Clock::now();
+    result.timings.parse = parsed - start;
+
+    // Last definition wins: later chunks, and later lines within a chunk, overwrite earlier ones
+    std::unordered_map<std::string, Definition*> latest;
+    std::vector<Definition*> assignments;
+    for (auto& chunk : chunks) {
+        for (auto& definition : chunk.definitions) {
+            if (!definition.isFunction) {
+                assignments.push_back(&definition);
+                continue;
+            }
+            auto [it, inserted] = latest.try_emplace(definition.ast->m_children[0]->getValue<std::string>(), &definition);
+            if (!inserted) {
+                it->second = &definition;
+                ++result.replacedFunctions;
+            }
+        }
+    }
+    // Registered in line order of the winning definitions, so the result never depends on hashing
+    std::vector<std::pair<std::string, Definition*>> winners(latest.begin(), latest.end());
+    std::sort(winners.begin(), winners.end(), [](const auto& l, const auto& r) { return l.second->line < r.second->line; });
+    std::vector<std::pair<std::string, FunctionInfo>> functions;
+    functions.reserve(winners.size());
+    for (auto& [name, definition] : winners) {
+        auto& ast = *definition->ast;
+        functions.emplace_back(name, FunctionInfo{ .argNames = { ast.m_children[0]->m_children[0]->getValue<std::string>() },
+            .body = std::move(ast.m_children[1]) });
+    }
+    result.functions = functions.size();
+    evaluator.defineFunctions(std::move(functions));
+    auto merged = Clock::now();
+    result.timings.merge = merged - parsed;
+
+    for (auto* assignment : assignments) {
+        try {
+            evaluator.evaluateValue(*assignment->ast);
+        }
+        catch (const std::exception& e) {
+            throw lineError(options, assignment->line, e.what());
+        }
+    }
+    result.variables = assignments.size();
+    auto evaluated = Clock::now();
+    result.timings.evaluate = evaluated - merged;
+
+    if (options.compile) {
+        // Compiling only reads the evaluator, so functions compile independently
+        std::vector<std::optional<Program>> programs(winners.size());
+        std::vector<std::string> errors(winners.size());
+        forEach(options.pool, winners.size(), [&](size_t i) {
+            const auto& call = *winners[i].second->ast->m_children[0];
+            try {
+                programs[i] = evaluator.compile(call, { call.m_children[0]->getValue<std::string>() });
+            }
+            catch (const std::exception& e) {
+                errors[i] = e.what();
+            }
+        });
+        for (size_t i = 0; i < winners.size(); ++i) {
+            if (programs[i]) {
+                result.programs.emplace(winners[i].first, std::move(*programs[i]));
+            }
+            else {
+                result.uncompiled.emplace(winners[i].first, std::move(errors[i]));
+            }
+        }
+        result.timings.compile = Clock::now() - evaluated;
+    }
+    return result;
+}
@@ -0,0 +1,182 @@
+#include "mathcore.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct mathcore_context {
+    Evaluator evaluator;
+    std::string error;
+};
+
+struct mathcore_program {
+    Program program;
+    ProgramWorkspace<double> workspace;
+    std::string error;
+};
+
+namespace {
+    // Lexing and parsing failures are told apart from later ones by stage
+    class SyntaxError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    std::unique_ptr<ASTNode> parse(const char* text) {
+        try {
+            Lexer lexer(text);
+            Parser parser(lexer.tokenize());
+            return parser.parseExpression();
+        }
+        catch (const std::bad_alloc&) {
+            throw;
+        }
+        catch (const std::exception& e) {
+            throw SyntaxError(e.what());
+        }
+    }
+
+    // Runs fn, turning any exception into a status and a message in `error`
+    template<typename F>
+    mathcore_status guarded(std::string& error, mathcore_status failure, F&& fn) noexcept {
+        try {
+            fn();
+            return MATHCORE_OK;
+        }
+        catch (const SyntaxError& e) {
+            error = e.what();
+            return MATHCORE_SYNTAX_ERROR;
+        }
+        catch (const std::invalid_argument& e) {
+            error = e.what();
+            return MATHCORE_INVALID_ARGUMENT;
+        }
+        catch (const std::bad_alloc&) {
+            error.clear();
+            return MATHCORE_OUT_OF_MEMORY;
+        }
+        catch (const std::exception& e) {
+            try {
+                error = e.what();
+            }
+            catch (...) {
+            }
+            return failure;
+        }
+        catch (...) {
+            return MATHCORE_INTERNAL_ERROR;
+        }
+    }
+}
+
+extern "C" {
+
+mathcore_context* mathcore_context_create(void) {
+    return new (std::nothrow) mathcore_context;
+}
+
+void mathcore_context_free(mathcore_context* context) {
+    delete context;
+}
+
+mathcore_status mathcore_context_evaluate(mathcore_context* context, const char* text, double* result) {
+    if (!context || !text) {
+        return MATHCORE_INVALID_ARGUMENT;
+    }
+    return guarded(context->error, MATHCORE_EVALUATION_ERROR, [&] {
+        double value = context->evaluator.evaluate(*parse(text));
+        if (result) {
+            *result = value;
+        }
+    });
+}
+
+mathcore_status mathcore_context_set_variable(mathcore_context* context, const char* name, double value) {
+    if (!context || !name) {
+        return MATHCORE_INVALID_ARGUMENT;
+    }
+    return guarded(context->error, MATHCORE_INTERNAL_ERROR, [&] {
+        context->evaluator.setVariable(name, value);
+    });
+}
+
+const char* mathcore_context_error(const mathcore_context* context) {
+    return context ? context->error.c_str() : "";
+}
+
+mathcore_status mathcore_compile(mathcore_context* context,
+    const char* const* formulas, size_t formula_count,
+    const char* const* inputs, size_t input_count,
+    mathcore_program** program) {
+    if (program) {
+        *program = nullptr;
+    }
+    if (!context || !program || !formulas || formula_count == 0 || (input_count > 0 && !inputs)) {
+        return MATHCORE_INVALID_ARGUMENT;
+    }
+    return guarded(context->error, MATHCORE_COMPILE_ERROR, [&] {
+        std::vector<std::unique_ptr<ASTNode>> asts;
+        std::vector<const ASTNode*> roots;
+        for (size_t i = 0; i < formula_count; ++i) {
+            if (!formulas[i]) {
+                throw std::invalid_argument("Formula " + std::to_string(i) + " is null");
+            }
+            asts.push_back(parse(formulas[i]));
+            roots.push_back(asts.back().get());
+        }
+        std::vector<std::string> names;
+        for (size_t i = 0; i < input_count; ++i) {
+            if (!inputs[i]) {
+                throw std::invalid_argument("Input name " + std::to_string(i) + " is null");
+            }
+            names.emplace_back(inputs[i]);
+        }
+        auto result = std::make_unique<mathcore_program>();
+        result->program = context->evaluator.compile(roots, std::move(names));
+        result->workspace = result->program.workspace<double>();
+        *program = result.release();
+    });
+}
+
+void mathcore_program_free(mathcore_program* program) {
+    delete program;
+}
+
+size_t mathcore_program_input_count(const mathcore_program* program) {
+    return program ? program->program.inputCount() : 0;
+}
+
+size_t mathcore_program_output_count(const mathcore_program* program) {
+    return program ? program->program.outputCount() : 0;
+}
+
+mathcore_status mathcore_program_evaluate(mathcore_program* program, const double* inputs, double* outputs) {
+    if (!program || !outputs || (!inputs && program->program.inputCount() > 0)) {
+        return MATHCORE_INVALID_ARGUMENT;
+    }
+    return guarded(program->error, MATHCORE_EVALUATION_ERROR, [&] {
+        program->program.run(std::span(inputs, program->program.inputCount()),
+            std::span(outputs, program->program.outputCount()), program->workspace);
+    });
+}
+
+mathcore_status mathcore_program_evaluate_batch(mathcore_program* program,
+    const double* const* inputs, double* const* outputs, size_t rows) {
+    if (!program || !outputs || (!inputs && program->program.inputCount() > 0)) {
+        return MATHCORE_INVALID_ARGUMENT;
+    }
+    return guarded(program->error, MATHCORE_EVALUATION_ERROR, [&] {
+        program->program.runBatch(std::span(inputs, program->program.inputCount()),
+            std::span(outputs, program->program.outputCount()), rows, program->workspace);
+    });
+}
+
+const char* mathcore_program_error(const mathcore_program* program) {
+    return program ? program->error.c_str() : "";
+}
+
+}
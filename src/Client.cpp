@@ -0,0 +1,168 @@
+#include "Client.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    [[noreturn]] void throwSystemError(const std::string& what) {
+        throw std::runtime_error(what + ": " + std::strerror(errno));
+    }
+
+    void sendAll(int fd, std::string_view data) {
+        while (!data.empty()) {
+            ssize_t sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throwSystemError("send");
+            }
+            data.remove_prefix(static_cast<size_t>(sent));
+        }
+    }
+
+    void receiveAll(int fd, char* data, size_t size) {
+        while (size > 0) {
+            ssize_t received = ::recv(fd, data, size, 0);
+            if (received == 0) {
+                throw std::runtime_error("Server closed the connection");
+            }
+            if (received < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throwSystemError("recv");
+            }
+            data += received;
+            size -= static_cast<size_t>(received);
+        }
+    }
+}
+
+Client::Client(const std::string& address) {
+    if (address.starts_with("unix:")) {
+        std::string path = address.substr(5);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            throw std::runtime_error("Invalid socket path: " + path);
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        m_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (m_fd < 0 || ::connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            int error = errno;
+            if (m_fd >= 0) {
+                ::close(m_fd);
+            }
+            errno = error;
+            throwSystemError("connect " + path);
+        }
+    }
+    else if (address.starts_with("tcp:")) {
+        int port = std::stoi(address.substr(4));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        m_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (m_fd < 0 || ::connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            int error = errno;
+            if (m_fd >= 0) {
+                ::close(m_fd);
+            }
+            errno = error;
+            throwSystemError("connect port " + std::to_string(port));
+        }
+        int on = 1;
+        ::setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    else {
+        throw std::runtime_error("Server address must be unix:PATH or tcp:PORT");
+    }
+}
+
+Client::~Client() {
+    ::close(m_fd);
+}
+
+std::string Client::request(std::string_view payload) {
+    sendAll(m_fd, protocol::frame(payload));
+    char header[protocol::s_headerSize];
+    receiveAll(m_fd, header, sizeof(header));
+    uint32_t size = protocol::Reader({ header, sizeof(header) }).u32();
+    if (size == 0 || size > protocol::s_maxPayload) {
+        throw std::runtime_error("Malformed response");
+    }
+    std::string response(size, '\0');
+    receiveAll(m_fd, response.data(), size);
+    if (static_cast<protocol::ResponseStatus>(response[0]) != protocol::ResponseStatus::Ok) {
+        throw std::runtime_error(response.substr(1));
+    }
+    return response.substr(1);
+}
+
+double Client::define(std::string_view assignment) {
+    std::string payload(1, static_cast<char>(protocol::RequestType::Define));
+    payload += assignment;
+    auto response = request(payload);
+    return protocol::Reader(response).f64();
+}
+
+double Client::evaluate(std::string_view expression) {
+    std::string payload(1, static_cast<char>(protocol::RequestType::Evaluate));
+    payload += expression;
+    auto response = request(payload);
+    return protocol::Reader(response).f64();
+}
+
+std::vector<std::vector<double>> Client::batch(const std::vector<std::string>& inputs,
+    const std::vector<std::string>& formulas, std::span<const std::vector<double>> columns) {
+    if (columns.size() != inputs.size()) {
+        throw std::invalid_argument("Batch needs one column per input");
+    }
+    size_t rows = columns.empty() ? 0 : columns[0].size();
+    std::string payload(1, static_cast<char>(protocol::RequestType::Batch));
+    protocol::putU32(payload, static_cast<uint32_t>(rows));
+    protocol::putU32(payload, static_cast<uint32_t>(inputs.size()));
+    for (const auto& input : inputs) {
+        protocol::putString(payload, input);
+    }
+    protocol::putU32(payload, static_cast<uint32_t>(formulas.size()));
+    for (const auto& formula : formulas) {
+        protocol::putString(payload, formula);
+    }
+    for (const auto& column : columns) {
+        if (column.size() != rows) {
+            throw std::invalid_argument("Batch columns must have the same length");
+        }
+        for (double value : column) {
+            protocol::putF64(payload, value);
+        }
+    }
+
+    auto response = request(payload);
+    protocol::Reader reader(response);
+    std::vector<std::vector<double>> results(formulas.size(), std::vector<double>(rows));
+    for (auto& column : results) {
+        for (double& value : column) {
+            value = reader.f64();
+        }
+    }
+    return results;
+}
+
+LatencySummary Client::stats() {
+    auto response = request(std::string(1, static_cast<char>(protocol::RequestType::Stats)));
+    protocol::Reader reader(response);
+    LatencySummary summary;
+    summary.requests = reader.u64();
+    summary.p50Micros = reader.f64();
+    summary.p99Micros = reader.f64();
+    return summary;
+}
@@ -0,0 +1,371 @@
+#include "CodeGen.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "SpecialKernelsSource.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+
+namespace {
+    // Identifiers in formulas are letters and digits, so names with an underscore can't
+    // collide with them; only keywords need renaming
+    const std::unordered_set<std::string_view> s_keywords = {
+        "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case",
+        "catch", "char", "char8_t", "char16_t", "char32_t", "class", "compl", "concept", "const", "consteval",
+        "constexpr", "constinit", "continue", "co_await", "co_return", "co_yield", "decltype", "default",
+        "delete", "do", "double", "else", "enum", "explicit", "export", "extern", "false", "float", "for",
+        "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not",
+        "not_eq", "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register",
+        "requires", "return", "short", "signed", "sizeof", "static", "struct", "switch", "template",
+        "this", "throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using",
+        "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq"
+    };
+
+    std::string identifier(const std::string& name) {
+        if (name.empty() || !std::all_of(name.begin(), name.end(), [](unsigned char c) { return std::isalnum(c) || c == '_'; })
+            || std::isdigit(static_cast<unsigned char>(name[0]))) {
+            throw std::runtime_error("Not a C++ identifier: " + name);
+        }
+        return s_keywords.contains(name) ? name + "_" : name;
+    }
+
+    // Exact, as a hexadecimal floating literal
+    std::string literal(double value) {
+        if (std::isnan(value)) {
+            return "::std::numeric_limits<double>::quiet_NaN()";
+        }
+        if (std::isinf(value)) {
+            return value > 0 ? "::std::numeric_limits<double>::infinity()" : "(-::std::numeric_limits<double>::infinity())";
+        }
+        std::array<char, 32> digits;
+        auto [end, ec] = std::to_chars(digits.data(), digits.data() + digits.size(), std::fabs(value), std::chars_format::hex);
+        std::string text = "0x" + std::string(digits.data(), end);
+        return std::signbit(value) ? "(-" + text + ")" : text;
+    }
+
+    std::string quoted(std::string_view message) {
+        std::string result = "\"";
+        for (char c : message) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+            }
+            result += c;
+        }
+        return result + '"';
+    }
+
+    // C++ for one instruction, given the text of its operands
+    struct Step {
+        std::string value;
+        std::string failure; // Condition under which the program throws `message`; empty if it can't
+        std::string message;
+
+        Step(std::string value, std::string failure = {}, std::string message = {})
+            : value{ std::move(value) }
+            , failure{ std::move(failure) }
+            , message{ std::move(message) } {
+        }
+    };
+
+    Step translate(const Instruction& ins, const std::string& a, const std::string& b, const std::string& c) {
+        auto call = [](std::string_view function, const std::string& x) { return "::std::" + std::string(function) + "(" + x + ")"; };
+        auto flag = [](const std::string& condition) { return "(" + condition + " ? 1.0 : 0.0)"; };
+        switch (ins.m_op) {
+        case OpCode::Negate: return { "-" + a };
+        case OpCode::Add: return { a + " + " + b };
+        case OpCode::Subtract: return { a + " - " + b };
+        case OpCode::Multiply: return { a + " * " + b };
+        case OpCode::Divide: return { a + " / " + b, b + " == 0", "Division by zero" };
+        case OpCode::IntDivide: return { "::std::floor(" + a + " / " + b + ")", b + " == 0", "Division by zero" };
+        case OpCode::Power: return { "::std::pow(" + a + ", " + b + ")" };
+        case OpCode::Mod:
+            return { "::std::fmod(::std::trunc(" + a + "), ::std::trunc(" + b + "))", "::std::trunc(" + b + ") == 0", "Division by zero" };
+        case OpCode::Factorial:
+            return { "detail_::factorial(" + a + ")", "!detail_::isNonNegativeInteger(" + a + ")", "Factorial requires a non-negative integer" };
+        case OpCode::Sin: return { call("sin", a) };
+        case OpCode::Cos: return { call("cos", a) };
+        case OpCode::Tan: return { call("tan", a), call("cos", a) + " == 0", "tan undefined at pi/2 + k*pi" };
+        case OpCode::Asin: return { call("asin", a), "(" + a + " < -1.0) | (" + a + " > 1.0)", "asin requires argument in [-1, 1]" };
+        case OpCode::Acos: return { call("acos", a), "(" + a + " < -1.0) | (" + a + " > 1.0)", "acos requires argument in [-1, 1]" };
+        case OpCode::Atan: return { call("atan", a) };
+        case OpCode::Atan2: return { "::std::atan2(" + a + ", " + b + ")" };
+        case OpCode::Exp: return { call("exp", a) };
+        case OpCode::Sqrt: return { call("sqrt", a), a + " < 0", "sqrt requires non-negative argument" };
+        case OpCode::Log: return { call("log", a), a + " <= 0", "log requires positive argument" };
+        case OpCode::Log10: return { call("log10", a), a + " <= 0", "log10 requires positive argument" };
+        case OpCode::Abs: return { call("abs", a) };
+        case OpCode::Floor: return { call("floor", a) };
+        case OpCode::Ceil: return { call("ceil", a) };
+        case OpCode::Round: return { call("round", a) };
+        case OpCode::Min: return { b + " < " + a + " ? " + b + " : " + a };
+        case OpCode::Max: return { a + " < " + b + " ? " + b + " : " + a };
+        case OpCode::Less: return { flag(a + " < " + b) };
+        case OpCode::LessEqual: return { flag(a + " <= " + b) };
+        case OpCode::Greater: return { flag(a + " > " + b) };
+        case OpCode::GreaterEqual: return { flag(a + " >= " + b) };
+        case OpCode::Equal: return { flag(a + " == " + b) };
+        case OpCode::NotEqual: return { flag(a + " != " + b) };
+        case OpCode::And: return { flag("(" + a + " != 0) & (" + b + " != 0)") };
+        case OpCode::Or: return { flag("(" + a + " != 0) | (" + b + " != 0)") };
+        case OpCode::Select: return { a + " != 0 ? " + b + " : " + c };
+        case OpCode::Gamma:
+            return { "detail_::gamma(" + a + ")", "detail_::isNonPositiveInteger(" + a + ")", "gamma undefined at non-positive integers" };
+        case OpCode::Lgamma:
+            return { "detail_::lgamma(" + a + ")", "detail_::isNonPositiveInteger(" + a + ")", "lgamma undefined at non-positive integers" };
+        case OpCode::Lfact: return { "detail_::lfact(" + a + ")", "!(" + a + " >= 0)", "lfact requires a non-negative argument" };
+        case OpCode::NCr: case OpCode::NPr: {
+            std::string name = ins.m_op == OpCode::NCr ? "nCr" : "nPr";
+            return { "detail_::" + name + "(" + a + ", " + b + ")",
+                "!detail_::isNonNegativeInteger(" + a + ") | !detail_::isNonNegativeInteger(" + b + ")",
+                name + " requires non-negative integer arguments" };
+        }
+        case OpCode::Call: throw std::runtime_error("Native functions cannot be exported to C++");
+        case OpCode::Random: case OpCode::RandomNormal: throw std::runtime_error("rand and randn cannot be exported to C++");
+        default: throw std::runtime_error("Unsupported instruction");
+        }
+    }
+
+    // What a register holds at some point of the program. Const and Input emit no code:
+    // later instructions read the literal or the parameter directly.
+    struct Source {
+        enum class Kind { Literal, Input, Register } kind;
+        std::string name;
+    };
+
+    std::string text(const Source& source, bool batch) {
+        if (!batch || source.kind == Source::Kind::Literal) {
+            return source.name;
+        }
+        return source.name + (source.kind == Source::Kind::Input ? "[base_ + i_]" : "[i_]");
+    }
+
+    // Walks the program's code, handing each instruction that computes something to
+    // `emit` along with the sources of its operands and guard
+    template<typename F>
+    Source walk(const CppFunction& function, const std::vector<std::string>& inputs, F emit) {
+        const Program& program = function.program;
+        std::vector<Source> sources(program.registerCount());
+        for (const auto& ins : program.code()) {
+            if (ins.m_op == OpCode::Const) {
+                sources[ins.m_dst] = { Source::Kind::Literal, literal(program.constants()[ins.m_lhs]) };
+                continue;
+            }
+            if (ins.m_op == OpCode::Input) {
+                sources[ins.m_dst] = { Source::Kind::Input, inputs[ins.m_lhs] };
+                continue;
+            }
+            const Source* guard = ins.m_guard == Instruction::s_unguarded ? nullptr : &sources[ins.m_guard];
+            // Operands are read before dst is written, which may be one of their registers
+            Source a = sources[ins.m_lhs];
+            Source b = sources[ins.m_rhs];
+            Source c = sources[ins.m_addend];
+            Source g = guard ? *guard : Source{};
+            sources[ins.m_dst] = { Source::Kind::Register, "r_" + std::to_string(ins.m_dst) };
+            emit(ins, a, b, c, guard ? &g : nullptr);
+        }
+        return sources[program.outputs()[0]];
+    }
+
+    void emitPreamble(std::ostream& out, std::string_view ns) {
+        out << "// Generated by cmdCalc --emit-cpp from formulas; regenerate rather than edit.\n"
+               "// Compile without -ffast-math: results match mathcore's bit for bit only under IEEE semantics.\n"
+               "#pragma once\n"
+               "#include <algorithm>\n"
+               "#include <array>\n"
+               "#include <cmath>\n"
+               "#include <cstddef>\n"
+               "#include <cstdint>\n"
+               "#include <limits>\n"
+               "#include <numbers>\n"
+               "#include <numeric>\n"
+               "#include <stdexcept>\n\n"
+               "namespace " << ns << " {\n"
+               "namespace detail_ {\n"
+               "    [[noreturn]] inline void fail(const char* message) {\n"
+               "        throw ::std::runtime_error(message);\n"
+               "    }\n\n"
+            << s_specialKernelsSource
+            << "}\n";
+    }
+
+    // Registers computed into, declared up front: allocation reuses them, so they aren't single-assignment
+    std::vector<uint32_t> computedRegisters(const Program& program) {
+        std::vector<uint32_t> registers;
+        for (const auto& ins : program.code()) {
+            if (ins.m_op != OpCode::Const && ins.m_op != OpCode::Input) {
+                registers.push_back(ins.m_dst);
+            }
+        }
+        std::sort(registers.begin(), registers.end());
+        registers.erase(std::unique(registers.begin(), registers.end()), registers.end());
+        return registers;
+    }
+
+    std::string failureCondition(const Step& step, const Source* guard, bool batch) {
+        if (!guard) {
+            return step.failure;
+        }
+        // Rows the guard excludes give NaN instead of failing; their values are never selected
+        return "(" + step.failure + ") & (" + text(*guard, batch) + " != 0)";
+    }
+
+    void emitScalar(std::ostream& out, const CppFunction& function, const std::string& name, const std::vector<std::string>& inputs) {
+        const Program& program = function.program;
+        out << "\ninline double " << name << "(";
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            out << (i ? ", " : "") << "double " << inputs[i];
+        }
+        out << ") {\n";
+        auto registers = computedRegisters(program);
+        for (size_t i = 0; i < registers.size(); ++i) {
+            out << (i ? ", " : "    double ") << "r_" << registers[i] << (i + 1 == registers.size() ? ";\n" : "");
+        }
+        Source result = walk(function, inputs, [&](const Instruction& ins, const Source& a, const Source& b,
+            const Source& c, const Source* guard) {
+            Step step = translate(ins, text(a, false), text(b, false), text(c, false));
+            if (!step.failure.empty()) {
+                out << "    if (" << failureCondition(step, guard, false) << ") {\n"
+                    << "        detail_::fail(" << quoted(step.message) << ");\n"
+                    << "    }\n";
+            }
+            out << "    r_" << ins.m_dst << " = " << step.value << ";\n";
+        });
+        out << "    return " << text(result, false) << ";\n}\n";
+    }
+
+    void emitBatch(std::ostream& out, const CppFunction& function, const std::string& name, const std::vector<std::string>& inputs) {
+        const Program& program = function.program;
+        out << "\n// out_[i] = " << name << "(";
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            out << (i ? ", " : "") << inputs[i] << "[i]";
+        }
+        out << ") for i < rows_\n"
+            << "inline void " << name << "_batch(";
+        for (const auto& input : inputs) {
+            out << "const double* " << input << ", ";
+        }
+        out << "double* out_, ::std::size_t rows_) {\n"
+            << "    constexpr ::std::size_t block_ = " << Program::s_blockSize << ";\n";
+        auto registers = computedRegisters(program);
+        for (size_t i = 0; i < registers.size(); ++i) {
+            out << (i ? ", " : "    double ") << "r_" << registers[i] << "[block_]" << (i + 1 == registers.size() ? ";\n" : "");
+        }
+        out << "    for (::std::size_t base_ = 0; base_ < rows_; base_ += block_) {\n"
+            << "        const ::std::size_t count_ = ::std::min(block_, rows_ - base_);\n";
+        Source result = walk(function, inputs, [&](const Instruction& ins, const Source& a, const Source& b,
+            const Source& c, const Source* guard) {
+            Step step = translate(ins, text(a, true), text(b, true), text(c, true));
+            if (step.failure.empty()) {
+                out << "        for (::std::size_t i_ = 0; i_ < count_; ++i_) {\n"
+                    << "            r_" << ins.m_dst << "[i_] = " << step.value << ";\n"
+                    << "        }\n";
+                return;
+            }
+            // Checked across the whole block, then thrown, so the loop stays branch-free
+            out << "        {\n"
+                << "            bool failed_ = false;\n"
+                << "            for (::std::size_t i_ = 0; i_ < count_; ++i_) {\n"
+                << "                failed_ |= " << failureCondition(step, guard, true) << ";\n"
+                << "                r_" << ins.m_dst << "[i_] = " << step.value << ";\n"
+                << "            }\n"
+                << "            if (failed_) {\n"
+                << "                detail_::fail(" << quoted(step.message) << ");\n"
+                << "            }\n"
+                << "        }\n";
+        });
+        out << "        for (::std::size_t i_ = 0; i_ < count_; ++i_) {\n"
+            << "            out_[base_ + i_] = " << text(result, true) << ";\n"
+            << "        }\n"
+            << "    }\n"
+            << "}\n";
+    }
+}
+
+std::vector<CppFunction> userCppFunctions(const Evaluator& evaluator) {
+    std::vector<CppFunction> result;
+    for (auto& [name, parameters] : evaluator.userFunctions()) {
+        ASTNode call(name, NodeType::Function);
+        for (const auto& parameter : parameters) {
+            call.appendChild(std::make_unique<ASTNode>(parameter, NodeType::Variable));
+        }
+        try {
+            result.push_back({ name, parameters, evaluator.compile(call, parameters) });
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error(name + ": " + e.what());
+        }
+    }
+    return result;
+}
+
+CppFunction cppExpression(const Evaluator& evaluator, std::string_view definition) {
+    Lexer lexer{ std::string(definition) };
+    Parser parser{ lexer.tokenize() };
+    auto ast = parser.parseExpression();
+    const auto* target = ast->m_type == NodeType::Operator && ast->getValue<OperatorType>() == OperatorType::Assignment
+        ? ast->m_children[0].get() : nullptr;
+    if (!target || target->m_type != NodeType::Function) {
+        throw std::runtime_error("Expected name(inputs...) = expression");
+    }
+    CppFunction function;
+    function.name = target->getValue<std::string>();
+    for (const auto& input : target->m_children) {
+        if (input->m_type != NodeType::Variable) {
+            throw std::runtime_error("Inputs of " + function.name + " must be names");
+        }
+        function.inputs.push_back(input->getValue<std::string>());
+    }
+    function.program = evaluator.compile(*ast->m_children[1], function.inputs);
+    return function;
+}
+
+void emitCpp(std::ostream& out, std::span<const CppFunction> functions, std::string_view ns) {
+    // Check everything before writing anything
+    std::vector<std::string> names;
+    std::vector<std::vector<std::string>> inputs;
+    for (const auto& function : functions) {
+        const Program& program = function.program;
+        try {
+            if (program.outputCount() != 1) {
+                throw std::runtime_error("Only single-output programs can be exported to C++");
+            }
+            if (program.inputCount() != function.inputs.size()) {
+                throw std::runtime_error("Program expects " + std::to_string(program.inputCount()) + " inputs");
+            }
+            const auto& options = program.compileOptions();
+            if (options.accuracy != Accuracy::Strict) {
+                throw std::runtime_error("Only programs compiled with strict accuracy can be exported to C++");
+            }
+            if (options.contractFma || options.expandPowers || options.polynomials != PolynomialScheme::None) {
+                throw std::runtime_error("Programs compiled with contractFma, expandPowers or polynomials round differently "
+                    "from the interpreter and can't be exported to C++");
+            }
+            names.push_back(identifier(function.name));
+            auto& parameters = inputs.emplace_back();
+            for (const auto& input : function.inputs) {
+                parameters.push_back(identifier(input));
+            }
+            for (const auto& ins : program.code()) {
+                if (ins.m_op != OpCode::Const && ins.m_op != OpCode::Input) {
+                    translate(ins, "a", "b", "c");
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error(function.name + ": " + e.what());
+        }
+    }
+    emitPreamble(out, ns);
+    for (size_t i = 0; i < functions.size(); ++i) {
+        emitScalar(out, functions[i], names[i], inputs[i]);
+        emitBatch(out, functions[i], names[i], inputs[i]);
+    }
+    out << "}\n";
+}
@@ -0,0 +1,544 @@
+#include "Columnar.h"
+#include "Program.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <system_error>
+#if defined(__unix__) || defined(__APPLE__)
+#define MATHCORE_COLUMNS_MMAP
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#endif
+
+namespace {
+    constexpr char s_magic[8] = { 'M', 'C', 'C', 'O', 'L', 'S', '0', '1' };
+    constexpr size_t s_headerSize = 24;
+    constexpr size_t s_entrySize = 16;
+    constexpr size_t s_alignment = 64;
+    // Rows evaluated per task: large enough to amortise a workspace and a write per output
+    constexpr size_t s_chunkRows = 65536;
+
+    // Columns are read and written in place, so the host must store them the way the file does
+    void requireLittleEndian() {
+        if constexpr (std::endian::native != std::endian::little) {
+            throw std::runtime_error("Columnar files need a little-endian host");
+        }
+    }
+
+    template<typename T>
+    T load(const std::byte* at) {
+        T value;
+        std::memcpy(&value, at, sizeof(T));
+        return value;
+    }
+
+    template<typename T>
+    void store(std::vector<std::byte>& out, size_t at, T value) {
+        std::memcpy(out.data() + at, &value, sizeof(T));
+    }
+
+    uint64_t alignUp(uint64_t offset) {
+        return (offset + s_alignment - 1) / s_alignment * s_alignment;
+    }
+
+    [[noreturn]] void malformed(const std::string& path, const std::string& what) {
+        throw std::runtime_error("Not a columnar file: " + path + " (" + what + ")");
+    }
+
+    std::string_view trim(std::string_view text) {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    std::vector<std::string_view> splitFields(std::string_view line) {
+        std::vector<std::string_view> fields;
+        size_t start = 0;
+        while (true) {
+            size_t comma = line.find(',', start);
+            fields.push_back(trim(line.substr(start, comma - start)));
+            if (comma == std::string_view::npos) {
+                return fields;
+            }
+            start = comma + 1;
+        }
+    }
+
+    bool blank(std::string_view line) {
+        return trim(line).empty();
+    }
+
+    // The values read so far for one CSV column: integers until a field isn't one
+    struct CsvColumn {
+        std::vector<int64_t> integers;
+        std::vector<double> doubles;
+        bool integral{ true };
+    };
+}
+
+#ifdef MATHCORE_COLUMNS_MMAP
+struct ColumnFile::Mapping {
+    void* address{ MAP_FAILED };
+    size_t size{};
+
+    ~Mapping() {
+        if (address != MAP_FAILED) {
+            ::munmap(address, size);
+        }
+    }
+    const std::byte* data() const { return static_cast<const std::byte*>(address); }
+};
+#else
+struct ColumnFile::Mapping {
+    std::vector<std::byte> bytes;
+    size_t size{};
+
+    const std::byte* data() const { return bytes.data(); }
+};
+#endif
+
+ColumnFile::ColumnFile(const std::string& path)
+    : m_mapping{ std::make_unique<Mapping>() } {
+    requireLittleEndian();
+#ifdef MATHCORE_COLUMNS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat info {};
+    if (::fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= s_headerSize) {
+        m_mapping->size = static_cast<size_t>(info.st_size);
+        m_mapping->address = ::mmap(nullptr, m_mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (m_mapping->size < s_headerSize) {
+        malformed(path, "too short");
+    }
+    if (m_mapping->address == MAP_FAILED) {
+        throw std::runtime_error("Cannot map " + path);
+    }
+    // Evaluation reads each column front to back
+    ::madvise(m_mapping->address, m_mapping->size, MADV_SEQUENTIAL);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    std::vector<char> bytes{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    m_mapping->bytes.resize(bytes.size());
+    std::memcpy(m_mapping->bytes.data(), bytes.data(), bytes.size());
+    m_mapping->size = bytes.size();
+    if (m_mapping->size < s_headerSize) {
+        malformed(path, "too short");
+    }
+#endif
+    const std::byte* base = m_mapping->data();
+    size_t size = m_mapping->size;
+    if (std::memcmp(base, s_magic, sizeof(s_magic)) != 0) {
+        malformed(path, "bad magic");
+    }
+    m_rows = load<uint64_t>(base + 8);
+    size_t count = load<uint32_t>(base + 16);
+    if (count > (size - s_headerSize) / s_entrySize) {
+        malformed(path, "truncated column directory");
+    }
+    size_t columnBytes = m_rows > size / sizeof(double) ? SIZE_MAX : m_rows * sizeof(double);
+    m_columns.reserve(count);
+    m_data.reserve(count);
+    for (size_t c = 0; c < count; ++c) {
+        const std::byte* entry = base + s_headerSize + c * s_entrySize;
+        uint64_t dataOffset = load<uint64_t>(entry);
+        size_t nameOffset = load<uint32_t>(entry + 8);
+        size_t nameLength = load<uint16_t>(entry + 12);
+        auto type = load<uint8_t>(entry + 14);
+        if (type > static_cast<uint8_t>(ColumnType::Int64)) {
+            malformed(path, "unknown type of column " + std::to_string(c));
+        }
+        if (nameOffset > size || nameLength > size - nameOffset) {
+            malformed(path, "name of column " + std::to_string(c) + " out of range");
+        }
+        if (dataOffset % sizeof(double) != 0 || dataOffset > size || columnBytes > size - dataOffset) {
+            malformed(path, "data of column " + std::to_string(c) + " out of range");
+        }
+        m_columns.push_back({ std::string(reinterpret_cast<const char*>(base + nameOffset), nameLength),
+            static_cast<ColumnType>(type) });
+        m_data.push_back(base + dataOffset);
+    }
+}
+
+ColumnFile::~ColumnFile() = default;
+ColumnFile::ColumnFile(ColumnFile&&) noexcept = default;
+ColumnFile& ColumnFile::operator=(ColumnFile&&) noexcept = default;
+
+std::optional<size_t> ColumnFile::find(std::string_view name) const {
+    for (size_t c = 0; c < m_columns.size(); ++c) {
+        if (m_columns[c].name == name) {
+            return c;
+        }
+    }
+    return std::nullopt;
+}
+
+std::span<const double> ColumnFile::doubles(size_t column) const {
+    if (m_columns.at(column).type != ColumnType::Float64) {
+        throw std::runtime_error("Column " + m_columns[column].name + " is not float64");
+    }
+    return { reinterpret_cast<const double*>(m_data[column]), m_rows };
+}
+
+std::span<const int64_t> ColumnFile::integers(size_t column) const {
+    if (m_columns.at(column).type != ColumnType::Int64) {
+        throw std::runtime_error("Column " + m_columns[column].name + " is not int64");
+    }
+    return { reinterpret_cast<const int64_t*>(m_data[column]), m_rows };
+}
+
+#ifdef MATHCORE_COLUMNS_MMAP
+struct ColumnWriter::File {
+    std::string path;
+    int fd{ -1 };
+};
+#else
+struct ColumnWriter::File {
+    std::string path;
+    std::fstream stream;
+    std::mutex mutex;
+};
+#endif
+
+ColumnWriter::ColumnWriter(const std::string& path, std::vector<ColumnSpec> columns, size_t rows)
+    : m_file{ std::make_unique<File>() }, m_columns{ std::move(columns) }, m_rows{ rows } {
+    requireLittleEndian();
+    m_file->path = path;
+    size_t names = 0;
+    for (const auto& column : m_columns) {
+        if (column.name.size() > UINT16_MAX) {
+            throw std::runtime_error("Column name too long: " + column.name.substr(0, 32) + "...");
+        }
+        names += column.name.size();
+    }
+    size_t directory = s_headerSize + m_columns.size() * s_entrySize;
+    if (m_columns.size() > UINT32_MAX || directory + names > UINT32_MAX) {
+        throw std::runtime_error("Too many columns");
+    }
+    std::vector<std::byte> header(directory + names);
+    std::memcpy(header.data(), s_magic, sizeof(s_magic));
+    store<uint64_t>(header, 8, rows);
+    store<uint32_t>(header, 16, static_cast<uint32_t>(m_columns.size()));
+    uint64_t offset = alignUp(header.size());
+    size_t nameOffset = directory;
+    for (size_t c = 0; c < m_columns.size(); ++c) {
+        size_t entry = s_headerSize + c * s_entrySize;
+        store<uint64_t>(header, entry, offset);
+        store<uint32_t>(header, entry + 8, static_cast<uint32_t>(nameOffset));
+        store<uint16_t>(header, entry + 12, static_cast<uint16_t>(m_columns[c].name.size()));
+        store<uint8_t>(header, entry + 14, static_cast<uint8_t>(m_columns[c].type));
+        std::memcpy(header.data() + nameOffset, m_columns[c].name.data(), m_columns[c].name.size());
+        nameOffset += m_columns[c].name.size();
+        m_offsets.push_back(offset);
+        offset = alignUp(offset + rows * sizeof(double));
+    }
+    uint64_t fileSize = m_columns.empty() ? header.size() : m_offsets.back() + rows * sizeof(double);
+#ifdef MATHCORE_COLUMNS_MMAP
+    m_file->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_file->fd < 0) {
+        throw std::runtime_error("Cannot create " + path);
+    }
+    // Sized up front so that writes of any rows, in any order, land inside the file
+    if (::ftruncate(m_file->fd, static_cast<off_t>(fileSize)) != 0) {
+        ::close(m_file->fd);
+        throw std::runtime_error("Cannot write " + path);
+    }
+#else
+    m_file->stream.open(path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+    if (!m_file->stream) {
+        throw std::runtime_error("Cannot create " + path);
+    }
+    if (fileSize > header.size()) {
+        m_file->stream.seekp(static_cast<std::streamoff>(fileSize - 1));
+        m_file->stream.put('\0');
+    }
+#endif
+    writeAt(0, header.data(), header.size());
+}
+
+ColumnWriter::~ColumnWriter() {
+#ifdef MATHCORE_COLUMNS_MMAP
+    if (m_file->fd >= 0) {
+        ::close(m_file->fd);
+    }
+#endif
+}
+
+void ColumnWriter::write(size_t column, size_t first, std::span<const double> values) {
+    if (m_columns.at(column).type != ColumnType::Float64) {
+        throw std::runtime_error("Column " + m_columns[column].name + " is not float64");
+    }
+    if (first > m_rows || values.size() > m_rows - first) {
+        throw std::out_of_range("Rows past the end of column " + m_columns[column].name);
+    }
+    writeAt(m_offsets[column] + first * sizeof(double), values.data(), values.size_bytes());
+}
+
+void ColumnWriter::write(size_t column, size_t first, std::span<const int64_t> values) {
+    if (m_columns.at(column).type != ColumnType::Int64) {
+        throw std::runtime_error("Column " + m_columns[column].name + " is not int64");
+    }
+    if (first > m_rows || values.size() > m_rows - first) {
+        throw std::out_of_range("Rows past the end of column " + m_columns[column].name);
+    }
+    writeAt(m_offsets[column] + first * sizeof(int64_t), values.data(), values.size_bytes());
+}
+
+void ColumnWriter::close() {
+#ifdef MATHCORE_COLUMNS_MMAP
+    if (m_file->fd < 0) {
+        return;
+    }
+    int result = ::close(m_file->fd);
+    m_file->fd = -1;
+    if (result != 0) {
+        throw std::runtime_error("Cannot write " + m_file->path);
+    }
+#else
+    if (!m_file->stream.is_open()) {
+        return;
+    }
+    m_file->stream.close();
+    if (!m_file->stream) {
+        throw std::runtime_error("Cannot write " + m_file->path);
+    }
+#endif
+}
+
+void ColumnWriter::writeAt(uint64_t offset, const void* data, size_t size) {
+#ifdef MATHCORE_COLUMNS_MMAP
+    if (m_file->fd < 0) {
+        throw std::runtime_error("Column file already closed: " + m_file->path);
+    }
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = ::pwrite(m_file->fd, bytes, size, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Cannot write " + m_file->path);
+        }
+        bytes += written;
+        offset += static_cast<uint64_t>(written);
+        size -= static_cast<size_t>(written);
+    }
+#else
+    std::lock_guard lock(m_file->mutex);
+    if (!m_file->stream.is_open()) {
+        throw std::runtime_error("Column file already closed: " + m_file->path);
+    }
+    m_file->stream.seekp(static_cast<std::streamoff>(offset));
+    m_file->stream.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    if (!m_file->stream) {
+        throw std::runtime_error("Cannot write " + m_file->path);
+    }
+#endif
+}
+
+void evaluateColumns(const Program& program, std::span<const std::string> inputNames, const ColumnFile& input,
+    ColumnWriter& output, ThreadPool* pool) {
+    if (inputNames.size() != program.inputCount()) {
+        throw std::invalid_argument("Program expects " + std::to_string(program.inputCount()) + " input columns");
+    }
+    if (output.columns().size() != program.outputCount()) {
+        throw std::invalid_argument("Program has " + std::to_string(program.outputCount()) + " outputs");
+    }
+    if (output.rows() != input.rows()) {
+        throw std::invalid_argument("Output has " + std::to_string(output.rows()) + " rows, input "
+            + std::to_string(input.rows()));
+    }
+    for (const auto& column : output.columns()) {
+        if (column.type != ColumnType::Float64) {
+            throw std::invalid_argument("Output column " + column.name + " is not float64");
+        }
+    }
+    std::vector<size_t> columns;
+    for (const auto& name : inputNames) {
+        auto column = input.find(name);
+        if (!column) {
+            throw std::runtime_error("Input column not found: " + name);
+        }
+        columns.push_back(*column);
+    }
+    // Integer columns are converted only if the program reads them
+    std::vector<bool> used(columns.size());
+    for (const auto& ins : program.code()) {
+        if (ins.m_op == OpCode::Input) {
+            used[ins.m_lhs] = true;
+        }
+    }
+
+    size_t rows = input.rows();
+    size_t chunks = (rows + s_chunkRows - 1) / s_chunkRows;
+    auto runChunk = [&](size_t chunk) {
+        size_t first = chunk * s_chunkRows;
+        size_t count = std::min(s_chunkRows, rows - first);
+        std::vector<const double*> inputs(columns.size());
+        std::vector<std::vector<double>> converted;
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (input.columns()[columns[i]].type == ColumnType::Float64) {
+                inputs[i] = input.doubles(columns[i]).data() + first;
+            }
+            else if (used[i]) {
+                auto integers = input.integers(columns[i]).subspan(first, count);
+                auto& values = converted.emplace_back(count);
+                std::transform(integers.begin(), integers.end(), values.begin(),
+                    [](int64_t value) { return static_cast<double>(value); });
+                inputs[i] = values.data();
+            }
+        }
+        std::vector<double> results(count * program.outputCount());
+        std::vector<double*> outputs;
+        for (size_t k = 0; k < program.outputCount(); ++k) {
+            outputs.push_back(results.data() + k * count);
+        }
+        auto workspace = program.workspace<double>();
+        workspace.firstRow = first;
+        program.runBatch<double>(inputs, outputs, count, workspace);
+        for (size_t k = 0; k < outputs.size(); ++k) {
+            output.write(k, first, std::span<const double>(outputs[k], count));
+        }
+    };
+    if (pool && program.pure() && chunks > 1) {
+        pool->parallelFor(chunks, runChunk);
+    }
+    else {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            runChunk(chunk);
+        }
+    }
+}
+
+void csvToColumns(std::istream& csv, const std::string& path) {
+    std::string line;
+    size_t lineNumber = 1;
+    while (std::getline(csv, line) && blank(line)) {
+        ++lineNumber;
+    }
+    if (blank(line)) {
+        throw std::runtime_error("CSV has no header row");
+    }
+    std::vector<ColumnSpec> specs;
+    for (auto name : splitFields(line)) {
+        if (name.empty()) {
+            throw std::runtime_error("line " + std::to_string(lineNumber) + ": empty column name");
+        }
+        if (std::any_of(specs.begin(), specs.end(), [&](const ColumnSpec& spec) { return spec.name == name; })) {
+            throw std::runtime_error("line " + std::to_string(lineNumber) + ": duplicate column " + std::string(name));
+        }
+        specs.push_back({ std::string(name), ColumnType::Float64 });
+    }
+
+    std::vector<CsvColumn> columns(specs.size());
+    size_t rows = 0;
+    while (std::getline(csv, line)) {
+        ++lineNumber;
+        if (blank(line)) {
+            continue;
+        }
+        auto fields = splitFields(line);
+        if (fields.size() != columns.size()) {
+            throw std::runtime_error("line " + std::to_string(lineNumber) + ": expected " + std::to_string(columns.size())
+                + " fields, got " + std::to_string(fields.size()));
+        }
+        for (size_t c = 0; c < fields.size(); ++c) {
+            auto field = fields[c];
+            const char* end = field.data() + field.size();
+            auto& column = columns[c];
+            if (column.integral) {
+                int64_t integer{};
+                auto [ptr, ec] = std::from_chars(field.data(), end, integer);
+                if (ec == std::errc{} && ptr == end) {
+                    column.integers.push_back(integer);
+                    column.doubles.push_back(static_cast<double>(integer));
+                    continue;
+                }
+            }
+            double value{};
+            auto [ptr, ec] = std::from_chars(field.data(), end, value);
+            if (field.empty() || ec != std::errc{} || ptr != end) {
+                throw std::runtime_error("line " + std::to_string(lineNumber) + ", column " + specs[c].name
+                    + ": not a number: '" + std::string(field) + "'");
+            }
+            if (column.integral) {
+                column.integral = false;
+                column.integers = {};
+            }
+            column.doubles.push_back(value);
+        }
+        ++rows;
+    }
+
+    for (size_t c = 0; c < specs.size(); ++c) {
+        if (columns[c].integral && rows > 0) {
+            specs[c].type = ColumnType::Int64;
+        }
+    }
+    ColumnWriter writer(path, specs, rows);
+    for (size_t c = 0; c < specs.size(); ++c) {
+        if (specs[c].type == ColumnType::Int64) {
+            writer.write(c, 0, std::span<const int64_t>(columns[c].integers));
+        }
+        else {
+            writer.write(c, 0, std::span<const double>(columns[c].doubles));
+        }
+    }
+    writer.close();
+}
+
+void columnsToCsv(const ColumnFile& file, std::ostream& csv) {
+    const auto& specs = file.columns();
+    for (size_t c = 0; c < specs.size(); ++c) {
+        csv << (c ? "," : "") << specs[c].name;
+    }
+    csv << '\n';
+    std::vector<std::span<const double>> doubles(specs.size());
+    std::vector<std::span<const int64_t>> integers(specs.size());
+    for (size_t c = 0; c < specs.size(); ++c) {
+        if (specs[c].type == ColumnType::Int64) {
+            integers[c] = file.integers(c);
+        }
+        else {
+            doubles[c] = file.doubles(c);
+        }
+    }
+    std::string line;
+    char buffer[32];
+    for (size_t row = 0; row < file.rows(); ++row) {
+        line.clear();
+        for (size_t c = 0; c < specs.size(); ++c) {
+            if (c) {
+                line += ',';
+            }
+            // Shortest form that reads back to the same value
+            auto [end, ec] = specs[c].type == ColumnType::Int64 ? std::to_chars(buffer, buffer + sizeof(buffer), integers[c][row])
+                : std::to_chars(buffer, buffer + sizeof(buffer), doubles[c][row]);
+            line.append(buffer, end);
+        }
+        line += '\n';
+        csv << line;
+    }
+}
@@ -0,0 +1,726 @@
+#include "Compiler.h"
+#include "Evaluator.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    constexpr uint32_t s_noRegister = std::numeric_limits<uint32_t>::max();
+
+    const std::unordered_map<std::string, OpCode> s_unaryBuiltins = {
+        {"sin", OpCode::Sin}, {"cos", OpCode::Cos}, {"tan", OpCode::Tan},
+        {"asin", OpCode::Asin}, {"acos", OpCode::Acos}, {"atan", OpCode::Atan},
+        {"exp", OpCode::Exp}, {"sqrt", OpCode::Sqrt}, {"log", OpCode::Log}, {"log10", OpCode::Log10},
+        {"abs", OpCode::Abs}, {"floor", OpCode::Floor}, {"ceil", OpCode::Ceil}, {"round", OpCode::Round},
+        {"factorial", OpCode::Factorial}, {"gamma", OpCode::Gamma}, {"lgamma", OpCode::Lgamma}, {"lfact", OpCode::Lfact}
+    };
+
+    const std::unordered_map<std::string, OpCode> s_binaryBuiltins = {
+        {"atan2", OpCode::Atan2}, {"nCr", OpCode::NCr}, {"nPr", OpCode::NPr}
+    };
+
+    // Random instructions read none either: their m_lhs is the call site. They also stay
+    // out of value numbering, since every call of rand() draws a value of its own.
+    bool readsRegisters(OpCode op) {
+        return op != OpCode::Const && op != OpCode::Input && op != OpCode::Random && op != OpCode::RandomNormal;
+    }
+
+    bool isPolynomial(OpCode op) {
+        return op == OpCode::Horner || op == OpCode::Estrin;
+    }
+
+    using Coefficients = std::vector<double>;
+
+    void trim(Coefficients& p) {
+        while (p.size() > 1 && p.back() == 0) {
+            p.pop_back();
+        }
+    }
+
+    Coefficients add(Coefficients a, const Coefficients& b, double sign) {
+        a.resize(std::max(a.size(), b.size()));
+        for (size_t i = 0; i < b.size(); ++i) {
+            a[i] += sign * b[i];
+        }
+        trim(a);
+        return a;
+    }
+
+    Coefficients multiply(const Coefficients& a, const Coefficients& b) {
+        Coefficients result(a.size() + b.size() - 1);
+        for (size_t i = 0; i < a.size(); ++i) {
+            for (size_t j = 0; j < b.size(); ++j) {
+                result[i + j] += a[i] * b[j];
+            }
+        }
+        trim(result);
+        return result;
+    }
+
+    // Instructions without domain errors may be dropped when unused. The others must
+    // still run, so a compiled formula fails wherever the interpreter would.
+    bool isRemovable(OpCode op) {
+        switch (op) {
+        case OpCode::Const: case OpCode::Input:
+        case OpCode::Negate: case OpCode::Add: case OpCode::Subtract: case OpCode::Multiply: case OpCode::Power:
+        case OpCode::Sin: case OpCode::Cos: case OpCode::Atan: case OpCode::Atan2: case OpCode::Exp:
+        case OpCode::Abs: case OpCode::Floor: case OpCode::Ceil: case OpCode::Round: case OpCode::Min: case OpCode::Max:
+        case OpCode::Less: case OpCode::LessEqual: case OpCode::Greater: case OpCode::GreaterEqual:
+        case OpCode::Equal: case OpCode::NotEqual: case OpCode::And: case OpCode::Or: case OpCode::Select:
+        case OpCode::Reciprocal: case OpCode::PowHalf: case OpCode::Fma: case OpCode::Horner: case OpCode::Estrin:
+        case OpCode::Random: case OpCode::RandomNormal:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // x * (1/c) == x / c for every x exactly when 1/c is a normal power of two,
+    // also in float, whose exponent range is the narrowest we run in
+    bool hasExactReciprocal(double c) {
+        int exponent;
+        return std::isfinite(c) && std::abs(std::frexp(c, &exponent)) == 0.5 && exponent > -125 && exponent < 126;
+    }
+}
+
+Compiler::Compiler(const Evaluator& evaluator, std::vector<std::string> inputNames,
+    const std::unordered_map<std::string, double>* localVars)
+    : m_evaluator{ evaluator }
+    , m_inputNames{ std::move(inputNames) }
+    , m_localVars{ localVars } {
+}
+
+Program Compiler::compile(const ASTNode& root) {
+    return compile(std::vector<const ASTNode*>{ &root });
+}
+
+Program Compiler::compile(const std::vector<const ASTNode*>& roots) {
+    m_program = Program{};
+    m_program.m_inputCount = static_cast<uint32_t>(m_inputNames.size());
+    m_program.m_options = m_evaluator.options;
+    m_inputRegisters.assign(m_inputNames.size(), s_noRegister);
+    m_constantRegisters.clear();
+    m_valueNumbers.clear();
+    m_callNumbers.clear();
+    m_nextRegister = 0;
+    m_inlineDepth = 0;
+    m_scope = 0;
+    m_inlining.clear();
+    m_guard = Instruction::s_unguarded;
+
+    for (const ASTNode* root : roots) {
+        m_program.m_outputs.push_back(compileNode(*root, nullptr));
+    }
+    eliminateDeadCode();
+    allocateRegisters();
+    return std::move(m_program);
+}
+
+uint32_t Compiler::emit(OpCode op, uint32_t lhs, uint32_t rhs, uint32_t addend) {
+    // Only instructions that can fail need a guard; a guarded one is not shared with
+    // an unguarded use, which must still fail
+    uint32_t guard = isRemovable(op) ? Instruction::s_unguarded : m_guard;
+    if (readsRegisters(op)) {
+        // IEEE addition and multiplication commute exactly, so a+b and b+a share a value number
+        if ((op == OpCode::Add || op == OpCode::Multiply || op == OpCode::Fma) && rhs < lhs) {
+            std::swap(lhs, rhs);
+        }
+        auto [it, inserted] = m_valueNumbers.try_emplace({ op, lhs, rhs, addend, guard }, m_nextRegister);
+        if (!inserted) {
+            return it->second;
+        }
+    }
+    uint32_t dst = m_nextRegister++;
+    m_program.m_code.push_back({ op, dst, lhs, rhs, addend, guard });
+    m_program.m_positions.push_back(m_position);
+    m_program.m_scopes.push_back(m_scope);
+    return dst;
+}
+
+uint32_t Compiler::emitConstant(double value) {
+    auto bits = std::bit_cast<uint64_t>(value);
+    if (auto it = m_constantRegisters.find(bits); it != m_constantRegisters.end()) {
+        return it->second;
+    }
+    m_program.m_constants.push_back(value);
+    uint32_t reg = emit(OpCode::Const, static_cast<uint32_t>(m_program.m_constants.size() - 1));
+    m_constantRegisters.emplace(bits, reg);
+    return reg;
+}
+
+uint32_t Compiler::emitArithmetic(OpCode op, uint32_t lhs, uint32_t rhs) {
+    auto& stats = m_program.m_stats;
+    if (op == OpCode::Power) {
+        if (auto exponent = constantValue(rhs)) {
+            // pow(x, 0) is 1 even for NaN, and pow(x, 1) is x
+            if (*exponent == 0 || *exponent == 1) {
+                ++stats.powersExpanded;
+                return emitPower(lhs, static_cast<int>(*exponent));
+            }
+            if (m_evaluator.options.expandPowers && *exponent == 0.5) {
+                ++stats.squareRoots;
+                return emitUnary(OpCode::PowHalf, lhs);
+            }
+            // Negative powers beyond -1 are left alone: 1/x^n overflows where pow(x, -n) is still finite
+            if (m_evaluator.options.expandPowers && std::floor(*exponent) == *exponent && *exponent >= -1
+                && *exponent <= s_maxExpandedPower) {
+                ++stats.powersExpanded;
+                return emitPower(lhs, static_cast<int>(*exponent));
+            }
+        }
+    }
+    else if (op == OpCode::Divide) {
+        if (auto divisor = constantValue(rhs); divisor && hasExactReciprocal(*divisor)) {
+            ++stats.divisionsByConstant;
+            return emit(OpCode::Multiply, lhs, emitConstant(1.0 / *divisor));
+        }
+    }
+    else if (op == OpCode::Add && m_evaluator.options.contractFma) {
+        // The product may be on either side; a product that is also used elsewhere stays
+        // alive, otherwise eliminateDeadCode drops it
+        for (auto [product, addend] : { std::pair{ lhs, rhs }, std::pair{ rhs, lhs } }) {
+            Instruction ins = m_program.m_code[product];
+            if (ins.m_op == OpCode::Multiply) {
+                ++stats.fmaContractions;
+                return emit(OpCode::Fma, ins.m_lhs, ins.m_rhs, addend);
+            }
+        }
+    }
+    return emit(op, lhs, rhs);
+}
+
+uint32_t Compiler::emitPower(uint32_t base, int exponent) {
+    if (exponent == 0) {
+        return emitConstant(1.0); // pow(x, 0) is 1 even for NaN
+    }
+    if (exponent < 0) {
+        return emitUnary(OpCode::Reciprocal, emitPower(base, -exponent));
+    }
+    // Square and multiply; value numbering shares the squares with other uses
+    uint32_t result = s_noRegister;
+    uint32_t square = base;
+    while (true) {
+        if (exponent & 1) {
+            result = result == s_noRegister ? square : emit(OpCode::Multiply, result, square);
+        }
+        exponent >>= 1;
+        if (exponent == 0) {
+            return result;
+        }
+        square = emit(OpCode::Multiply, square, square);
+    }
+}
+
+std::optional<uint32_t> Compiler::compilePolynomial(const ASTNode& node, const Bindings* params) {
+    uint32_t variable = s_noRegister;
+    size_t operators = 0;
+    auto op = node.getValue<OperatorType>();
+    if (op == OperatorType::Divide && node.m_children.size() == 2) {
+        // A ratio keeps its one division, so division by zero is still reported
+        auto numerator = collectPolynomial(*node.m_children[0], params, variable, operators);
+        auto denominator = numerator ? collectPolynomial(*node.m_children[1], params, variable, operators) : std::nullopt;
+        if (denominator && denominator->size() > 1 && operators + 1 >= s_minPolynomialOperators) {
+            uint32_t lhs = emitPolynomial(variable, *numerator);
+            return emit(OpCode::Divide, lhs, emitPolynomial(variable, *denominator));
+        }
+        variable = s_noRegister;
+        operators = 0;
+    }
+    auto coefficients = collectPolynomial(node, params, variable, operators);
+    if (!coefficients || coefficients->size() < 3 || operators < s_minPolynomialOperators
+        || std::count(coefficients->begin(), coefficients->end(), 0.0) + 2 > static_cast<ptrdiff_t>(coefficients->size())) {
+        return std::nullopt;
+    }
+    return emitPolynomial(variable, *coefficients);
+}
+
+std::optional<std::vector<double>> Compiler::collectPolynomial(const ASTNode& node, const Bindings* params,
+    uint32_t& variable, size_t& operators) {
+    if (node.m_type == NodeType::Number) {
+        return Coefficients{ node.getValue<double>() };
+    }
+    if (node.m_type == NodeType::Variable) {
+        uint32_t reg = compileVariable(node.getValue<std::string>(), params);
+        if (auto value = constantValue(reg)) {
+            return Coefficients{ *value };
+        }
+        if (variable == s_noRegister) {
+            variable = reg;
+        }
+        return reg == variable ? std::optional{ Coefficients{ 0.0, 1.0 } } : std::nullopt;
+    }
+    if (node.m_type != NodeType::Operator) {
+        return std::nullopt;
+    }
+    ++operators;
+    auto op = node.getValue<OperatorType>();
+    if (op != OperatorType::Add && op != OperatorType::Subtract && op != OperatorType::Multiply && op != OperatorType::Divide
+        && op != OperatorType::Power && op != OperatorType::UnaryMinus && op != OperatorType::UnaryPlus) {
+        return std::nullopt;
+    }
+    auto result = collectPolynomial(*node.m_children[0], params, variable, operators);
+    if (result && op == OperatorType::UnaryMinus) {
+        for (double& c : *result) {
+            c = -c;
+        }
+    }
+    for (size_t i = 1; i < node.m_children.size() && result; ++i) {
+        auto rhs = collectPolynomial(*node.m_children[i], params, variable, operators);
+        if (!rhs) {
+            return std::nullopt;
+        }
+        bool constant = rhs->size() == 1;
+        double c = rhs->front();
+        switch (op) {
+        case OperatorType::Add: result = add(std::move(*result), *rhs, 1.0); break;
+        case OperatorType::Subtract: result = add(std::move(*result), *rhs, -1.0); break;
+        case OperatorType::Multiply:
+            if (result->size() + rhs->size() - 2 > Program::s_maxPolynomialDegree) {
+                return std::nullopt;
+            }
+            result = multiply(*result, *rhs);
+            break;
+        case OperatorType::Divide:
+            // Only by nonzero constants; dividing by zero must still fail at run time
+            if (!constant || c == 0) {
+                return std::nullopt;
+            }
+            for (double& coefficient : *result) {
+                coefficient /= c;
+            }
+            break;
+        default: { // Power
+            if (constant && result->size() == 1) {
+                result->front() = std::pow(result->front(), c);
+                break;
+            }
+            if (!constant || c < 0 || std::floor(c) != c || (result->size() - 1) * c > Program::s_maxPolynomialDegree) {
+                return std::nullopt;
+            }
+            Coefficients power{ 1.0 };
+            for (int k = 0; k < static_cast<int>(c); ++k) {
+                power = multiply(power, *result);
+            }
+            result = std::move(power);
+            break;
+        }
+        }
+    }
+    return result;
+}
+
+uint32_t Compiler::emitPolynomial(uint32_t variable, const std::vector<double>& coefficients) {
+    if (coefficients.size() == 1) {
+        return emitConstant(coefficients.front());
+    }
+    auto first = static_cast<uint32_t>(m_program.m_constants.size());
+    m_program.m_constants.insert(m_program.m_constants.end(), coefficients.begin(), coefficients.end());
+    ++m_program.m_stats.polynomials;
+    OpCode op = m_evaluator.options.polynomials == PolynomialScheme::Estrin ? OpCode::Estrin : OpCode::Horner;
+    return emit(op, variable, first, static_cast<uint32_t>(coefficients.size() - 1));
+}
+
+std::optional<double> Compiler::constantValue(uint32_t reg) const {
+    const auto& ins = m_program.m_code[reg];
+    if (ins.m_op != OpCode::Const) {
+        return std::nullopt;
+    }
+    return m_program.m_constants[ins.m_lhs];
+}
+
+std::vector<uint32_t> Compiler::operands(const Instruction& ins) const {
+    std::vector<uint32_t> result;
+    if (ins.m_op == OpCode::Call) {
+        result = m_program.m_calls[ins.m_lhs].args;
+    }
+    else if (ins.m_op == OpCode::Fma || ins.m_op == OpCode::Select) {
+        result = { ins.m_lhs, ins.m_rhs, ins.m_addend };
+    }
+    else if (isPolynomial(ins.m_op)) {
+        result = { ins.m_lhs, ins.m_lhs, ins.m_lhs };
+    }
+    else {
+        result = { ins.m_lhs, ins.m_rhs, ins.m_rhs };
+    }
+    if (ins.m_guard != Instruction::s_unguarded) {
+        result.push_back(ins.m_guard);
+    }
+    return result;
+}
+
+uint32_t Compiler::compileNode(const ASTNode& node, const Bindings* params) {
+    // Children restore the position on return, so instructions emitted after them
+    // are still attributed to this node
+    size_t outer = std::exchange(m_position, node.m_position);
+    uint32_t result = lowerNode(node, params);
+    m_position = outer;
+    return result;
+}
+
+uint32_t Compiler::lowerNode(const ASTNode& node, const Bindings* params) {
+    switch (node.m_type) {
+    case NodeType::Number:
+        return emitConstant(node.getValue<double>());
+
+    case NodeType::Variable:
+        return compileVariable(node.getValue<std::string>(), params);
+
+    case NodeType::Operator: {
+        if (m_evaluator.options.polynomials != PolynomialScheme::None) {
+            if (auto result = compilePolynomial(node, params)) {
+                return *result;
+            }
+        }
+        auto op = node.getValue<OperatorType>();
+        if (isLogical(op)) {
+            return compileLogical(node, params);
+        }
+        switch (op) {
+        case OperatorType::UnaryMinus: return emitUnary(OpCode::Negate, compileNode(*node.m_children[0], params));
+        case OperatorType::UnaryPlus: return compileNode(*node.m_children[0], params);
+        case OperatorType::Factorial: return emitUnary(OpCode::Factorial, compileNode(*node.m_children[0], params));
+        case OperatorType::Assignment: throw std::runtime_error("Assignment cannot be compiled");
+        default: break;
+        }
+        OpCode code;
+        switch (op) {
+        case OperatorType::Add: code = OpCode::Add; break;
+        case OperatorType::Subtract: code = OpCode::Subtract; break;
+        case OperatorType::Multiply: code = OpCode::Multiply; break;
+        case OperatorType::Divide: code = OpCode::Divide; break;
+        case OperatorType::Int_divide: code = OpCode::IntDivide; break;
+        case OperatorType::Power: code = OpCode::Power; break;
+        case OperatorType::Mod: code = OpCode::Mod; break;
+        case OperatorType::Less: code = OpCode::Less; break;
+        case OperatorType::LessEqual: code = OpCode::LessEqual; break;
+        case OperatorType::Greater: code = OpCode::Greater; break;
+        case OperatorType::GreaterEqual: code = OpCode::GreaterEqual; break;
+        case OperatorType::Equal: code = OpCode::Equal; break;
+        case OperatorType::NotEqual: code = OpCode::NotEqual; break;
+        default: throw std::runtime_error("Unsupported operator");
+        }
+        // n-ary chains fold left to right, like the interpreter
+        uint32_t result = compileNode(*node.m_children[0], params);
+        for (size_t i = 1; i < node.m_children.size(); ++i) {
+            result = emitArithmetic(code, result, compileNode(*node.m_children[i], params));
+        }
+        return result;
+    }
+
+    case NodeType::Function:
+        return compileFunction(node, params);
+
+    case NodeType::Array:
+        throw std::runtime_error("Arrays cannot be compiled");
+
+    default:
+        throw std::runtime_error("Unsupported node type");
+    }
+}
+
+uint32_t Compiler::compileVariable(const std::string& name, const Bindings* params) {
+    // Mirrors Evaluator: a function body sees its parameters, the top level sees
+    // inputs and the caller's locals, and both fall back to global variables
+    if (params) {
+        if (auto it = params->find(name); it != params->end()) {
+            return it->second;
+        }
+    }
+    else {
+        for (size_t i = 0; i < m_inputNames.size(); ++i) {
+            if (m_inputNames[i] == name) {
+                if (m_inputRegisters[i] == s_noRegister) {
+                    m_inputRegisters[i] = emit(OpCode::Input, static_cast<uint32_t>(i));
+                }
+                return m_inputRegisters[i];
+            }
+        }
+        if (m_localVars) {
+            if (auto it = m_localVars->find(name); it != m_localVars->end()) {
+                return emitConstant(it->second);
+            }
+        }
+    }
+    if (auto it = m_evaluator.variables.find(name); it != m_evaluator.variables.end()) {
+        return emitConstant(it->second);
+    }
+    if (m_evaluator.arrays.contains(name)) {
+        throw std::runtime_error("Arrays cannot be compiled: " + name);
+    }
+    throw std::runtime_error("Undefined variable: " + name);
+}
+
+uint32_t Compiler::compileFunction(const ASTNode& node, const Bindings* params) {
+    const auto& name = node.getValue<std::string>();
+    const auto& args = node.m_children;
+
+    if (auto it = s_unaryBuiltins.find(name); it != s_unaryBuiltins.end()) {
+        if (args.size() != 1) {
+            throw std::runtime_error(name + " expects one argument");
+        }
+        return emitUnary(it->second, compileNode(*args[0], params));
+    }
+    if (auto it = s_binaryBuiltins.find(name); it != s_binaryBuiltins.end()) {
+        if (args.size() != 2) {
+            throw std::runtime_error(name + " expects two arguments");
+        }
+        uint32_t lhs = compileNode(*args[0], params);
+        uint32_t rhs = compileNode(*args[1], params);
+        return emit(it->second, lhs, rhs);
+    }
+    if (name == "min" || name == "max") {
+        if (args.empty()) {
+            throw std::runtime_error(name + " requires at least one argument");
+        }
+        OpCode op = name == "min" ? OpCode::Min : OpCode::Max;
+        uint32_t result = compileNode(*args[0], params);
+        for (size_t i = 1; i < args.size(); ++i) {
+            result = emit(op, result, compileNode(*args[i], params));
+        }
+        return result;
+    }
+    if (name == "sum" || name == "prod" || name == "integrate") {
+        throw std::runtime_error(name + " cannot be compiled");
+    }
+    if (name == "if") {
+        return compileIf(node, params);
+    }
+    if (name == "rand" || name == "randn") {
+        return compileRandom(node, params);
+    }
+    if (name == "prev" || name == "lag") {
+        throw std::runtime_error(name + " can only be used in a scan");
+    }
+    if (auto native = m_evaluator.natives.find(name); native != m_evaluator.natives.end()) {
+        return compileNative(name, native->second, node, params);
+    }
+
+    auto it = m_evaluator.functions.find(name);
+    if (it == m_evaluator.functions.end()) {
+        throw std::runtime_error("Undefined function: " + name);
+    }
+    const auto& func = it->second;
+    if (func.argNames.size() != args.size()) {
+        throw std::runtime_error("Incorrect number of arguments for function: " + name);
+    }
+    if (m_inlineDepth >= s_maxInlineDepth) {
+        throw std::runtime_error("Function calls nested too deeply to compile: " + name);
+    }
+    // Inlining a recursive call never ends, whatever if() would cut it short at run time
+    if (std::find(m_inlining.begin(), m_inlining.end(), name) != m_inlining.end()) {
+        throw std::runtime_error("Recursive functions cannot be compiled: " + name);
+    }
+    Bindings bindings;
+    for (size_t i = 0; i < args.size(); ++i) {
+        bindings[func.argNames[i]] = compileNode(*args[i], params);
+    }
+    auto& names = m_program.m_functionNames;
+    auto scope = static_cast<uint32_t>(std::find(names.begin(), names.end(), name) - names.begin());
+    if (scope == names.size()) {
+        names.push_back(name);
+    }
+    uint32_t outer = std::exchange(m_scope, scope);
+    ++m_inlineDepth;
+    m_inlining.push_back(name);
+    uint32_t result = compileNode(*func.body, &bindings);
+    m_inlining.pop_back();
+    --m_inlineDepth;
+    m_scope = outer;
+    return result;
+}
+
+uint32_t Compiler::compileGuarded(const ASTNode& node, const Bindings* params, uint32_t mask) {
+    uint32_t outer = m_guard;
+    m_guard = outer == Instruction::s_unguarded ? mask : emit(OpCode::And, outer, mask);
+    uint32_t result = compileNode(node, params);
+    m_guard = outer;
+    return result;
+}
+
+uint32_t Compiler::compileLogical(const ASTNode& node, const Bindings* params) {
+    // Each operand is guarded by the rows the ones before it left undecided
+    bool isAnd = node.getValue<OperatorType>() == OperatorType::And;
+    OpCode combine = isAnd ? OpCode::And : OpCode::Or;
+    uint32_t result = compileNode(*node.m_children[0], params);
+    for (size_t i = 1; i < node.m_children.size(); ++i) {
+        uint32_t undecided = isAnd ? result : emit(OpCode::Equal, result, emitConstant(0.0));
+        result = emit(combine, result, compileGuarded(*node.m_children[i], params, undecided));
+    }
+    return result;
+}
+
+uint32_t Compiler::compileIf(const ASTNode& node, const Bindings* params) {
+    const auto& args = node.m_children;
+    if (args.size() != 3) {
+        throw std::runtime_error("if expects 3 arguments");
+    }
+    uint32_t condition = compileNode(*args[0], params);
+    if (auto value = constantValue(condition)) {
+        return compileNode(*args[*value != 0 ? 1 : 2], params);
+    }
+    uint32_t chosen = compileGuarded(*args[1], params, condition);
+    uint32_t other = compileGuarded(*args[2], params, emit(OpCode::Equal, condition, emitConstant(0.0)));
+    return emit(OpCode::Select, condition, chosen, other);
+}
+
+uint32_t Compiler::compileRandom(const ASTNode& node, const Bindings* params) {
+    const auto& name = node.getValue<std::string>();
+    const auto& args = node.m_children;
+    if (!args.empty() && args.size() != 2) {
+        throw std::runtime_error(name + " expects zero or two arguments");
+    }
+    bool normal = name == "randn";
+    uint32_t value = emit(normal ? OpCode::RandomNormal : OpCode::Random, m_program.m_randomSites++);
+    if (args.empty()) {
+        return value;
+    }
+    // rand(a, b) = a + (b - a) * rand(), randn(mu, sigma) = mu + sigma * randn()
+    uint32_t low = compileNode(*args[0], params);
+    uint32_t high = compileNode(*args[1], params);
+    uint32_t scale = normal ? high : emitArithmetic(OpCode::Subtract, high, low);
+    return emitArithmetic(OpCode::Add, low, emitArithmetic(OpCode::Multiply, scale, value));
+}
+
+uint32_t Compiler::compileNative(const std::string& name, const std::shared_ptr<const NativeFunction>& native,
+    const ASTNode& node, const Bindings* params) {
+    native->checkArity(name, node.m_children.size());
+    std::vector<uint32_t> args;
+    std::vector<double> constants;
+    for (const auto& child : node.m_children) {
+        args.push_back(compileNode(*child, params));
+        if (auto value = constantValue(args.back())) {
+            constants.push_back(*value);
+        }
+    }
+    if (!native->pure) {
+        if (m_guard != Instruction::s_unguarded) {
+            throw std::runtime_error("Impure functions in a condition's branches cannot be compiled: " + name);
+        }
+        m_program.m_pure = false;
+    }
+    else if (constants.size() == args.size()) {
+        try {
+            double value = native->scalar(constants);
+            ++m_program.m_stats.foldedCalls;
+            return emitConstant(value);
+        }
+        catch (const std::exception&) {
+            // Left to fail at run time, like the interpreter
+        }
+    }
+    else if (auto it = m_callNumbers.find({ native.get(), args, m_guard }); it != m_callNumbers.end()) {
+        return it->second;
+    }
+    m_program.m_calls.push_back({ native, args });
+    uint32_t result = emit(OpCode::Call, static_cast<uint32_t>(m_program.m_calls.size() - 1));
+    if (native->pure) {
+        m_callNumbers.emplace(std::tuple{ native.get(), std::move(args), m_guard }, result);
+    }
+    return result;
+}
+
+void Compiler::eliminateDeadCode() {
+    auto& code = m_program.m_code;
+    std::vector<bool> live(m_nextRegister);
+    for (uint32_t output : m_program.m_outputs) {
+        live[output] = true;
+    }
+    for (size_t i = code.size(); i-- > 0;) {
+        if (!isRemovable(code[i].m_op)) {
+            live[code[i].m_dst] = true;
+        }
+        if (live[code[i].m_dst] && readsRegisters(code[i].m_op)) {
+            for (uint32_t reg : operands(code[i])) {
+                live[reg] = true;
+            }
+        }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (live[code[i].m_dst]) {
+            code[kept] = code[i];
+            m_program.m_positions[kept] = m_program.m_positions[i];
+            m_program.m_scopes[kept] = m_program.m_scopes[i];
+            ++kept;
+        }
+    }
+    m_program.m_stats.deadInstructions = code.size() - kept;
+    code.resize(kept);
+    m_program.m_positions.resize(kept);
+    m_program.m_scopes.resize(kept);
+}
+
+void Compiler::allocateRegisters() {
+    // Virtual registers are single-assignment; map them onto as few physical
+    // registers as possible so batch blocks stay cache resident
+    auto& code = m_program.m_code;
+    std::vector<size_t> lastUse(m_nextRegister, 0);
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (readsRegisters(code[i].m_op)) {
+            for (uint32_t reg : operands(code[i])) {
+                lastUse[reg] = i;
+            }
+        }
+    }
+    for (uint32_t output : m_program.m_outputs) {
+        lastUse[output] = code.size();
+    }
+
+    std::vector<uint32_t> physical(m_nextRegister, s_noRegister);
+    std::vector<uint32_t> freeList;
+    std::vector<uint32_t> released;
+    uint32_t registerCount = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        auto& ins = code[i];
+        if (readsRegisters(ins.m_op)) {
+            auto reads = operands(ins);
+            if (ins.m_op == OpCode::Call) {
+                for (auto& arg : m_program.m_calls[ins.m_lhs].args) {
+                    arg = physical[arg];
+                }
+            }
+            else {
+                ins.m_lhs = physical[ins.m_lhs];
+                ins.m_rhs = isPolynomial(ins.m_op) ? ins.m_rhs : physical[ins.m_rhs];
+                if (ins.m_op == OpCode::Fma || ins.m_op == OpCode::Select) {
+                    ins.m_addend = physical[ins.m_addend];
+                }
+            }
+            if (ins.m_guard != Instruction::s_unguarded) {
+                ins.m_guard = physical[ins.m_guard];
+            }
+            for (size_t k = 0; k < reads.size(); ++k) {
+                bool repeated = std::find(reads.begin(), reads.begin() + k, reads[k]) != reads.begin() + k;
+                if (!repeated && lastUse[reads[k]] == i) {
+                    released.push_back(physical[reads[k]]);
+                }
+            }
+        }
+        // A guarded instruction may be redone row by row after failing, so it must not
+        // overwrite its own operands: they are released only after dst is chosen
+        bool guarded = ins.m_guard != Instruction::s_unguarded;
+        if (!guarded) {
+            freeList.insert(freeList.end(), released.begin(), released.end());
+            released.clear();
+        }
+        uint32_t reg;
+        if (!freeList.empty()) {
+            reg = freeList.back();
+            freeList.pop_back();
+        }
+        else {
+            reg = registerCount++;
+        }
+        physical[ins.m_dst] = reg;
+        ins.m_dst = reg;
+        freeList.insert(freeList.end(), released.begin(), released.end());
+        released.clear();
+    }
+    for (auto& output : m_program.m_outputs) {
+        output = physical[output];
+    }
+    m_program.m_registerCount = registerCount;
+}
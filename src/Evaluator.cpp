@@ -1,8 +1,504 @@
 #include "Evaluator.h"
+#include "Compiler.h"
+#include "FastMath.h"
+#include "Random.h"
+#include "Reduction.h"
+#include "SpecialFunctions.h"
+#include "ThreadPool.h"
 #include <stdexcept>
 #include <cmath>
 #include <algorithm>
+#include <compare>
+#include <array>
+#include <deque>
 #include <limits>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+
+namespace {
+    const std::unordered_set<std::string> s_builtinFunctions = {
+        "sin", "cos", "tan", "asin", "acos", "atan", "atan2",
+        "exp", "sqrt", "log", "log10",
+        "abs", "floor", "ceil", "round", "min", "max",
+        "factorial", "gamma", "lgamma", "lfact", "nCr", "nPr",
+        "sum", "prod", "integrate", "mean", "dot", "norm", "linspace", "range", "if", "rand", "randn", "prev", "lag"
+    };
+
+    // Built-ins of one or two numbers. Given arrays, they apply elementwise.
+    struct Builtin {
+        size_t arity;
+        double (*apply)(double x, double y);
+    };
+
+    const std::unordered_map<std::string, Builtin> s_elementwise = {
+        { "sin", { 1, [](double x, double) { return std::sin(x); } } },
+        { "cos", { 1, [](double x, double) { return std::cos(x); } } },
+        { "tan", { 1, [](double x, double) {
+            if (std::cos(x) == 0) throw std::runtime_error("tan undefined at pi/2 + k*pi");
+            return std::tan(x);
+        } } },
+        { "asin", { 1, [](double x, double) {
+            if (x < -1.0 || x > 1.0) throw std::runtime_error("asin requires argument in [-1, 1]");
+            return std::asin(x);
+        } } },
+        { "acos", { 1, [](double x, double) {
+            if (x < -1.0 || x > 1.0) throw std::runtime_error("acos requires argument in [-1, 1]");
+            return std::acos(x);
+        } } },
+        { "atan", { 1, [](double x, double) { return std::atan(x); } } },
+        { "atan2", { 2, [](double y, double x) { return std::atan2(y, x); } } },
+        { "exp", { 1, [](double x, double) { return std::exp(x); } } },
+        { "sqrt", { 1, [](double x, double) {
+            if (x < 0) throw std::runtime_error("sqrt requires non-negative argument");
+            return std::sqrt(x);
+        } } },
+        { "log", { 1, [](double x, double) {
+            if (x <= 0) throw std::runtime_error("log requires positive argument");
+            return std::log(x);
+        } } },
+        { "log10", { 1, [](double x, double) {
+            if (x <= 0) throw std::runtime_error("log10 requires positive argument");
+            return std::log10(x);
+        } } },
+        { "abs", { 1, [](double x, double) { return std::abs(x); } } },
+        { "floor", { 1, [](double x, double) { return std::floor(x); } } },
+        { "ceil", { 1, [](double x, double) { return std::ceil(x); } } },
+        { "round", { 1, [](double x, double) { return std::round(x); } } },
+        { "factorial", { 1, [](double x, double) { return special::factorial(x); } } },
+        { "gamma", { 1, [](double x, double) { return special::gamma(x); } } },
+        { "lgamma", { 1, [](double x, double) { return special::lgamma(x); } } },
+        { "lfact", { 1, [](double x, double) { return special::lfact(x); } } },
+        { "nCr", { 2, [](double n, double k) { return special::nCr(n, k); } } },
+        { "nPr", { 2, [](double n, double k) { return special::nPr(n, k); } } },
+    };
+
+    // Built-ins with FastMath kernels, when the session's accuracy selects them
+    std::optional<fastmath::Function> kernelFor(const std::string& name, Accuracy accuracy) {
+        return accuracy == Accuracy::Strict ? std::nullopt : fastmath::find(name);
+    }
+
+    // The kernels give NaN for log of x <= 0 where s_elementwise fails. tan needs no check:
+    // neither cos nor the kernels' divisor is ever 0 at a double.
+    void checkKernelDomain(const std::string& name, std::span<const double> x) {
+        if (name != "log" && name != "log10") {
+            return;
+        }
+        bool nonPositive = false;
+        for (double v : x) {
+            nonPositive |= v <= 0;
+        }
+        if (nonPositive) {
+            throw std::runtime_error(name + " requires positive argument");
+        }
+    }
+
+    constexpr size_t s_stackArguments = 8; // Native calls with more arguments allocate
+
+    void checkArity(const std::string& name, size_t arity, size_t given) {
+        if (given != arity) {
+            throw std::runtime_error(name + (arity == 1 ? " expects one argument" : arity == 2 ? " expects two arguments"
+                : " expects " + std::to_string(arity) + " arguments"));
+        }
+    }
+
+    bool isArrayReduction(const std::string& name, size_t arguments) {
+        return ((name == "sum" || name == "prod") && arguments != 4) || name == "mean" || name == "dot" || name == "norm";
+    }
+
+    double applyBinary(OperatorType op, double left, double right) {
+        switch (op) {
+        case OperatorType::Add: return left + right;
+        case OperatorType::Subtract: return left - right;
+        case OperatorType::Multiply: return left * right;
+        case OperatorType::Divide:
+            if (right == 0) throw std::runtime_error("Division by zero");
+            return left / right;
+        case OperatorType::Power: return std::pow(left, right);
+        case OperatorType::Int_divide:
+            if(right == 0) throw std::runtime_error("Division by zero");
+            return std::floor(left / right);
+        case OperatorType::Mod: {
+            // Operands are truncated first, as integer % would; fmod keeps that defined for any magnitude
+            double divisor = std::trunc(right);
+            if (divisor == 0) throw std::runtime_error("Division by zero");
+            return std::fmod(std::trunc(left), divisor);
+        }
+        default: throw std::runtime_error("Unsupported operator");
+        }
+    }
+
+    using Exact = std::variant<int64_t, double>;
+
+    constexpr double s_twoPow63 = 9223372036854775808.0;
+    constexpr int64_t s_maxExactFactorial = 20; // 21! overflows int64
+
+    // Integral doubles in int64 range are held exactly; -0 stays a double so its sign survives
+    Exact exact(double x) {
+        if (x >= -s_twoPow63 && x < s_twoPow63 && std::trunc(x) == x && !(x == 0 && std::signbit(x))) {
+            return static_cast<int64_t>(x);
+        }
+        return x;
+    }
+
+    double toDouble(const Exact& value) {
+        return std::visit([](auto x) { return static_cast<double>(x); }, value);
+    }
+
+    // Integer results that are zero where IEEE arithmetic would give -0
+    Exact signedZero(bool negative) {
+        return negative ? Exact{ -0.0 } : Exact{ int64_t{ 0 } };
+    }
+
+    std::optional<int64_t> checkedAdd(int64_t a, int64_t b) {
+        if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) return std::nullopt;
+        return a + b;
+    }
+
+    std::optional<int64_t> checkedSubtract(int64_t a, int64_t b) {
+        if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b)) return std::nullopt;
+        return a - b;
+    }
+
+    std::optional<int64_t> checkedMultiply(int64_t a, int64_t b) {
+        if (a == 0 || b == 0) return 0;
+        if (a == -1) return b == INT64_MIN ? std::nullopt : std::optional<int64_t>(-b);
+        if (b == -1) return a == INT64_MIN ? std::nullopt : std::optional<int64_t>(-a);
+        int64_t product = static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+        if (product / b != a) return std::nullopt;
+        return product;
+    }
+
+    std::optional<int64_t> checkedPower(int64_t base, int64_t exponent) {
+        int64_t result = 1;
+        while (exponent > 0) {
+            if (exponent & 1) {
+                auto next = checkedMultiply(result, base);
+                if (!next) return std::nullopt;
+                result = *next;
+            }
+            exponent >>= 1;
+            if (exponent > 0) {
+                auto square = checkedMultiply(base, base);
+                if (!square) return std::nullopt;
+                base = *square;
+            }
+        }
+        return result;
+    }
+
+    // a op b on integers; nullopt when the result isn't an int64 (overflow, inexact quotient,
+    // negative exponent) and must be computed in double instead
+    std::optional<Exact> applyInteger(OperatorType op, int64_t a, int64_t b) {
+        switch (op) {
+        case OperatorType::Add: return checkedAdd(a, b);
+        case OperatorType::Subtract: return checkedSubtract(a, b);
+        case OperatorType::Multiply: {
+            auto product = checkedMultiply(a, b);
+            if (product && *product == 0) return signedZero((a < 0) != (b < 0));
+            return product;
+        }
+        case OperatorType::Divide:
+        case OperatorType::Int_divide: {
+            if (b == 0) throw std::runtime_error("Division by zero");
+            if (b == -1) {
+                if (a == 0) return signedZero(true);
+                return checkedMultiply(a, -1);
+            }
+            int64_t quotient = a / b;
+            bool exactQuotient = a % b == 0;
+            if (op == OperatorType::Divide && !exactQuotient) return std::nullopt;
+            if (!exactQuotient && (a < 0) != (b < 0)) --quotient;
+            // floor(a / b) is -0 only for a zero dividend; a nonzero one rounds down to +0
+            return quotient == 0 ? signedZero(a == 0 && b < 0) : Exact{ quotient };
+        }
+        case OperatorType::Mod: {
+            if (b == 0) throw std::runtime_error("Division by zero");
+            int64_t remainder = b == -1 ? 0 : a % b;
+            return remainder == 0 ? signedZero(a < 0) : Exact{ remainder };
+        }
+        case OperatorType::Power:
+            if (b < 0) return std::nullopt;
+            return checkedPower(a, b);
+        default:
+            return std::nullopt;
+        }
+    }
+
+    bool isNegativeZero(const Exact& value) {
+        const auto* x = std::get_if<double>(&value);
+        return x && *x == 0 && std::signbit(*x);
+    }
+
+    Exact applyExact(OperatorType op, const Exact& left, const Exact& right) {
+        const auto* a = std::get_if<int64_t>(&left);
+        const auto* b = std::get_if<int64_t>(&right);
+        if (a && b) {
+            if (auto result = applyInteger(op, *a, *b)) {
+                return *result;
+            }
+        }
+        // n + -0 and n - -0 are n, also in IEEE arithmetic; the parser turns a - 0 into a + -0,
+        // which must not push an exact sum into double
+        if (a && isNegativeZero(right) && (op == OperatorType::Add || op == OperatorType::Subtract)) {
+            return *a;
+        }
+        if (b && isNegativeZero(left) && op == OperatorType::Add) {
+            return *b;
+        }
+        // The defined fallback: the same operation on the operands rounded to double
+        return applyBinary(op, toDouble(left), toDouble(right));
+    }
+
+    // Integers are compared without rounding them to double, so 2^53 + 1 > 2^53
+    std::partial_ordering compareExact(const Exact& left, const Exact& right) {
+        const auto* a = std::get_if<int64_t>(&left);
+        const auto* b = std::get_if<int64_t>(&right);
+        if (a && b) return *a <=> *b;
+        if (!a && !b) return std::get<double>(left) <=> std::get<double>(right);
+        if (!a) return 0 <=> compareExact(right, left);
+        double x = std::get<double>(right);
+        if (std::isnan(x)) return std::partial_ordering::unordered;
+        if (x >= s_twoPow63) return std::partial_ordering::less;
+        if (x < -s_twoPow63) return std::partial_ordering::greater;
+        double whole = std::trunc(x);
+        if (auto n = static_cast<int64_t>(whole); *a != n) return *a <=> n;
+        return 0.0 <=> x - whole;
+    }
+
+    bool holds(OperatorType op, std::partial_ordering order) {
+        switch (op) {
+        case OperatorType::Less: return order < 0;
+        case OperatorType::LessEqual: return order <= 0;
+        case OperatorType::Greater: return order > 0;
+        case OperatorType::GreaterEqual: return order >= 0;
+        case OperatorType::Equal: return order == 0;
+        default: return order != 0; // NaN is unequal to everything
+        }
+    }
+
+    bool isTrue(const Exact& value) {
+        return toDouble(value) != 0;
+    }
+
+    bool isArithmetic(const ASTNode& node) {
+        return node.m_type == NodeType::Operator && node.getValue<OperatorType>() != OperatorType::Assignment;
+    }
+
+    Array toArray(const Value& value) {
+        if (const auto* array = std::get_if<Array>(&value)) {
+            return *array;
+        }
+        double scalar = std::get<double>(value);
+        return Array(std::span(&scalar, 1));
+    }
+
+    size_t broadcastSize(size_t size, const Value& value) {
+        const auto* array = std::get_if<Array>(&value);
+        if (!array || size == array->size()) {
+            return size;
+        }
+        if (size == SIZE_MAX) {
+            return array->size();
+        }
+        throw std::runtime_error("Array sizes differ: " + std::to_string(size) + " and " + std::to_string(array->size()));
+    }
+
+    // result[i] = f(lhs[i], rhs[i]), a number standing for every element. Separate loops
+    // per shape keep each one simple enough to vectorise for the arithmetic operators.
+    template<typename F>
+    Array broadcast(const Value& lhs, const Value& rhs, F f) {
+        Array result(broadcastSize(broadcastSize(SIZE_MAX, lhs), rhs));
+        double* out = result.mutableData();
+        const auto* a = std::get_if<Array>(&lhs);
+        const auto* b = std::get_if<Array>(&rhs);
+        if (a && b) {
+            const double* x = a->data();
+            const double* y = b->data();
+            for (size_t i = 0; i < result.size(); ++i) out[i] = f(x[i], y[i]);
+        }
+        else if (a) {
+            const double* x = a->data();
+            double y = std::get<double>(rhs);
+            for (size_t i = 0; i < result.size(); ++i) out[i] = f(x[i], y);
+        }
+        else {
+            double x = std::get<double>(lhs);
+            const double* y = b->data();
+            for (size_t i = 0; i < result.size(); ++i) out[i] = f(x, y[i]);
+        }
+        return result;
+    }
+
+    template<typename F>
+    Array map(const Array& values, F f) {
+        Array result(values.size());
+        double* out = result.mutableData();
+        const double* x = values.data();
+        for (size_t i = 0; i < values.size(); ++i) {
+            out[i] = f(x[i]);
+        }
+        return result;
+    }
+
+    // Calls a native function for every element, through its batch variant a block at a time if it has one
+    Array mapNative(const NativeFunction& native, const std::vector<Value>& args, size_t size) {
+        Array result(size);
+        double* out = result.mutableData();
+        if (!native.batch) {
+            std::vector<double> row(args.size());
+            for (size_t k = 0; k < size; ++k) {
+                for (size_t i = 0; i < args.size(); ++i) {
+                    const auto* array = std::get_if<Array>(&args[i]);
+                    row[i] = array ? (*array)[k] : std::get<double>(args[i]);
+                }
+                out[k] = native.scalar(row);
+            }
+            return result;
+        }
+        constexpr size_t block = Program::s_blockSize;
+        std::vector<double> repeated(args.size() * block); // Numbers, as block-long columns
+        std::vector<const double*> columns(args.size());
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (const double* number = std::get_if<double>(&args[i])) {
+                std::fill_n(repeated.begin() + i * block, block, *number);
+            }
+        }
+        for (size_t offset = 0; offset < size; offset += block) {
+            for (size_t i = 0; i < args.size(); ++i) {
+                const auto* array = std::get_if<Array>(&args[i]);
+                columns[i] = array ? array->data() + offset : repeated.data() + i * block;
+            }
+            native.batch(columns, out + offset, std::min(block, size - offset));
+        }
+        return result;
+    }
+
+    void requireNonZero(const Value& divisor) {
+        auto values = toArray(divisor).values();
+        if (std::find(values.begin(), values.end(), 0.0) != values.end()) {
+            throw std::runtime_error("Division by zero");
+        }
+    }
+
+    Array applyElementwise(OperatorType op, const Value& lhs, const Value& rhs) {
+        switch (op) {
+        case OperatorType::Add: return broadcast(lhs, rhs, [](double x, double y) { return x + y; });
+        case OperatorType::Subtract: return broadcast(lhs, rhs, [](double x, double y) { return x - y; });
+        case OperatorType::Multiply: return broadcast(lhs, rhs, [](double x, double y) { return x * y; });
+        case OperatorType::Divide:
+            requireNonZero(rhs);
+            return broadcast(lhs, rhs, [](double x, double y) { return x / y; });
+        case OperatorType::Int_divide:
+            requireNonZero(rhs);
+            return broadcast(lhs, rhs, [](double x, double y) { return std::floor(x / y); });
+        // Masks of 0 and 1; both operands of && and || are evaluated for arrays
+        case OperatorType::Less: return broadcast(lhs, rhs, [](double x, double y) { return x < y ? 1.0 : 0.0; });
+        case OperatorType::LessEqual: return broadcast(lhs, rhs, [](double x, double y) { return x <= y ? 1.0 : 0.0; });
+        case OperatorType::Greater: return broadcast(lhs, rhs, [](double x, double y) { return x > y ? 1.0 : 0.0; });
+        case OperatorType::GreaterEqual: return broadcast(lhs, rhs, [](double x, double y) { return x >= y ? 1.0 : 0.0; });
+        case OperatorType::Equal: return broadcast(lhs, rhs, [](double x, double y) { return x == y ? 1.0 : 0.0; });
+        case OperatorType::NotEqual: return broadcast(lhs, rhs, [](double x, double y) { return x != y ? 1.0 : 0.0; });
+        case OperatorType::And: return broadcast(lhs, rhs, [](double x, double y) { return x != 0 && y != 0 ? 1.0 : 0.0; });
+        case OperatorType::Or: return broadcast(lhs, rhs, [](double x, double y) { return x != 0 || y != 0 ? 1.0 : 0.0; });
+        default:
+            return broadcast(lhs, rhs, [op](double x, double y) { return applyBinary(op, x, y); });
+        }
+    }
+
+    Array linspace(double first, double last, double count) {
+        if (count < 0 || std::floor(count) != count) {
+            throw std::runtime_error("linspace requires a non-negative integer count");
+        }
+        if (count > static_cast<double>(Array::s_maxSize)) {
+            throw std::runtime_error("linspace count exceeds the array size limit");
+        }
+        Array result(static_cast<size_t>(count));
+        double* out = result.mutableData();
+        size_t n = result.size();
+        for (size_t i = 0; i < n; ++i) {
+            // Interpolated from both ends so the last element is exactly `last`
+            double t = n == 1 ? 0.0 : static_cast<double>(i) / static_cast<double>(n - 1);
+            out[i] = i + 1 == n && n > 1 ? last : first + (last - first) * t;
+        }
+        return result;
+    }
+
+    // first, first + step, ... while short of last, like Python's range
+    Array range(double first, double last, double step) {
+        if (step == 0 || !std::isfinite(step) || !std::isfinite(first) || !std::isfinite(last)) {
+            throw std::runtime_error("range requires finite bounds and a non-zero step");
+        }
+        double count = std::max(0.0, std::ceil((last - first) / step));
+        if (count > static_cast<double>(Array::s_maxSize)) {
+            throw std::runtime_error("range exceeds the array size limit");
+        }
+        Array result(static_cast<size_t>(count));
+        double* out = result.mutableData();
+        for (size_t i = 0; i < result.size(); ++i) {
+            out[i] = first + static_cast<double>(i) * step;
+        }
+        return result;
+    }
+
+    // Keeps profiler frames balanced when evaluation throws
+    class ProfileFrame {
+        Profiler& m_profiler;
+
+    public:
+        ProfileFrame(Profiler& profiler, const ASTNode& node)
+            : m_profiler{ profiler } {
+            m_profiler.enter(node);
+        }
+        ~ProfileFrame() {
+            m_profiler.leave();
+        }
+    };
+
+    class ProfileScope {
+        Profiler* m_profiler;
+
+    public:
+        ProfileScope(Profiler* profiler, const std::string& function)
+            : m_profiler{ profiler } {
+            if (m_profiler) {
+                m_profiler->pushScope(function);
+            }
+        }
+        ~ProfileScope() {
+            if (m_profiler) {
+                m_profiler->popScope();
+            }
+        }
+    };
+}
+
+BudgetExceeded::BudgetExceeded(Limit limit)
+    : std::runtime_error{ limit == Limit::Steps ? "Evaluation step limit exceeded"
+        : limit == Limit::Deadline ? "Evaluation deadline exceeded" : "Evaluation cancelled" }
+    , m_limit{ limit } {
+}
+
+void Evaluator::BudgetState::charge(uint64_t count) {
+    uint64_t before = steps.fetch_add(count, std::memory_order_relaxed);
+    uint64_t after = before + count;
+    if (limits.maxSteps && after > limits.maxSteps) {
+        throw BudgetExceeded(BudgetExceeded::Limit::Steps);
+    }
+    if (before / s_checkInterval != after / s_checkInterval) {
+        check();
+    }
+}
+
+void Evaluator::BudgetState::check() const {
+    if (limits.cancellation.stop_requested()) {
+        throw BudgetExceeded(BudgetExceeded::Limit::Cancelled);
+    }
+    if (limits.deadline && std::chrono::steady_clock::now() >= *limits.deadline) {
+        throw BudgetExceeded(BudgetExceeded::Limit::Deadline);
+    }
+}
 
 Evaluator::Evaluator() {
     // Initialize mathematical constants
@@ -13,6 +509,29 @@ Evaluator::Evaluator() {
 }
 
 double Evaluator::evaluate(const ASTNode& node, std::unordered_map<std::string, double>* localVars) {
+    if (budget) {
+        budget->charge(1);
+    }
+    if (!profiler) {
+        return evaluateNode(node, localVars);
+    }
+    ProfileFrame frame(*profiler, node);
+    return evaluateNode(node, localVars);
+}
+
+double Evaluator::evaluate(const ASTNode& node, const EvaluationBudget& limits, std::unordered_map<std::string, double>* localVars) {
+    BudgetState state{ limits };
+    state.check();
+    // Nested budgeted evaluations get their own budget, then hand the outer one back
+    struct Restore {
+        BudgetState*& slot;
+        BudgetState* previous;
+        ~Restore() { slot = previous; }
+    } restore{ budget, std::exchange(budget, &state) };
+    return evaluate(node, localVars);
+}
+
+double Evaluator::evaluateNode(const ASTNode& node, std::unordered_map<std::string, double>* localVars) {
     switch (node.m_type) {
     case NodeType::Number:
         return node.getValue<double>();
@@ -25,17 +544,17 @@ double Evaluator::evaluate(const ASTNode& node, std::unordered_map<std::string,
         if (variables.find(name) != variables.end()) {
             return variables[name];
         }
+        if (arrays.contains(name)) {
+            throw std::runtime_error("Array used where a number is expected: " + name);
+        }
         throw std::runtime_error("Undefined variable: " + name);
     }
 
+    case NodeType::Array:
+        throw std::runtime_error("Array used where a number is expected");
+
     case NodeType::Operator: {
         auto op = node.getValue<OperatorType>();
-        if (op == OperatorType::UnaryMinus) {
-            return -evaluate(*node.m_children[0], localVars);
-        }
-        if (op == OperatorType::UnaryPlus) {
-            return evaluate(*node.m_children[0], localVars);
-        }
         if (op == OperatorType::Assignment) {
             if (node.m_children[0]->m_type == NodeType::Function) {
                 auto name = node.m_children[0]->getValue<std::string>();
@@ -43,7 +562,7 @@ double Evaluator::evaluate(const ASTNode& node, std::unordered_map<std::string,
                     throw std::runtime_error("Function assignment requires one variable argument");
                 }
                 std::vector<std::string> argNames = { node.m_children[0]->m_children[0]->getValue<std::string>() };
-                functions[name] = { std::move(argNames), node.m_children[1]->clone() };
+                defineFunction(name, { .argNames = std::move(argNames), .body = node.m_children[1]->clone() });
                 return 0.0;
             }
             if (node.m_children[0]->m_type != NodeType::Variable) {
@@ -52,153 +571,768 @@ double Evaluator::evaluate(const ASTNode& node, std::unordered_map<std::string,
             auto name = node.m_children[0]->getValue<std::string>();
             double value = evaluate(*node.m_children[1], localVars);
             variables[name] = value;
+            arrays.erase(name);
+            ++globalsVersion;
             return value;
         }
-        if (op == OperatorType::Factorial) {
-            double arg = evaluate(*node.m_children[0], localVars);
-            if (arg < 0 || std::floor(arg) != arg) {
-                throw std::runtime_error("Factorial requires a non-negative integer");
+        return toDouble(evaluateArithmetic(node, localVars));
+    }
+
+    case NodeType::Function: {
+        auto name = node.getValue<std::string>();
+        if (isArrayReduction(name, node.m_children.size())) {
+            return evaluateArrayReduction(name, node, localVars);
+        }
+        // Range reductions: sum(i, a, b, expr), prod(i, a, b, expr), integrate(x, a, b, expr)
+        if (name == "sum" || name == "prod" || name == "integrate") {
+            return evaluateReduction(name, node, localVars);
+        }
+        if (name == "if") {
+            // Only the branch taken is evaluated
+            checkArity(name, 3, node.m_children.size());
+            bool condition = evaluate(*node.m_children[0], localVars) != 0;
+            return evaluate(*node.m_children[condition ? 1 : 2], localVars);
+        }
+        if (name == "min" || name == "max") {
+            if (node.m_children.empty()) {
+                throw std::runtime_error(name + " requires at least one argument");
             }
-            int n = static_cast<int>(arg);
-            double result = 1.0;
-            for (int i = 2; i <= n; ++i) {
-                result *= i;
+            // Folded as the arguments are evaluated; array arguments are scanned in place
+            bool isMin = name == "min";
+            std::optional<double> best;
+            for (const auto& child : node.m_children) {
+                double candidate;
+                if (isArrayExpression(*child, localVars)) {
+                    auto array = std::get<Array>(evaluateValue(*child, localVars));
+                    if (array.empty()) {
+                        throw std::runtime_error(name + " of an empty array");
+                    }
+                    candidate = isMin ? kernel::minimum(array.values()) : kernel::maximum(array.values());
+                }
+                else {
+                    candidate = evaluate(*child, localVars);
+                }
+                if (!best || (isMin ? candidate < *best : *best < candidate)) {
+                    best = candidate;
+                }
             }
-            return result;
+            return *best;
         }
-        double left = evaluate(*node.m_children[0], localVars);
-        double right = evaluate(*node.m_children[1], localVars);
-        switch (op) {
-        case OperatorType::Add: return left + right;
-        case OperatorType::Subtract: return left - right;
-        case OperatorType::Multiply: return left * right;
-        case OperatorType::Divide:
-            if (right == 0) throw std::runtime_error("Division by zero");
-            return left / right;
-        case OperatorType::Power: return std::pow(left, right);
-        case OperatorType::Int_divide:
-            if(right == 0) throw std::runtime_error("Division by zero");
-            return std::floor(left / right);
-        case OperatorType::Mod:return static_cast<double>(static_cast<int>(left) % static_cast<int>(right));
-        default: throw std::runtime_error("Unsupported operator");
+        if (name == "linspace" || name == "range") {
+            throw std::runtime_error("Array used where a number is expected: " + name);
+        }
+        if (name == "rand" || name == "randn") {
+            return evaluateRandom(name, node, localVars);
+        }
+        if (name == "prev" || name == "lag") {
+            throw std::runtime_error(name + " can only be used in a scan");
+        }
+        if (auto builtin = s_elementwise.find(name); builtin != s_elementwise.end()) {
+            const auto [arity, apply] = builtin->second;
+            checkArity(name, arity, node.m_children.size());
+            double x = evaluate(*node.m_children[0], localVars);
+            if (auto kernel = kernelFor(name, options.accuracy)) {
+                checkKernelDomain(name, std::span(&x, 1));
+                return fastmath::apply(*kernel, options.accuracy, x);
+            }
+            return apply(x, arity == 2 ? evaluate(*node.m_children[1], localVars) : 0.0);
+        }
+        if (auto native = natives.find(name); native != natives.end()) {
+            return callNative(name, *native->second, node, localVars);
+        }
+        auto it = functions.find(name);
+        if (it == functions.end()) {
+            throw std::runtime_error("Undefined function: " + name);
+        }
+        return callFunction(name, it->second, node, localVars);
+    }
+
+    default:
+        throw std::runtime_error("Unsupported node type");
+    }
+}
+
+Evaluator::ExactNumber Evaluator::evaluateArithmetic(const ASTNode& node, std::unordered_map<std::string, double>* localVars) {
+    auto op = node.getValue<OperatorType>();
+    Exact value = evaluateOperand(*node.m_children[0], localVars);
+    if (op == OperatorType::UnaryPlus) {
+        return value;
+    }
+    if (op == OperatorType::UnaryMinus) {
+        if (const auto* n = std::get_if<int64_t>(&value); n && *n != INT64_MIN) {
+            return *n == 0 ? Exact{ -0.0 } : Exact{ -*n };
+        }
+        return -toDouble(value);
+    }
+    if (op == OperatorType::Factorial) {
+        if (const auto* n = std::get_if<int64_t>(&value); n && *n >= 0 && *n <= s_maxExactFactorial) {
+            int64_t product = 1;
+            for (int64_t k = 2; k <= *n; ++k) {
+                product *= k;
+            }
+            return product;
+        }
+        return special::factorial(toDouble(value));
+    }
+    if (isLogical(op)) {
+        // Operands after the one that decides the result are not evaluated
+        bool isAnd = op == OperatorType::And;
+        for (size_t i = 1; isTrue(value) == isAnd && i < node.m_children.size(); ++i) {
+            value = evaluateOperand(*node.m_children[i], localVars);
         }
+        return int64_t{ isTrue(value) };
+    }
+    if (isComparison(op)) {
+        return int64_t{ holds(op, compareExact(value, evaluateOperand(*node.m_children[1], localVars))) };
+    }
+    // Chains of a left-associative operator are stored as one node and folded left to right
+    for (size_t i = 1; i < node.m_children.size(); ++i) {
+        value = applyExact(op, value, evaluateOperand(*node.m_children[i], localVars));
+    }
+    return value;
+}
+
+Evaluator::ExactNumber Evaluator::evaluateOperand(const ASTNode& node, std::unordered_map<std::string, double>* localVars) {
+    if (!isArithmetic(node)) {
+        return exact(evaluate(node, localVars));
+    }
+    // Same bookkeeping as evaluate(), without rounding the operand to double
+    if (budget) {
+        budget->charge(1);
+    }
+    if (!profiler) {
+        return evaluateArithmetic(node, localVars);
+    }
+    ProfileFrame frame(*profiler, node);
+    return evaluateArithmetic(node, localVars);
+}
+
+void Evaluator::setVariable(const std::string& name, double value) {
+    variables[name] = value;
+    arrays.erase(name);
+    ++globalsVersion;
+}
+
+void Evaluator::setVariable(const std::string& name, Array value) {
+    arrays[name] = std::move(value);
+    variables.erase(name);
+    ++globalsVersion;
+}
+
+Value Evaluator::evaluateValue(const ASTNode& node, std::unordered_map<std::string, double>* localVars) {
+    if (!isArrayExpression(node, localVars)) {
+        return evaluate(node, localVars);
+    }
+    if (budget) {
+        budget->charge(1);
     }
+    if (!profiler) {
+        return evaluateArrayNode(node, localVars);
+    }
+    ProfileFrame frame(*profiler, node);
+    return evaluateArrayNode(node, localVars);
+}
 
+bool Evaluator::isArrayExpression(const ASTNode& node, const std::unordered_map<std::string, double>* localVars) const {
+    switch (node.m_type) {
+    case NodeType::Array:
+        return true;
+    case NodeType::Variable: {
+        const auto& name = node.getValue<std::string>();
+        return !(localVars && localVars->contains(name)) && arrays.contains(name);
+    }
+    case NodeType::Operator:
+        if (node.getValue<OperatorType>() == OperatorType::Assignment) {
+            return node.m_children[0]->m_type == NodeType::Variable && isArrayExpression(*node.m_children[1], localVars);
+        }
+        break;
     case NodeType::Function: {
-        auto name = node.getValue<std::string>();
-        // Trigonometric functions
-        if (name == "sin" || name == "cos" || name == "tan") {
-            if (node.m_children.size() != 1) {
-                throw std::runtime_error(name + " expects one argument");
-            }
-            double arg = evaluate(*node.m_children[0], localVars);
-            if (name == "sin") return std::sin(arg);
-            if (name == "cos") return std::cos(arg);
-            if (name == "tan") {
-                if (std::cos(arg) == 0) throw std::runtime_error("tan undefined at pi/2 + k*pi");
-                return std::tan(arg);
-            }
-        }
-        if (name == "asin" || name == "acos") {
-            if (node.m_children.size() != 1) {
-                throw std::runtime_error(name + " expects one argument");
-            }
-            double arg = evaluate(*node.m_children[0], localVars);
-            if (arg < -1.0 || arg > 1.0) throw std::runtime_error(name + " requires argument in [-1, 1]");
-            return name == "asin" ? std::asin(arg) : std::acos(arg);
-        }
-        if (name == "atan") {
-            if (node.m_children.size() != 1) {
-                throw std::runtime_error("atan expects one argument");
-            }
-            return std::atan(evaluate(*node.m_children[0], localVars));
-        }
-        if (name == "atan2") {
-            if (node.m_children.size() != 2) {
-                throw std::runtime_error("atan2 expects two arguments");
-            }
-            double y = evaluate(*node.m_children[0], localVars);
-            double x = evaluate(*node.m_children[1], localVars);
-            return std::atan2(y, x);
-        }
-        // Exponential and logarithmic
-        if (name == "exp" || name == "sqrt") {
-            if (node.m_children.size() != 1) {
-                throw std::runtime_error(name + " expects one argument");
-            }
-            double arg = evaluate(*node.m_children[0], localVars);
-            if (name == "sqrt" && arg < 0) throw std::runtime_error("sqrt requires non-negative argument");
-            return name == "exp" ? std::exp(arg) : std::sqrt(arg);
-        }
-        if (name == "log" || name == "log10") {
-            if (node.m_children.size() != 1) {
-                throw std::runtime_error(name + " expects one argument");
-            }
-            double arg = evaluate(*node.m_children[0], localVars);
-            if (arg <= 0) throw std::runtime_error(name + " requires positive argument");
-            return name == "log" ? std::log(arg) : std::log10(arg);
-        }
-        // Rounding and utility
-        if (name == "abs" || name == "floor" || name == "ceil" || name == "round") {
-            if (node.m_children.size() != 1) {
-                throw std::runtime_error(name + " expects one argument");
-            }
-            double arg = evaluate(*node.m_children[0], localVars);
-            if (name == "abs") return std::abs(arg);
-            if (name == "floor") return std::floor(arg);
-            if (name == "ceil") return std::ceil(arg);
-            if (name == "round") return std::round(arg);
-        }
-        if (name == "min") {
-            if (node.m_children.empty()) {
-                throw std::runtime_error("min requires at least one argument");
+        const auto& name = node.getValue<std::string>();
+        if (name == "linspace" || name == "range") {
+            return true;
+        }
+        // Reductions return numbers, also over arrays
+        if (name == "sum" || name == "prod" || name == "integrate" || name == "mean" || name == "dot" || name == "norm"
+            || name == "min" || name == "max") {
+            return false;
+        }
+        break;
+    }
+    default:
+        return false;
+    }
+    return std::any_of(node.m_children.begin(), node.m_children.end(),
+        [&](const auto& child) { return isArrayExpression(*child, localVars); });
+}
+
+Array Evaluator::evaluateArrayNode(const ASTNode& node, std::unordered_map<std::string, double>* localVars) {
+    auto argument = [&](size_t i) { return evaluateValue(*node.m_children[i], localVars); };
+    auto charge = [this](const Array& result) {
+        if (budget) {
+            budget->charge(result.size());
+        }
+        return result;
+    };
+
+    switch (node.m_type) {
+    case NodeType::Array: {
+        // Elements that are arrays are spliced in: [v, 0] appends a zero to v
+        std::vector<Value> elements;
+        size_t size = 0;
+        for (size_t i = 0; i < node.m_children.size(); ++i) {
+            elements.push_back(argument(i));
+            size += std::holds_alternative<Array>(elements.back()) ? std::get<Array>(elements.back()).size() : 1;
+        }
+        Array result(size);
+        double* out = result.mutableData();
+        for (const auto& element : elements) {
+            if (const auto* array = std::get_if<Array>(&element)) {
+                out = std::copy(array->data(), array->data() + array->size(), out);
             }
-            std::vector<double> args;
-            for (const auto& child : node.m_children) {
-                args.push_back(evaluate(*child, localVars));
+            else {
+                *out++ = std::get<double>(element);
             }
-            return *std::min_element(args.begin(), args.end());
         }
-        if (name == "factorial") {
-            if (node.m_children.size() != 1) {
-                throw std::runtime_error("factorial expects one argument");
+        return charge(result);
+    }
+
+    case NodeType::Variable:
+        return arrays.at(node.getValue<std::string>());
+
+    case NodeType::Operator: {
+        auto op = node.getValue<OperatorType>();
+        if (op == OperatorType::Assignment) {
+            auto name = node.m_children[0]->getValue<std::string>();
+            auto value = std::get<Array>(argument(1));
+            setVariable(name, value);
+            return value;
+        }
+        Value value = argument(0);
+        if (op == OperatorType::UnaryPlus) {
+            return toArray(value);
+        }
+        if (op == OperatorType::UnaryMinus) {
+            return charge(map(toArray(value), [](double x) { return -x; }));
+        }
+        if (op == OperatorType::Factorial) {
+            return charge(map(toArray(value), [](double x) { return special::factorial(x); }));
+        }
+        for (size_t i = 1; i < node.m_children.size(); ++i) {
+            value = charge(applyElementwise(op, value, argument(i)));
+        }
+        return toArray(value);
+    }
+
+    case NodeType::Function: {
+        const auto& name = node.getValue<std::string>();
+        if (name == "linspace") {
+            checkArity(name, 3, node.m_children.size());
+            double first = evaluate(*node.m_children[0], localVars);
+            double last = evaluate(*node.m_children[1], localVars);
+            return charge(linspace(first, last, evaluate(*node.m_children[2], localVars)));
+        }
+        if (name == "range") {
+            if (node.m_children.size() != 2 && node.m_children.size() != 3) {
+                throw std::runtime_error("range expects two or three arguments");
             }
-            double arg = evaluate(*node.m_children[0], localVars);
-            if (arg < 0 || std::floor(arg) != arg) {
-                throw std::runtime_error("factorial requires a non-negative integer");
+            double first = evaluate(*node.m_children[0], localVars);
+            double last = evaluate(*node.m_children[1], localVars);
+            double step = node.m_children.size() == 3 ? evaluate(*node.m_children[2], localVars) : 1.0;
+            return charge(range(first, last, step));
+        }
+        if (name == "if") {
+            checkArity(name, 3, node.m_children.size());
+            if (!isArrayExpression(*node.m_children[0], localVars)) {
+                return toArray(argument(evaluate(*node.m_children[0], localVars) != 0 ? 1 : 2));
             }
-            int n = static_cast<int>(arg);
-            double result = 1.0;
-            for (int i = 2; i <= n; ++i) {
-                result *= i;
+            // A mask selects elementwise between both branches, which are computed in full
+            Value condition = argument(0);
+            Value chosen = argument(1);
+            Value other = argument(2);
+            Array result(broadcastSize(broadcastSize(broadcastSize(SIZE_MAX, condition), chosen), other));
+            double* out = result.mutableData();
+            for (size_t k = 0; k < result.size(); ++k) {
+                auto element = [k](const Value& value) {
+                    const auto* array = std::get_if<Array>(&value);
+                    return array ? (*array)[k] : std::get<double>(value);
+                };
+                out[k] = element(condition) != 0 ? element(chosen) : element(other);
             }
-            return result;
+            return charge(result);
         }
-        if (name == "max") {
-            if (node.m_children.empty()) {
-                throw std::runtime_error("max requires at least one argument");
+        if (auto builtin = s_elementwise.find(name); builtin != s_elementwise.end()) {
+            const auto [arity, apply] = builtin->second;
+            checkArity(name, arity, node.m_children.size());
+            if (auto kernel = kernelFor(name, options.accuracy)) {
+                Array x = toArray(argument(0));
+                checkKernelDomain(name, x.values());
+                Array result(x.size());
+                fastmath::apply(*kernel, options.accuracy, x.values(), result.mutableData());
+                return charge(result);
             }
-            std::vector<double> args;
-            for (const auto& child : node.m_children) {
-                args.push_back(evaluate(*child, localVars));
+            if (arity == 1) {
+                return charge(map(toArray(argument(0)), [apply](double x) { return apply(x, 0.0); }));
             }
-            return *std::max_element(args.begin(), args.end());
+            Value x = argument(0);
+            return charge(broadcast(x, argument(1), apply));
+        }
+        // Native and user functions are called once per element, with numbers repeated across the call
+        auto native = natives.find(name);
+        auto it = functions.find(name);
+        if (native != natives.end()) {
+            native->second->checkArity(name, node.m_children.size());
         }
-        if (functions.find(name) == functions.end()) {
+        else if (it == functions.end()) {
             throw std::runtime_error("Undefined function: " + name);
         }
-        auto& func = functions[name];
-        if (func.argNames.size() != node.m_children.size()) {
+        else if (it->second.argNames.size() != node.m_children.size()) {
             throw std::runtime_error("Incorrect number of arguments for function: " + name);
         }
-        std::unordered_map<std::string, double> funcVars;
-        for (size_t i = 0; i < func.argNames.size(); ++i) {
-            funcVars[func.argNames[i]] = evaluate(*node.m_children[i], localVars);
+        std::vector<Value> args;
+        size_t size = SIZE_MAX;
+        for (size_t i = 0; i < node.m_children.size(); ++i) {
+            args.push_back(argument(i));
+            size = broadcastSize(size, args.back());
         }
-        return evaluate(*func.body, &funcVars);
+        if (native != natives.end()) {
+            return charge(mapNative(*native->second, args, size));
+        }
+        Array result(size);
+        double* out = result.mutableData();
+        std::vector<double> row(args.size());
+        for (size_t k = 0; k < size; ++k) {
+            for (size_t i = 0; i < args.size(); ++i) {
+                const auto* array = std::get_if<Array>(&args[i]);
+                row[i] = array ? (*array)[k] : std::get<double>(args[i]);
+            }
+            out[k] = invoke(name, it->second, row);
+        }
+        return result;
     }
 
     default:
         throw std::runtime_error("Unsupported node type");
     }
+}
+
+double Evaluator::evaluateArrayReduction(const std::string& name, const ASTNode& node, std::unordered_map<std::string, double>* localVars) {
+    if ((name == "sum" || name == "prod") && node.m_children.size() != 1) {
+        throw std::runtime_error(name + " expects an array, or an index, two bounds and a body");
+    }
+    checkArity(name, name == "dot" ? 2 : 1, node.m_children.size());
+    Array values = toArray(evaluateValue(*node.m_children[0], localVars));
+    if (budget) {
+        budget->charge(values.size());
+    }
+    if (name == "sum") return kernel::sum(values.values());
+    if (name == "prod") return kernel::product(values.values());
+    if (name == "norm") return kernel::norm(values.values());
+    if (name == "mean") {
+        if (values.empty()) {
+            throw std::runtime_error("mean of an empty array");
+        }
+        return kernel::sum(values.values()) / static_cast<double>(values.size());
+    }
+    return kernel::dot(values.values(), toArray(evaluateValue(*node.m_children[1], localVars)).values());
+}
+
+Program Evaluator::compile(const ASTNode& node, std::vector<std::string> inputs) const {
+    return Compiler(*this, std::move(inputs)).compile(node);
+}
+
+Program Evaluator::compile(const std::vector<const ASTNode*>& nodes, std::vector<std::string> inputs) const {
+    return Compiler(*this, std::move(inputs)).compile(nodes);
+}
+
+double Evaluator::evaluateReduction(const std::string& name, const ASTNode& node, std::unordered_map<std::string, double>* localVars) {
+    if (node.m_children.size() != 4) {
+        throw std::runtime_error(name + " expects four arguments");
+    }
+    if (node.m_children[0]->m_type != NodeType::Variable) {
+        throw std::runtime_error(name + " requires a variable as its first argument");
+    }
+    const auto& index = node.m_children[0]->getValue<std::string>();
+    double lower = evaluate(*node.m_children[1], localVars);
+    double upper = evaluate(*node.m_children[2], localVars);
+    const ASTNode& body = *node.m_children[3];
+
+    // Compile the body once and run it over whole blocks of the range. Bodies the
+    // compiler can't handle (assignments, nested reductions) are interpreted instead.
+    std::optional<Program> program;
+    try {
+        program = Compiler(*this, { index }, localVars).compile(body);
+    }
+    catch (const std::exception&) {
+    }
+
+    // Each point of the range draws rand() values of its own row: randomRow plus the
+    // index's offset from the lower bound for sum and prod, wherever the block runs, and
+    // plus the number of points asked for before it for integrate, which runs serially
+    uint64_t randomBase = randomRow;
+    uint64_t drawn = 0;
+    auto firstRow = [&](std::span<const double> points) {
+        if (name == "integrate") {
+            drawn += points.size();
+            return randomBase + drawn - points.size();
+        }
+        return randomBase + static_cast<uint64_t>(points[0] - lower);
+    };
+
+    // Compiled bodies compute in double. If some point of the range comes to an integer past
+    // 2^53, which the interpreter would keep exact, the whole range is interpreted instead.
+    std::atomic<bool> roundedIntegers = false;
+    BatchFunction f;
+    std::unordered_map<std::string, double> scope;
+    std::vector<uint64_t> instructionNanos;
+    uint64_t rows = 0;
+    auto interpret = [&] {
+        if (localVars) {
+            scope = *localVars;
+        }
+        f = [&](std::span<const double> points, std::span<double> results) {
+            for (size_t i = 0; i < points.size(); ++i) {
+                scope[index] = points[i];
+                results[i] = evaluate(body, &scope);
+            }
+        };
+    };
+    if (program && profiler) {
+        instructionNanos.resize(program->code().size());
+        f = [&](std::span<const double> points, std::span<double> results) {
+            const double* column = points.data();
+            double* output = results.data();
+            if (program->profileBatch({ &column, 1 }, { &output, 1 }, points.size(), instructionNanos, firstRow(points))) {
+                roundedIntegers = true;
+            }
+            rows += points.size();
+        };
+    }
+    else if (program) {
+        f = [&](std::span<const double> points, std::span<double> results) {
+            const double* column = points.data();
+            auto workspace = program->workspace<double>(points.size());
+            workspace.firstRow = firstRow(points);
+            workspace.checkIntegers = true;
+            double* output = results.data();
+            program->runBatch<double>({ &column, 1 }, { &output, 1 }, points.size(), workspace);
+            if (workspace.roundedIntegers) {
+                roundedIntegers = true;
+            }
+        };
+    }
+    else {
+        interpret();
+    }
+
+    if (program && budget) {
+        // Interpreted bodies are charged node by node through evaluate()
+        f = [inner = std::move(f), state = budget, cost = std::max<uint64_t>(program->code().size(), 1)](
+                std::span<const double> points, std::span<double> results) {
+            state->charge(points.size() * cost);
+            inner(points, results);
+        };
+    }
+
+    auto reduce = [&] {
+        if (name == "integrate") {
+            return integrate(f, lower, upper).value;
+        }
+        if (std::floor(lower) != lower || std::floor(upper) != upper) {
+            throw std::runtime_error(name + " requires integer bounds");
+        }
+        constexpr double maxBound = 9007199254740992.0; // 2^53, beyond which indices aren't exact
+        if (std::abs(lower) > maxBound || std::abs(upper) > maxBound) {
+            throw std::runtime_error(name + " bounds are out of range");
+        }
+        auto kind = name == "sum" ? ReductionKind::Sum : ReductionKind::Product;
+        // Interpreted bodies share `scope` and profiled ones share the timings, so only
+        // plain compiled ones may run in parallel, and only without impure native calls
+        double reduced = reduceRange(kind, static_cast<int64_t>(lower), static_cast<int64_t>(upper), f,
+            program && program->pure() && !profiler ? &ThreadPool::shared() : nullptr);
+        drawn = upper < lower ? 0 : static_cast<uint64_t>(upper - lower) + 1;
+        return reduced;
+    };
+    double result = reduce();
+    if (roundedIntegers) {
+        // Impure native calls in the body are made a second time
+        program.reset();
+        randomRow = randomBase;
+        drawn = 0;
+        interpret();
+        result = reduce();
+    }
+    if (program && program->randomSites() > 0) {
+        randomRow = randomBase + drawn;
+    }
+    if (program && profiler) {
+        // Instruction times are reported as children of this reduction's frame
+        profiler->record(*program, instructionNanos, rows);
+    }
+    return result;
+}
+
+double Evaluator::evaluateRandom(const std::string& name, const ASTNode& node, std::unordered_map<std::string, double>* localVars) {
+    const auto& args = node.m_children;
+    if (!args.empty() && args.size() != 2) {
+        throw std::runtime_error(name + " expects zero or two arguments");
+    }
+    bool normal = name == "randn";
+    double low = args.empty() ? 0.0 : evaluate(*args[0], localVars);
+    double high = args.empty() ? 0.0 : evaluate(*args[1], localVars);
+    double value = rng::draw(normal ? rng::Distribution::Normal : rng::Distribution::Uniform, options.seed, randomRow++,
+        rng::s_interpreterSite);
+    if (args.empty()) {
+        return value;
+    }
+    return low + (normal ? high : high - low) * value;
+}
+
+double Evaluator::callFunction(const std::string& name, FunctionInfo& func, const ASTNode& node, std::unordered_map<std::string, double>* localVars) {
+    if (func.argNames.size() != node.m_children.size()) {
+        throw std::runtime_error("Incorrect number of arguments for function: " + name);
+    }
+    std::vector<double> args(node.m_children.size());
+    for (size_t i = 0; i < args.size(); ++i) {
+        args[i] = evaluate(*node.m_children[i], localVars);
+    }
+    return invoke(name, func, args);
+}
+
+double Evaluator::callNative(const std::string& name, const NativeFunction& native, const ASTNode& node, std::unordered_map<std::string, double>* localVars) {
+    native.checkArity(name, node.m_children.size());
+    std::array<double, s_stackArguments> small;
+    std::vector<double> large(node.m_children.size() > s_stackArguments ? node.m_children.size() : 0);
+    auto args = large.empty() ? std::span(small).first(node.m_children.size()) : std::span(large);
+    for (size_t i = 0; i < args.size(); ++i) {
+        args[i] = evaluate(*node.m_children[i], localVars);
+    }
+    ProfileScope scope(profiler, name);
+    return native.scalar(args);
+}
+
+double Evaluator::invoke(const std::string& name, FunctionInfo& func, std::span<const double> args) {
+    bool cached = memoize && isPure(name, func);
+    if (cached) {
+        if (func.memo.empty()) {
+            func.memo.reset(args.size(), memoCapacity);
+        }
+        // Functions reading globals are pure only until the next assignment
+        if (func.readsGlobals && func.memoGlobalsVersion != globalsVersion) {
+            func.memo.clear();
+            func.memoGlobalsVersion = globalsVersion;
+        }
+        double result;
+        if (func.memo.lookup(args, result)) {
+            return result;
+        }
+    }
+
+    std::unordered_map<std::string, double> funcVars;
+    for (size_t i = 0; i < func.argNames.size(); ++i) {
+        funcVars[func.argNames[i]] = args[i];
+    }
+    double result;
+    {
+        ProfileScope scope(profiler, name);
+        result = evaluate(*func.body, &funcVars);
+    }
+    if (cached) {
+        func.memo.insert(args, result);
+    }
+    return result;
+}
+
+bool Evaluator::isPure(const std::string& name, FunctionInfo& func) {
+    std::unordered_set<std::string> analysing;
+    bool provisional = false;
+    return analysePurity(name, func, analysing, provisional);
+}
+
+bool Evaluator::analysePurity(const std::string& name, FunctionInfo& func, std::unordered_set<std::string>& analysing, bool& provisional) {
+    if (func.pure) {
+        return *func.pure;
+    }
+    // Assume purity of a definition still being analysed so recursive definitions terminate;
+    // anything that relied on the assumption is only known once that analysis completes
+    if (analysing.contains(name)) {
+        provisional = true;
+        return true;
+    }
+    analysing.insert(name);
+    bool dependsOnAnalysing = false;
+    func.readsGlobals = false;
+    func.callees.clear();
+
+    bool pure = true;
+    // Each pending node carries the set of names bound at that point: the parameters,
+    // plus the index variables of enclosing reductions
+    std::deque<std::unordered_set<std::string>> scopes;
+    scopes.emplace_back(func.argNames.begin(), func.argNames.end());
+    std::vector<std::pair<const ASTNode*, const std::unordered_set<std::string>*>> pending = { { func.body.get(), &scopes.front() } };
+    while (!pending.empty()) {
+        auto [current, bound] = pending.back();
+        pending.pop_back();
+        if (current->m_type == NodeType::Operator && current->getValue<OperatorType>() == OperatorType::Assignment) {
+            pure = false;
+        }
+        else if (current->m_type == NodeType::Variable && !bound->contains(current->getValue<std::string>())) {
+            func.readsGlobals = true;
+        }
+        else if (current->m_type == NodeType::Function) {
+            const auto& callee = current->getValue<std::string>();
+            bool isReduction = callee == "sum" || callee == "prod" || callee == "integrate";
+            if (isReduction && current->m_children.size() == 4 && current->m_children[0]->m_type == NodeType::Variable) {
+                auto& inner = scopes.emplace_back(*bound);
+                inner.insert(current->m_children[0]->getValue<std::string>());
+                pending.emplace_back(current->m_children[1].get(), bound);
+                pending.emplace_back(current->m_children[2].get(), bound);
+                pending.emplace_back(current->m_children[3].get(), &inner);
+                continue;
+            }
+            if (callee == "rand" || callee == "randn") {
+                pure = false;
+            }
+            else if (auto native = natives.find(callee); native != natives.end()) {
+                func.callees.insert(callee); // Re-registering it resets this analysis
+                pure = native->second->pure && pure;
+            }
+            else if (!s_builtinFunctions.contains(callee)) {
+                func.callees.insert(callee);
+                auto it = functions.find(callee);
+                if (it == functions.end()) {
+                    pure = false;
+                }
+                else if (it->first != name) {
+                    pure = analysePurity(it->first, it->second, analysing, dependsOnAnalysing) && pure;
+                    func.readsGlobals = func.readsGlobals || it->second.readsGlobals;
+                    func.callees.insert(it->second.callees.begin(), it->second.callees.end());
+                }
+            }
+        }
+        for (const auto& child : current->m_children) {
+            pending.emplace_back(child.get(), bound);
+        }
+    }
+    analysing.erase(name);
+    // Assuming purity can only hide impurity, so an impure result is final either way. A pure
+    // one that relied on a caller still being analysed is left for a later call to settle:
+    // mutually recursive f and g are impure together when f calls something impure
+    if (!pure || !dependsOnAnalysing || analysing.empty()) {
+        func.pure = pure;
+    }
+    provisional = provisional || dependsOnAnalysing;
+    return pure;
+}
+
+void Evaluator::defineFunction(const std::string& name, FunctionInfo info) {
+    if (natives.contains(name)) {
+        throw std::runtime_error("Cannot redefine native function: " + name);
+    }
+    // Anything that (transitively) calls the old definition must be re-analysed
+    for (auto& [other, func] : functions) {
+        if (other == name || func.callees.contains(name)) {
+            func.pure.reset();
+            func.callees.clear();
+            func.memo.clear();
+        }
+    }
+    functions[name] = std::move(info);
+}
+
+void Evaluator::defineFunctions(std::vector<std::pair<std::string, FunctionInfo>> definitions) {
+    std::unordered_set<std::string> names;
+    for (const auto& [name, info] : definitions) {
+        if (natives.contains(name)) {
+            throw std::runtime_error("Cannot redefine native function: " + name);
+        }
+        names.insert(name);
+    }
+    // One invalidation pass for the whole batch instead of one per definition
+    for (auto& [other, func] : functions) {
+        if (names.contains(other) || std::any_of(func.callees.begin(), func.callees.end(),
+            [&names](const std::string& callee) { return names.contains(callee); })) {
+            func.pure.reset();
+            func.callees.clear();
+            func.memo.clear();
+        }
+    }
+    functions.reserve(functions.size() + definitions.size());
+    for (auto& [name, info] : definitions) {
+        functions[name] = std::move(info);
+    }
+}
+
+void Evaluator::registerFunction(const std::string& name, NativeFunction function) {
+    if (s_builtinFunctions.contains(name)) {
+        throw std::runtime_error("Cannot replace built-in function: " + name);
+    }
+    if (functions.contains(name)) {
+        throw std::runtime_error("Function already defined by a formula: " + name);
+    }
+    if (!function.scalar) {
+        throw std::runtime_error("Native function needs a scalar implementation: " + name);
+    }
+    if (function.minArity > function.maxArity) {
+        throw std::runtime_error("Native function arity range is empty: " + name);
+    }
+    // Callers analysed against an earlier registration may have changed purity
+    for (auto& [other, func] : functions) {
+        if (func.callees.contains(name)) {
+            func.pure.reset();
+            func.callees.clear();
+            func.memo.clear();
+        }
+    }
+    natives[name] = std::make_shared<const NativeFunction>(std::move(function));
+}
+
+void Evaluator::setMemoization(bool enabled, size_t capacity) {
+    memoize = enabled;
+    memoCapacity = capacity;
+    for (auto& [name, func] : functions) {
+        func.memo = MemoCache{};
+    }
+}
+
+std::vector<std::pair<std::string, std::vector<std::string>>> Evaluator::userFunctions() const {
+    std::vector<std::pair<std::string, std::vector<std::string>>> result;
+    for (const auto& [name, info] : functions) {
+        result.emplace_back(name, info.argNames);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void Evaluator::setCompileOptions(const CompileOptions& o) {
+    if (o.accuracy != options.accuracy) {
+        for (auto& [name, func] : functions) {
+            func.memo.clear();
+        }
+    }
+    if (o.seed != options.seed) {
+        randomRow = 0;
+    }
+    options = o;
+}
+
+void Evaluator::setSeed(uint64_t seed) {
+    options.seed = seed;
+    randomRow = 0;
+}
+
+MemoStats Evaluator::memoStats(const std::string& name) const {
+    auto it = functions.find(name);
+    if (it == functions.end()) {
+        throw std::runtime_error("Undefined function: " + name);
+    }
+    return it->second.memo.stats();
+}
+
+std::vector<std::pair<std::string, MemoStats>> Evaluator::memoStats() const {
+    std::vector<std::pair<std::string, MemoStats>> result;
+    for (const auto& [name, func] : functions) {
+        result.emplace_back(name, func.memo.stats());
+    }
+    std::sort(result.begin(), result.end(), [](const auto& l, const auto& r) { return l.first < r.first; });
+    return result;
 }
\ No newline at end of file
@@ -0,0 +1,341 @@
+#include "FastMath.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace {
+    // Minimax (Remez) fits, lowest degree first, with the maximum weighted error of the
+    // fit itself; rounding in the kernels adds to it.
+
+    // (e^r - 1 - r) / r^2 on |r| <= ln2/2, relative to e^r: 3.6e-18 and 3.1e-9
+    constexpr double s_expUlp[] = {
+        0.50000000000000111, 0.16666666666666413, 0.041666666666530267, 0.0083333333334943364,
+        0.0013888888943597779, 0.00019841269506771099, 2.4801493136098381e-05, 2.7557586274478321e-06,
+        2.7630233950750775e-07, 2.5000069627625309e-08
+    };
+    constexpr double s_expFast[] = {
+        0.49999993451700897, 0.16666520689846134, 0.04166838736278955, 0.0083687098229737796,
+        0.0013814613184743312
+    };
+    // (sin r - r) / r^3 in z = r^2 on |r| <= pi/4, relative to sin r: 3.4e-18 and 3.6e-9
+    constexpr double s_sinUlp[] = {
+        -0.16666666666666632, 0.0083333333333224253, -0.00019841269829816953, 2.7557313695226739e-06,
+        -2.5050758653288619e-08, 1.5896827929249299e-10
+    };
+    constexpr double s_sinFast[] = { -0.1666665494370109, 0.0083321781461396169, -0.00019517298981470155 };
+    // (cos r - 1 + z/2) / z^2 in z = r^2 on |r| <= pi/4, absolute: 4.7e-20 and 9.5e-11
+    constexpr double s_cosUlp[] = {
+        0.041666666666666602, -0.0013888888888874138, 2.4801587289491837e-05, -2.7557314355244309e-07,
+        2.0875723684771295e-09, -1.1359669885418601e-11
+    };
+    constexpr double s_cosFast[] = { 0.041666646866442815, -0.0013887367515742328, 2.4438451593700066e-05 };
+    // (log(1 + f) - 2s) / (s z) in z = s^2, s = f / (2 + f), for 1 + f in [sqrt(1/2), sqrt(2)],
+    // weighted by z: 2.5e-18 and 1.6e-9
+    constexpr double s_logUlp[] = {
+        0.6666666666666734, 0.39999999999414682, 0.28571428742387522, 0.22222198573193391,
+        0.18183564325724602, 0.15314050560909742, 0.14795949623036472
+    };
+    constexpr double s_logFast[] = { 0.66666776381620896, 0.39977541575520181, 0.29871727760189509 };
+
+    // Constants split so that products with the integers of a reduction are exact: ln2 and
+    // log10(2) have 42 and 33 significant bits in the high part, and each of the first three
+    // pieces of pi/2 has 33
+    constexpr double s_ln2Hi = 0x1.62e42fefa38p-1;
+    constexpr double s_ln2Lo = 0x1.ef35793c7673p-45;
+    constexpr double s_invLn2 = 0x1.71547652b82fep+0;
+    constexpr double s_log10Of2Hi = 0x1.3441350ap-2;
+    constexpr double s_log10Of2Lo = -0x1.0c0219dc1da99p-39;
+    constexpr double s_invLn10 = 0x1.bcb7b1526e50ep-2;
+    constexpr double s_halfPi[] = { 0x1.921fb544p+0, 0x1.0b4611a6p-34, 0x1.3198a2ep-69, 0x1.b839a252049c1p-104 };
+    constexpr double s_twoOverPi = 0x1.45f306dc9c883p-1;
+    constexpr double s_sqrtHalf = 0x1.6a09e667f3bcdp-1;
+
+    // Past this, q pi/2 no longer comes off exactly and sin, cos and tan use the C library
+    constexpr double s_trigLimit = 0x1p20;
+    // x + s_shifter rounds x (|x| < 2^51) to an integer held in the low mantissa bits
+    constexpr double s_shifter = 0x1.8p52;
+    constexpr uint64_t s_mantissa = (uint64_t{ 1 } << 52) - 1;
+    constexpr double s_infinity = std::numeric_limits<double>::infinity();
+    constexpr double s_nan = std::numeric_limits<double>::quiet_NaN();
+
+    // The kernels below are branch-free and use only 64-bit integer adds, shifts and masks
+    // on the bit patterns, which SSE2 has, so the loops over them vectorise
+
+    uint64_t bits(double x) { return std::bit_cast<uint64_t>(x); }
+    double fromBits(uint64_t b) { return std::bit_cast<double>(b); }
+
+    // round(x) as a double and as an integer
+    int64_t roundToInteger(double x, double& rounded) {
+        double shifted = x + s_shifter;
+        rounded = shifted - s_shifter;
+        return static_cast<int64_t>(bits(shifted) - bits(s_shifter));
+    }
+
+    // 2^k for -1022 <= k <= 1023
+    double power2(int64_t k) {
+        return fromBits(static_cast<uint64_t>(k + 1023) << 52);
+    }
+
+    // b when the low bit of q is set, a otherwise
+    double selectOdd(int64_t q, double a, double b) {
+        uint64_t mask = uint64_t{ 0 } - static_cast<uint64_t>(q & 1);
+        return fromBits((bits(a) & ~mask) | (bits(b) & mask));
+    }
+
+    // -y when bit 1 of q is set
+    double negateIf2(int64_t q, double y) {
+        return fromBits(bits(y) ^ (static_cast<uint64_t>(q & 2) << 62));
+    }
+
+    template<size_t N>
+    double horner(const double (&c)[N], double x) {
+        double p = c[N - 1];
+        for (size_t k = N - 1; k-- > 0;) {
+            p = p * x + c[k];
+        }
+        return p;
+    }
+
+    // Exact a + b as a rounded sum and its error
+    std::pair<double, double> twoSum(double a, double b) {
+        double s = a + b;
+        double bb = s - a;
+        return { s, (a - (s - bb)) + (b - bb) };
+    }
+
+    template<bool Precise>
+    double expKernel(double x) {
+        // e^x is inf or 0 beyond these; NaN passes both comparisons unchanged
+        x = x > 710.0 ? 710.0 : x;
+        x = x < -746.0 ? -746.0 : x;
+        // x = k ln2 + r, |r| <= ln2/2. k ln2Hi is exact and so is x minus it.
+        double kd;
+        int64_t k = roundToInteger(x * s_invLn2, kd);
+        double hi = x - kd * s_ln2Hi;
+        double lo = kd * s_ln2Lo;
+        double r = hi - lo;
+        double p = Precise ? horner(s_expUlp, r) : horner(s_expFast, r);
+        // The rounding error of r is added back in the tail
+        double y = 1.0 + (r + (r * r * p + ((hi - r) - lo)));
+        // 2^k as two normal factors: overflow gives inf and subnormal results are rounded once
+        double half;
+        int64_t k1 = roundToInteger(kd * 0.5, half);
+        return y * power2(k1) * power2(k - k1);
+    }
+
+    // x = 2^k (1 + f) with 1 + f in [sqrt(1/2), sqrt(2)), for positive finite x
+    double reduceLog(double x, double& k) {
+        bool subnormal = x < 0x1p-1022;
+        double scaled = x * (subnormal ? 0x1p52 : 1.0);
+        // Adding 1 - sqrt(1/2) to the mantissa carries into the exponent from sqrt(2) up
+        uint64_t u = bits(scaled) + (bits(1.0) - bits(s_sqrtHalf));
+        double biased = fromBits((u >> 52) | bits(0x1p52)) - 0x1p52;
+        k = biased - (subnormal ? 1023.0 + 52.0 : 1023.0);
+        return fromBits((u & s_mantissa) + bits(s_sqrtHalf)) - 1.0;
+    }
+
+    // log(1 + f) = 2 atanh(s) = f - f^2/2 + s (f^2/2 + z P(z)), split so the large terms
+    // are added last; returns the parts without f
+    template<bool Precise>
+    double logTail(double f) {
+        double halfSquare = 0.5 * f * f;
+        double s = f / (2.0 + f);
+        double z = s * s;
+        double p = z * (Precise ? horner(s_logUlp, z) : horner(s_logFast, z));
+        return s * (halfSquare + p) - halfSquare;
+    }
+
+    // The C library's log at 0, inf, negative numbers and NaN
+    double logSpecial(double x, double y) {
+        y = x == s_infinity ? x : y;
+        y = x == 0 ? -s_infinity : y;
+        return (x < 0) | (x != x) ? s_nan : y;
+    }
+
+    template<bool Precise>
+    double logKernel(double x) {
+        double k;
+        double f = reduceLog(x, k);
+        double y = (logTail<Precise>(f) + k * s_ln2Lo + f) + k * s_ln2Hi;
+        return logSpecial(x, y);
+    }
+
+    template<bool Precise>
+    double log10Kernel(double x) {
+        double k;
+        double f = reduceLog(x, k);
+        double y = ((logTail<Precise>(f) + f) * s_invLn10 + k * s_log10Of2Lo) + k * s_log10Of2Hi;
+        return logSpecial(x, y);
+    }
+
+    // x = q pi/2 + r + rl with |r| <= pi/4 (slightly more from rounding) and rl below
+    // r's last bit, for |x| <= s_trigLimit
+    inline int64_t reduceTrig(double x, double& r, double& rl) {
+        double qd;
+        int64_t q = roundToInteger(x * s_twoOverPi, qd);
+        double t = x - qd * s_halfPi[0];
+        auto [s1, e1] = twoSum(t, -qd * s_halfPi[1]);
+        auto [s2, e2] = twoSum(s1, -qd * s_halfPi[2]);
+        double lo = (e1 + e2) - qd * s_halfPi[3];
+        r = s2 + lo;
+        rl = (s2 - r) + lo;
+        return q;
+    }
+
+    template<bool Precise>
+    inline double sinPolynomial(double r, double rl) {
+        double z = r * r;
+        if constexpr (Precise) {
+            return r + (r * z * horner(s_sinUlp, z) + rl * (1.0 - 0.5 * z));
+        }
+        return r + r * z * horner(s_sinFast, z);
+    }
+
+    template<bool Precise>
+    inline double cosPolynomial(double r, double rl) {
+        double z = r * r;
+        double halfZ = 0.5 * z;
+        double w = 1.0 - halfZ;
+        if constexpr (Precise) {
+            // 1 - z/2 loses bits to rounding; they are recovered and added back with the tail
+            return w + (((1.0 - w) - halfZ) + (z * z * horner(s_cosUlp, z) - r * rl));
+        }
+        return w + z * z * horner(s_cosFast, z);
+    }
+
+    template<bool Precise>
+    double sinKernel(double x) {
+        double r, rl;
+        int64_t q = reduceTrig(x, r, rl);
+        double y = negateIf2(q, selectOdd(q, sinPolynomial<Precise>(r, rl), cosPolynomial<Precise>(r, rl)));
+        return x == 0 ? x : y; // Keeps the sign of -0
+    }
+
+    template<bool Precise>
+    double cosKernel(double x) {
+        double r, rl;
+        int64_t q = reduceTrig(x, r, rl);
+        return negateIf2(q + 1, selectOdd(q, cosPolynomial<Precise>(r, rl), sinPolynomial<Precise>(r, rl)));
+    }
+
+    template<bool Precise>
+    double tanKernel(double x) {
+        double r, rl;
+        int64_t q = reduceTrig(x, r, rl);
+        double s = sinPolynomial<Precise>(r, rl);
+        double c = cosPolynomial<Precise>(r, rl);
+        // -cos/sin in odd quadrants
+        double y = selectOdd(q, s, -c) / selectOdd(q, c, s);
+        return x == 0 ? x : y;
+    }
+
+    template<typename F>
+    void lanes(std::span<const double> x, double* out, F f) {
+        for (size_t i = 0; i < x.size(); ++i) {
+            out[i] = f(x[i]);
+        }
+    }
+
+    // Chunks are computed into a buffer first, as out may alias x and the rare arguments
+    // past s_trigLimit are redone with the C library
+    template<typename F>
+    void trigLanes(std::span<const double> x, double* out, F f, double (*fallback)(double)) {
+        constexpr size_t chunk = 256;
+        std::array<double, chunk> y;
+        for (size_t start = 0; start < x.size(); start += chunk) {
+            size_t count = std::min(chunk, x.size() - start);
+            const double* in = x.data() + start;
+            uint64_t large = 0;
+            for (size_t i = 0; i < count; ++i) {
+                y[i] = f(in[i]);
+                large |= bits(std::abs(in[i]) <= s_trigLimit ? 0.0 : 1.0);
+            }
+            if (!large) {
+                std::copy_n(y.begin(), count, out + start);
+                continue;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                out[start + i] = std::abs(in[i]) <= s_trigLimit ? y[i] : fallback(in[i]);
+            }
+        }
+    }
+
+    double libmSin(double x) { return std::sin(x); }
+    double libmCos(double x) { return std::cos(x); }
+    double libmTan(double x) { return std::tan(x); }
+
+    template<bool Precise>
+    void applyKernel(fastmath::Function function, std::span<const double> x, double* out) {
+        switch (function) {
+        case fastmath::Function::Sin: trigLanes(x, out, [](double v) { return sinKernel<Precise>(v); }, libmSin); break;
+        case fastmath::Function::Cos: trigLanes(x, out, [](double v) { return cosKernel<Precise>(v); }, libmCos); break;
+        case fastmath::Function::Tan: trigLanes(x, out, [](double v) { return tanKernel<Precise>(v); }, libmTan); break;
+        case fastmath::Function::Exp: lanes(x, out, [](double v) { return expKernel<Precise>(v); }); break;
+        case fastmath::Function::Log: lanes(x, out, [](double v) { return logKernel<Precise>(v); }); break;
+        case fastmath::Function::Log10: lanes(x, out, [](double v) { return log10Kernel<Precise>(v); }); break;
+        }
+    }
+
+    void applyStrict(fastmath::Function function, std::span<const double> x, double* out) {
+        switch (function) {
+        case fastmath::Function::Sin: lanes(x, out, libmSin); break;
+        case fastmath::Function::Cos: lanes(x, out, libmCos); break;
+        case fastmath::Function::Tan: lanes(x, out, libmTan); break;
+        case fastmath::Function::Exp: lanes(x, out, [](double v) { return std::exp(v); }); break;
+        case fastmath::Function::Log: lanes(x, out, [](double v) { return std::log(v); }); break;
+        case fastmath::Function::Log10: lanes(x, out, [](double v) { return std::log10(v); }); break;
+        }
+    }
+
+    constexpr std::pair<std::string_view, Accuracy> s_accuracyNames[] = {
+        { "strict", Accuracy::Strict }, { "ulp", Accuracy::Ulp }, { "fast", Accuracy::Fast }
+    };
+}
+
+void fastmath::apply(Function function, Accuracy accuracy, std::span<const double> x, double* out) {
+    switch (accuracy) {
+    case Accuracy::Strict: applyStrict(function, x, out); break;
+    case Accuracy::Ulp: applyKernel<true>(function, x, out); break;
+    case Accuracy::Fast: applyKernel<false>(function, x, out); break;
+    }
+}
+
+double fastmath::apply(Function function, Accuracy accuracy, double x) {
+    double y;
+    apply(function, accuracy, std::span(&x, 1), &y);
+    return y;
+}
+
+std::optional<fastmath::Function> fastmath::find(std::string_view name) {
+    constexpr std::pair<std::string_view, Function> functions[] = {
+        { "sin", Function::Sin }, { "cos", Function::Cos }, { "tan", Function::Tan },
+        { "exp", Function::Exp }, { "log", Function::Log }, { "log10", Function::Log10 }
+    };
+    for (const auto& [functionName, function] : functions) {
+        if (functionName == name) {
+            return function;
+        }
+    }
+    return std::nullopt;
+}
+
+std::string_view fastmath::accuracyName(Accuracy accuracy) {
+    for (const auto& [name, value] : s_accuracyNames) {
+        if (value == accuracy) {
+            return name;
+        }
+    }
+    return "strict";
+}
+
+std::optional<Accuracy> fastmath::parseAccuracy(std::string_view name) {
+    for (const auto& [accuracyName, value] : s_accuracyNames) {
+        if (accuracyName == name) {
+            return value;
+        }
+    }
+    return std::nullopt;
+}
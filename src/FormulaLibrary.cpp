@@ -0,0 +1,182 @@
+#include "FormulaLibrary.h"
+#include "BulkLoad.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+double LibrarySnapshot::call(const std::string& name, double argument) const {
+    if (auto it = functions.find(name); it != functions.end()) {
+        return it->second.run(std::span(&argument, 1));
+    }
+    if (auto it = uncompiled.find(name); it != uncompiled.end()) {
+        throw std::runtime_error(name + " cannot be called concurrently: " + it->second);
+    }
+    throw std::runtime_error("Undefined function: " + name);
+}
+
+FormulaLibrary::FormulaLibrary(std::string path)
+    : m_path{ std::move(path) } {
+    publish(load());
+}
+
+FormulaLibrary::~FormulaLibrary() {
+#ifdef __linux__
+    if (m_watcher.joinable()) {
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = ::write(m_stopEvent, &one, sizeof(one));
+        m_watcher.join();
+        ::close(m_stopEvent);
+    }
+#endif
+    for (const auto& retired : m_retired) {
+        delete retired.snapshot;
+    }
+    delete m_current.load();
+}
+
+std::unique_ptr<LibrarySnapshot> FormulaLibrary::load() const {
+    std::ifstream file(m_path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + m_path);
+    }
+    std::string text{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    auto snapshot = std::make_unique<LibrarySnapshot>();
+    auto loaded = loadDefinitions(snapshot->definitions, text,
+        { .pool = &ThreadPool::shared(), .compile = true, .source = m_path });
+    snapshot->functions = std::move(loaded.programs);
+    snapshot->uncompiled = std::move(loaded.uncompiled);
+    return snapshot;
+}
+
+void FormulaLibrary::publish(std::unique_ptr<LibrarySnapshot> snapshot) {
+    std::lock_guard lock(m_writerMutex);
+    snapshot->version = m_nextVersion++;
+    const LibrarySnapshot* old = m_current.exchange(snapshot.release());
+    // Readers that announce an epoch from here on load the new pointer
+    uint64_t epoch = m_epoch.fetch_add(1) + 1;
+    if (old) {
+        m_retired.push_back({ old, epoch });
+    }
+    collect();
+}
+
+void FormulaLibrary::collect() {
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (const auto& slot : m_slots) {
+        if (uint64_t epoch = slot.epoch.load(); epoch != 0) {
+            oldest = std::min(oldest, epoch);
+        }
+    }
+    std::erase_if(m_retired, [oldest](const Retired& retired) {
+        if (retired.epoch > oldest) {
+            return false;
+        }
+        delete retired.snapshot;
+        return true;
+    });
+}
+
+FormulaLibrary::ReadGuard FormulaLibrary::read() const {
+    size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    for (size_t attempt = 0;; ++attempt) {
+        ReaderSlot& slot = m_slots[(start + attempt) % s_readerSlots];
+        bool expected = false;
+        if (!slot.used.load(std::memory_order_relaxed) && slot.used.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            // Announce before loading the pointer: a writer that swaps after our load
+            // is ordered after the announcement and keeps the snapshot alive
+            slot.epoch.store(m_epoch.load());
+            return ReadGuard(&slot, m_current.load());
+        }
+        if (attempt % s_readerSlots == s_readerSlots - 1) {
+            std::this_thread::yield(); // More concurrent readers than slots
+        }
+    }
+}
+
+bool FormulaLibrary::reload() {
+    try {
+        publish(load());
+    }
+    catch (const std::exception& e) {
+        std::lock_guard lock(m_writerMutex);
+        m_lastError = e.what();
+        return false;
+    }
+    return true;
+}
+
+std::string FormulaLibrary::lastError() const {
+    std::lock_guard lock(m_writerMutex);
+    return m_lastError;
+}
+
+size_t FormulaLibrary::retiredCount() const {
+    std::lock_guard lock(m_writerMutex);
+    return m_retired.size();
+}
+
+#ifdef __linux__
+void FormulaLibrary::watch() {
+    if (m_watcher.joinable()) {
+        return;
+    }
+    // Watch the directory: editors often save by writing a new file and renaming it over the old one
+    auto slash = m_path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : m_path.substr(0, slash + 1);
+    int inotify = ::inotify_init1(IN_CLOEXEC);
+    if (inotify < 0 || ::inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        if (inotify >= 0) {
+            ::close(inotify);
+        }
+        throw std::runtime_error("Cannot watch " + directory);
+    }
+    m_stopEvent = ::eventfd(0, EFD_CLOEXEC);
+    m_watcher = std::thread([this, inotify] { watchLoop(inotify); });
+}
+
+void FormulaLibrary::watchLoop(int inotify) {
+    auto slash = m_path.rfind('/');
+    std::string name = slash == std::string::npos ? m_path : m_path.substr(slash + 1);
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[] = { { inotify, POLLIN, 0 }, { m_stopEvent, POLLIN, 0 } };
+    while (true) {
+        // The timeout also retries reclaiming snapshots that readers held at the last swap
+        if (::poll(fds, 2, 100) > 0) {
+            if (fds[1].revents) {
+                break;
+            }
+            bool changed = false;
+            ssize_t length = ::read(inotify, buffer, sizeof(buffer));
+            for (ssize_t offset = 0; offset < length;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                changed = changed || (event->len > 0 && name == event->name);
+                offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            }
+            if (changed) {
+                reload();
+            }
+        }
+        std::lock_guard lock(m_writerMutex);
+        collect();
+    }
+    ::close(inotify);
+}
+#else
+void FormulaLibrary::watch() {
+    throw std::runtime_error("Watching library files needs inotify (Linux)");
+}
+
+void FormulaLibrary::watchLoop(int) {
+}
+#endif
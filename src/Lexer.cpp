@@ -26,7 +26,20 @@ std::vector<Token> Lexer::tokenize() {
 		{'^', OperatorType::Power},
 		{'!', OperatorType::Factorial},
 		{'%', OperatorType::Mod},
-		{'=', OperatorType::Assignment}
+		{'=', OperatorType::Assignment},
+		{'<', OperatorType::Less},
+		{'>', OperatorType::Greater},
+		{'&', OperatorType::And},
+		{'|', OperatorType::Or}
+	};
+	// Two-character operators, matched before their first character alone
+	static const std::unordered_map<std::string_view, OperatorType> pairedOperators = {
+		{"<=", OperatorType::LessEqual},
+		{">=", OperatorType::GreaterEqual},
+		{"==", OperatorType::Equal},
+		{"!=", OperatorType::NotEqual},
+		{"&&", OperatorType::And},
+		{"||", OperatorType::Or}
 	};
 
 	auto isOperator = [](char c) -> bool {
@@ -34,7 +47,7 @@ std::vector<Token> Lexer::tokenize() {
 		};
 
 	auto getCharType = [&isOperator](char c) -> CharType {
-		if (c == '(' || c == ')') return CharType::Parenthesis;
+		if (c == '(' || c == ')' || c == '[' || c == ']') return CharType::Parenthesis;
 		if (c == '.') return CharType::Dot;
 		if (c == ',') return CharType::Comma;
 		if (std::isdigit(c)) return CharType::Digit;
@@ -43,11 +56,24 @@ std::vector<Token> Lexer::tokenize() {
 		return CharType::None;
 		};
 
+	// Tokens record where they start in the original, unstripped text
+	auto placeLast = [&](size_t at) {
+		tokens.back().m_position = m_offsets[at];
+		};
+
+	// Characters that were next to each other before whitespace was stripped, so "< =" is two operators
+	auto adjacent = [&](size_t at) {
+		return at + 1 < m_input.size() && m_offsets[at + 1] == m_offsets[at] + 1;
+		};
+
 	bool wasDot = false;
 	bool isScientific = false;
+	size_t bufferStart{};
 	CharType currType{};
 	for (int i{}; i < m_input.length(); ++i) {
 		currType = getCharType(m_input[i]);
+		if (buffer.empty())
+			bufferStart = i;
 
 		if (!buffer.empty()) {
 			if (getCharType(buffer.back()) == CharType::Digit && std::tolower(m_input[i]) == 'e') {
@@ -65,8 +91,23 @@ std::vector<Token> Lexer::tokenize() {
 		}
 		switch (currType) {
 			case CharType::Operator:
-				if(!isScientific)
-					tokens.emplace_back(validOperators.at(m_input[i])); 
+				if (!isScientific) {
+					// "3!==6" is a factorial compared with 6 rather than "3 != = 6"
+					bool factorialThenEqual = m_input[i] == '!' && adjacent(i + 1) && m_input[i + 2] == '=';
+					auto paired = adjacent(i) && !factorialThenEqual
+						? pairedOperators.find(std::string_view(m_input).substr(i, 2)) : pairedOperators.end();
+					if (paired != pairedOperators.end()) {
+						tokens.emplace_back(paired->second);
+						placeLast(i);
+						++i;
+						continue;
+					}
+					if (m_input[i] == '&' || m_input[i] == '|') {
+						throw std::runtime_error(std::string("Expected '") + m_input[i] + m_input[i] + "' at position " + std::to_string(m_offsets[i]));
+					}
+					tokens.emplace_back(validOperators.at(m_input[i]));
+					placeLast(i);
+				}
 				else if (isScientific) {
 					if ((m_input[i] == '+' || m_input[i] == '-') && buffer.back() == 'e') {
 						buffer += m_input[i];
@@ -78,7 +119,7 @@ std::vector<Token> Lexer::tokenize() {
 					}
 				}
 				break;
-			case CharType::Parenthesis:tokens.emplace_back(TokenType::Parenthesis, m_input[i]); break;
+			case CharType::Parenthesis:tokens.emplace_back(TokenType::Parenthesis, m_input[i]); placeLast(i); break;
 			case CharType::Digit:buffer += m_input[i]; break;
 			case CharType::Alpha:buffer += m_input[i]; break;
 			case CharType::Dot:
@@ -92,7 +133,7 @@ std::vector<Token> Lexer::tokenize() {
 				wasDot = true;
 				currType = CharType::Digit;
 				break;
-			case CharType::Comma:tokens.emplace_back(TokenType::Comma, ','); break;
+			case CharType::Comma:tokens.emplace_back(TokenType::Comma, ','); placeLast(i); break;
 		}
 
 		if (i + 1 < m_input.length()) {
@@ -106,17 +147,20 @@ std::vector<Token> Lexer::tokenize() {
 				}
 
 				tokens.emplace_back(toDouble(buffer));
+				placeLast(bufferStart);
 				buffer.clear(); wasDot = false; isScientific = false;
 			}
 			else if (currType == CharType::Alpha) {
 				if (buffer == "log" && i + 3 < m_input.size() && m_input.substr(i+1, 2) == "10" && m_input[i+3] == '(') {
 					tokens.emplace_back(TokenType::Function, buffer+"10");
+					placeLast(bufferStart);
 					buffer.clear(); wasDot = false; isScientific = false;
 					i += 2;
 					continue;
 				}
 				else if (buffer == "atan" && i + 2 < m_input.size() && m_input[i + 1] == '2' && m_input[i + 2] == '(') {
 					tokens.emplace_back(TokenType::Function, buffer + "2");
+					placeLast(bufferStart);
 					buffer.clear(); wasDot = false; isScientific = false;
 					i++;
 					continue;
@@ -124,6 +168,7 @@ std::vector<Token> Lexer::tokenize() {
 				else if (currType == CharType::Alpha && nextType != CharType::Alpha) {
 					TokenType alphaType = m_input[i + 1] == '(' ? TokenType::Function : TokenType::Variable;
 					tokens.emplace_back(alphaType, buffer);
+					placeLast(bufferStart);
 					buffer.clear(); wasDot = false; isScientific = false;
 				}
 			}
@@ -135,9 +180,11 @@ std::vector<Token> Lexer::tokenize() {
 				throw std::runtime_error("Incomplete scientific notation at position " + std::to_string(m_input.length()));
 			}
 			tokens.emplace_back(toDouble(buffer));
+			placeLast(bufferStart);
 		}
 		else if (currType == CharType::Alpha) {
 			tokens.emplace_back(TokenType::Variable, buffer);
+			placeLast(bufferStart);
 		}
 	}
 	return tokens;
@@ -0,0 +1,91 @@
+#include "MemoCache.h"
+#include <algorithm>
+#include <bit>
+
+void MemoCache::reset(size_t arity, size_t capacity) {
+    m_arity = arity;
+    m_capacity = std::bit_ceil(std::max<size_t>(capacity, s_probeWindow));
+    m_keys.assign(m_capacity * std::max<size_t>(arity, 1), 0);
+    m_values.assign(m_capacity, 0.0);
+    m_used.assign(m_capacity, 0);
+    m_stats = {};
+}
+
+void MemoCache::clear() {
+    std::fill(m_used.begin(), m_used.end(), 0);
+    m_stats.entries = 0;
+}
+
+MemoStats MemoCache::stats() const {
+    return m_stats;
+}
+
+size_t MemoCache::homeSlot(std::span<const double> args) const {
+    // splitmix64 finaliser over the raw bits, so +0.0 and -0.0 (or NaN payloads) stay distinct
+    uint64_t hash = 0x9e3779b97f4a7c15ull;
+    for (double arg : args) {
+        uint64_t z = hash ^ std::bit_cast<uint64_t>(arg);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        hash = z ^ (z >> 31);
+    }
+    return static_cast<size_t>(hash) & (m_capacity - 1);
+}
+
+bool MemoCache::matches(size_t slot, std::span<const double> args) const {
+    const uint64_t* key = &m_keys[slot * m_arity];
+    for (size_t i = 0; i < m_arity; ++i) {
+        if (key[i] != std::bit_cast<uint64_t>(args[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MemoCache::lookup(std::span<const double> args, double& result) {
+    if (m_capacity == 0 || args.size() != m_arity) {
+        return false;
+    }
+    size_t home = homeSlot(args);
+    for (size_t probe = 0; probe < s_probeWindow; ++probe) {
+        size_t slot = (home + probe) & (m_capacity - 1);
+        if (!m_used[slot]) {
+            break;
+        }
+        if (matches(slot, args)) {
+            ++m_stats.hits;
+            result = m_values[slot];
+            return true;
+        }
+    }
+    ++m_stats.misses;
+    return false;
+}
+
+void MemoCache::insert(std::span<const double> args, double result) {
+    if (m_capacity == 0 || args.size() != m_arity) {
+        return;
+    }
+    size_t home = homeSlot(args);
+    size_t target = home;
+    bool found = false;
+    for (size_t probe = 0; probe < s_probeWindow; ++probe) {
+        size_t slot = (home + probe) & (m_capacity - 1);
+        if (!m_used[slot] || matches(slot, args)) {
+            target = slot;
+            found = true;
+            break;
+        }
+    }
+    if (!m_used[target]) {
+        m_used[target] = 1;
+        ++m_stats.entries;
+    }
+    else if (!found) {
+        ++m_stats.evictions;
+    }
+    for (size_t i = 0; i < m_arity; ++i) {
+        m_keys[target * m_arity + i] = std::bit_cast<uint64_t>(args[i]);
+    }
+    m_values[target] = result;
+}
@@ -0,0 +1,21 @@
+#include "NativeFunction.h"
+#include <stdexcept>
+
+namespace {
+    std::string arguments(size_t count) {
+        return count == 0 ? "no arguments" : count == 1 ? "one argument" : count == 2 ? "two arguments" : std::to_string(count) + " arguments";
+    }
+}
+
+void NativeFunction::checkArity(const std::string& name, size_t given) const {
+    if (given >= minArity && given <= maxArity) {
+        return;
+    }
+    if (minArity == maxArity) {
+        throw std::runtime_error(name + " expects " + arguments(minArity));
+    }
+    if (maxArity == s_variadic) {
+        throw std::runtime_error(name + " expects at least " + arguments(minArity));
+    }
+    throw std::runtime_error(name + " expects " + std::to_string(minArity) + " to " + arguments(maxArity));
+}
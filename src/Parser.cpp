@@ -1,183 +1,239 @@
 #include "Parser.h"
+#include <algorithm>
 #include <stdexcept>
 
-Parser::Parser(const std::vector<Token>& tokens) {
-    m_tokens.reserve(tokens.size());
-    for (size_t i = 0; i < tokens.size(); ++i) {
-        if (tokens[i].m_tType == TokenType::Operator &&
-            (tokens[i].getValue<OperatorType>() == OperatorType::Add ||
-                tokens[i].getValue<OperatorType>() == OperatorType::Subtract))
-        {
-            bool isUnary = false;
-            if (i == 0) {
-                isUnary = true;
+Parser::Parser(std::span<const Token> tokens, size_t maxDepth)
+    : m_tokens{ tokens }
+    , m_maxDepth{ maxDepth } {
+}
+
+Parser::Parser(std::vector<Token>&& tokens, size_t maxDepth)
+    : m_ownedTokens{ std::move(tokens) }
+    , m_maxDepth{ maxDepth } {
+    m_tokens = m_ownedTokens;
+}
+
+std::unique_ptr<ASTNode> Parser::parseExpression() {
+    m_operands.clear();
+    m_frames.clear();
+
+    // Alternates between expecting an operand (prefix position) and an operator (infix position)
+    bool expectOperand = true;
+    while (!atEnd()) {
+        const Token& token = next();
+        size_t position = token.m_position;
+
+        if (expectOperand) {
+            switch (token.m_tType) {
+            case TokenType::Number:
+                pushOperand(makeNode(position, token.getValue<double>()), 1);
+                expectOperand = false;
+                break;
+
+            case TokenType::Variable:
+                pushOperand(makeNode(position, token.getValue<std::string>(), NodeType::Variable), 1);
+                expectOperand = false;
+                break;
+
+            case TokenType::Function: {
+                if (atEnd() || peek().m_tType != TokenType::Parenthesis || peek().getValue<char>() != '(') {
+                    throw std::runtime_error("Expected '(' after function at position " + std::to_string(position));
+                }
+                next();
+                pushFrame({ FrameKind::Call, {}, 0, m_operands.size(), position,
+                    makeNode(position, token.getValue<std::string>(), NodeType::Function) });
+                if (!atEnd() && peek().m_tType == TokenType::Parenthesis && peek().getValue<char>() == ')') {
+                    closeGroup(peek().m_position, ')');
+                    next();
+                    expectOperand = false;
+                }
+                break;
             }
-            else {
-                const Token& prev = tokens[i - 1];
-                if (prev.m_tType == TokenType::Operator ||
-                    (prev.m_tType == TokenType::Parenthesis && prev.getValue<char>() == '('))
-                {
-                    isUnary = true;
+
+            case TokenType::Parenthesis:
+                if (token.getValue<char>() == '[') {
+                    pushFrame({ FrameKind::Array, {}, 0, m_operands.size(), position, makeNode(position, NodeType::Array) });
+                    if (!atEnd() && peek().m_tType == TokenType::Parenthesis && peek().getValue<char>() == ']') {
+                        closeGroup(peek().m_position, ']');
+                        next();
+                        expectOperand = false;
+                    }
+                    break;
+                }
+                if (token.getValue<char>() != '(') {
+                    throw std::runtime_error("Expected expression at position " + std::to_string(position));
                 }
+                pushFrame({ FrameKind::Group, {}, 0, m_operands.size(), position });
+                break;
+
+            case TokenType::Operator: {
+                auto op = token.getValue<OperatorType>();
+                if (op == OperatorType::Subtract) op = OperatorType::UnaryMinus;
+                if (op == OperatorType::Add) op = OperatorType::UnaryPlus;
+                if (op != OperatorType::UnaryMinus && op != OperatorType::UnaryPlus) {
+                    throw std::runtime_error("Expected unary operator at position " + std::to_string(position));
+                }
+                pushFrame({ FrameKind::Prefix, op, getBindingPower(op), m_operands.size(), position });
+                break;
             }
 
-            if (isUnary) {
-                OperatorType unaryOp = (tokens[i].getValue<OperatorType>() == OperatorType::Subtract)
-                    ? OperatorType::UnaryMinus
-                    : OperatorType::UnaryPlus;
-                m_tokens.push_back(Token(unaryOp));
-                continue;
+            default:
+                throw std::runtime_error("Expected expression at position " + std::to_string(position));
+            }
+            continue;
+        }
+
+        switch (token.m_tType) {
+        case TokenType::Operator: {
+            auto op = token.getValue<OperatorType>();
+            if (op == OperatorType::Factorial) {
+                // Postfix factorial binds tighter than anything, so it applies to the last operand
+                auto& top = m_operands.back();
+                auto node = makeNode(position, OperatorType::Factorial);
+                node->appendChild(std::move(top.node));
+                size_t depth = top.depth + 1;
+                m_operands.pop_back();
+                pushOperand(std::move(node), depth);
+                break;
+            }
+            if (op == OperatorType::UnaryMinus || op == OperatorType::UnaryPlus) {
+                throw std::runtime_error("Unexpected unary operator at position " + std::to_string(position));
             }
+            int bp = getBindingPower(op);
+            reduceWhile(bp);
+            pushFrame({ FrameKind::Binary, op, isRightAssociative(op) ? bp : bp + 1, m_operands.size(), position });
+            expectOperand = true;
+            break;
         }
 
-        m_tokens.push_back(tokens[i]);
-    }
-}
-
-std::unique_ptr<ASTNode> Parser::parseExpression(int minBP) {
-    auto lhs = parseTerm();
-    if (!lhs) {
-        throw std::runtime_error("Expected expression at position " + std::to_string(m_pos));
-    }
-
-    while (!atEnd()) {
-        auto opToken = peek();
-        if (opToken.m_tType != TokenType::Operator) {
+        case TokenType::Parenthesis:
+            if (token.getValue<char>() != ')' && token.getValue<char>() != ']') {
+                throw std::runtime_error(std::string("Unexpected '") + token.getValue<char>() + "' at position " + std::to_string(position));
+            }
+            closeGroup(position, token.getValue<char>());
             break;
-        }
-        auto op = opToken.getValue<OperatorType>();
-        if (op == OperatorType::UnaryMinus || op == OperatorType::UnaryPlus || op == OperatorType::Factorial) {
-            break; // Handled in parseTerm
-        }
 
-        int bp = getBindingPower(op);
-        if (bp < minBP) {
+        case TokenType::Comma:
+            reduceWhile(-1);
+            if (m_frames.empty() || (m_frames.back().kind != FrameKind::Call && m_frames.back().kind != FrameKind::Array)) {
+                throw std::runtime_error("Unexpected ',' at position " + std::to_string(position));
+            }
+            expectOperand = true;
             break;
-        }
 
-        next();
-        auto rhs = parseExpression(bp);
-        if (!rhs) {
-            throw std::runtime_error("Expected right operand at position " + std::to_string(m_pos));
+        default:
+            throw std::runtime_error("Unexpected token at position " + std::to_string(position));
         }
-
-        auto node = std::make_unique<ASTNode>(op);
-        node->appendChild(std::move(lhs));
-        node->appendChild(std::move(rhs));
-        lhs = std::move(node);
     }
 
-    // Handle postfix factorial after any expression
-    while (!atEnd() && peek().m_tType == TokenType::Operator && peek().getValue<OperatorType>() == OperatorType::Factorial) {
-        next();
-        auto node = std::make_unique<ASTNode>(OperatorType::Factorial);
-        node->appendChild(std::move(lhs));
-        lhs = std::move(node);
+    if (expectOperand) {
+        if (m_operands.empty() && m_frames.empty()) {
+            throw std::runtime_error("Unexpected end of input");
+        }
+        throw std::runtime_error("Expected operand after position " + std::to_string(m_tokens.back().m_position));
     }
-
-    return lhs;
+    reduceWhile(-1);
+    if (!m_frames.empty()) {
+        bool array = m_frames.back().kind == FrameKind::Array;
+        throw std::runtime_error(std::string(array ? "Expected ']' for '['" : "Expected ')' for '('") + " at position "
+            + std::to_string(m_frames.back().position));
+    }
+    auto result = std::move(m_operands.back().node);
+    m_operands.clear();
+    return result;
 }
 
-std::unique_ptr<ASTNode> Parser::parseTerm() {
-    if (atEnd()) {
-        throw std::runtime_error("Unexpected end of input");
+void Parser::pushFrame(Frame frame) {
+    if (m_frames.size() >= m_maxDepth) {
+        throw std::runtime_error("Expression nesting exceeds the limit of " + std::to_string(m_maxDepth) + " levels");
     }
+    m_frames.push_back(std::move(frame));
+}
 
-    auto token = next();
-
-    switch (token.m_tType) {
-    case TokenType::Number: {
-        auto node = std::make_unique<ASTNode>(token.getValue<double>());
-        // Check for postfix factorial (e.g., 5!)
-        while (!atEnd() && peek().m_tType == TokenType::Operator && peek().getValue<OperatorType>() == OperatorType::Factorial) {
-            next();
-            auto factorialNode = std::make_unique<ASTNode>(OperatorType::Factorial);
-            factorialNode->appendChild(std::move(node));
-            node = std::move(factorialNode);
-        }
-        return node;
+void Parser::pushOperand(std::unique_ptr<ASTNode> node, size_t depth) {
+    if (depth > m_maxDepth) {
+        throw std::runtime_error("Expression nesting exceeds the limit of " + std::to_string(m_maxDepth) + " levels");
     }
+    m_operands.push_back({ std::move(node), depth });
+}
 
-    case TokenType::Variable:
-        return std::make_unique<ASTNode>(token.getValue<std::string>(), NodeType::Variable);
-
-    case TokenType::Function: {
-        auto node = std::make_unique<ASTNode>(token.getValue<std::string>(), NodeType::Function);
-        if (atEnd() || peek().m_tType != TokenType::Parenthesis || peek().getValue<char>() != '(') {
-            throw std::runtime_error("Expected '(' after function at position " + std::to_string(token.m_position));
-        }
-        next();
-        auto args = parseFunctionArgs();
-        for (auto& arg : args) {
-            node->appendChild(std::move(arg));
-        }
-        if (atEnd() || peek().m_tType != TokenType::Parenthesis || peek().getValue<char>() != ')') {
-            throw std::runtime_error("Expected ')' after function arguments at position " + std::to_string(m_pos));
+void Parser::reduceWhile(int leftBP) {
+    // Pending operators whose right operand is complete are folded into nodes
+    while (!m_frames.empty()) {
+        const auto& top = m_frames.back();
+        if (top.kind != FrameKind::Binary && top.kind != FrameKind::Prefix) {
+            break;
         }
-        next();
-        // Check for factorial after function (e.g., max(1,2)!)
-        while (!atEnd() && peek().m_tType == TokenType::Operator && peek().getValue<OperatorType>() == OperatorType::Factorial) {
-            next();
-            auto factorialNode = std::make_unique<ASTNode>(OperatorType::Factorial);
-            factorialNode->appendChild(std::move(node));
-            node = std::move(factorialNode);
+        if (leftBP >= top.rightBP) {
+            break;
         }
-        return node;
+        reduceTop();
     }
+}
 
-    case TokenType::Parenthesis: {
-        if (token.getValue<char>() != '(') {
-            throw std::runtime_error("Expected '(' at position " + std::to_string(token.m_position));
-        }
-        auto expr = parseExpression(0);
-        if (atEnd() || peek().m_tType != TokenType::Parenthesis || peek().getValue<char>() != ')') {
-            throw std::runtime_error("Expected ')' at position " + std::to_string(m_pos));
-        }
-        next();
-        // Check for factorial after parenthesized expression (e.g., (-5)!)
-        while (!atEnd() && peek().m_tType == TokenType::Operator && peek().getValue<OperatorType>() == OperatorType::Factorial) {
-            next();
-            auto factorialNode = std::make_unique<ASTNode>(OperatorType::Factorial);
-            factorialNode->appendChild(std::move(expr));
-            expr = std::move(factorialNode);
-        }
-        return expr;
+void Parser::reduceTop() {
+    Frame frame = std::move(m_frames.back());
+    m_frames.pop_back();
+
+    if (frame.kind == FrameKind::Prefix) {
+        Operand operand = std::move(m_operands.back());
+        m_operands.pop_back();
+        auto node = makeNode(frame.position, frame.op);
+        node->appendChild(std::move(operand.node));
+        pushOperand(std::move(node), operand.depth + 1);
+        return;
     }
 
-    case TokenType::Operator: {
-        auto op = token.getValue<OperatorType>();
-        if (op != OperatorType::UnaryMinus && op != OperatorType::UnaryPlus) {
-            throw std::runtime_error("Expected unary operator at position " + std::to_string(token.m_position));
-        }
-        int bp = getBindingPower(op);
-        auto operand = parseExpression(bp);
-        if (!operand) {
-            throw std::runtime_error("Expected operand after unary operator at position " + std::to_string(m_pos));
-        }
-        auto node = std::make_unique<ASTNode>(op);
-        node->appendChild(std::move(operand));
-        return node;
+    Operand rhs = std::move(m_operands.back());
+    m_operands.pop_back();
+    Operand lhs = std::move(m_operands.back());
+    m_operands.pop_back();
+
+    // (a op b) op c is folded left to right either way, so extend the existing node.
+    // Comparisons stay binary: a < b < c compares the 0 or 1 of a < b with c.
+    auto& left = *lhs.node;
+    if (!isRightAssociative(frame.op) && !isComparison(frame.op) && left.m_type == NodeType::Operator
+        && left.getValue<OperatorType>() == frame.op && left.m_children.size() >= 2) {
+        left.appendChild(std::move(rhs.node));
+        pushOperand(std::move(lhs.node), std::max(lhs.depth, rhs.depth + 1));
+        return;
     }
-
-    default:
-        throw std::runtime_error("Unexpected token at position " + std::to_string(token.m_position));
+    // a + b - c is a + b + (-c) bit for bit in IEEE arithmetic, so alternating
+    // additive chains stay one node as well
+    if (frame.op == OperatorType::Subtract && left.m_type == NodeType::Operator
+        && left.getValue<OperatorType>() == OperatorType::Add && left.m_children.size() >= 2) {
+        auto negated = makeNode(frame.position, OperatorType::UnaryMinus);
+        negated->appendChild(std::move(rhs.node));
+        left.appendChild(std::move(negated));
+        pushOperand(std::move(lhs.node), std::max(lhs.depth, rhs.depth + 2));
+        return;
     }
+
+    auto node = makeNode(frame.position, frame.op);
+    node->appendChild(std::move(lhs.node));
+    node->appendChild(std::move(rhs.node));
+    pushOperand(std::move(node), std::max(lhs.depth, rhs.depth) + 1);
 }
 
-std::vector<std::unique_ptr<ASTNode>> Parser::parseFunctionArgs() {
-    std::vector<std::unique_ptr<ASTNode>> args;
-    if (!atEnd() && peek().m_tType == TokenType::Parenthesis && peek().getValue<char>() == ')') {
-        return args;
+void Parser::closeGroup(size_t position, char bracket) {
+    reduceWhile(-1);
+    bool matches = !m_frames.empty() && (bracket == ']'
+        ? m_frames.back().kind == FrameKind::Array
+        : m_frames.back().kind == FrameKind::Group || m_frames.back().kind == FrameKind::Call);
+    if (!matches) {
+        throw std::runtime_error(std::string("Unexpected '") + bracket + "' at position " + std::to_string(position));
     }
-
-    while (true) {
-        auto arg = parseExpression(0);
-        args.push_back(std::move(arg));
-        if (atEnd() || peek().m_tType != TokenType::Comma) {
-            break;
-        }
-        next();
+    Frame frame = std::move(m_frames.back());
+    m_frames.pop_back();
+    if (frame.kind == FrameKind::Group) {
+        return;
     }
 
-    return args;
+    size_t depth = 0;
+    for (size_t i = frame.operandBase; i < m_operands.size(); ++i) {
+        depth = std::max(depth, m_operands[i].depth);
+        frame.call->appendChild(std::move(m_operands[i].node));
+    }
+    m_operands.resize(frame.operandBase);
+    pushOperand(std::move(frame.call), depth + 1);
 }
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include "Plot.h"
+#include "Evaluator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+    constexpr double s_nan = std::numeric_limits<double>::quiet_NaN();
+
+    // Height of the part of the curve a viewer would look at: the spread of finite
+    // samples with the outer 2% on each side dropped, so poles don't flatten the rest
+    double visibleHeight(const std::vector<double>& y) {
+        std::vector<double> finite;
+        std::copy_if(y.begin(), y.end(), std::back_inserter(finite), [](double v) { return std::isfinite(v); });
+        if (finite.empty()) {
+            return 1.0;
+        }
+        std::sort(finite.begin(), finite.end());
+        size_t trim = finite.size() / 50;
+        double height = finite[finite.size() - 1 - trim] - finite[trim];
+        return height > 0 ? height : std::max(std::abs(finite[finite.size() / 2]), 1.0);
+    }
+
+    // How far y[i] is from the line through its neighbours, relative to height;
+    // 1 where the curve enters or leaves f's domain
+    double deviation(const SampledCurve& curve, size_t i, double height) {
+        if (i == 0 || i + 1 >= curve.x.size()) {
+            return 0.0;
+        }
+        double y0 = curve.y[i - 1];
+        double y1 = curve.y[i];
+        double y2 = curve.y[i + 1];
+        bool finite0 = std::isfinite(y0), finite1 = std::isfinite(y1), finite2 = std::isfinite(y2);
+        if (!finite0 || !finite1 || !finite2) {
+            return finite0 == finite1 && finite1 == finite2 ? 0.0 : 1.0;
+        }
+        double t = (curve.x[i] - curve.x[i - 1]) / (curve.x[i + 1] - curve.x[i - 1]);
+        return std::abs(y1 - (y0 + t * (y2 - y0))) / height;
+    }
+
+    void evaluate(const BatchFunction& f, std::span<const double> points, std::span<double> results) {
+        if (!points.empty()) {
+            f(points, results);
+        }
+    }
+}
+
+SampledCurve sampleAdaptive(const BatchFunction& f, double a, double b, const SamplingOptions& options) {
+    if (!std::isfinite(a) || !std::isfinite(b) || !(a < b)) {
+        throw std::invalid_argument("plot range must be finite with a < b");
+    }
+    size_t budget = std::max<size_t>(options.maxPoints, 3);
+    size_t initial = std::clamp<size_t>(options.initialPoints, 3, budget);
+    double minWidth = options.minWidth * (b - a);
+
+    SampledCurve curve;
+    curve.x.resize(initial);
+    for (size_t i = 0; i < initial; ++i) {
+        curve.x[i] = a + (b - a) * static_cast<double>(i) / static_cast<double>(initial - 1);
+    }
+    curve.x.back() = b;
+    curve.y.resize(initial);
+    evaluate(f, curve.x, curve.y);
+
+    std::vector<std::pair<double, size_t>> candidates; // (score, interval [i, i + 1])
+    std::vector<double> midpoints;
+    std::vector<double> values;
+    while (curve.x.size() < budget) {
+        double height = visibleHeight(curve.y);
+        candidates.clear();
+        for (size_t i = 0; i + 1 < curve.x.size(); ++i) {
+            if (curve.x[i + 1] - curve.x[i] <= minWidth) {
+                continue;
+            }
+            // A straying sample puts both intervals around it in doubt
+            double score = std::max(deviation(curve, i, height), deviation(curve, i + 1, height));
+            if (!std::isfinite(curve.y[i]) != !std::isfinite(curve.y[i + 1])) {
+                score = std::max(score, 1.0);
+            }
+            if (score > options.tolerance) {
+                candidates.emplace_back(score, i);
+            }
+        }
+        if (candidates.empty()) {
+            break;
+        }
+        size_t take = std::min(candidates.size(), budget - curve.x.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + take, candidates.end(),
+            [](const auto& l, const auto& r) { return l.first > r.first; });
+        candidates.resize(take);
+        std::sort(candidates.begin(), candidates.end(), [](const auto& l, const auto& r) { return l.second < r.second; });
+
+        midpoints.clear();
+        for (const auto& [score, i] : candidates) {
+            midpoints.push_back(0.5 * (curve.x[i] + curve.x[i + 1]));
+        }
+        values.resize(midpoints.size());
+        evaluate(f, midpoints, values);
+        ++curve.rounds;
+
+        // Merge: midpoint k goes right after the left end of its interval
+        SampledCurve merged;
+        merged.x.reserve(curve.x.size() + midpoints.size());
+        merged.y.reserve(curve.x.size() + midpoints.size());
+        size_t next = 0;
+        for (size_t i = 0; i < curve.x.size(); ++i) {
+            merged.x.push_back(curve.x[i]);
+            merged.y.push_back(curve.y[i]);
+            if (next < candidates.size() && candidates[next].second == i) {
+                merged.x.push_back(midpoints[next]);
+                merged.y.push_back(values[next]);
+                ++next;
+            }
+        }
+        merged.rounds = curve.rounds;
+        curve = std::move(merged);
+    }
+    return curve;
+}
+
+SampledCurve plot(Evaluator& eval, const ASTNode& expression, const std::string& variable,
+    double a, double b, const SamplingOptions& options) {
+    std::optional<Program> program;
+    try {
+        program = eval.compile(expression, { variable });
+    }
+    catch (const std::exception&) {
+    }
+
+    BatchFunction f;
+    std::unordered_map<std::string, double> scope;
+    if (program) {
+        auto workspace = program->workspace<double>();
+        f = [&program, workspace](std::span<const double> points, std::span<double> results) mutable {
+            const double* column = points.data();
+            double* output = results.data();
+            try {
+                program->runBatch<double>({ &column, 1 }, { &output, 1 }, points.size(), workspace);
+            }
+            catch (const std::runtime_error&) {
+                // Some row is outside the domain; find which ones, one row at a time
+                for (size_t i = 0; i < points.size(); ++i) {
+                    try {
+                        program->run<double>(points.subspan(i, 1), results.subspan(i, 1), workspace);
+                    }
+                    catch (const std::runtime_error&) {
+                        results[i] = s_nan;
+                    }
+                }
+            }
+        };
+    }
+    else {
+        f = [&](std::span<const double> points, std::span<double> results) {
+            for (size_t i = 0; i < points.size(); ++i) {
+                scope[variable] = points[i];
+                try {
+                    results[i] = eval.evaluate(expression, &scope);
+                }
+                catch (const std::runtime_error&) {
+                    results[i] = s_nan;
+                }
+            }
+        };
+    }
+    return sampleAdaptive(f, a, b, options);
+}
+
+void writeCsv(std::ostream& out, const SampledCurve& curve) {
+    auto precision = out.precision(std::numeric_limits<double>::max_digits10);
+    out << "x,y\n";
+    for (size_t i = 0; i < curve.x.size(); ++i) {
+        out << curve.x[i] << ',' << curve.y[i] << '\n';
+    }
+    out.precision(precision);
+}
+
+void writeBinary(std::ostream& out, const SampledCurve& curve) {
+    uint64_t count = curve.x.size();
+    out.write("MCPLOT01", 8);
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(curve.x.data()), static_cast<std::streamsize>(count * sizeof(double)));
+    out.write(reinterpret_cast<const char*>(curve.y.data()), static_cast<std::streamsize>(count * sizeof(double)));
+}
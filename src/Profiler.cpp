@@ -0,0 +1,150 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+Profiler::Profiler() {
+    clear();
+}
+
+size_t Profiler::child(std::string label) {
+    auto [it, inserted] = m_frames[m_current].children.try_emplace(std::move(label), m_frames.size());
+    if (inserted) {
+        m_frames.push_back({ it->first, m_current });
+    }
+    return it->second;
+}
+
+uint64_t Profiler::exclusive(size_t frame) const {
+    uint64_t nested = 0;
+    for (const auto& [label, index] : m_frames[frame].children) {
+        nested += m_frames[index].inclusiveNanos;
+    }
+    // Clock granularity can make children add up to slightly more than their parent
+    return m_frames[frame].inclusiveNanos > nested ? m_frames[frame].inclusiveNanos - nested : 0;
+}
+
+void Profiler::enter(const ASTNode& node) {
+    std::string name = label(node);
+    if (!m_scopes.empty()) {
+        name = m_scopes.back() + ':' + name;
+    }
+    m_current = child(std::move(name));
+    ++m_frames[m_current].calls;
+    m_open.emplace_back(m_current, Clock::now());
+}
+
+void Profiler::leave() {
+    if (m_open.empty()) {
+        throw std::logic_error("Profiler::leave without enter");
+    }
+    auto [frame, started] = m_open.back();
+    m_open.pop_back();
+    m_frames[frame].inclusiveNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count();
+    m_current = m_frames[frame].parent;
+}
+
+void Profiler::pushScope(const std::string& function) {
+    m_scopes.push_back(function);
+}
+
+void Profiler::popScope() {
+    m_scopes.pop_back();
+}
+
+void Profiler::record(std::string label, uint64_t calls, uint64_t nanos) {
+    if (!m_scopes.empty()) {
+        label = m_scopes.back() + ':' + label;
+    }
+    auto& frame = m_frames[child(std::move(label))];
+    frame.calls += calls;
+    frame.inclusiveNanos += nanos;
+}
+
+void Profiler::record(const Program& program, std::span<const uint64_t> instructionNanos, uint64_t rows) {
+    std::map<std::string, uint64_t> grouped;
+    for (size_t i = 0; i < instructionNanos.size(); ++i) {
+        OpCode op = program.code()[i].m_op;
+        if (op == OpCode::Const || op == OpCode::Input) {
+            continue;
+        }
+        std::ostringstream name;
+        if (!program.function(i).empty()) {
+            name << program.function(i) << ':';
+        }
+        name << Program::opName(op) << '@' << program.positions()[i];
+        grouped[name.str()] += instructionNanos[i];
+    }
+    for (auto& [name, nanos] : grouped) {
+        record(name, rows, nanos);
+    }
+}
+
+std::vector<ProfileEntry> Profiler::entries() const {
+    std::unordered_map<std::string, ProfileEntry> byLabel;
+    // Depth-first walk keeping the labels on the current path, so recursion isn't counted twice
+    std::unordered_map<std::string, size_t> onPath;
+    auto visit = [&](auto& self, size_t index) -> void {
+        const Frame& frame = m_frames[index];
+        auto& entry = byLabel[frame.label];
+        entry.label = frame.label;
+        entry.calls += frame.calls;
+        entry.exclusiveNanos += exclusive(index);
+        if (onPath[frame.label]++ == 0) {
+            entry.inclusiveNanos += frame.inclusiveNanos;
+        }
+        for (const auto& [label, child] : frame.children) {
+            self(self, child);
+        }
+        --onPath[frame.label];
+    };
+    for (const auto& [label, index] : m_frames[0].children) {
+        visit(visit, index);
+    }
+
+    std::vector<ProfileEntry> result;
+    for (auto& [label, entry] : byLabel) {
+        result.push_back(std::move(entry));
+    }
+    std::sort(result.begin(), result.end(), [](const ProfileEntry& l, const ProfileEntry& r) {
+        return l.exclusiveNanos != r.exclusiveNanos ? l.exclusiveNanos > r.exclusiveNanos : l.label < r.label;
+    });
+    return result;
+}
+
+void Profiler::writeCollapsed(std::ostream& out) const {
+    auto visit = [&](auto& self, size_t index, const std::string& stack) -> void {
+        const Frame& frame = m_frames[index];
+        std::string path = stack.empty() ? frame.label : stack + ';' + frame.label;
+        if (uint64_t nanos = exclusive(index)) {
+            out << path << ' ' << nanos << '\n';
+        }
+        for (const auto& [label, child] : frame.children) {
+            self(self, child, path);
+        }
+    };
+    for (const auto& [label, index] : m_frames[0].children) {
+        visit(visit, index, "");
+    }
+}
+
+void Profiler::clear() {
+    m_frames.assign(1, Frame{});
+    m_open.clear();
+    m_scopes.clear();
+    m_current = 0;
+}
+
+std::string Profiler::label(const ASTNode& node) {
+    std::ostringstream out;
+    switch (node.m_type) {
+    case NodeType::Number: out << node.getValue<double>(); break;
+    case NodeType::Variable:
+    case NodeType::Function: out << node.getValue<std::string>(); break;
+    case NodeType::Operator: out << node.getValue<OperatorType>(); break;
+    case NodeType::Array: out << "[]"; break;
+    }
+    out << '@' << node.m_position;
+    return out.str();
+}
@@ -0,0 +1,551 @@
+#include "Program.h"
+#include "Random.h"
+#include "SpecialFunctions.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace {
+    template<typename T, typename F>
+    void unaryLanes(T* dst, const T* arg, size_t count, F f) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = f(arg[i]);
+        }
+    }
+
+    template<typename T, typename F>
+    void binaryLanes(T* dst, const T* lhs, const T* rhs, size_t count, F f) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = f(lhs[i], rhs[i]);
+        }
+    }
+
+    // The special functions are double precision only
+    template<typename T, double (*F)(double)>
+    T viaDouble(T x) {
+        return static_cast<T>(F(static_cast<double>(x)));
+    }
+
+    template<typename T, double (*F)(double, double)>
+    T viaDouble(T x, T y) {
+        return static_cast<T>(F(static_cast<double>(x), static_cast<double>(y)));
+    }
+
+    // Below Accuracy::Strict, sin, cos, tan, exp, log and log10 run FastMath's double
+    // kernels over the whole block; long double keeps the C library's precision
+    template<typename T>
+    bool useKernels(Accuracy accuracy) {
+        return accuracy != Accuracy::Strict && !std::is_same_v<T, long double>;
+    }
+
+    template<typename T>
+    void kernelLanes(fastmath::Function function, Accuracy accuracy, T* dst, const T* arg, size_t count) {
+        if constexpr (std::is_same_v<T, double>) {
+            fastmath::apply(function, accuracy, std::span(arg, count), dst);
+        }
+        else {
+            std::array<double, Program::s_blockSize> wide;
+            std::copy_n(arg, count, wide.begin());
+            fastmath::apply(function, accuracy, std::span(wide.data(), count), wide.data());
+            std::copy_n(wide.begin(), count, dst);
+        }
+    }
+
+    // The kernels give NaN for log of x <= 0; programs fail there as the interpreter does
+    template<typename T>
+    void requirePositive(const T* arg, size_t count, const char* message) {
+        bool nonPositive = false;
+        for (size_t i = 0; i < count; ++i) {
+            nonPositive |= arg[i] <= 0;
+        }
+        if (nonPositive) {
+            throw std::runtime_error(message);
+        }
+    }
+
+    // Pairs up terms, then pairs of pairs with x^2, x^4, ...: a dependency chain of
+    // about 2 log2(degree) operations instead of Horner's 2 degree
+    template<typename T>
+    T estrin(const T* c, size_t degree, T x) {
+        std::array<T, Program::s_maxPolynomialDegree / 2 + 1> terms;
+        size_t count = degree + 1;
+        for (size_t j = 0; j < count / 2; ++j) {
+            terms[j] = c[2 * j] + c[2 * j + 1] * x;
+        }
+        if (count & 1) {
+            terms[count / 2] = c[count - 1];
+        }
+        count = (count + 1) / 2;
+        T power = x * x;
+        while (count > 1) {
+            for (size_t j = 0; j < count / 2; ++j) {
+                terms[j] = terms[2 * j] + terms[2 * j + 1] * power;
+            }
+            if (count & 1) {
+                terms[count / 2] = terms[count - 1];
+            }
+            count = (count + 1) / 2;
+            power *= power;
+        }
+        return terms[0];
+    }
+
+    // Native calls take doubles; other types are converted row by row. Arguments are
+    // gathered first since dst may share a register with one of them.
+    template<typename T, typename Registers>
+    void callLanes(T* dst, const NativeCall& call, Registers reg, size_t count) {
+        constexpr size_t s_stackArguments = 8;
+        const NativeFunction& native = *call.function;
+        size_t arity = call.args.size();
+        if constexpr (std::is_same_v<T, double>) {
+            if (native.batch) {
+                std::array<const double*, s_stackArguments> small;
+                std::vector<const double*> large(arity > s_stackArguments ? arity : 0);
+                std::span<const double*> columns = arity > s_stackArguments ? std::span(large) : std::span(small).first(arity);
+                for (size_t j = 0; j < arity; ++j) {
+                    columns[j] = reg(call.args[j]);
+                }
+                std::array<double, Program::s_blockSize> results;
+                native.batch(columns, results.data(), count);
+                std::copy_n(results.begin(), count, dst);
+                return;
+            }
+        }
+        std::array<double, s_stackArguments> small;
+        std::vector<double> large(arity > s_stackArguments ? arity : 0);
+        std::span<double> row = arity > s_stackArguments ? std::span(large) : std::span(small).first(arity);
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t j = 0; j < arity; ++j) {
+                row[j] = static_cast<double>(reg(call.args[j])[i]);
+            }
+            dst[i] = static_cast<T>(native.scalar(row));
+        }
+    }
+
+    template<typename T>
+    void randomLanes(rng::Distribution distribution, uint64_t seed, uint64_t row, uint32_t site, T* dst, size_t count) {
+        if constexpr (std::is_same_v<T, double>) {
+            rng::fill(distribution, seed, row, site, dst, count);
+        }
+        else {
+            std::array<double, Program::s_blockSize> wide;
+            rng::fill(distribution, seed, row, site, wide.data(), count);
+            std::copy_n(wide.begin(), count, dst);
+        }
+    }
+
+    // The operations Evaluator applies to int64 operands that can give an integer double
+    // rounds. Negation and remainders are exact in both; 20! and below are exact doubles.
+    bool combinesIntegers(OpCode op) {
+        switch (op) {
+        case OpCode::Add: case OpCode::Subtract: case OpCode::Multiply:
+        case OpCode::Divide: case OpCode::IntDivide: case OpCode::Power:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool isInteger(double x) {
+        return std::trunc(x) == x;
+    }
+
+    // Whether some row of an integer operation came to an integer in [2^53, 2^63], where
+    // Evaluator's exact int64 result may differ from the double one. dst may share a register
+    // with an operand, which then counts as an integer: a false alarm, never a missed one.
+    bool roundsIntegers(const double* dst, const double* lhs, const double* rhs, size_t count) {
+        constexpr double twoPow53 = 9007199254740992.0;
+        constexpr double twoPow63 = 9223372036854775808.0;
+        bool large = false;
+        for (size_t i = 0; i < count; ++i) {
+            large |= std::abs(dst[i]) >= twoPow53;
+        }
+        if (!large) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            double magnitude = std::abs(dst[i]);
+            if (magnitude >= twoPow53 && magnitude <= twoPow63 && isInteger(lhs[i]) && isInteger(rhs[i])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<typename T>
+    std::vector<T> convertConstants(const std::vector<double>& constants) {
+        return std::vector<T>(constants.begin(), constants.end());
+    }
+
+}
+
+template<typename T>
+ProgramWorkspace<T> Program::workspace(size_t maxRows) const {
+    ProgramWorkspace<T> result;
+    result.constants = convertConstants<T>(m_constants);
+    result.stride = std::clamp<size_t>(maxRows, 1, s_blockSize);
+    result.registers.resize(static_cast<size_t>(m_registerCount) * result.stride);
+    result.columns.resize(m_inputCount);
+    return result;
+}
+
+template<typename T>
+T Program::run(std::span<const std::type_identity_t<T>> inputs) const {
+    if (m_outputs.size() != 1) {
+        throw std::invalid_argument("Program has " + std::to_string(m_outputs.size()) + " outputs");
+    }
+    T result{};
+    run<T>(inputs, std::span<T>(&result, 1));
+    return result;
+}
+
+template<typename T>
+void Program::run(std::span<const std::type_identity_t<T>> inputs, std::span<std::type_identity_t<T>> outputs) const {
+    auto scratch = workspace<T>(1);
+    run(inputs, outputs, scratch);
+}
+
+template<typename T>
+void Program::run(std::span<const std::type_identity_t<T>> inputs, std::span<std::type_identity_t<T>> outputs,
+    ProgramWorkspace<T>& workspace) const {
+    if (inputs.size() != m_inputCount) {
+        throw std::invalid_argument("Program expects " + std::to_string(m_inputCount) + " inputs");
+    }
+    if (outputs.size() != m_outputs.size()) {
+        throw std::invalid_argument("Program has " + std::to_string(m_outputs.size()) + " outputs");
+    }
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        workspace.columns[i] = &inputs[i];
+    }
+    runBlock<T>(workspace.columns, workspace.constants, workspace.firstRow, 0, 1, workspace.registers.data(), workspace.stride,
+        workspace.checkIntegers ? &workspace.roundedIntegers : nullptr);
+    for (size_t i = 0; i < m_outputs.size(); ++i) {
+        outputs[i] = workspace.registers[m_outputs[i] * workspace.stride];
+    }
+}
+
+template<typename T>
+void Program::runBatch(std::span<const std::type_identity_t<T>* const> inputs, std::type_identity_t<T>* output, size_t rows) const {
+    if (m_outputs.size() != 1) {
+        throw std::invalid_argument("Program has " + std::to_string(m_outputs.size()) + " outputs");
+    }
+    runBatch<T>(inputs, std::span<T* const>(&output, 1), rows);
+}
+
+template<typename T>
+void Program::runBatch(std::span<const std::type_identity_t<T>* const> inputs, std::span<std::type_identity_t<T>* const> outputs, size_t rows) const {
+    auto scratch = workspace<T>(rows);
+    runBatch(inputs, outputs, rows, scratch);
+}
+
+template<typename T>
+void Program::runBatch(std::span<const std::type_identity_t<T>* const> inputs, std::span<std::type_identity_t<T>* const> outputs, size_t rows,
+    ProgramWorkspace<T>& workspace) const {
+    if (inputs.size() != m_inputCount) {
+        throw std::invalid_argument("Program expects " + std::to_string(m_inputCount) + " input columns");
+    }
+    if (outputs.size() != m_outputs.size()) {
+        throw std::invalid_argument("Program has " + std::to_string(m_outputs.size()) + " outputs");
+    }
+    size_t stride = workspace.stride;
+    for (size_t offset = 0; offset < rows; offset += stride) {
+        size_t count = std::min(stride, rows - offset);
+        runBlock<T>(inputs, workspace.constants, workspace.firstRow, offset, count, workspace.registers.data(), stride,
+            workspace.checkIntegers ? &workspace.roundedIntegers : nullptr);
+        for (size_t i = 0; i < m_outputs.size(); ++i) {
+            std::copy_n(workspace.registers.data() + static_cast<size_t>(m_outputs[i]) * stride, count, outputs[i] + offset);
+        }
+    }
+}
+
+std::string_view Program::opName(OpCode op) {
+    static constexpr std::array<std::string_view, 50> s_names = {
+        "Const", "Input",
+        "Negate", "Add", "Subtract", "Multiply", "Divide", "IntDivide", "Power", "Mod", "Factorial",
+        "Sin", "Cos", "Tan", "Asin", "Acos", "Atan", "Atan2",
+        "Exp", "Sqrt", "Log", "Log10",
+        "Abs", "Floor", "Ceil", "Round", "Min", "Max",
+        "Less", "LessEqual", "Greater", "GreaterEqual", "Equal", "NotEqual", "And", "Or", "Select",
+        "Gamma", "Lgamma", "Lfact", "NCr", "NPr",
+        "Reciprocal", "PowHalf", "Fma",
+        "Horner", "Estrin",
+        "Call",
+        "Random", "RandomNormal"
+    };
+    return s_names[static_cast<size_t>(op)];
+}
+
+bool Program::profileBatch(std::span<const double* const> inputs, std::span<double* const> outputs, size_t rows,
+    std::span<uint64_t> instructionNanos, uint64_t firstRow) const {
+    if (inputs.size() != m_inputCount || outputs.size() != m_outputs.size() || instructionNanos.size() != m_code.size()) {
+        throw std::invalid_argument("Program profile arguments don't match the program");
+    }
+    auto workspace = this->workspace<double>(rows);
+    workspace.firstRow = firstRow;
+    size_t stride = workspace.stride;
+    for (size_t offset = 0; offset < rows; offset += stride) {
+        size_t count = std::min(stride, rows - offset);
+        runBlock<double>(inputs, workspace.constants, workspace.firstRow, offset, count, workspace.registers.data(), stride,
+            &workspace.roundedIntegers, instructionNanos.data());
+        for (size_t i = 0; i < m_outputs.size(); ++i) {
+            std::copy_n(workspace.registers.data() + static_cast<size_t>(m_outputs[i]) * stride, count, outputs[i] + offset);
+        }
+    }
+    return workspace.roundedIntegers;
+}
+
+template<typename T>
+void Program::runBlock(std::span<const T* const> inputs, std::span<const T> constants, uint64_t firstRow,
+    size_t offset, size_t count, T* registers, size_t stride, bool* roundedIntegers, uint64_t* instructionNanos) const {
+    auto reg = [&](uint32_t r) { return registers + static_cast<size_t>(r) * stride; };
+
+    std::chrono::steady_clock::time_point started;
+    for (size_t index = 0; index < m_code.size(); ++index) {
+        const auto& ins = m_code[index];
+        if (instructionNanos) {
+            if (index > 0) {
+                auto now = std::chrono::steady_clock::now();
+                instructionNanos[index - 1] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - started).count();
+                started = now;
+            }
+            else {
+                started = std::chrono::steady_clock::now();
+            }
+        }
+        T* dst = reg(ins.m_dst);
+        if (ins.m_op == OpCode::Const) {
+            std::fill_n(dst, count, constants[ins.m_lhs]);
+            continue;
+        }
+        if (ins.m_op == OpCode::Input) {
+            std::copy_n(inputs[ins.m_lhs] + offset, count, dst);
+            continue;
+        }
+        if (ins.m_op == OpCode::Random || ins.m_op == OpCode::RandomNormal) {
+            auto distribution = ins.m_op == OpCode::Random ? rng::Distribution::Uniform : rng::Distribution::Normal;
+            randomLanes(distribution, m_options.seed, firstRow + offset, ins.m_lhs, dst, count);
+            continue;
+        }
+        if (ins.m_guard == Instruction::s_unguarded) {
+            execute<T>(ins, constants, registers, stride, 0, count);
+        }
+        else {
+            try {
+                execute<T>(ins, constants, registers, stride, 0, count);
+            }
+            catch (const std::exception&) {
+                // Some row failed: redo the block row by row, failing only if the guard selects
+                // that row. The compiler keeps guarded instructions' operands out of dst.
+                const T* guard = reg(ins.m_guard);
+                for (size_t i = 0; i < count; ++i) {
+                    if (guard[i] != 0) {
+                        execute<T>(ins, constants, registers, stride, i, 1);
+                    }
+                    else {
+                        dst[i] = std::numeric_limits<T>::quiet_NaN();
+                    }
+                }
+            }
+        }
+        if constexpr (std::is_same_v<T, double>) {
+            if (roundedIntegers && !*roundedIntegers && combinesIntegers(ins.m_op)) {
+                *roundedIntegers = roundsIntegers(dst, reg(ins.m_lhs), reg(ins.m_rhs), count);
+            }
+        }
+    }
+    if (instructionNanos && !m_code.empty()) {
+        instructionNanos[m_code.size() - 1] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started).count();
+    }
+}
+
+template<typename T>
+void Program::execute(const Instruction& ins, std::span<const T> constants, T* registers, size_t stride,
+    size_t lane, size_t count) const {
+    auto reg = [&](uint32_t r) { return registers + static_cast<size_t>(r) * stride + lane; };
+    T* dst = reg(ins.m_dst);
+    const T* a = reg(ins.m_lhs);
+    const T* b = reg(ins.m_rhs);
+    switch (ins.m_op) {
+    case OpCode::Negate: unaryLanes(dst, a, count, [](T x) { return -x; }); break;
+    case OpCode::Add: binaryLanes(dst, a, b, count, [](T x, T y) { return x + y; }); break;
+    case OpCode::Subtract: binaryLanes(dst, a, b, count, [](T x, T y) { return x - y; }); break;
+    case OpCode::Multiply: binaryLanes(dst, a, b, count, [](T x, T y) { return x * y; }); break;
+    case OpCode::Divide:
+        binaryLanes(dst, a, b, count, [](T x, T y) {
+            if (y == 0) throw std::runtime_error("Division by zero");
+            return x / y;
+            });
+        break;
+    case OpCode::IntDivide:
+        binaryLanes(dst, a, b, count, [](T x, T y) {
+            if (y == 0) throw std::runtime_error("Division by zero");
+            return std::floor(x / y);
+            });
+        break;
+    case OpCode::Power: binaryLanes(dst, a, b, count, [](T x, T y) { return std::pow(x, y); }); break;
+    case OpCode::Reciprocal: unaryLanes(dst, a, count, [](T x) { return T(1) / x; }); break;
+    case OpCode::PowHalf:
+        // std::pow(x, 0.5) is +0 at -0 and +inf at -inf, where sqrt gives -0 and NaN
+        unaryLanes(dst, a, count, [](T x) { return std::isinf(x) ? std::abs(x) : std::sqrt(x) + T(0); });
+        break;
+    case OpCode::Horner: {
+        // Coefficient-major, so each step is one vectorisable pass over the block's rows;
+        // a separate accumulator because dst may share a register with x
+        const T* c = constants.data() + ins.m_rhs;
+        std::array<T, s_blockSize> acc;
+        std::fill_n(acc.begin(), count, c[ins.m_addend]);
+        for (size_t k = ins.m_addend; k-- > 0;) {
+            for (size_t i = 0; i < count; ++i) {
+                acc[i] = acc[i] * a[i] + c[k];
+            }
+        }
+        std::copy_n(acc.begin(), count, dst);
+        break;
+    }
+    case OpCode::Estrin: {
+        const T* c = constants.data() + ins.m_rhs;
+        unaryLanes(dst, a, count, [&](T x) { return estrin(c, ins.m_addend, x); });
+        break;
+    }
+    case OpCode::Call: callLanes(dst, m_calls[ins.m_lhs], reg, count); break;
+    case OpCode::Fma: {
+        const T* c = reg(ins.m_addend);
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = std::fma(a[i], b[i], c[i]);
+        }
+        break;
+    }
+    case OpCode::Mod:
+        binaryLanes(dst, a, b, count, [](T x, T y) {
+            // As the interpreter: truncate, then the remainder has the dividend's sign
+            T divisor = std::trunc(y);
+            if (divisor == 0) throw std::runtime_error("Division by zero");
+            return std::fmod(std::trunc(x), divisor);
+            });
+        break;
+    case OpCode::Factorial: unaryLanes(dst, a, count, viaDouble<T, special::factorial>); break;
+    case OpCode::Gamma: unaryLanes(dst, a, count, viaDouble<T, special::gamma>); break;
+    case OpCode::Lgamma: unaryLanes(dst, a, count, viaDouble<T, special::lgamma>); break;
+    case OpCode::Lfact: unaryLanes(dst, a, count, viaDouble<T, special::lfact>); break;
+    case OpCode::NCr: binaryLanes(dst, a, b, count, viaDouble<T, special::nCr>); break;
+    case OpCode::NPr: binaryLanes(dst, a, b, count, viaDouble<T, special::nPr>); break;
+    case OpCode::Sin:
+        if (useKernels<T>(m_options.accuracy)) {
+            kernelLanes(fastmath::Function::Sin, m_options.accuracy, dst, a, count);
+            break;
+        }
+        unaryLanes(dst, a, count, [](T x) { return std::sin(x); });
+        break;
+    case OpCode::Cos:
+        if (useKernels<T>(m_options.accuracy)) {
+            kernelLanes(fastmath::Function::Cos, m_options.accuracy, dst, a, count);
+            break;
+        }
+        unaryLanes(dst, a, count, [](T x) { return std::cos(x); });
+        break;
+    case OpCode::Tan:
+        // cos of a double is never 0, and neither is the kernels' divisor: only the
+        // C library path checks
+        if (useKernels<T>(m_options.accuracy)) {
+            kernelLanes(fastmath::Function::Tan, m_options.accuracy, dst, a, count);
+            break;
+        }
+        unaryLanes(dst, a, count, [](T x) {
+            if (std::cos(x) == 0) throw std::runtime_error("tan undefined at pi/2 + k*pi");
+            return std::tan(x);
+            });
+        break;
+    case OpCode::Asin:
+        unaryLanes(dst, a, count, [](T x) {
+            if (x < -1.0 || x > 1.0) throw std::runtime_error("asin requires argument in [-1, 1]");
+            return std::asin(x);
+            });
+        break;
+    case OpCode::Acos:
+        unaryLanes(dst, a, count, [](T x) {
+            if (x < -1.0 || x > 1.0) throw std::runtime_error("acos requires argument in [-1, 1]");
+            return std::acos(x);
+            });
+        break;
+    case OpCode::Atan: unaryLanes(dst, a, count, [](T x) { return std::atan(x); }); break;
+    case OpCode::Atan2: binaryLanes(dst, a, b, count, [](T y, T x) { return std::atan2(y, x); }); break;
+    case OpCode::Exp:
+        if (useKernels<T>(m_options.accuracy)) {
+            kernelLanes(fastmath::Function::Exp, m_options.accuracy, dst, a, count);
+            break;
+        }
+        unaryLanes(dst, a, count, [](T x) { return std::exp(x); });
+        break;
+    case OpCode::Sqrt:
+        unaryLanes(dst, a, count, [](T x) {
+            if (x < 0) throw std::runtime_error("sqrt requires non-negative argument");
+            return std::sqrt(x);
+            });
+        break;
+    case OpCode::Log:
+        if (useKernels<T>(m_options.accuracy)) {
+            requirePositive(a, count, "log requires positive argument");
+            kernelLanes(fastmath::Function::Log, m_options.accuracy, dst, a, count);
+            break;
+        }
+        unaryLanes(dst, a, count, [](T x) {
+            if (x <= 0) throw std::runtime_error("log requires positive argument");
+            return std::log(x);
+            });
+        break;
+    case OpCode::Log10:
+        if (useKernels<T>(m_options.accuracy)) {
+            requirePositive(a, count, "log10 requires positive argument");
+            kernelLanes(fastmath::Function::Log10, m_options.accuracy, dst, a, count);
+            break;
+        }
+        unaryLanes(dst, a, count, [](T x) {
+            if (x <= 0) throw std::runtime_error("log10 requires positive argument");
+            return std::log10(x);
+            });
+        break;
+    case OpCode::Abs: unaryLanes(dst, a, count, [](T x) { return std::abs(x); }); break;
+    case OpCode::Floor: unaryLanes(dst, a, count, [](T x) { return std::floor(x); }); break;
+    case OpCode::Ceil: unaryLanes(dst, a, count, [](T x) { return std::ceil(x); }); break;
+    case OpCode::Round: unaryLanes(dst, a, count, [](T x) { return std::round(x); }); break;
+    // std::min/max semantics: the first argument wins ties and NaN comparisons
+    case OpCode::Min: binaryLanes(dst, a, b, count, [](T x, T y) { return y < x ? y : x; }); break;
+    case OpCode::Max: binaryLanes(dst, a, b, count, [](T x, T y) { return x < y ? y : x; }); break;
+    // Selects rather than branches, so the loops vectorise to compares and blends
+    case OpCode::Less: binaryLanes(dst, a, b, count, [](T x, T y) { return x < y ? T(1) : T(0); }); break;
+    case OpCode::LessEqual: binaryLanes(dst, a, b, count, [](T x, T y) { return x <= y ? T(1) : T(0); }); break;
+    case OpCode::Greater: binaryLanes(dst, a, b, count, [](T x, T y) { return x > y ? T(1) : T(0); }); break;
+    case OpCode::GreaterEqual: binaryLanes(dst, a, b, count, [](T x, T y) { return x >= y ? T(1) : T(0); }); break;
+    case OpCode::Equal: binaryLanes(dst, a, b, count, [](T x, T y) { return x == y ? T(1) : T(0); }); break;
+    case OpCode::NotEqual: binaryLanes(dst, a, b, count, [](T x, T y) { return x != y ? T(1) : T(0); }); break;
+    case OpCode::And: binaryLanes(dst, a, b, count, [](T x, T y) { return (x != 0) & (y != 0) ? T(1) : T(0); }); break;
+    case OpCode::Or: binaryLanes(dst, a, b, count, [](T x, T y) { return (x != 0) | (y != 0) ? T(1) : T(0); }); break;
+    case OpCode::Select: {
+        const T* c = reg(ins.m_addend);
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = a[i] != 0 ? b[i] : c[i];
+        }
+        break;
+    }
+    default: throw std::runtime_error("Unsupported instruction");
+    }
+}
+
+#define INSTANTIATE_PROGRAM(T) \
+    template ProgramWorkspace<T> Program::workspace<T>(size_t) const; \
+    template T Program::run<T>(std::span<const T>) const; \
+    template void Program::run<T>(std::span<const T>, std::span<T>) const; \
+    template void Program::run<T>(std::span<const T>, std::span<T>, ProgramWorkspace<T>&) const; \
+    template void Program::runBatch<T>(std::span<const T* const>, T*, size_t) const; \
+    template void Program::runBatch<T>(std::span<const T* const>, std::span<T* const>, size_t) const; \
+    template void Program::runBatch<T>(std::span<const T* const>, std::span<T* const>, size_t, ProgramWorkspace<T>&) const;
+
+INSTANTIATE_PROGRAM(float)
+INSTANTIATE_PROGRAM(double)
+INSTANTIATE_PROGRAM(long double)
@@ -0,0 +1,93 @@
+#include "Random.h"
+#include "FastMath.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numbers>
+#include <span>
+
+namespace {
+    // Multipliers and Weyl key increments of Philox4x32
+    constexpr uint32_t s_multiplier0 = 0xD2511F53;
+    constexpr uint32_t s_multiplier1 = 0xCD9E8D57;
+    constexpr uint32_t s_weyl0 = 0x9E3779B9;
+    constexpr uint32_t s_weyl1 = 0xBB67AE85;
+    constexpr int s_rounds = 10;
+    constexpr size_t s_lanes = 256;
+    constexpr uint64_t s_one = 0x3FF0000000000000; // Bits of 1.0
+
+    struct Words {
+        uint32_t c0, c1, c2, c3;
+    };
+
+    // Branch-free 32x32 -> 64 bit products, xors and adds, so a loop over rows vectorises
+    inline Words rounds(Words c, uint32_t k0, uint32_t k1) {
+        for (int round = 0; round < s_rounds; ++round) {
+            uint64_t p0 = static_cast<uint64_t>(s_multiplier0) * c.c0;
+            uint64_t p1 = static_cast<uint64_t>(s_multiplier1) * c.c2;
+            c = { static_cast<uint32_t>(p1 >> 32) ^ c.c1 ^ k0, static_cast<uint32_t>(p1),
+                static_cast<uint32_t>(p0 >> 32) ^ c.c3 ^ k1, static_cast<uint32_t>(p0) };
+            k0 += s_weyl0;
+            k1 += s_weyl1;
+        }
+        return c;
+    }
+
+    // [1, 2) from the top 52 bits of a 64-bit word: exact, and vectorises where an
+    // integer to double conversion doesn't
+    inline double oneToTwo(uint64_t word) {
+        return std::bit_cast<double>(s_one | (word >> 12));
+    }
+
+    // Up to s_lanes rows; the two 64-bit halves of each row's block go to `low` and `high`
+    void blocks(uint64_t seed, uint64_t firstRow, uint32_t site, size_t count, uint64_t* low, uint64_t* high) {
+        auto k0 = static_cast<uint32_t>(seed);
+        auto k1 = static_cast<uint32_t>(seed >> 32);
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t row = firstRow + i;
+            Words c = rounds({ static_cast<uint32_t>(row), static_cast<uint32_t>(row >> 32), site, 0 }, k0, k1);
+            low[i] = static_cast<uint64_t>(c.c0) << 32 | c.c1;
+            high[i] = static_cast<uint64_t>(c.c2) << 32 | c.c3;
+        }
+    }
+
+    void fillLanes(rng::Distribution distribution, uint64_t seed, uint64_t firstRow, uint32_t site, double* out, size_t count) {
+        std::array<uint64_t, s_lanes> low, high;
+        blocks(seed, firstRow, site, count, low.data(), high.data());
+        if (distribution == rng::Distribution::Uniform) {
+            for (size_t i = 0; i < count; ++i) {
+                out[i] = oneToTwo(low[i]) - 1.0;
+            }
+            return;
+        }
+        // Box-Muller, keeping the cosine half: u in (0, 1] so the logarithm is finite, and
+        // the kernels rather than the C library, so the values are the same everywhere
+        std::array<double, s_lanes> radius, angle;
+        for (size_t i = 0; i < count; ++i) {
+            radius[i] = 2.0 - oneToTwo(low[i]);
+            angle[i] = 2 * std::numbers::pi * (oneToTwo(high[i]) - 1.0);
+        }
+        fastmath::apply(fastmath::Function::Log, Accuracy::Ulp, std::span(radius.data(), count), radius.data());
+        fastmath::apply(fastmath::Function::Cos, Accuracy::Ulp, std::span(angle.data(), count), angle.data());
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = std::sqrt(-2.0 * radius[i]) * angle[i];
+        }
+    }
+}
+
+std::array<uint32_t, 4> rng::philox(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key) {
+    Words c = rounds({ counter[0], counter[1], counter[2], counter[3] }, key[0], key[1]);
+    return { c.c0, c.c1, c.c2, c.c3 };
+}
+
+void rng::fill(Distribution distribution, uint64_t seed, uint64_t firstRow, uint32_t site, double* out, size_t count) {
+    for (size_t offset = 0; offset < count; offset += s_lanes) {
+        fillLanes(distribution, seed, firstRow + offset, site, out + offset, std::min(s_lanes, count - offset));
+    }
+}
+
+double rng::draw(Distribution distribution, uint64_t seed, uint64_t row, uint32_t site) {
+    double value;
+    fillLanes(distribution, seed, row, site, &value, 1);
+    return value;
+}
@@ -0,0 +1,206 @@
+#include "Reduction.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    constexpr size_t s_blockSize = 4096;
+
+    // Neumaier's variant of Kahan summation, so large terms don't swallow small ones
+    double compensatedSum(std::span<const double> values) {
+        double sum = 0.0;
+        double compensation = 0.0;
+        for (double v : values) {
+            double t = sum + v;
+            if (std::abs(sum) >= std::abs(v)) {
+                compensation += (sum - t) + v;
+            }
+            else {
+                compensation += (v - t) + sum;
+            }
+            sum = t;
+        }
+        return sum + compensation;
+    }
+
+    double pairwiseCombine(ReductionKind kind, std::span<const double> values) {
+        if (values.empty()) {
+            return kind == ReductionKind::Sum ? 0.0 : 1.0;
+        }
+        if (values.size() == 1) {
+            return values[0];
+        }
+        size_t half = values.size() / 2;
+        double lhs = pairwiseCombine(kind, values.first(half));
+        double rhs = pairwiseCombine(kind, values.subspan(half));
+        return kind == ReductionKind::Sum ? lhs + rhs : lhs * rhs;
+    }
+
+    // 15-point Kronrod nodes on [-1, 1] (positive half, descending) and weights;
+    // odd indices and the centre are the embedded 7-point Gauss nodes
+    constexpr std::array<double, 8> s_kronrodNodes = {
+        0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+        0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+        0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+        0.207784955007898467600689403773245, 0.0
+    };
+    constexpr std::array<double, 8> s_kronrodWeights = {
+        0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+        0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+        0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+        0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+    };
+    constexpr std::array<double, 4> s_gaussWeights = {
+        0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+        0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+    };
+    constexpr size_t s_pointsPerInterval = 15;
+
+    struct Interval {
+        double a{};
+        double b{};
+        double value{};
+        double error{};
+
+        bool operator<(const Interval& other) const {
+            return error < other.error;
+        }
+    };
+
+    void kronrodPoints(double a, double b, std::span<double> points) {
+        double centre = 0.5 * (a + b);
+        double halfLength = 0.5 * (b - a);
+        for (size_t j = 0; j < 7; ++j) {
+            points[2 * j] = centre - halfLength * s_kronrodNodes[j];
+            points[2 * j + 1] = centre + halfLength * s_kronrodNodes[j];
+        }
+        points[14] = centre;
+    }
+
+    Interval kronrodRule(double a, double b, std::span<const double> values) {
+        double halfLength = 0.5 * (b - a);
+        double kronrod = s_kronrodWeights[7] * values[14];
+        double gauss = s_gaussWeights[3] * values[14];
+        for (size_t j = 0; j < 7; ++j) {
+            double pair = values[2 * j] + values[2 * j + 1];
+            kronrod += s_kronrodWeights[j] * pair;
+            if (j % 2 == 1) {
+                gauss += s_gaussWeights[j / 2] * pair;
+            }
+        }
+        return { a, b, kronrod * halfLength, std::abs((kronrod - gauss) * halfLength) };
+    }
+}
+
+double reduceRange(ReductionKind kind, int64_t first, int64_t last, const BatchFunction& f, ThreadPool* pool) {
+    if (last < first) {
+        return kind == ReductionKind::Sum ? 0.0 : 1.0;
+    }
+    auto count = static_cast<uint64_t>(last - first) + 1;
+    size_t blocks = static_cast<size_t>((count + s_blockSize - 1) / s_blockSize);
+    std::vector<double> partials(blocks);
+
+    auto reduceBlock = [&](size_t block) {
+        uint64_t begin = block * s_blockSize;
+        size_t size = static_cast<size_t>(std::min<uint64_t>(s_blockSize, count - begin));
+        std::vector<double> points(size);
+        std::vector<double> results(size);
+        for (size_t k = 0; k < size; ++k) {
+            points[k] = static_cast<double>(first + static_cast<int64_t>(begin + k));
+        }
+        f(points, results);
+        if (kind == ReductionKind::Sum) {
+            partials[block] = compensatedSum(results);
+        }
+        else {
+            double product = 1.0;
+            for (double r : results) {
+                product *= r;
+            }
+            partials[block] = product;
+        }
+    };
+
+    if (pool && blocks > 1) {
+        pool->parallelFor(blocks, reduceBlock);
+    }
+    else {
+        for (size_t block = 0; block < blocks; ++block) {
+            reduceBlock(block);
+        }
+    }
+    return pairwiseCombine(kind, partials);
+}
+
+QuadratureResult integrate(const BatchFunction& f, double a, double b,
+    double absTolerance, double relTolerance, size_t maxIntervals) {
+    if (!std::isfinite(a) || !std::isfinite(b)) {
+        throw std::runtime_error("integrate requires finite bounds");
+    }
+    if (a == b) {
+        return { 0.0, 0.0, 0, true };
+    }
+    if (a > b) {
+        auto result = integrate(f, b, a, absTolerance, relTolerance, maxIntervals);
+        result.value = -result.value;
+        return result;
+    }
+
+    QuadratureResult result;
+    std::array<double, 2 * s_pointsPerInterval> points{};
+    std::array<double, 2 * s_pointsPerInterval> values{};
+
+    auto first = std::span(points).first(s_pointsPerInterval);
+    kronrodPoints(a, b, first);
+    f(first, std::span(values).first(s_pointsPerInterval));
+    result.evaluations += s_pointsPerInterval;
+
+    std::priority_queue<Interval> intervals;
+    intervals.push(kronrodRule(a, b, std::span(values).first(s_pointsPerInterval)));
+    double total = intervals.top().value;
+    double error = intervals.top().error;
+
+    while (error > std::max(absTolerance, relTolerance * std::abs(total)) && intervals.size() < maxIntervals) {
+        Interval worst = intervals.top();
+        double mid = 0.5 * (worst.a + worst.b);
+        if (mid <= worst.a || mid >= worst.b) {
+            break; // Interval can't be split any further in double precision
+        }
+        intervals.pop();
+
+        kronrodPoints(worst.a, mid, std::span(points).first(s_pointsPerInterval));
+        kronrodPoints(mid, worst.b, std::span(points).subspan(s_pointsPerInterval));
+        f(points, values);
+        result.evaluations += 2 * s_pointsPerInterval;
+
+        Interval left = kronrodRule(worst.a, mid, std::span(values).first(s_pointsPerInterval));
+        Interval right = kronrodRule(mid, worst.b, std::span(values).subspan(s_pointsPerInterval));
+        total += left.value + right.value - worst.value;
+        error += left.error + right.error - worst.error;
+        intervals.push(left);
+        intervals.push(right);
+    }
+
+    // Re-add from scratch in a fixed order; the running totals drift after many updates
+    std::vector<Interval> pieces;
+    pieces.reserve(intervals.size());
+    while (!intervals.empty()) {
+        pieces.push_back(intervals.top());
+        intervals.pop();
+    }
+    std::sort(pieces.begin(), pieces.end(), [](const Interval& l, const Interval& r) { return l.a < r.a; });
+    std::vector<double> pieceValues;
+    std::vector<double> pieceErrors;
+    for (const auto& piece : pieces) {
+        pieceValues.push_back(piece.value);
+        pieceErrors.push_back(piece.error);
+    }
+    result.value = compensatedSum(pieceValues);
+    result.error = compensatedSum(pieceErrors);
+    result.converged = result.error <= std::max(absTolerance, relTolerance * std::abs(result.value));
+    return result;
+}
@@ -0,0 +1,466 @@
+#include "Scan.h"
+#include "Columnar.h"
+#include "Evaluator.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    // Rows per task of a linear recurrence. Fixed rather than derived from the thread
+    // count, so the chunk boundaries, and with them the rounding, never change.
+    constexpr size_t s_chunkRows = 65536;
+    // Rows whose free parts are computed together before stepping through them
+    constexpr size_t s_stepRows = 4096;
+    constexpr double s_maxLag = 9007199254740992.0; // 2^53
+
+    // Names the formula can't spell (identifiers are letters only), used as program inputs
+    std::string prevName(const std::string& output) {
+        return "prev(" + output + ")";
+    }
+
+    std::string lagName(const std::string& input, size_t rows) {
+        return "lag(" + input + ", " + std::to_string(rows) + ")";
+    }
+
+    std::string partName(size_t part) {
+        return "#" + std::to_string(part);
+    }
+
+    bool contains(const ASTNode& node, const std::string& variable) {
+        if (node.m_type == NodeType::Variable && node.getValue<std::string>() == variable) {
+            return true;
+        }
+        return std::any_of(node.m_children.begin(), node.m_children.end(),
+            [&](const auto& child) { return contains(*child, variable); });
+    }
+
+    bool drawsRandom(const ASTNode& node) {
+        if (node.m_type == NodeType::Function && (node.getValue<std::string>() == "rand" || node.getValue<std::string>() == "randn")) {
+            return true;
+        }
+        return std::any_of(node.m_children.begin(), node.m_children.end(),
+            [](const auto& child) { return drawsRandom(*child); });
+    }
+
+    std::unique_ptr<ASTNode> variable(const std::string& name, size_t position) {
+        auto node = std::make_unique<ASTNode>(name, NodeType::Variable);
+        node->m_position = position;
+        return node;
+    }
+
+    // y -> slope * y + offset, as formulas of the row; nullptr stands for 0
+    struct Affine {
+        std::unique_ptr<ASTNode> slope;
+        std::unique_ptr<ASTNode> offset;
+    };
+
+    std::unique_ptr<ASTNode> combine(OperatorType op, std::unique_ptr<ASTNode> lhs, std::unique_ptr<ASTNode> rhs) {
+        if (!rhs) {
+            return lhs;
+        }
+        if (!lhs) {
+            if (op == OperatorType::Add) {
+                return rhs;
+            }
+            auto negated = std::make_unique<ASTNode>(OperatorType::UnaryMinus);
+            negated->appendChild(std::move(rhs));
+            return negated;
+        }
+        auto node = std::make_unique<ASTNode>(op);
+        node->appendChild(std::move(lhs));
+        node->appendChild(std::move(rhs));
+        return node;
+    }
+
+    bool isOne(const ASTNode* node) {
+        return node && node->m_type == NodeType::Number && node->getValue<double>() == 1.0;
+    }
+
+    // The formula as an affine function of the previous output, if it is one: sums,
+    // differences and negations of affine terms, and affine terms multiplied or divided
+    // by factors free of it
+    std::optional<Affine> affine(const ASTNode& node, const std::string& prev) {
+        if (!contains(node, prev)) {
+            return Affine{ nullptr, node.clone() };
+        }
+        if (node.m_type == NodeType::Variable) {
+            return Affine{ std::make_unique<ASTNode>(1.0), nullptr };
+        }
+        if (node.m_type != NodeType::Operator) {
+            return std::nullopt;
+        }
+        auto op = node.getValue<OperatorType>();
+        const auto& children = node.m_children;
+        switch (op) {
+        case OperatorType::UnaryPlus:
+            return affine(*children[0], prev);
+        case OperatorType::UnaryMinus: {
+            auto inner = affine(*children[0], prev);
+            if (!inner) {
+                return std::nullopt;
+            }
+            return Affine{ combine(OperatorType::Subtract, nullptr, std::move(inner->slope)),
+                combine(OperatorType::Subtract, nullptr, std::move(inner->offset)) };
+        }
+        case OperatorType::Add:
+        case OperatorType::Subtract: {
+            auto result = affine(*children[0], prev);
+            for (size_t i = 1; result && i < children.size(); ++i) {
+                auto term = affine(*children[i], prev);
+                if (!term) {
+                    return std::nullopt;
+                }
+                result->slope = combine(op, std::move(result->slope), std::move(term->slope));
+                result->offset = combine(op, std::move(result->offset), std::move(term->offset));
+            }
+            return result;
+        }
+        case OperatorType::Multiply:
+        case OperatorType::Divide: {
+            // One factor holds the previous output; for a quotient, the dividend
+            auto holders = std::count_if(children.begin(), children.end(), [&](const auto& child) { return contains(*child, prev); });
+            size_t holder = std::find_if(children.begin(), children.end(), [&](const auto& child) { return contains(*child, prev); }) - children.begin();
+            if (holders != 1 || (op == OperatorType::Divide && holder != 0)) {
+                return std::nullopt;
+            }
+            auto inner = affine(*children[holder], prev);
+            if (!inner) {
+                return std::nullopt;
+            }
+            // The factors keep their places, so the product folds in the same order
+            auto scale = [&](std::unique_ptr<ASTNode> term) -> std::unique_ptr<ASTNode> {
+                if (!term) {
+                    return nullptr;
+                }
+                if (op == OperatorType::Multiply && isOne(term.get()) && children.size() == 2) {
+                    return children[1 - holder]->clone();
+                }
+                auto node = std::make_unique<ASTNode>(op);
+                for (size_t i = 0; i < children.size(); ++i) {
+                    node->appendChild(i == holder ? std::move(term) : children[i]->clone());
+                }
+                return node;
+            };
+            return Affine{ scale(std::move(inner->slope)), scale(std::move(inner->offset)) };
+        }
+        default:
+            return std::nullopt;
+        }
+    }
+
+    // Moves the largest subtrees that don't depend on the previous row into `parts`,
+    // leaving variables named after them. Only operands every row evaluates are moved:
+    // if() branches, the later operands of && and || and reduction bodies stay put, so
+    // they fail only for the rows the formula evaluates them for.
+    void extract(std::unique_ptr<ASTNode>& node, const std::string& prev, std::vector<std::unique_ptr<ASTNode>>& parts) {
+        if (!contains(*node, prev) && !drawsRandom(*node)) {
+            if (node->m_type == NodeType::Number || node->m_type == NodeType::Variable) {
+                return;
+            }
+            size_t position = node->m_position;
+            parts.push_back(std::move(node));
+            node = variable(partName(parts.size() - 1), position);
+            return;
+        }
+        size_t evaluated = node->m_children.size();
+        if (node->m_type == NodeType::Function) {
+            const auto& name = node->getValue<std::string>();
+            if (name == "if") {
+                evaluated = 1;
+            }
+            else if (name == "sum" || name == "prod" || name == "integrate") {
+                evaluated = 0;
+            }
+        }
+        else if (node->m_type == NodeType::Operator && isLogical(node->getValue<OperatorType>())) {
+            evaluated = 1;
+        }
+        for (size_t i = 0; i < evaluated; ++i) {
+            extract(node->m_children[i], prev, parts);
+        }
+    }
+}
+
+Scan::Scan(const Evaluator& evaluator, const ASTNode& formula, std::vector<std::string> inputs, std::string output)
+    : m_inputs{ std::move(inputs) }
+    , m_output{ std::move(output) } {
+    auto body = formula.clone();
+    substitute(body);
+    std::string prev = prevName(m_output);
+    std::vector<std::string> names = m_inputs;
+    for (const auto& lag : m_lags) {
+        names.push_back(lagName(m_inputs[lag.column], lag.rows));
+    }
+    m_reads.resize(names.size());
+    auto markReads = [this](const Program& program) {
+        for (const auto& ins : program.code()) {
+            if (ins.m_op == OpCode::Input && ins.m_lhs < m_reads.size()) {
+                m_reads[ins.m_lhs] = true;
+            }
+        }
+    };
+
+    // rand() in a slope and an offset would be two draws where the formula has one
+    if (!drawsRandom(*body)) {
+        if (auto recurrence = affine(*body, prev)) {
+            // Without prev(y) every row stands alone: a NaN or infinite row before must not
+            // turn into NaN through a slope of 0
+            auto offset = recurrence->offset ? std::move(recurrence->offset) : std::make_unique<ASTNode>(0.0);
+            std::vector<const ASTNode*> roots = { offset.get() };
+            if (recurrence->slope) {
+                roots.insert(roots.begin(), recurrence->slope.get());
+            }
+            m_block = evaluator.compile(roots, names);
+            markReads(m_block);
+            m_linear = true;
+            return;
+        }
+    }
+
+    std::vector<std::unique_ptr<ASTNode>> parts;
+    extract(body, prev, parts);
+    std::vector<const ASTNode*> roots;
+    for (const auto& part : parts) {
+        roots.push_back(part.get());
+    }
+    m_block = evaluator.compile(roots, names);
+    for (size_t part = 0; part < parts.size(); ++part) {
+        names.push_back(partName(part));
+    }
+    names.push_back(prev);
+    m_step = evaluator.compile(*body, std::move(names));
+    markReads(m_block);
+    markReads(m_step);
+}
+
+void Scan::substitute(std::unique_ptr<ASTNode>& node) {
+    if (node->m_type == NodeType::Function) {
+        const auto& name = node->getValue<std::string>();
+        const auto& args = node->m_children;
+        if (name == "prev") {
+            if (args.size() != 1 || args[0]->m_type != NodeType::Variable || args[0]->getValue<std::string>() != m_output) {
+                throw std::runtime_error("prev takes the scan's output: prev(" + m_output + ")");
+            }
+            node = variable(prevName(m_output), node->m_position);
+            return;
+        }
+        if (name == "lag") {
+            auto column = m_inputs.end();
+            double rows = 0;
+            if (args.size() == 2 && args[0]->m_type == NodeType::Variable && args[1]->m_type == NodeType::Number) {
+                column = std::find(m_inputs.begin(), m_inputs.end(), args[0]->getValue<std::string>());
+                rows = args[1]->getValue<double>();
+            }
+            if (column == m_inputs.end() || !(rows >= 1 && rows <= s_maxLag) || std::floor(rows) != rows) {
+                throw std::runtime_error("lag takes an input column and a whole number of rows: lag(x, 1)");
+            }
+            Lag lag{ static_cast<size_t>(column - m_inputs.begin()), static_cast<size_t>(rows) };
+            if (std::none_of(m_lags.begin(), m_lags.end(), [&](const Lag& l) { return l.column == lag.column && l.rows == lag.rows; })) {
+                m_lags.push_back(lag);
+            }
+            node = variable(lagName(*column, lag.rows), node->m_position);
+            return;
+        }
+    }
+    for (auto& child : node->m_children) {
+        substitute(child);
+    }
+}
+
+std::vector<const double*> Scan::columns(const Gather& gather, size_t first, size_t count,
+    std::vector<std::vector<double>>& buffers) const {
+    std::vector<const double*> result;
+    for (size_t column = 0; column < m_inputs.size(); ++column) {
+        result.push_back(m_reads[column] ? gather(column, first, count, buffers) : nullptr);
+    }
+    for (size_t i = 0; i < m_lags.size(); ++i) {
+        const auto& lag = m_lags[i];
+        if (!m_reads[m_inputs.size() + i]) {
+            result.push_back(nullptr);
+            continue;
+        }
+        if (first >= lag.rows) {
+            result.push_back(gather(lag.column, first - lag.rows, count, buffers));
+            continue;
+        }
+        // Rows before the lag's first are NaN; gathered before the buffer is added, since
+        // adding a buffer moves the others (their rows stay where they are)
+        size_t start = std::min(std::max(first, lag.rows), first + count);
+        const double* source = start < first + count ? gather(lag.column, start - lag.rows, first + count - start, buffers) : nullptr;
+        auto& buffer = buffers.emplace_back(count, std::numeric_limits<double>::quiet_NaN());
+        std::copy_n(source, first + count - start, buffer.begin() + (start - first));
+        result.push_back(buffer.data());
+    }
+    return result;
+}
+
+void Scan::run(std::span<const double* const> inputs, double* output, size_t rows, double initial, ThreadPool* pool) const {
+    if (inputs.size() != m_inputs.size()) {
+        throw std::invalid_argument("Scan expects " + std::to_string(m_inputs.size()) + " input columns");
+    }
+    auto gather = [inputs](size_t column, size_t first, size_t, std::vector<std::vector<double>>&) {
+        return inputs[column] + first;
+    };
+    auto emit = [output](size_t first, std::span<const double> values) {
+        std::copy(values.begin(), values.end(), output + first);
+    };
+    run(gather, emit, rows, initial, pool);
+}
+
+void Scan::run(const ColumnFile& input, ColumnWriter& output, size_t column, double initial, ThreadPool* pool) const {
+    if (output.rows() != input.rows()) {
+        throw std::invalid_argument("Output has " + std::to_string(output.rows()) + " rows, input "
+            + std::to_string(input.rows()));
+    }
+    if (column >= output.columns().size() || output.columns()[column].type != ColumnType::Float64) {
+        throw std::invalid_argument("Scan output needs a float64 column");
+    }
+    std::vector<size_t> columns;
+    for (const auto& name : m_inputs) {
+        auto found = input.find(name);
+        if (!found) {
+            throw std::runtime_error("Input column not found: " + name);
+        }
+        columns.push_back(*found);
+    }
+    auto gather = [&](size_t i, size_t first, size_t count, std::vector<std::vector<double>>& buffers) {
+        if (input.columns()[columns[i]].type == ColumnType::Float64) {
+            return input.doubles(columns[i]).data() + first;
+        }
+        auto integers = input.integers(columns[i]).subspan(first, count);
+        auto& values = buffers.emplace_back(count);
+        std::transform(integers.begin(), integers.end(), values.begin(),
+            [](int64_t value) { return static_cast<double>(value); });
+        return static_cast<const double*>(values.data());
+    };
+    auto emit = [&output, column](size_t first, std::span<const double> values) {
+        output.write(column, first, values);
+    };
+    run(gather, emit, input.rows(), initial, pool);
+}
+
+void Scan::run(const Gather& gather, const Emit& emit, size_t rows, double initial, ThreadPool* pool) const {
+    if (m_linear) {
+        runLinear(gather, emit, rows, initial, pool);
+    }
+    else {
+        runSteps(gather, emit, rows, initial);
+    }
+}
+
+void Scan::runLinear(const Gather& gather, const Emit& emit, size_t rows, double initial, ThreadPool* pool) const {
+    // The first pass computes each row's slope and offset; the second turns the offsets
+    // into the outputs once the chunk's starting value is known. A program with only the
+    // offset is a formula without prev(y), complete after the first pass.
+    bool recurrent = m_block.outputCount() == 2;
+    size_t chunks = (rows + s_chunkRows - 1) / s_chunkRows;
+    std::vector<double> slopes(recurrent ? rows : 0);
+    std::vector<double> offsets(recurrent ? rows : 0);
+    std::vector<std::pair<double, double>> maps(chunks); // Each chunk's rows composed into one map
+    auto compose = [&](size_t chunk) {
+        size_t first = chunk * s_chunkRows;
+        size_t count = std::min(s_chunkRows, rows - first);
+        std::vector<std::vector<double>> buffers;
+        auto columns = this->columns(gather, first, count, buffers);
+        auto workspace = m_block.workspace<double>();
+        workspace.firstRow = first;
+        if (!recurrent) {
+            std::vector<double> values(count);
+            double* outputs[] = { values.data() };
+            m_block.runBatch<double>(columns, outputs, count, workspace);
+            emit(first, values);
+            return;
+        }
+        double* outputs[] = { slopes.data() + first, offsets.data() + first };
+        m_block.runBatch<double>(columns, outputs, count, workspace);
+        double slope = 1, offset = 0;
+        for (size_t i = first; i < first + count; ++i) {
+            slope = slopes[i] * slope;
+            offset = slopes[i] * offset + offsets[i];
+        }
+        maps[chunk] = { slope, offset };
+    };
+    std::vector<double> starts(chunks);
+    auto accumulate = [&](size_t chunk) {
+        size_t first = chunk * s_chunkRows;
+        size_t last = std::min(first + s_chunkRows, rows);
+        double y = starts[chunk];
+        for (size_t i = first; i < last; ++i) {
+            y = slopes[i] * y + offsets[i];
+            offsets[i] = y;
+        }
+        emit(first, std::span<const double>(offsets.data() + first, last - first));
+    };
+
+    // Impure native functions must see the rows in order
+    bool parallel = pool && chunks > 1 && m_block.pure();
+    if (parallel) {
+        pool->parallelFor(chunks, compose);
+    }
+    else {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            compose(chunk);
+        }
+    }
+    if (!recurrent) {
+        return;
+    }
+    double y = initial;
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        starts[chunk] = y;
+        y = maps[chunk].first * y + maps[chunk].second;
+    }
+    if (parallel) {
+        pool->parallelFor(chunks, accumulate);
+    }
+    else {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            accumulate(chunk);
+        }
+    }
+}
+
+void Scan::runSteps(const Gather& gather, const Emit& emit, size_t rows, double initial) const {
+    size_t parts = m_block.outputCount();
+    std::vector<double> values(parts * s_stepRows);
+    std::vector<double*> outputs(parts);
+    for (size_t part = 0; part < parts; ++part) {
+        outputs[part] = values.data() + part * s_stepRows;
+    }
+    // Only the step's inputs it reads are gathered for each row; the last is prev(y)
+    std::vector<uint32_t> reads;
+    for (const auto& ins : m_step.code()) {
+        if (ins.m_op == OpCode::Input) {
+            reads.push_back(ins.m_lhs);
+        }
+    }
+    std::vector<double> row(m_step.inputCount());
+    size_t prevInput = row.size() - 1;
+    auto blockWorkspace = m_block.workspace<double>();
+    auto stepWorkspace = m_step.workspace<double>(1);
+    std::vector<double> results(s_stepRows);
+    double previous = initial;
+    for (size_t first = 0; first < rows; first += s_stepRows) {
+        size_t count = std::min(s_stepRows, rows - first);
+        std::vector<std::vector<double>> buffers;
+        auto columns = this->columns(gather, first, count, buffers);
+        if (parts > 0) {
+            blockWorkspace.firstRow = first;
+            m_block.runBatch<double>(columns, outputs, count, blockWorkspace);
+        }
+        columns.insert(columns.end(), outputs.begin(), outputs.end());
+        for (size_t j = 0; j < count; ++j) {
+            for (uint32_t input : reads) {
+                row[input] = input == prevInput ? previous : columns[input][j];
+            }
+            stepWorkspace.firstRow = first + j;
+            m_step.run<double>(row, std::span(&previous, 1), stepWorkspace);
+            results[j] = previous;
+        }
+        emit(first, std::span<const double>(results.data(), count));
+    }
+}
@@ -0,0 +1,500 @@
+#include "Server.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Protocol.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // epoll tags; connections are numbered from 1
+    constexpr uint64_t s_listenTag = 0;
+    constexpr uint64_t s_wakeTag = UINT64_MAX;
+    constexpr size_t s_programCacheLimit = 256;
+    // Rows of a batch run between two checks of the request deadline
+    constexpr size_t s_deadlineRows = 4096;
+
+    [[noreturn]] void throwSystemError(const std::string& what) {
+        throw std::runtime_error(what + ": " + std::strerror(errno));
+    }
+
+    std::unique_ptr<ASTNode> parse(std::string_view text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return parser.parseExpression();
+    }
+}
+
+struct Server::Session {
+    Evaluator evaluator;
+    // Batch requests compiled against the session's current variables
+    std::unordered_map<std::string, Program> programs;
+};
+
+struct Server::Connection {
+    uint64_t id{};
+    Descriptor socket;
+    std::shared_ptr<Session> session = std::make_shared<Session>();
+    std::string input;
+    std::string output;
+    size_t written{};
+    std::deque<std::pair<std::string, Clock::time_point>> pending;
+    bool busy{};
+    bool writing{};
+};
+
+struct Server::Completion {
+    uint64_t connection{};
+    std::string response;
+    Clock::time_point start;
+};
+
+void LatencyRecorder::record(std::chrono::nanoseconds latency) {
+    std::lock_guard lock(m_mutex);
+    double micros = std::chrono::duration<double, std::micro>(latency).count();
+    if (m_samples.size() < s_window) {
+        m_samples.push_back(micros);
+    }
+    else {
+        m_samples[m_next] = micros;
+        m_next = (m_next + 1) % s_window;
+    }
+    ++m_total;
+}
+
+LatencySummary LatencyRecorder::summary() const {
+    std::vector<double> samples;
+    LatencySummary result;
+    {
+        std::lock_guard lock(m_mutex);
+        samples = m_samples;
+        result.requests = m_total;
+    }
+    if (samples.empty()) {
+        return result;
+    }
+    auto percentile = [&](double p) {
+        auto rank = static_cast<size_t>(p * static_cast<double>(samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+        return samples[rank];
+    };
+    result.p50Micros = percentile(0.50);
+    result.p99Micros = percentile(0.99);
+    return result;
+}
+
+Server::Descriptor::~Descriptor() {
+    reset(-1);
+}
+
+void Server::Descriptor::reset(int fd) {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+    m_fd = fd;
+}
+
+Server::Server(const std::string& address, size_t workers)
+    : m_workers{ std::max<size_t>(workers, 1) + 1 } {
+    // The event loop thread never runs requests, so the pool gets one extra slot
+    if (address.starts_with("unix:")) {
+        m_socketPath = address.substr(5);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (m_socketPath.empty() || m_socketPath.size() >= sizeof(addr.sun_path)) {
+            throw std::runtime_error("Invalid socket path: " + m_socketPath);
+        }
+        std::memcpy(addr.sun_path, m_socketPath.c_str(), m_socketPath.size() + 1);
+        m_listen.reset(::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+        if (m_listen.get() < 0) {
+            throwSystemError("socket");
+        }
+        ::unlink(m_socketPath.c_str()); // Left behind by a previous run
+        if (::bind(m_listen.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            throwSystemError("bind " + m_socketPath);
+        }
+    }
+    else if (address.starts_with("tcp:")) {
+        int port = std::stoi(address.substr(4));
+        if (port < 0 || port > 65535) {
+            throw std::runtime_error("Invalid port: " + address.substr(4));
+        }
+        m_listen.reset(::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+        if (m_listen.get() < 0) {
+            throwSystemError("socket");
+        }
+        int on = 1;
+        ::setsockopt(m_listen.get(), SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (::bind(m_listen.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            throwSystemError("bind port " + std::to_string(port));
+        }
+        socklen_t length = sizeof(addr);
+        ::getsockname(m_listen.get(), reinterpret_cast<sockaddr*>(&addr), &length);
+        m_port = ntohs(addr.sin_port);
+    }
+    else {
+        throw std::runtime_error("Server address must be unix:PATH or tcp:PORT");
+    }
+    if (::listen(m_listen.get(), SOMAXCONN) < 0) {
+        throwSystemError("listen");
+    }
+
+    m_epoll.reset(::epoll_create1(EPOLL_CLOEXEC));
+    m_wake.reset(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (m_epoll.get() < 0 || m_wake.get() < 0) {
+        throwSystemError("epoll");
+    }
+    watch(m_listen.get(), s_listenTag, EPOLLIN);
+    watch(m_wake.get(), s_wakeTag, EPOLLIN);
+}
+
+Server::~Server() {
+    if (!m_socketPath.empty()) {
+        ::unlink(m_socketPath.c_str());
+    }
+}
+
+void Server::watch(int fd, uint64_t tag, uint32_t events, bool modify) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = tag;
+    if (::epoll_ctl(m_epoll.get(), modify ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) < 0) {
+        throwSystemError("epoll_ctl");
+    }
+}
+
+void Server::run() {
+    std::array<epoll_event, 64> events;
+    while (!m_stopping.load()) {
+        int ready = ::epoll_wait(m_epoll.get(), events.data(), static_cast<int>(events.size()), -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throwSystemError("epoll_wait");
+        }
+        for (int i = 0; i < ready; ++i) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == s_listenTag) {
+                accept();
+                continue;
+            }
+            if (tag == s_wakeTag) {
+                uint64_t count;
+                while (::read(m_wake.get(), &count, sizeof(count)) > 0) {
+                }
+                complete();
+                continue;
+            }
+            auto it = m_connections.find(tag);
+            if (it == m_connections.end()) {
+                continue; // Closed while handling an earlier event of this batch
+            }
+            Connection& connection = *it->second;
+            if ((events[i].events & EPOLLOUT) && !flush(connection)) {
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                read(connection);
+            }
+        }
+    }
+}
+
+void Server::stop() {
+    m_stopping.store(true);
+    uint64_t one = 1;
+    [[maybe_unused]] auto written = ::write(m_wake.get(), &one, sizeof(one));
+}
+
+void Server::accept() {
+    while (true) {
+        int fd = ::accept4(m_listen.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return; // EAGAIN, or out of descriptors: retried on the next readiness event
+        }
+        if (m_socketPath.empty()) {
+            int on = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        auto connection = std::make_unique<Connection>();
+        connection->id = m_nextConnection++;
+        connection->socket.reset(fd);
+        watch(fd, connection->id, EPOLLIN);
+        m_connections.emplace(connection->id, std::move(connection));
+    }
+}
+
+bool Server::read(Connection& connection) {
+    std::array<char, 64 * 1024> buffer;
+    while (true) {
+        ssize_t received = ::recv(connection.socket.get(), buffer.data(), buffer.size(), 0);
+        if (received > 0) {
+            connection.input.append(buffer.data(), static_cast<size_t>(received));
+            continue;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        close(connection.id); // Peer closed, or a socket error
+        return false;
+    }
+
+    auto now = Clock::now();
+    std::string_view input = connection.input;
+    size_t offset = 0;
+    while (input.size() - offset >= protocol::s_headerSize) {
+        uint32_t size = protocol::Reader(input.substr(offset, protocol::s_headerSize)).u32();
+        if (size == 0 || size > protocol::s_maxPayload) {
+            close(connection.id); // Not speaking our protocol
+            return false;
+        }
+        if (input.size() - offset - protocol::s_headerSize < size) {
+            break;
+        }
+        connection.pending.emplace_back(std::string(input.substr(offset + protocol::s_headerSize, size)), now);
+        offset += protocol::s_headerSize + size;
+    }
+    connection.input.erase(0, offset);
+    dispatch(connection);
+    return true;
+}
+
+bool Server::flush(Connection& connection) {
+    while (connection.written < connection.output.size()) {
+        ssize_t sent = ::send(connection.socket.get(), connection.output.data() + connection.written,
+            connection.output.size() - connection.written, MSG_NOSIGNAL);
+        if (sent >= 0) {
+            connection.written += static_cast<size_t>(sent);
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        close(connection.id);
+        return false;
+    }
+    if (connection.written == connection.output.size()) {
+        connection.output.clear();
+        connection.written = 0;
+    }
+    // Only ask for writability while a response is stuck in the buffer
+    bool writing = !connection.output.empty();
+    if (writing != connection.writing) {
+        connection.writing = writing;
+        watch(connection.socket.get(), connection.id, writing ? EPOLLIN | EPOLLOUT : EPOLLIN, true);
+    }
+    return true;
+}
+
+void Server::dispatch(Connection& connection) {
+    if (connection.busy || connection.pending.empty()) {
+        return;
+    }
+    connection.busy = true;
+    auto next = std::move(connection.pending.front());
+    connection.pending.pop_front();
+    m_workers.post([this, id = connection.id, session = connection.session, request = std::move(next.first), start = next.second] {
+        Completion done{ id, protocol::frame(handle(*session, request)), start };
+        {
+            std::lock_guard lock(m_completedMutex);
+            m_completed.push_back(std::move(done));
+        }
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = ::write(m_wake.get(), &one, sizeof(one));
+    });
+}
+
+void Server::complete() {
+    std::vector<Completion> completed;
+    {
+        std::lock_guard lock(m_completedMutex);
+        completed.swap(m_completed);
+    }
+    for (auto& done : completed) {
+        m_latency.record(Clock::now() - done.start);
+        auto it = m_connections.find(done.connection);
+        if (it == m_connections.end()) {
+            continue; // Client went away while its request ran
+        }
+        Connection& connection = *it->second;
+        connection.output += done.response;
+        connection.busy = false;
+        if (flush(connection)) {
+            dispatch(connection);
+        }
+    }
+}
+
+void Server::close(uint64_t id) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end()) {
+        return;
+    }
+    ::epoll_ctl(m_epoll.get(), EPOLL_CTL_DEL, it->second->socket.get(), nullptr);
+    m_connections.erase(it);
+}
+
+std::string Server::handle(Session& session, std::string_view request) {
+    using protocol::RequestType;
+    std::string response(1, static_cast<char>(protocol::ResponseStatus::Ok));
+    try {
+        protocol::Reader reader(request);
+        switch (static_cast<RequestType>(reader.u8())) {
+        case RequestType::Define:
+        case RequestType::Evaluate: {
+            bool define = static_cast<RequestType>(request[0]) == RequestType::Define;
+            auto ast = parse(reader.rest());
+            bool assignment = ast->m_type == NodeType::Operator && ast->getValue<OperatorType>() == OperatorType::Assignment;
+            if (define && !assignment) {
+                throw std::runtime_error("Define expects an assignment");
+            }
+            EvaluationBudget budget{ m_maxSteps };
+            if (m_timeout.count() > 0) {
+                budget.deadline = std::chrono::steady_clock::now() + m_timeout;
+            }
+            protocol::putF64(response, session.evaluator.evaluate(*ast, budget));
+            // Either may have changed variables the compiled programs captured
+            session.programs.clear();
+            break;
+        }
+        case RequestType::Batch: {
+            auto deadline = Clock::now() + m_timeout;
+            uint32_t rows = reader.u32();
+            // Every name takes at least its 4-byte length, so no count can exceed what is left
+            auto count = [&reader] {
+                uint32_t n = reader.u32();
+                if (n > reader.remaining() / 4) {
+                    throw std::runtime_error("Truncated message");
+                }
+                return n;
+            };
+            std::vector<std::string> inputs(count());
+            for (auto& input : inputs) {
+                input = reader.string();
+            }
+            std::vector<std::string> formulas(count());
+            for (auto& formula : formulas) {
+                formula = reader.string();
+            }
+            if (formulas.empty()) {
+                throw std::runtime_error("Batch needs at least one formula");
+            }
+            if (reader.remaining() != static_cast<uint64_t>(rows) * inputs.size() * sizeof(double)) {
+                throw std::runtime_error("Batch data does not match its row and input counts");
+            }
+            // The results must fit in one response frame; this also bounds what they allocate
+            if (1 + static_cast<uint64_t>(rows) * formulas.size() * sizeof(double) > protocol::s_maxPayload) {
+                throw std::runtime_error("Batch results would exceed the maximum message size");
+            }
+
+            std::string key;
+            for (const auto& input : inputs) {
+                key += input + ',';
+            }
+            for (const auto& formula : formulas) {
+                key += '\n' + formula;
+            }
+            auto it = session.programs.find(key);
+            if (it == session.programs.end()) {
+                std::vector<std::unique_ptr<ASTNode>> asts;
+                std::vector<const ASTNode*> roots;
+                for (const auto& formula : formulas) {
+                    asts.push_back(parse(formula));
+                    roots.push_back(asts.back().get());
+                }
+                if (session.programs.size() >= s_programCacheLimit) {
+                    session.programs.clear();
+                }
+                it = session.programs.emplace(key, session.evaluator.compile(roots, inputs)).first;
+            }
+
+            std::vector<std::vector<double>> columns(inputs.size(), std::vector<double>(rows));
+            std::vector<const double*> inputColumns;
+            for (auto& column : columns) {
+                for (double& value : column) {
+                    value = reader.f64();
+                }
+                inputColumns.push_back(column.data());
+            }
+            std::vector<std::vector<double>> results(formulas.size(), std::vector<double>(rows));
+            std::vector<double*> outputColumns;
+            for (auto& column : results) {
+                outputColumns.push_back(column.data());
+            }
+            // The request limits, with a step being one instruction applied to one row as in
+            // compiled reductions: the step count is known before running, the deadline is
+            // checked between blocks
+            const Program& program = it->second;
+            uint64_t steps = static_cast<uint64_t>(rows) * std::max<size_t>(program.code().size(), 1);
+            if (m_maxSteps && steps > m_maxSteps) {
+                throw BudgetExceeded(BudgetExceeded::Limit::Steps);
+            }
+            auto workspace = program.workspace<double>();
+            for (size_t first = 0; first < rows; first += s_deadlineRows) {
+                if (m_timeout.count() > 0 && Clock::now() >= deadline) {
+                    throw BudgetExceeded(BudgetExceeded::Limit::Deadline);
+                }
+                size_t block = std::min<size_t>(s_deadlineRows, rows - first);
+                for (size_t k = 0; k < inputs.size(); ++k) {
+                    inputColumns[k] = columns[k].data() + first;
+                }
+                for (size_t k = 0; k < formulas.size(); ++k) {
+                    outputColumns[k] = results[k].data() + first;
+                }
+                workspace.firstRow = first;
+                program.runBatch<double>(inputColumns, outputColumns, block, workspace);
+            }
+
+            response.reserve(1 + results.size() * rows * sizeof(double));
+            for (const auto& column : results) {
+                for (double value : column) {
+                    protocol::putF64(response, value);
+                }
+            }
+            break;
+        }
+        case RequestType::Stats: {
+            auto summary = m_latency.summary();
+            protocol::putU64(response, summary.requests);
+            protocol::putF64(response, summary.p50Micros);
+            protocol::putF64(response, summary.p99Micros);
+            break;
+        }
+        default:
+            throw std::runtime_error("Unknown request type");
+        }
+    }
+    catch (const std::exception& e) {
+        response.assign(1, static_cast<char>(protocol::ResponseStatus::Error));
+        response += e.what();
+    }
+    return response;
+}
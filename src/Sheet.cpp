@@ -0,0 +1,221 @@
+#include "Sheet.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+    bool isAssignment(const ASTNode& node) {
+        return node.m_type == NodeType::Operator && node.getValue<OperatorType>() == OperatorType::Assignment;
+    }
+
+    bool containsAssignment(const ASTNode& root) {
+        std::vector<const ASTNode*> pending = { &root };
+        while (!pending.empty()) {
+            const ASTNode* current = pending.back();
+            pending.pop_back();
+            if (isAssignment(*current)) {
+                return true;
+            }
+            for (const auto& child : current->m_children) {
+                pending.push_back(child.get());
+            }
+        }
+        return false;
+    }
+}
+
+void Sheet::add(const std::string& line) {
+    if (std::all_of(line.begin(), line.end(), [](unsigned char c) { return std::isspace(c); })) {
+        return;
+    }
+    Lexer lexer(line);
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    if (!isAssignment(*ast)) {
+        throw std::runtime_error("Sheet lines must be assignments: " + line);
+    }
+    if (ast->m_children[0]->m_type == NodeType::Function) {
+        m_definitions.push_back(std::move(ast));
+        return;
+    }
+    if (ast->m_children[0]->m_type != NodeType::Variable) {
+        throw std::runtime_error("Assignment target must be a variable");
+    }
+    const auto& name = ast->m_children[0]->getValue<std::string>();
+    if (m_cellIndex.contains(name)) {
+        throw std::runtime_error("Variable defined twice in sheet: " + name);
+    }
+    if (containsAssignment(*ast->m_children[1])) {
+        throw std::runtime_error("Sheet cells cannot contain nested assignments: " + name);
+    }
+    m_cellIndex.emplace(name, m_cells.size());
+    m_cells.push_back({ name, std::move(ast->m_children[1]) });
+}
+
+std::vector<std::vector<size_t>> Sheet::schedule(const Evaluator& eval) const {
+    // Free variables of a cell, looking through the bodies of the user functions it
+    // calls, since those read globals at call time
+    auto references = [&](const ASTNode& root) {
+        std::unordered_set<std::string> names;
+        std::unordered_set<std::string> visitedFunctions;
+        std::deque<std::unordered_set<std::string>> scopes(1);
+        std::vector<std::pair<const ASTNode*, const std::unordered_set<std::string>*>> pending = { { &root, &scopes.front() } };
+        while (!pending.empty()) {
+            auto [current, bound] = pending.back();
+            pending.pop_back();
+            if (current->m_type == NodeType::Variable && !bound->contains(current->getValue<std::string>())) {
+                names.insert(current->getValue<std::string>());
+            }
+            else if (current->m_type == NodeType::Function) {
+                const auto& callee = current->getValue<std::string>();
+                bool isReduction = callee == "sum" || callee == "prod" || callee == "integrate";
+                if (isReduction && current->m_children.size() == 4 && current->m_children[0]->m_type == NodeType::Variable) {
+                    auto& inner = scopes.emplace_back(*bound);
+                    inner.insert(current->m_children[0]->getValue<std::string>());
+                    pending.emplace_back(current->m_children[1].get(), bound);
+                    pending.emplace_back(current->m_children[2].get(), bound);
+                    pending.emplace_back(current->m_children[3].get(), &inner);
+                    continue;
+                }
+                auto it = eval.functions.find(callee);
+                if (it != eval.functions.end() && visitedFunctions.insert(callee).second) {
+                    auto& params = scopes.emplace_back(it->second.argNames.begin(), it->second.argNames.end());
+                    pending.emplace_back(it->second.body.get(), &params);
+                }
+            }
+            for (const auto& child : current->m_children) {
+                pending.emplace_back(child.get(), bound);
+            }
+        }
+        return names;
+    };
+
+    std::vector<std::vector<size_t>> dependents(m_cells.size());
+    std::vector<std::vector<size_t>> dependencies(m_cells.size());
+    std::vector<size_t> unresolved(m_cells.size());
+    for (size_t cell = 0; cell < m_cells.size(); ++cell) {
+        for (const auto& name : references(*m_cells[cell].expression)) {
+            if (auto it = m_cellIndex.find(name); it != m_cellIndex.end()) {
+                dependents[it->second].push_back(cell);
+                dependencies[cell].push_back(it->second);
+                ++unresolved[cell];
+            }
+        }
+    }
+
+    // Kahn's algorithm, one wave at a time; cells within a wave stay in line order
+    std::vector<std::vector<size_t>> waves;
+    std::vector<size_t> wave;
+    for (size_t cell = 0; cell < m_cells.size(); ++cell) {
+        if (unresolved[cell] == 0) {
+            wave.push_back(cell);
+        }
+    }
+    size_t scheduled = 0;
+    while (!wave.empty()) {
+        scheduled += wave.size();
+        std::vector<size_t> next;
+        for (size_t cell : wave) {
+            for (size_t dependent : dependents[cell]) {
+                if (--unresolved[dependent] == 0) {
+                    next.push_back(dependent);
+                }
+            }
+        }
+        std::sort(next.begin(), next.end());
+        waves.push_back(std::move(wave));
+        wave = std::move(next);
+    }
+    if (scheduled == m_cells.size()) {
+        return waves;
+    }
+
+    // Every unscheduled cell waits on another unscheduled cell, so following those
+    // dependencies from any of them must come back round
+    size_t current = std::find_if(unresolved.begin(), unresolved.end(), [](size_t n) { return n > 0; }) - unresolved.begin();
+    std::vector<size_t> path;
+    std::vector<size_t> position(m_cells.size(), m_cells.size());
+    while (position[current] == m_cells.size()) {
+        position[current] = path.size();
+        path.push_back(current);
+        current = *std::find_if(dependencies[current].begin(), dependencies[current].end(),
+            [&](size_t dependency) { return unresolved[dependency] > 0; });
+    }
+    std::string cycle;
+    for (size_t i = position[current]; i < path.size(); ++i) {
+        cycle += m_cells[path[i]].name + " -> ";
+    }
+    throw std::runtime_error("Circular reference: " + cycle + m_cells[current].name);
+}
+
+std::vector<double> Sheet::evaluate(Evaluator& eval, ThreadPool* pool) const {
+    std::vector<double> results(m_cells.size());
+    for (const auto& definition : m_definitions) {
+        eval.evaluate(*definition);
+    }
+    for (const auto& wave : schedule(eval)) {
+        // Workers only read eval (compiling resolves variables up front); results are
+        // written back after the wave, in line order
+        std::vector<double> values(wave.size());
+        std::vector<char> compiled(wave.size());
+        std::vector<std::optional<std::string>> errors(wave.size());
+        // Cell k of the wave draws its rand() values from row base + k, whichever thread runs it
+        uint64_t base = eval.randomRow;
+        eval.randomRow += wave.size();
+        auto run = [&](size_t k) {
+            std::optional<Program> program;
+            try {
+                program = eval.compile(*m_cells[wave[k]].expression);
+            }
+            catch (const std::exception&) {
+                return;
+            }
+            try {
+                auto workspace = program->workspace<double>(1);
+                workspace.firstRow = base + k;
+                workspace.checkIntegers = true;
+                program->run<double>({}, std::span(&values[k], 1), workspace);
+                // Integers past 2^53 are only exact in the interpreter
+                compiled[k] = !workspace.roundedIntegers;
+            }
+            catch (const std::exception& e) {
+                compiled[k] = 1;
+                errors[k] = e.what();
+            }
+        };
+        if (pool && wave.size() > 1) {
+            pool->parallelFor(wave.size(), run);
+        }
+        else {
+            for (size_t k = 0; k < wave.size(); ++k) {
+                run(k);
+            }
+        }
+
+        for (size_t k = 0; k < wave.size(); ++k) {
+            const Cell& cell = m_cells[wave[k]];
+            if (!compiled[k]) {
+                try {
+                    values[k] = eval.evaluate(*cell.expression);
+                }
+                catch (const std::exception& e) {
+                    errors[k] = e.what();
+                }
+            }
+            if (errors[k]) {
+                throw std::runtime_error(cell.name + ": " + *errors[k]);
+            }
+            eval.variables[cell.name] = values[k];
+            ++eval.globalsVersion;
+            results[wave[k]] = values[k];
+        }
+    }
+    return results;
+}
@@ -0,0 +1,63 @@
+#include "SpecialFunctions.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+namespace kernels {
+#include "SpecialKernels.inl"
+}
+
+namespace {
+    void requireCombinatoricArgs(const char* name, double n, double k) {
+        if (!kernels::isNonNegativeInteger(n) || !kernels::isNonNegativeInteger(k)) {
+            throw std::runtime_error(std::string(name) + " requires non-negative integer arguments");
+        }
+    }
+}
+
+namespace special {
+    double factorial(double n) {
+        if (!kernels::isNonNegativeInteger(n)) {
+            throw std::runtime_error("Factorial requires a non-negative integer");
+        }
+        return kernels::factorial(n);
+    }
+
+    double gamma(double x) {
+        if (kernels::isNonPositiveInteger(x)) {
+            throw std::runtime_error("gamma undefined at non-positive integers");
+        }
+        return kernels::gamma(x);
+    }
+
+    double lgamma(double x) {
+        if (kernels::isNonPositiveInteger(x)) {
+            throw std::runtime_error("lgamma undefined at non-positive integers");
+        }
+        return kernels::lgamma(x);
+    }
+
+    double lfact(double n) {
+        if (!(n >= 0)) {
+            throw std::runtime_error("lfact requires a non-negative argument");
+        }
+        return kernels::lfact(n);
+    }
+
+    double nCr(double n, double k) {
+        requireCombinatoricArgs("nCr", n, k);
+        return kernels::nCr(n, k);
+    }
+
+    double nPr(double n, double k) {
+        requireCombinatoricArgs("nPr", n, k);
+        return kernels::nPr(n, k);
+    }
+}
@@ -0,0 +1,173 @@
+// Factorial, gamma and combinatorics kernels, shared by SpecialFunctions.cpp and the headers
+// cmdCalc --emit-cpp writes, which embed this file as it is (see CodeGen.cpp). Hence the
+// standard library only, fully qualified names, and NaN instead of an exception outside a
+// function's domain: callers check the domain first and report it their own way.
+
+inline constexpr ::std::size_t maxFactorial = 170;
+
+// n! for n = 0 .. 170, built by the same sequential product the old loops used
+inline constexpr ::std::array<double, maxFactorial + 1> factorials = [] {
+    ::std::array<double, maxFactorial + 1> table{};
+    table[0] = 1.0;
+    for (::std::size_t i = 1; i <= maxFactorial; ++i) {
+        table[i] = table[i - 1] * static_cast<double>(i);
+    }
+    return table;
+}();
+
+// Lanczos coefficients for g = 7, n = 9
+inline constexpr double lanczosG = 7.0;
+inline constexpr ::std::array<double, 9> lanczos = {
+    0.99999999999980993, 676.5203681218851, -1259.1392167224028,
+    771.32342877765313, -176.61502916214059, 12.507343278686905,
+    -0.13857109526572012, 9.9843695780195716e-6, 1.5056327351493116e-7
+};
+inline constexpr double halfLogTwoPi = 0.91893853320467274178;
+// Up to 2^53 every integer is representable, so such results are computed exactly
+inline constexpr ::std::uint64_t exactIntegerLimit = ::std::uint64_t{ 1 } << 53;
+
+inline bool isNonNegativeInteger(double x) {
+    return x >= 0 && ::std::floor(x) == x;
+}
+
+inline bool isNonPositiveInteger(double x) {
+    return x <= 0 && ::std::floor(x) == x;
+}
+
+inline double factorial(double n) {
+    if (!isNonNegativeInteger(n)) {
+        return ::std::numeric_limits<double>::quiet_NaN();
+    }
+    if (n > static_cast<double>(maxFactorial)) {
+        return ::std::numeric_limits<double>::infinity();
+    }
+    return factorials[static_cast<::std::size_t>(n)];
+}
+
+// Sum part of the Lanczos series for gamma(x + 1), valid for x >= -0.5
+inline double lanczosSeries(double x) {
+    double sum = lanczos[0];
+    for (::std::size_t i = 1; i < lanczos.size(); ++i) {
+        sum += lanczos[i] / (x + static_cast<double>(i));
+    }
+    return sum;
+}
+
+// Lanczos approximation, exact table values at positive integers; NaN at non-positive integers
+inline double gamma(double x) {
+    if (::std::isnan(x) || isNonPositiveInteger(x)) {
+        return ::std::numeric_limits<double>::quiet_NaN();
+    }
+    if (x >= 1 && ::std::floor(x) == x) {
+        return factorial(x - 1);
+    }
+    if (x < 0.5) {
+        // Reflection: gamma(x) * gamma(1 - x) = pi / sin(pi * x)
+        return ::std::numbers::pi / (::std::sin(::std::numbers::pi * x) * gamma(1.0 - x));
+    }
+    if (x > static_cast<double>(maxFactorial) + 1) {
+        return ::std::numeric_limits<double>::infinity();
+    }
+    double z = x - 1.0;
+    double t = z + lanczosG + 0.5;
+    // t^(z + 0.5) alone overflows long before gamma(x) does, so apply it in two halves
+    double halfPower = ::std::pow(t, 0.5 * (z + 0.5));
+    return ::std::sqrt(2.0 * ::std::numbers::pi) * halfPower * (halfPower * ::std::exp(-t)) * lanczosSeries(z);
+}
+
+// log|gamma(x)|, Stirling series for large x; NaN at non-positive integers
+inline double lgamma(double x) {
+    if (::std::isnan(x) || isNonPositiveInteger(x)) {
+        return ::std::numeric_limits<double>::quiet_NaN();
+    }
+    if (x >= 1 && x <= static_cast<double>(maxFactorial) + 1 && ::std::floor(x) == x) {
+        return ::std::log(factorials[static_cast<::std::size_t>(x) - 1]);
+    }
+    if (x < 0.5) {
+        return ::std::log(::std::numbers::pi / ::std::abs(::std::sin(::std::numbers::pi * x))) - lgamma(1.0 - x);
+    }
+    if (x >= 15.0) {
+        // Stirling series; the first omitted term is below 1e-17 for x >= 15
+        double inv = 1.0 / x;
+        double inv2 = inv * inv;
+        double series = inv * (1.0 / 12 - inv2 * (1.0 / 360 - inv2 * (1.0 / 1260 - inv2 * (1.0 / 1680))));
+        return (x - 0.5) * ::std::log(x) - x + halfLogTwoPi + series;
+    }
+    double z = x - 1.0;
+    double t = z + lanczosG + 0.5;
+    return halfLogTwoPi + (z + 0.5) * ::std::log(t) - t + ::std::log(lanczosSeries(z));
+}
+
+// log(n!) for any non-negative n, without overflow
+inline double lfact(double n) {
+    if (!(n >= 0)) {
+        return ::std::numeric_limits<double>::quiet_NaN();
+    }
+    return lgamma(n + 1.0);
+}
+
+// n! / (n - k)! / (divideBy ? k! : 1) by a running product of integers, exact in every step:
+// after step i it holds C(n - k + i, i) or n! / (n - k + i)!. Zero once the result passes 2^53
+inline ::std::uint64_t exactProduct(double n, double k, bool divideBy) {
+    if (!(n < static_cast<double>(exactIntegerLimit))) {
+        return 0;
+    }
+    auto ni = static_cast<::std::uint64_t>(n);
+    auto ki = static_cast<::std::uint64_t>(k);
+    ::std::uint64_t result = 1;
+    for (::std::uint64_t i = 1; i <= ki; ++i) {
+        ::std::uint64_t factor = ni - ki + i;
+        if (divideBy) {
+            // result * factor is a multiple of i, so i / gcd(result, i) divides factor
+            ::std::uint64_t common = ::std::gcd(result, i);
+            result /= common;
+            factor /= i / common;
+        }
+        // The partial results only grow, so passing the limit early means the result does too
+        if (result > exactIntegerLimit / factor) {
+            return 0;
+        }
+        result *= factor;
+    }
+    return result;
+}
+
+// Binomial coefficient and permutations: exact while the result is at most 2^53, then from
+// the factorial table or in log space once n! overflows; NaN unless both arguments are
+// non-negative integers
+inline double nCr(double n, double k) {
+    if (!isNonNegativeInteger(n) || !isNonNegativeInteger(k)) {
+        return ::std::numeric_limits<double>::quiet_NaN();
+    }
+    if (k > n) {
+        return 0.0;
+    }
+    k = ::std::min(k, n - k);
+    if (auto exact = exactProduct(n, k, true)) {
+        return static_cast<double>(exact);
+    }
+    if (n <= static_cast<double>(maxFactorial)) {
+        auto ni = static_cast<::std::size_t>(n);
+        auto ki = static_cast<::std::size_t>(k);
+        return factorials[ni] / (factorials[ki] * factorials[ni - ki]);
+    }
+    return ::std::exp(lfact(n) - lfact(k) - lfact(n - k));
+}
+
+inline double nPr(double n, double k) {
+    if (!isNonNegativeInteger(n) || !isNonNegativeInteger(k)) {
+        return ::std::numeric_limits<double>::quiet_NaN();
+    }
+    if (k > n) {
+        return 0.0;
+    }
+    if (auto exact = exactProduct(n, k, false)) {
+        return static_cast<double>(exact);
+    }
+    if (n <= static_cast<double>(maxFactorial)) {
+        auto ni = static_cast<::std::size_t>(n);
+        auto ki = static_cast<::std::size_t>(k);
+        return factorials[ni] / factorials[ni - ki];
+    }
+    return ::std::exp(lfact(n) - lfact(n - k));
+}
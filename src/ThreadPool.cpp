@@ -0,0 +1,129 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    // The calling thread always participates, so one thread fewer is spawned
+    size_t workers = threadCount > 1 ? threadCount - 1 : 0;
+    m_workers.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+        m_workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::post(std::function<void()> task) {
+    if (m_workers.empty()) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_wakeup.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(m_mutex);
+            m_wakeup.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+            if (m_stopping && m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || m_workers.empty()) {
+        for (size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    // Shared between the caller and helpers; helpers that start late find no work left
+    struct Job {
+        const std::function<void(size_t)>* fn;
+        size_t count;
+        std::atomic<size_t> next{};
+        std::atomic<size_t> finished{};
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t errorIndex = SIZE_MAX;
+        std::exception_ptr error;
+
+        void work() {
+            size_t i;
+            while ((i = next.fetch_add(1)) < count) {
+                size_t completed = 1;
+                try {
+                    (*fn)(i);
+                }
+                catch (...) {
+                    {
+                        std::lock_guard lock(mutex);
+                        if (i < errorIndex) {
+                            errorIndex = i;
+                            error = std::current_exception();
+                        }
+                    }
+                    // Indices nobody has claimed yet are all above i, so their errors
+                    // could never be the one reported: skip them
+                    size_t unclaimed = next.exchange(count);
+                    completed += count - std::min(unclaimed, count);
+                }
+                if (finished.fetch_add(completed) + completed == count) {
+                    std::lock_guard lock(mutex);
+                    done.notify_all();
+                }
+            }
+        }
+    };
+    auto job = std::make_shared<Job>();
+    job->fn = &fn;
+    job->count = count;
+
+    size_t helpers = std::min(m_workers.size(), count - 1);
+    {
+        std::lock_guard lock(m_mutex);
+        for (size_t i = 0; i < helpers; ++i) {
+            m_tasks.emplace_back([job] { job->work(); });
+        }
+    }
+    m_wakeup.notify_all();
+
+    job->work();
+
+    std::unique_lock lock(job->mutex);
+    job->done.wait(lock, [&] { return job->finished.load() == count; });
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
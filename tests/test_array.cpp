@@ -0,0 +1,153 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+#include "Array.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+
+namespace {
+    std::unique_ptr<ASTNode> parse(const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return parser.parseExpression();
+    }
+
+    std::vector<double> elements(const Value& value) {
+        auto values = std::get<Array>(value).values();
+        return { values.begin(), values.end() };
+    }
+}
+
+TEST_CASE("Array kernels agree with plain loops for every tail length") {
+    for (size_t n = 0; n <= 3 * kernel::s_lanes + 1; ++n) {
+        std::vector<double> x(n);
+        std::vector<double> y(n);
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = std::sin(static_cast<double>(i) + 0.5) * 10.0;
+            y[i] = static_cast<double>(i % 5) - 2.0;
+        }
+        REQUIRE(kernel::sum(x) == Catch::Approx(std::accumulate(x.begin(), x.end(), 0.0)).margin(1e-12));
+        REQUIRE(kernel::dot(x, y) == Catch::Approx(std::inner_product(x.begin(), x.end(), y.begin(), 0.0)).margin(1e-12));
+        REQUIRE(kernel::norm(x) == Catch::Approx(std::sqrt(std::inner_product(x.begin(), x.end(), x.begin(), 0.0))).margin(1e-12));
+        if (n > 0) {
+            REQUIRE(kernel::minimum(x) == *std::min_element(x.begin(), x.end()));
+            REQUIRE(kernel::maximum(x) == *std::max_element(x.begin(), x.end()));
+        }
+    }
+    std::vector<double> small{ 1.0, 2.0, 3.0, 4.0, 5.0 };
+    REQUIRE(kernel::product(small) == 120.0);
+}
+
+TEST_CASE("Array kernels: compensation, scaling and NaN order") {
+    // 1 + 1e-16 * 1000: a plain running sum loses every small term
+    std::vector<double> values(1001, 1e-16);
+    values[0] = 1.0;
+    REQUIRE(kernel::sum(values) == Catch::Approx(1.0 + 1e-13).epsilon(1e-15));
+
+    std::vector<double> huge(20, 1e200);
+    REQUIRE(kernel::norm(huge) == Catch::Approx(std::sqrt(20.0) * 1e200));
+    std::vector<double> tiny(20, 1e-200);
+    REQUIRE(kernel::norm(tiny) == Catch::Approx(std::sqrt(20.0) * 1e-200));
+
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    std::vector<double> nanFirst(20, 1.0);
+    nanFirst[0] = nan;
+    REQUIRE(std::isnan(kernel::minimum(nanFirst)));
+    std::vector<double> nanLater(20, 1.0);
+    nanLater[11] = nan;
+    nanLater[13] = -4.0;
+    REQUIRE(kernel::minimum(nanLater) == -4.0);
+    REQUIRE(kernel::maximum(nanLater) == 1.0);
+}
+
+TEST_CASE("Arrays: literals, constructors and elementwise operators") {
+    Evaluator eval;
+    REQUIRE(elements(eval.evaluateValue(*parse("[1, 2, 3]"))) == std::vector<double>{ 1, 2, 3 });
+    REQUIRE(elements(eval.evaluateValue(*parse("[]"))).empty());
+    REQUIRE(elements(eval.evaluateValue(*parse("[[1, 2], 3, [4]]"))) == std::vector<double>{ 1, 2, 3, 4 });
+    REQUIRE(elements(eval.evaluateValue(*parse("range(0, 5)"))) == std::vector<double>{ 0, 1, 2, 3, 4 });
+    REQUIRE(elements(eval.evaluateValue(*parse("range(5, 0, -2)"))) == std::vector<double>{ 5, 3, 1 });
+    REQUIRE(elements(eval.evaluateValue(*parse("linspace(0, 1, 5)"))) == std::vector<double>{ 0, 0.25, 0.5, 0.75, 1 });
+    REQUIRE(std::get<Array>(eval.evaluateValue(*parse("linspace(0, 0.3, 7)"))).values().back() == 0.3);
+
+    REQUIRE(elements(eval.evaluateValue(*parse("[1, 2, 3] * 2 + 1"))) == std::vector<double>{ 3, 5, 7 });
+    REQUIRE(elements(eval.evaluateValue(*parse("10 - [1, 2] ^ 2"))) == std::vector<double>{ 9, 6 });
+    REQUIRE(elements(eval.evaluateValue(*parse("[1, 2] * [3, 4] - [1, 1]"))) == std::vector<double>{ 2, 7 });
+    REQUIRE(elements(eval.evaluateValue(*parse("-[1, 2]!"))) == std::vector<double>{ -1, -2 });
+    REQUIRE(elements(eval.evaluateValue(*parse("[7, -7] % 3"))) == std::vector<double>{ 1, -1 });
+    REQUIRE(elements(eval.evaluateValue(*parse("atan2([1, -1], 1)")))[1] == Catch::Approx(-std::atan(1.0)));
+    REQUIRE(elements(eval.evaluateValue(*parse("abs([-1, 2])"))) == std::vector<double>{ 1, 2 });
+
+    REQUIRE_THROWS_WITH(eval.evaluateValue(*parse("[1, 2] + [1, 2, 3]")), "Array sizes differ: 2 and 3");
+    REQUIRE_THROWS_WITH(eval.evaluateValue(*parse("1 / [1, 0]")), "Division by zero");
+    REQUIRE_THROWS_WITH(eval.evaluateValue(*parse("sqrt([1, -1])")), "sqrt requires non-negative argument");
+    REQUIRE_THROWS_WITH(eval.evaluateValue(*parse("range(0, 1, 0)")), "range requires finite bounds and a non-zero step");
+    REQUIRE_THROWS(parse("[1, 2"));
+    REQUIRE_THROWS(parse("(1, 2]"));
+}
+
+TEST_CASE("Arrays: variables share storage") {
+    Evaluator eval;
+    eval.evaluateValue(*parse("v = linspace(1, 4, 4)"));
+    eval.evaluateValue(*parse("w = v"));
+    auto v = std::get<Array>(eval.evaluateValue(*parse("v")));
+    auto w = std::get<Array>(eval.evaluateValue(*parse("w")));
+    REQUIRE(v.data() == w.data());
+    REQUIRE(v.useCount() == 4); // v, w and the two copies here
+
+    REQUIRE(elements(eval.evaluateValue(*parse("v * w"))) == std::vector<double>{ 1, 4, 9, 16 });
+    // Reassigning a number replaces the array
+    REQUIRE(std::get<double>(eval.evaluateValue(*parse("v = 2"))) == 2.0);
+    REQUIRE(eval.evaluate(*parse("v + 1")) == 3.0);
+    REQUIRE_THROWS_WITH(eval.evaluate(*parse("w + 1")), "Array used where a number is expected: w");
+    REQUIRE_THROWS_WITH(eval.compile(*parse("w + 1")), "Arrays cannot be compiled: w");
+
+    eval.setVariable("u", Array(std::vector<double>{ 2.0, 3.0 }));
+    REQUIRE(eval.evaluate(*parse("dot(u, u)")) == 13.0);
+}
+
+TEST_CASE("Arrays: reductions and functions") {
+    Evaluator eval;
+    eval.evaluateValue(*parse("v = [3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5]"));
+    REQUIRE(eval.evaluate(*parse("sum(v)")) == 44.0);
+    REQUIRE(eval.evaluate(*parse("prod([1, 2, 3, 4])")) == 24.0);
+    REQUIRE(eval.evaluate(*parse("mean(v)")) == Catch::Approx(4.0));
+    REQUIRE(eval.evaluate(*parse("norm([3, 4])")) == 5.0);
+    REQUIRE(eval.evaluate(*parse("dot(v, v * 0 + 1)")) == 44.0);
+    REQUIRE(eval.evaluate(*parse("min(v, 2)")) == 1.0);
+    REQUIRE(eval.evaluate(*parse("max(0, v, 7)")) == 9.0);
+    REQUIRE(eval.evaluate(*parse("sum(i, 1, 4, i)")) == 10.0); // Range form still works
+    REQUIRE(eval.evaluate(*parse("sum(7)")) == 7.0);
+    REQUIRE_THROWS_WITH(eval.evaluate(*parse("mean([])")), "mean of an empty array");
+    REQUIRE_THROWS_WITH(eval.evaluate(*parse("max([])")), "max of an empty array");
+    REQUIRE_THROWS_WITH(eval.evaluate(*parse("dot([1, 2], [1])")), "dot needs arrays of the same size, got 2 and 1");
+
+    // User functions are applied to each element
+    eval.evaluate(*parse("f(x) = x^2 + 1"));
+    REQUIRE(elements(eval.evaluateValue(*parse("f([1, 2, 3])"))) == std::vector<double>{ 2, 5, 10 });
+    REQUIRE(eval.evaluate(*parse("sum(f(range(0, 4)))")) == 18.0);
+    REQUIRE(std::get<double>(eval.evaluateValue(*parse("f(2)"))) == 5.0);
+}
+
+TEST_CASE("Arrays: elementwise work counts against evaluation budgets") {
+    Evaluator eval;
+    REQUIRE_THROWS_AS(eval.evaluate(*parse("sum(sqrt(range(0, 1000000)))"), EvaluationBudget{ .maxSteps = 10000 }),
+        BudgetExceeded);
+    REQUIRE_THROWS_WITH(eval.evaluateValue(*parse("range(0, 1e12)")), "range exceeds the array size limit");
+}
+
+TEST_CASE("Arrays compare elementwise into masks") {
+    Evaluator eval;
+    eval.setVariable("v", Array(std::vector<double>{ -2, -1, 0, 1, 2 }));
+    REQUIRE(elements(eval.evaluateValue(*parse("v > 0"))) == std::vector<double>{ 0, 0, 0, 1, 1 });
+    REQUIRE(elements(eval.evaluateValue(*parse("v >= -1 && v != 1"))) == std::vector<double>{ 0, 1, 1, 0, 1 });
+    REQUIRE(elements(eval.evaluateValue(*parse("if(v < 0, -v, v * 10)"))) == std::vector<double>{ 2, 1, 0, 10, 20 });
+    REQUIRE(eval.evaluate(*parse("sum(v == 0 || v == 2)")) == 2.0);
+    REQUIRE(elements(eval.evaluateValue(*parse("if(1, v, 0)"))) == elements(eval.evaluateValue(*parse("v"))));
+}
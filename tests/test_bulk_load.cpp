@@ -0,0 +1,86 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <string>
+#include "BulkLoad.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "ThreadPool.h"
+
+namespace {
+    double evaluate(Evaluator& eval, const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return eval.evaluate(*parser.parseExpression());
+    }
+
+    std::string name(size_t i) {
+        std::string result;
+        do {
+            result += static_cast<char>('a' + i % 26);
+            i /= 26;
+        } while (i > 0);
+        return result;
+    }
+
+    std::string library(size_t count) {
+        std::string text = "# generated\nrate = 2\n\n";
+        for (size_t i = 0; i < count; ++i) {
+            text += "fn" + name(i) + "(x) = x * rate + " + std::to_string(i) + "\n";
+        }
+        // Redefinitions: the later one wins, also across chunk boundaries
+        text += "fna(x) = x - 1\n";
+        text += "total = fna(10) + fnb(1)\n";
+        return text;
+    }
+}
+
+TEST_CASE("Bulk load: last definition wins and assignments see final functions") {
+    std::string text = "f(x) = x + 1\nk = f(1)\n  # comment\n\nf(x) = x * 10\ng(y) = f(y) + k\n";
+    Evaluator eval;
+    auto result = loadDefinitions(eval, text);
+    REQUIRE(result.definitions == 4);
+    REQUIRE(result.functions == 2);
+    REQUIRE(result.replacedFunctions == 1);
+    REQUIRE(result.variables == 1);
+    REQUIRE(evaluate(eval, "k") == 10.0);
+    REQUIRE(evaluate(eval, "g(2)") == 30.0);
+    REQUIRE(result.programs.empty());
+}
+
+TEST_CASE("Bulk load: parallel and serial loads agree") {
+    std::string text = library(5000);
+    Evaluator serial;
+    Evaluator parallel;
+    auto one = loadDefinitions(serial, text, { .compile = true });
+    ThreadPool pool(4);
+    auto many = loadDefinitions(parallel, text, { .pool = &pool, .compile = true });
+
+    REQUIRE(one.functions == 5000);
+    REQUIRE(many.functions == one.functions);
+    REQUIRE(many.replacedFunctions == 1);
+    REQUIRE(many.programs.size() == 5000);
+    REQUIRE(many.uncompiled.empty());
+    REQUIRE(evaluate(parallel, "total") == 9.0 + 3.0);
+    REQUIRE(evaluate(serial, "total") == evaluate(parallel, "total"));
+    for (size_t i : { 1, 77, 4999 }) {
+        std::string call = "fn" + name(i) + "(3)";
+        REQUIRE(evaluate(parallel, call) == 6.0 + static_cast<double>(i));
+        double x = 3.0;
+        REQUIRE(many.programs.at("fn" + name(i)).run(std::span(&x, 1)) == 6.0 + static_cast<double>(i));
+    }
+}
+
+TEST_CASE("Bulk load: errors name the first failing line") {
+    ThreadPool pool(4);
+    std::string text = library(2000);
+    std::string broken = text + "h(x) = (x\n" + "k = 1 +\n";
+    Evaluator eval;
+    REQUIRE_THROWS_WITH(loadDefinitions(eval, broken, { .pool = &pool, .source = "lib.txt" }),
+        "lib.txt:2006: Expected ')' for '(' at position 7");
+    REQUIRE_THROWS(evaluate(eval, "fna(1)")); // Nothing was registered
+
+    REQUIRE_THROWS_WITH(loadDefinitions(eval, "a = 1\n2 + 2\n", { .pool = &pool }), "input:2: expected a definition");
+    REQUIRE_THROWS_WITH(loadDefinitions(eval, "f(x, y) = x\n"), "input:1: Function assignment requires one variable argument");
+    REQUIRE_THROWS_WITH(loadDefinitions(eval, "a = 1\nb = c\n"), "input:2: Undefined variable: c");
+}
@@ -0,0 +1,93 @@
+/* Exercises libmathcore through its C interface only */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "mathcore.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++failures; \
+        } \
+    } while (0)
+
+static void testContext(void) {
+    mathcore_context* context = mathcore_context_create();
+    double value = 0.0;
+    CHECK(context != NULL);
+    CHECK(mathcore_context_evaluate(context, "x = 4", &value) == MATHCORE_OK && value == 4.0);
+    CHECK(mathcore_context_evaluate(context, "f(t) = t^2 + x", NULL) == MATHCORE_OK);
+    CHECK(mathcore_context_evaluate(context, "f(3)", &value) == MATHCORE_OK && value == 13.0);
+    CHECK(mathcore_context_set_variable(context, "x", 10.0) == MATHCORE_OK);
+    CHECK(mathcore_context_evaluate(context, "f(3)", &value) == MATHCORE_OK && value == 19.0);
+
+    CHECK(mathcore_context_evaluate(context, "1 / 0", &value) == MATHCORE_EVALUATION_ERROR);
+    CHECK(strcmp(mathcore_context_error(context), "Division by zero") == 0);
+    CHECK(mathcore_context_evaluate(context, "(1 + 2", &value) == MATHCORE_SYNTAX_ERROR);
+    CHECK(mathcore_context_evaluate(NULL, "1", &value) == MATHCORE_INVALID_ARGUMENT);
+    mathcore_context_free(context);
+}
+
+static void testProgram(void) {
+    mathcore_context* context = mathcore_context_create();
+    const char* formulas[] = { "s * exp(-r * t)", "k * exp(-r * t)" };
+    const char* inputs[] = { "s", "r", "t" };
+    mathcore_program* program = NULL;
+    double row[3] = { 100.0, 0.05, 2.0 };
+    double outputs[2];
+    double s[4] = { 1.0, 2.0, 3.0, 4.0 };
+    double r[4] = { 0.0, 0.1, 0.2, 0.3 };
+    double t[4] = { 1.0, 1.0, 1.0, 1.0 };
+    double first[4];
+    double second[4];
+    const double* columns[3] = { s, r, t };
+    double* results[2] = { first, second };
+    int i;
+
+    CHECK(mathcore_compile(context, formulas, 2, inputs, 3, &program) == MATHCORE_COMPILE_ERROR);
+    CHECK(program == NULL);
+    CHECK(strcmp(mathcore_context_error(context), "Undefined variable: k") == 0);
+
+    mathcore_context_set_variable(context, "k", 50.0);
+    CHECK(mathcore_compile(context, formulas, 2, inputs, 3, &program) == MATHCORE_OK);
+    CHECK(mathcore_program_input_count(program) == 3);
+    CHECK(mathcore_program_output_count(program) == 2);
+
+    CHECK(mathcore_program_evaluate(program, row, outputs) == MATHCORE_OK);
+    CHECK(fabs(outputs[0] - 100.0 * exp(-0.1)) < 1e-12);
+    CHECK(fabs(outputs[1] - 50.0 * exp(-0.1)) < 1e-12);
+
+    CHECK(mathcore_program_evaluate_batch(program, columns, results, 4) == MATHCORE_OK);
+    for (i = 0; i < 4; ++i) {
+        CHECK(fabs(first[i] - s[i] * exp(-r[i])) < 1e-12);
+        CHECK(fabs(second[i] - 50.0 * exp(-r[i])) < 1e-12);
+    }
+    mathcore_program_free(program);
+
+    {
+        const char* root[] = { "sqrt(x)" };
+        const char* names[] = { "x" };
+        double negative = -1.0;
+        double result = 0.0;
+        CHECK(mathcore_compile(context, root, 1, names, 1, &program) == MATHCORE_OK);
+        CHECK(mathcore_program_evaluate(program, &negative, &result) == MATHCORE_EVALUATION_ERROR);
+        CHECK(strcmp(mathcore_program_error(program), "sqrt requires non-negative argument") == 0);
+        CHECK(mathcore_program_evaluate(program, NULL, &result) == MATHCORE_INVALID_ARGUMENT);
+        mathcore_program_free(program);
+    }
+    mathcore_context_free(context);
+}
+
+int main(void) {
+    testContext();
+    testProgram();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All C API checks passed\n");
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "Lexer.h"
+#include "Parser.h"
+#include "Evaluator.h"
+#include "Columnar.h"
+#include "ThreadPool.h"
+
+namespace {
+    struct TempFile {
+        std::string path;
+
+        explicit TempFile(const std::string& name)
+            : path{ "/tmp/mathcore_" + name + "_" + std::to_string(::getpid()) + ".cols" } {
+        }
+        ~TempFile() { std::remove(path.c_str()); }
+    };
+
+    Program compile(Evaluator& eval, const std::vector<std::string>& formulas, std::vector<std::string> inputs) {
+        std::vector<std::unique_ptr<ASTNode>> asts;
+        std::vector<const ASTNode*> roots;
+        for (const auto& formula : formulas) {
+            Lexer lexer(formula);
+            Parser parser(lexer.tokenize());
+            asts.push_back(parser.parseExpression());
+            roots.push_back(asts.back().get());
+        }
+        return eval.compile(roots, std::move(inputs));
+    }
+}
+
+TEST_CASE("Columnar: columns round-trip and start on aligned offsets") {
+    TempFile file("roundtrip");
+    std::vector<double> x = { 0.1, -2.5, std::numeric_limits<double>::infinity(), 1e-310, 3 };
+    std::vector<int64_t> n = { 1, -7, INT64_MAX, INT64_MIN, 0 };
+    ColumnWriter writer(file.path, { { "x", ColumnType::Float64 }, { "count", ColumnType::Int64 } }, x.size());
+    // Rows in any order, from any number of calls
+    writer.write(1, 0, std::span<const int64_t>(n));
+    writer.write(0, 3, std::span<const double>(x).subspan(3));
+    writer.write(0, 0, std::span<const double>(x).first(3));
+    REQUIRE_THROWS(writer.write(0, 4, std::span<const double>(x).first(2)));
+    REQUIRE_THROWS(writer.write(1, 0, std::span<const double>(x)));
+    writer.close();
+
+    ColumnFile columns(file.path);
+    REQUIRE(columns.rows() == x.size());
+    REQUIRE(columns.columns().size() == 2);
+    REQUIRE(columns.columns()[1].name == "count");
+    REQUIRE(columns.find("count") == 1);
+    REQUIRE_FALSE(columns.find("y"));
+    REQUIRE(std::vector<double>(columns.doubles(0).begin(), columns.doubles(0).end()) == x);
+    REQUIRE(std::vector<int64_t>(columns.integers(1).begin(), columns.integers(1).end()) == n);
+    REQUIRE_THROWS_WITH(columns.doubles(1), "Column count is not float64");
+    // Mapped pages are page aligned, so offsets that are multiples of 64 give cache-line aligned columns
+    REQUIRE(reinterpret_cast<uintptr_t>(columns.doubles(0).data()) % 64 == 0);
+    REQUIRE(reinterpret_cast<uintptr_t>(columns.integers(1).data()) % 64 == 0);
+}
+
+TEST_CASE("Columnar: evaluateColumns reads inputs in place and matches runBatch") {
+    TempFile in("eval_in"), out("eval_out"), serialOut("eval_serial");
+    const size_t rows = 200003; // Several chunks with a partial one at the end
+    std::vector<double> x(rows);
+    std::vector<int64_t> k(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        x[i] = 0.001 * static_cast<double>(i) - 50;
+        k[i] = static_cast<int64_t>(i % 97) - 40;
+    }
+    ColumnWriter writer(in.path, { { "k", ColumnType::Int64 }, { "unused", ColumnType::Int64 }, { "x", ColumnType::Float64 } }, rows);
+    writer.write(0, 0, std::span<const int64_t>(k));
+    writer.write(1, 0, std::span<const int64_t>(k));
+    writer.write(2, 0, std::span<const double>(x));
+    writer.close();
+
+    Evaluator eval;
+    std::vector<std::string> inputs = { "x", "k", "unused" };
+    auto program = compile(eval, { "sin(x) * k + 1", "if(x > 0, sqrt(x), -x)" }, inputs);
+    ColumnFile input(in.path);
+    ThreadPool pool(4);
+    ColumnWriter parallel(out.path, { { "y", ColumnType::Float64 }, { "z", ColumnType::Float64 } }, rows);
+    evaluateColumns(program, inputs, input, parallel, &pool);
+    parallel.close();
+    ColumnWriter serial(serialOut.path, { { "y", ColumnType::Float64 }, { "z", ColumnType::Float64 } }, rows);
+    evaluateColumns(program, inputs, input, serial);
+    serial.close();
+
+    std::vector<double> kd(k.begin(), k.end()), y(rows), z(rows);
+    const double* columns[] = { x.data(), kd.data(), kd.data() };
+    double* results[] = { y.data(), z.data() };
+    program.runBatch<double>(columns, results, rows);
+    ColumnFile a(out.path), b(serialOut.path);
+    REQUIRE(std::vector<double>(a.doubles(0).begin(), a.doubles(0).end()) == y);
+    REQUIRE(std::vector<double>(a.doubles(1).begin(), a.doubles(1).end()) == z);
+    REQUIRE(std::vector<double>(b.doubles(0).begin(), b.doubles(0).end()) == y);
+    REQUIRE(std::vector<double>(b.doubles(1).begin(), b.doubles(1).end()) == z);
+
+    std::vector<std::string> missing = { "x", "k", "w" };
+    ColumnWriter unused(serialOut.path, { { "y", ColumnType::Float64 }, { "z", ColumnType::Float64 } }, rows);
+    REQUIRE_THROWS_WITH(evaluateColumns(program, missing, input, unused), "Input column not found: w");
+}
+
+TEST_CASE("Columnar: CSV converts to columns and back") {
+    TempFile file("csv");
+    std::istringstream csv("t, price ,n\r\n0,1.5,3\n1,0.1,-4\n\n2,1e300,9223372036854775807\n");
+    csvToColumns(csv, file.path);
+    ColumnFile columns(file.path);
+    REQUIRE(columns.rows() == 3);
+    REQUIRE(columns.columns()[0].type == ColumnType::Int64);
+    REQUIRE(columns.columns()[1].name == "price");
+    REQUIRE(columns.columns()[1].type == ColumnType::Float64);
+    REQUIRE(columns.integers(2)[2] == INT64_MAX);
+    REQUIRE(columns.doubles(1)[1] == 0.1);
+
+    std::ostringstream back;
+    columnsToCsv(columns, back);
+    REQUIRE(back.str() == "t,price,n\n0,1.5,3\n1,0.1,-4\n2,1e+300,9223372036854775807\n");
+
+    std::istringstream ragged("a,b\n1,2\n3\n");
+    REQUIRE_THROWS_WITH(csvToColumns(ragged, file.path), "line 3: expected 2 fields, got 1");
+    std::istringstream text("a,b\n1,x\n");
+    REQUIRE_THROWS_WITH(csvToColumns(text, file.path), "line 2, column b: not a number: 'x'");
+}
+
+TEST_CASE("Columnar: malformed files are rejected") {
+    TempFile file("bad");
+    REQUIRE_THROWS_WITH(ColumnFile(file.path), "Cannot open " + file.path);
+    std::ofstream(file.path, std::ios::binary) << "MCPLOT01 and some more bytes";
+    REQUIRE_THROWS_WITH(ColumnFile(file.path), "Not a columnar file: " + file.path + " (bad magic)");
+
+    {
+        ColumnWriter writer(file.path, { { "x", ColumnType::Float64 } }, 1000);
+    }
+    // Cut off in the middle of the data
+    REQUIRE(::truncate(file.path.c_str(), 4000) == 0);
+    REQUIRE_THROWS_WITH(ColumnFile(file.path), "Not a columnar file: " + file.path + " (data of column 0 out of range)");
+}
@@ -0,0 +1,216 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "BulkLoad.h"
+#include "CodeGen.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+// Generated from tests/emit_cpp_formulas.txt by cmdCalc --emit-cpp while building
+#include "emitted_formulas.h"
+
+namespace {
+    struct Exported {
+        std::string signature;
+        // Empty for user functions; the text of an --expr in CMakeLists.txt otherwise
+        std::string body;
+        double (*scalar)(const double* args);
+        void (*batch)(const double* const* columns, double* out, size_t rows);
+    };
+
+    const std::vector<Exported> s_exported = {
+        { "growth(t)", "", [](const double* a) { return emitted::growth(a[0]); },
+            [](const double* const* c, double* out, size_t rows) { emitted::growth_batch(c[0], out, rows); } },
+        { "steps(n)", "", [](const double* a) { return emitted::steps(a[0]); },
+            [](const double* const* c, double* out, size_t rows) { emitted::steps_batch(c[0], out, rows); } },
+        { "root(x)", "", [](const double* a) { return emitted::root(a[0]); },
+            [](const double* const* c, double* out, size_t rows) { emitted::root_batch(c[0], out, rows); } },
+        { "trig(x)", "", [](const double* a) { return emitted::trig(a[0]); },
+            [](const double* const* c, double* out, size_t rows) { emitted::trig_batch(c[0], out, rows); } },
+        { "nested(x)", "", [](const double* a) { return emitted::nested(a[0]); },
+            [](const double* const* c, double* out, size_t rows) { emitted::nested_batch(c[0], out, rows); } },
+        { "guarded(x)", "", [](const double* a) { return emitted::guarded(a[0]); },
+            [](const double* const* c, double* out, size_t rows) { emitted::guarded_batch(c[0], out, rows); } },
+        // A parameter named after a keyword is renamed in the generated code
+        { "bump(int)", "", [](const double* a) { return emitted::bump(a[0]); },
+            [](const double* const* c, double* out, size_t rows) { emitted::bump_batch(c[0], out, rows); } },
+        { "special(x)", "", [](const double* a) { return emitted::special(a[0]); },
+            [](const double* const* c, double* out, size_t rows) { emitted::special_batch(c[0], out, rows); } },
+        { "angle(x, y)", "atan2(y, x) + asin(x / 2) - acos(y / 4)", [](const double* a) { return emitted::angle(a[0], a[1]); },
+            [](const double* const* c, double* out, size_t rows) { emitted::angle_batch(c[0], c[1], out, rows); } },
+        { "mix(x, y)", "min(x, y) * max(x, y) - abs(x - y) + floor(x) - ceil(y) + round(x * y) + growth(y)",
+            [](const double* a) { return emitted::mix(a[0], a[1]); },
+            [](const double* const* c, double* out, size_t rows) { emitted::mix_batch(c[0], c[1], out, rows); } },
+        { "logic(x, y)", "(x < y && y <= 2) || x == 3 || x != y && x >= -1", [](const double* a) { return emitted::logic(a[0], a[1]); },
+            [](const double* const* c, double* out, size_t rows) { emitted::logic_batch(c[0], c[1], out, rows); } },
+    };
+
+    const std::vector<double> s_grid = { -3, -1.5, -0.5, 0, 0.5, 1, 2, 3, 7.25 };
+
+    // A value, or the message of the exception thrown instead
+    struct Outcome {
+        double value{};
+        std::string error;
+    };
+
+    template<typename F>
+    Outcome capture(F f) {
+        try {
+            return { f(), {} };
+        }
+        catch (const std::exception& e) {
+            return { 0, e.what() };
+        }
+    }
+
+    Evaluator& formulas() {
+        static Evaluator evaluator = [] {
+            Evaluator e;
+            std::ifstream file(EMIT_CPP_FORMULAS);
+            loadDefinitions(e, std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+            return e;
+        }();
+        return evaluator;
+    }
+
+    // Every combination of grid values for `arity` arguments, row-major
+    std::vector<std::vector<double>> gridRows(size_t arity) {
+        std::vector<std::vector<double>> rows{ {} };
+        for (size_t i = 0; i < arity; ++i) {
+            std::vector<std::vector<double>> longer;
+            for (const auto& row : rows) {
+                for (double value : s_grid) {
+                    longer.push_back(row);
+                    longer.back().push_back(value);
+                }
+            }
+            rows = std::move(longer);
+        }
+        return rows;
+    }
+
+    bool sameBits(double a, double b) {
+        return (std::isnan(a) && std::isnan(b)) || (a == b && std::signbit(a) == std::signbit(b));
+    }
+
+    std::unique_ptr<ASTNode> parse(const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return parser.parseExpression();
+    }
+
+    // What the generated functions were made from, and the formula the interpreter evaluates
+    struct Reference {
+        CppFunction function;
+        std::unique_ptr<ASTNode> formula;
+    };
+
+    Reference reference(const Exported& exported) {
+        Evaluator& eval = formulas();
+        if (!exported.body.empty()) {
+            return { cppExpression(eval, exported.signature + " = " + exported.body), parse(exported.body) };
+        }
+        auto call = parse(exported.signature);
+        for (auto& function : userCppFunctions(eval)) {
+            if (function.name == call->getValue<std::string>()) {
+                return { std::move(function), std::move(call) };
+            }
+        }
+        throw std::runtime_error("Not exported: " + exported.signature);
+    }
+}
+
+TEST_CASE("EmitCpp: generated functions agree with the interpreter and compiled programs") {
+    Evaluator& eval = formulas();
+    REQUIRE(userCppFunctions(eval).size() == 9); // square is also inlined into nested
+    for (const auto& exported : s_exported) {
+        auto [function, formula] = reference(exported);
+        for (const auto& row : gridRows(function.inputs.size())) {
+            std::unordered_map<std::string, double> inputs;
+            for (size_t i = 0; i < row.size(); ++i) {
+                inputs[function.inputs[i]] = row[i];
+            }
+            Outcome interpreted = capture([&] { return eval.evaluate(*formula, &inputs); });
+            Outcome program = capture([&] { return function.program.run(std::span<const double>(row)); });
+            Outcome generated = capture([&] { return exported.scalar(row.data()); });
+            INFO(exported.signature << " at " << row[0] << (row.size() > 1 ? ", " + std::to_string(row[1]) : ""));
+            REQUIRE(generated.error == interpreted.error);
+            REQUIRE(generated.error == program.error);
+            REQUIRE(sameBits(generated.value, interpreted.value));
+            REQUIRE(sameBits(generated.value, program.value));
+        }
+    }
+}
+
+TEST_CASE("EmitCpp: batch functions match runBatch and fail where it does") {
+    for (const auto& exported : s_exported) {
+        auto [function, formula] = reference(exported);
+        // The rows that don't fail, repeated past a block to cover the tail
+        std::vector<std::vector<double>> columns(function.inputs.size());
+        for (int repeat = 0; repeat < 7; ++repeat) {
+            for (const auto& row : gridRows(function.inputs.size())) {
+                if (capture([&] { return exported.scalar(row.data()); }).error.empty()) {
+                    for (size_t i = 0; i < row.size(); ++i) {
+                        columns[i].push_back(row[i]);
+                    }
+                }
+            }
+        }
+        size_t rows = columns[0].size();
+        std::vector<const double*> inputs;
+        for (const auto& column : columns) {
+            inputs.push_back(column.data());
+        }
+        std::vector<double> expected(rows), generated(rows);
+        function.program.runBatch<double>(inputs, expected.data(), rows);
+        exported.batch(inputs.data(), generated.data(), rows);
+        INFO(exported.signature << " over " << rows << " rows");
+        for (size_t i = 0; i < rows; ++i) {
+            REQUIRE(sameBits(generated[i], expected[i]));
+        }
+    }
+
+    const double x[] = { 4, 9, -1, 16 };
+    const double* columns[] = { x };
+    double out[4];
+    REQUIRE_THROWS_WITH(emitted::root_batch(x, out, 4), "sqrt requires non-negative argument");
+    // The guard turns the failing row into a value the if() doesn't select
+    emitted::guarded_batch(x, out, 4);
+    REQUIRE(out[2] == 0.0);
+    REQUIRE(out[3] == std::log(15.0));
+    auto guarded = reference(s_exported[5]);
+    double expected[4];
+    guarded.function.program.runBatch<double>(columns, expected, 4);
+    REQUIRE(sameBits(out[2], expected[2]));
+}
+
+TEST_CASE("EmitCpp: functions that can't be exported are reported") {
+    Evaluator eval;
+    loadDefinitions(eval, "g(x) = rand() + x\nf(x) = x + 1");
+    auto functions = userCppFunctions(eval);
+    std::ostringstream out;
+    REQUIRE_THROWS_WITH(emitCpp(out, functions), "g: rand and randn cannot be exported to C++");
+    REQUIRE(out.str().empty());
+
+    Evaluator recursive;
+    loadDefinitions(recursive, "h(x) = if(x > 0, h(x - 1), 0)");
+    REQUIRE_THROWS_WITH(userCppFunctions(recursive), "h: Recursive functions cannot be compiled: h");
+
+    auto options = eval.compileOptions();
+    options.expandPowers = true;
+    eval.setCompileOptions(options);
+    auto expanded = userCppFunctions(eval);
+    REQUIRE_THROWS_WITH(emitCpp(out, std::span(expanded).subspan(0, 1)), "f: Programs compiled with contractFma, expandPowers "
+        "or polynomials round differently from the interpreter and can't be exported to C++");
+
+    options.expandPowers = false;
+    options.accuracy = Accuracy::Fast;
+    eval.setCompileOptions(options);
+    auto fast = userCppFunctions(eval);
+    REQUIRE_THROWS_WITH(emitCpp(out, std::span(fast).subspan(0, 1)), "f: Only programs compiled with strict accuracy can be exported to C++");
+}
@@ -1,7 +1,12 @@
 ﻿#define CATCH_CONFIG_MAIN
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
+#include <chrono>
 #include <cstdint>
+#include <cmath>
+#include <stop_token>
+#include <string>
+#include <thread>
 
 #include "Lexer.h"
 #include "Parser.h"
@@ -303,4 +308,403 @@ TEST_CASE("Function definition and evaluation") {
         auto ast2 = parser2.parseExpression();
         REQUIRE(eval.evaluate(*ast2) == Catch::Approx(8.0)); // f(4) = 4 * 2 = 8
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Range reductions") {
+    Evaluator eval;
+    SECTION("sum(i,1,100,i)") {
+        Lexer lexer("sum(i, 1, 100, i)");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(5050.0));
+    }
+    SECTION("prod(i,1,5,i)") {
+        Lexer lexer("prod(i, 1, 5, i)");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(120.0));
+    }
+    SECTION("Empty range") {
+        Lexer lexer("sum(i, 5, 1, i) + prod(i, 5, 1, i)");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(1.0));
+    }
+    SECTION("Large range spanning several blocks") {
+        Lexer lexer("sum(k, 1, 100000, 1/k^2)");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(1.6449240668982262).epsilon(1e-12));
+    }
+    SECTION("Nested sum uses the outer index") {
+        Lexer lexer("sum(i, 1, 4, sum(j, 1, i, j))");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(20.0));
+    }
+    SECTION("Body calls a user function with its parameter") {
+        Lexer lexer1("f(n) = sum(i, 1, n, i^2)");
+        Parser parser1(lexer1.tokenize());
+        auto ast1 = parser1.parseExpression();
+        eval.evaluate(*ast1);
+
+        Lexer lexer2("f(3)");
+        Parser parser2(lexer2.tokenize());
+        auto ast2 = parser2.parseExpression();
+        REQUIRE(eval.evaluate(*ast2) == Catch::Approx(14.0));
+    }
+    SECTION("integrate(x,0,pi,sin(x))") {
+        Lexer lexer("integrate(x, 0, pi, sin(x))");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(2.0).epsilon(1e-12));
+    }
+    SECTION("Non-integer bounds") {
+        Lexer lexer("sum(i, 0.5, 3, i)");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE_THROWS_AS(eval.evaluate(*ast), std::runtime_error);
+    }
+    SECTION("Domain error inside the body") {
+        Lexer lexer("sum(i, -2, 2, sqrt(i))");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE_THROWS_AS(eval.evaluate(*ast), std::runtime_error);
+    }
+}
+
+TEST_CASE("Factorial, gamma and combinatorics functions") {
+    Evaluator eval;
+    SECTION("170! is finite, 171! overflows") {
+        Lexer lexer("170!");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(7.257415615307994e306));
+
+        Lexer lexer2("factorial(171)");
+        Parser parser2(lexer2.tokenize());
+        auto ast2 = parser2.parseExpression();
+        REQUIRE(std::isinf(eval.evaluate(*ast2)));
+    }
+    SECTION("Factorial of a non-integer") {
+        Lexer lexer("2.5!");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE_THROWS_AS(eval.evaluate(*ast), std::runtime_error);
+    }
+    SECTION("gamma(0.5)") {
+        Lexer lexer("gamma(0.5)");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(1.7724538509055160).epsilon(1e-13));
+    }
+    SECTION("nCr(52,5)") {
+        Lexer lexer("nCr(52, 5)");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == 2598960.0);
+    }
+    SECTION("nPr(10,3)") {
+        Lexer lexer("nPr(10, 3)");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == 720.0);
+    }
+    SECTION("lfact(1000)") {
+        Lexer lexer("lfact(1000)");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(5912.128178488163).epsilon(1e-13));
+    }
+}
+
+TEST_CASE("Operator associativity") {
+    Evaluator eval;
+    SECTION("Subtraction is left-associative") {
+        Lexer lexer("10 - 4 - 3");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(3.0));
+    }
+    SECTION("Division and multiplication evaluate left to right") {
+        Lexer lexer("8 / 2 * 4");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(16.0));
+    }
+    SECTION("Power is right-associative") {
+        Lexer lexer("2 ^ 3 ^ 2");
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(512.0));
+    }
+    SECTION("Long generated chain") {
+        std::string text = "0";
+        for (int i = 1; i <= 100000; ++i) {
+            text += (i % 2 ? "+" : "-") + std::to_string(i % 7);
+        }
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        double expected = 0;
+        for (int i = 1; i <= 100000; ++i) {
+            expected += (i % 2 ? 1 : -1) * (i % 7);
+        }
+        REQUIRE(eval.evaluate(*ast) == Catch::Approx(expected));
+    }
+}
+
+TEST_CASE("Memoization of pure user functions") {
+    Evaluator eval;
+    eval.setMemoization(true);
+    auto run = [&eval](const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        return eval.evaluate(*ast);
+    };
+
+    SECTION("Repeated calls hit the cache") {
+        run("f(x) = x^2 + 1");
+        REQUIRE(run("f(3) + f(3) + f(4)") == Catch::Approx(37.0));
+        auto stats = eval.memoStats("f");
+        REQUIRE(stats.hits == 1);
+        REQUIRE(stats.misses == 2);
+        REQUIRE(stats.hitRate() == Catch::Approx(1.0 / 3.0));
+    }
+    SECTION("Redefining a callee invalidates callers") {
+        run("g(x) = x + 1");
+        run("f(x) = g(x) * 2");
+        REQUIRE(run("f(1)") == Catch::Approx(4.0));
+        REQUIRE(run("f(1)") == Catch::Approx(4.0));
+        run("g(x) = x + 2");
+        REQUIRE(run("f(1)") == Catch::Approx(6.0));
+    }
+    SECTION("Functions reading globals see reassignments") {
+        run("a = 1");
+        run("h(x) = x + a");
+        REQUIRE(run("h(1)") == Catch::Approx(2.0));
+        run("a = 5");
+        REQUIRE(run("h(1)") == Catch::Approx(6.0));
+    }
+    SECTION("Reduction indices are not globals") {
+        run("s(n) = sum(i, 1, n, i)");
+        REQUIRE(run("s(10) + s(10)") == Catch::Approx(110.0));
+        run("i = 3");
+        REQUIRE(eval.memoStats("s").hits == 1);
+        REQUIRE(run("s(10)") == Catch::Approx(55.0));
+        REQUIRE(eval.memoStats("s").hits == 2);
+    }
+    SECTION("Functions with assignments are never cached") {
+        run("k(x) = (b = x)");
+        run("k(2)");
+        run("k(2)");
+        REQUIRE(eval.memoStats("k").hits == 0);
+        REQUIRE(eval.memoStats("k").misses == 0);
+    }
+    SECTION("Memoization is off by default") {
+        Evaluator plain;
+        Lexer lexer1("f(x) = x * 2");
+        Parser parser1(lexer1.tokenize());
+        auto ast1 = parser1.parseExpression();
+        plain.evaluate(*ast1);
+        Lexer lexer2("f(1) + f(1)");
+        Parser parser2(lexer2.tokenize());
+        auto ast2 = parser2.parseExpression();
+        REQUIRE(plain.evaluate(*ast2) == Catch::Approx(4.0));
+        REQUIRE(plain.memoStats("f").hits == 0);
+    }
+}
+
+TEST_CASE("Evaluation budgets") {
+    Evaluator eval;
+    auto parse = [](const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return parser.parseExpression();
+    };
+    eval.evaluate(*parse("f(x) = x + 1"));
+    eval.evaluate(*parse("g(x) = f(f(f(f(x))))"));
+    eval.evaluate(*parse("h(x) = g(g(g(g(x))))"));
+
+    SECTION("Unlimited budgets change nothing") {
+        REQUIRE(eval.evaluate(*parse("h(0)"), EvaluationBudget{}) == 16.0);
+    }
+    SECTION("Step limit counts interpreted nodes") {
+        auto call = parse("h(0)");
+        REQUIRE(eval.evaluate(*call, EvaluationBudget{ .maxSteps = 1000 }) == 16.0);
+        try {
+            eval.evaluate(*call, EvaluationBudget{ .maxSteps = 20 });
+            FAIL("expected BudgetExceeded");
+        }
+        catch (const BudgetExceeded& e) {
+            REQUIRE(e.limit() == BudgetExceeded::Limit::Steps);
+            REQUIRE(std::string(e.what()) == "Evaluation step limit exceeded");
+        }
+        // The budget ends with the evaluation
+        REQUIRE(eval.evaluate(*call) == 16.0);
+    }
+    SECTION("Step limit counts compiled reduction rows") {
+        REQUIRE(eval.evaluate(*parse("sum(i, 1, 100, i)"), EvaluationBudget{ .maxSteps = 10000 }) == 5050.0);
+        REQUIRE_THROWS_AS(eval.evaluate(*parse("sum(i, 1, 100000000, i^2)"), EvaluationBudget{ .maxSteps = 100000 }),
+            BudgetExceeded);
+        // Interpreted bodies (here an assignment) are charged per node
+        REQUIRE_THROWS_AS(eval.evaluate(*parse("sum(i, 1, 100000000, y = i)"), EvaluationBudget{ .maxSteps = 100000 }),
+            BudgetExceeded);
+    }
+    SECTION("Deadline") {
+        auto start = std::chrono::steady_clock::now();
+        EvaluationBudget budget{ .deadline = start + std::chrono::milliseconds(20) };
+        try {
+            eval.evaluate(*parse("sum(i, 1, 10000000000, sqrt(i))"), budget);
+            FAIL("expected BudgetExceeded");
+        }
+        catch (const BudgetExceeded& e) {
+            REQUIRE(e.limit() == BudgetExceeded::Limit::Deadline);
+        }
+        REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+    }
+    SECTION("Cancellation from another thread") {
+        std::stop_source source;
+        std::thread canceller([&source] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            source.request_stop();
+        });
+        try {
+            eval.evaluate(*parse("sum(i, 1, 10000000000, y = i)"), EvaluationBudget{ .cancellation = source.get_token() });
+            FAIL("expected BudgetExceeded");
+        }
+        catch (const BudgetExceeded& e) {
+            REQUIRE(e.limit() == BudgetExceeded::Limit::Cancelled);
+        }
+        canceller.join();
+        // A token that is already stopped fails before any work
+        REQUIRE_THROWS_WITH(eval.evaluate(*parse("1"), EvaluationBudget{ .cancellation = source.get_token() }),
+            "Evaluation cancelled");
+    }
+    SECTION("Memoized results are not cached from an interrupted call") {
+        eval.setMemoization(true);
+        eval.evaluate(*parse("s(n) = sum(i, 1, n, i)"));
+        REQUIRE_THROWS_AS(eval.evaluate(*parse("s(1000000)"), EvaluationBudget{ .maxSteps = 1000 }), BudgetExceeded);
+        REQUIRE(eval.evaluate(*parse("s(1000000)")) == 500000500000.0);
+        REQUIRE(eval.memoStats("s").hits == 0);
+    }
+}
+
+TEST_CASE("Integer arithmetic is exact in int64") {
+    Evaluator eval;
+    auto evaluate = [&eval](const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return eval.evaluate(*parser.parseExpression());
+    };
+
+    SECTION("Intermediates beyond 2^53 stay exact") {
+        // 123456789 * 987654321 = 121932631112635269, which double rounds to ...264
+        REQUIRE(evaluate("123456789 * 987654321 % 1000000007") == 259106859.0);
+        REQUIRE(evaluate("2^62 + 1 - 2^62") == 1.0);
+        REQUIRE(evaluate("(2^60 + 3) \\ 2 - 2^59") == 1.0);
+        REQUIRE(evaluate("20! / 19! + 20! - 20!") == 20.0);
+        eval.setVariable("id", 3000000019.0);
+        REQUIRE(evaluate("(id * 2654435761) % 1024") == 547.0); // 0 in double
+    }
+    SECTION("Overflow falls back to double") {
+        REQUIRE(evaluate("2^63") == std::ldexp(1.0, 63));
+        REQUIRE(evaluate("2^62 * 4 - 2^64") == 0.0);
+        REQUIRE(evaluate("3037000500 * 3037000500") == 3037000500.0 * 3037000500.0);
+        REQUIRE(evaluate("25!") == Catch::Approx(1.5511210043330986e25));
+        REQUIRE(evaluate("-(-2^62 * 2)") == std::ldexp(1.0, 63));
+    }
+    SECTION("Division, floor division and modulus") {
+        REQUIRE(evaluate("7 / 2") == 3.5);
+        REQUIRE(evaluate("-7 \\ 2") == -4.0);
+        REQUIRE(evaluate("7 \\ -2") == -4.0);
+        REQUIRE(evaluate("-7 % 3") == -1.0);
+        REQUIRE(evaluate("7.9 % 2.5") == 1.0);
+        REQUIRE(evaluate("10000000000 % 7") == 10000000000.0 - 7.0 * 1428571428.0);
+        REQUIRE_THROWS_WITH(evaluate("5 % 0"), "Division by zero");
+        REQUIRE_THROWS_WITH(evaluate("5 % 0.5"), "Division by zero");
+        REQUIRE_THROWS_WITH(evaluate("5 \\ 0"), "Division by zero");
+    }
+    SECTION("Zero keeps the sign double arithmetic gives it") {
+        REQUIRE(std::signbit(evaluate("-0")));
+        REQUIRE(std::signbit(evaluate("0 * -3")));
+        REQUIRE(std::signbit(evaluate("-6 % 3")));
+        REQUIRE(std::signbit(evaluate("0 \\ -5")));
+        REQUIRE(std::signbit(evaluate("0 \\ -2")));
+        REQUIRE(std::signbit(evaluate("0 / -2")));
+        REQUIRE_FALSE(std::signbit(evaluate("-1 \\ -2")));
+        REQUIRE_FALSE(std::signbit(evaluate("1 \\ 2")));
+        REQUIRE(evaluate("atan2(-1 \\ -2, -1)") == Catch::Approx(3.141592653589793));
+        REQUIRE_FALSE(std::signbit(evaluate("3 - 3")));
+    }
+    SECTION("Compiled reduction bodies give the interpreter's integers") {
+        // Large enough a range to run in parallel blocks
+        REQUIRE(evaluate("sum(i, 1, 100000, (2^53 + i) % 2)") == 50000.0);
+        REQUIRE(evaluate("sum(i, 1, 4, (3037000499 * 3037000499 + i) % 10)") == 14.0);
+        REQUIRE(evaluate("prod(i, 1, 3, 2^53 + i - 2^53)") == 6.0);
+    }
+    SECTION("Subtracting zero keeps a sum exact") {
+        REQUIRE(evaluate("(2^53 + 1 - 0) % 2") == 1.0);
+        REQUIRE(evaluate("(-0 + 2^53 + 1) % 2") == 1.0);
+        REQUIRE(evaluate("2^62 + 1 - 0 - 2^62") == 1.0);
+        REQUIRE(std::signbit(evaluate("-0 - 0")));
+        REQUIRE_FALSE(std::signbit(evaluate("0 - 0")));
+    }
+}
+
+TEST_CASE("Comparisons, logical operators and if") {
+    Evaluator eval;
+    auto evaluate = [&eval](const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return eval.evaluate(*parser.parseExpression());
+    };
+
+    SECTION("Comparisons give 1 or 0") {
+        REQUIRE(evaluate("1 < 2") == 1.0);
+        REQUIRE(evaluate("2 <= 1") == 0.0);
+        REQUIRE(evaluate("3 > 2 + 1") == 0.0);
+        REQUIRE(evaluate("3 >= 2 + 1") == 1.0);
+        REQUIRE(evaluate("0.1 + 0.2 == 0.3") == 0.0);
+        REQUIRE(evaluate("1 != 1") == 0.0);
+        REQUIRE(evaluate("3! == 6") == 1.0);
+        REQUIRE(evaluate("3!==6") == 1.0);
+        REQUIRE_THROWS(evaluate("1 < = 2"));
+        REQUIRE(evaluate("3 > 2 > 1") == 0.0); // (3 > 2) > 1
+        eval.setVariable("nan", std::nan(""));
+        REQUIRE(evaluate("nan == nan") == 0.0);
+        REQUIRE(evaluate("nan != nan") == 1.0);
+        REQUIRE(evaluate("nan < 1 || nan >= 1") == 0.0);
+    }
+    SECTION("Integers compare exactly") {
+        REQUIRE(evaluate("2^53 + 1 > 2^53") == 1.0);
+        REQUIRE(evaluate("2^62 + 1 == 2^62") == 0.0);
+        REQUIRE(evaluate("(2^62 - 1) * 2 + 1 < 2^63") == 1.0); // INT64_MAX against the double 2^63
+        REQUIRE(evaluate("3 < 3.5 && -3 > -3.5") == 1.0);
+    }
+    SECTION("&& and || short-circuit") {
+        REQUIRE(evaluate("0 && 1 / 0") == 0.0);
+        REQUIRE(evaluate("2 || log(-1)") == 1.0);
+        REQUIRE(evaluate("1 && 2 && 3") == 1.0);
+        REQUIRE(evaluate("0 || 0 || 0.5") == 1.0);
+        REQUIRE_THROWS_WITH(evaluate("1 && 1 / 0"), "Division by zero");
+        evaluate("x = 0");
+        evaluate("0 && (x = 5)");
+        REQUIRE(evaluate("x") == 0.0);
+    }
+    SECTION("if evaluates only the branch taken") {
+        REQUIRE(evaluate("if(2 > 1, 10, 1 / 0)") == 10.0);
+        REQUIRE(evaluate("if(0, log(0), -1)") == -1.0);
+        evaluate("step(x) = if(x < 0, 0, if(x < 1, x, 1))");
+        REQUIRE(evaluate("step(-2) + step(0.5) + step(7)") == 1.5);
+        evaluate("fib(n) = if(n < 2, n, fib(n - 1) + fib(n - 2))");
+        REQUIRE(evaluate("fib(20)") == 6765.0);
+        REQUIRE_THROWS_WITH(evaluate("if(1, 2)"), "if expects 3 arguments");
+    }
+    SECTION("Piecewise bodies compile to selects in reductions") {
+        // |i - 50| summed without abs; log only where it is defined
+        REQUIRE(evaluate("sum(i, 1, 100, if(i < 50, 50 - i, i - 50))") == 2500.0);
+        REQUIRE(evaluate("sum(i, -1000, 1000, if(i > 0 && log(i) > 1, 1, 0))") == 998.0);
+    }
+}
@@ -0,0 +1,161 @@
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+#include "Lexer.h"
+#include "Parser.h"
+#include "Evaluator.h"
+#include "FastMath.h"
+
+namespace {
+    using fastmath::Function;
+
+    struct Domain {
+        double lo, hi;
+        bool logarithmic; // Uniform in log2(x), for arguments spanning many binades
+    };
+
+    struct Bound {
+        Function function;
+        long double (*reference)(long double);
+        double ulps;      // Accuracy::Ulp, in units of the last place of the rounded reference
+        double relative;  // Accuracy::Fast
+        std::vector<Domain> domains;
+    };
+
+    double ulpsBetween(double y, long double reference) {
+        double rounded = static_cast<double>(reference);
+        double ulp = rounded == 0 ? std::numeric_limits<double>::denorm_min()
+            : std::max(std::ldexp(1.0, std::ilogb(rounded) - 52), std::numeric_limits<double>::denorm_min());
+        return static_cast<double>(std::fabs(y - reference) / ulp);
+    }
+
+    const std::vector<Bound> s_bounds = {
+        { Function::Sin, sinl, 1, 1e-8, { { -10, 10, false }, { -1e6, 1e6, false }, { -1e-3, 1e-3, false } } },
+        { Function::Cos, cosl, 1, 1e-8, { { -10, 10, false }, { -1e6, 1e6, false }, { 1.5, 1.6, false } } },
+        { Function::Tan, tanl, 2.5, 1e-8, { { -10, 10, false }, { -1e6, 1e6, false }, { 1.5, 1.6, false } } },
+        { Function::Exp, expl, 1, 1e-8, { { -708, 709.7, false }, { -1, 1, false }, { -745, -708, false } } },
+        { Function::Log, logl, 1, 1e-8, { { -1074, 1023, true }, { 0.7, 1.42, false }, { 0.999, 1.001, false } } },
+        { Function::Log10, log10l, 2, 1e-8, { { -1074, 1023, true }, { 0.7, 1.42, false } } },
+    };
+}
+
+TEST_CASE("FastMath: kernels stay within their documented error bounds") {
+    std::mt19937_64 rng(2024);
+    std::vector<double> x(100000), ulp(x.size()), fast(x.size());
+    for (const auto& bound : s_bounds) {
+        for (const auto& domain : bound.domains) {
+            std::uniform_real_distribution<double> pick(domain.lo, domain.hi);
+            for (double& v : x) {
+                v = domain.logarithmic ? std::exp2(pick(rng)) : pick(rng);
+            }
+            fastmath::apply(bound.function, Accuracy::Ulp, x, ulp.data());
+            fastmath::apply(bound.function, Accuracy::Fast, x, fast.data());
+            double maxUlps = 0;
+            double maxRelative = 0;
+            for (size_t i = 0; i < x.size(); ++i) {
+                long double reference = bound.reference(x[i]);
+                maxUlps = std::max(maxUlps, ulpsBetween(ulp[i], reference));
+                // exp's subnormal results have fewer significant bits than the bound
+                if (std::fabs(reference) >= std::numeric_limits<double>::min()) {
+                    maxRelative = std::max(maxRelative, static_cast<double>(std::fabs((fast[i] - reference) / reference)));
+                }
+            }
+            INFO("function " << static_cast<int>(bound.function) << " on [" << domain.lo << ", " << domain.hi << "]");
+            CHECK(maxUlps <= bound.ulps);
+            CHECK(maxRelative <= bound.relative);
+        }
+    }
+}
+
+TEST_CASE("FastMath: special values follow the C library") {
+    const double inf = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    for (Accuracy accuracy : { Accuracy::Ulp, Accuracy::Fast }) {
+        REQUIRE(fastmath::apply(Function::Exp, accuracy, inf) == inf);
+        REQUIRE(fastmath::apply(Function::Exp, accuracy, 710.0) == inf);
+        REQUIRE(fastmath::apply(Function::Exp, accuracy, -inf) == 0.0);
+        REQUIRE(fastmath::apply(Function::Exp, accuracy, 0.0) == 1.0);
+        REQUIRE(std::isnan(fastmath::apply(Function::Exp, accuracy, nan)));
+        REQUIRE(fastmath::apply(Function::Log, accuracy, 0.0) == -inf);
+        REQUIRE(fastmath::apply(Function::Log, accuracy, inf) == inf);
+        REQUIRE(fastmath::apply(Function::Log, accuracy, 1.0) == 0.0);
+        REQUIRE(std::isnan(fastmath::apply(Function::Log, accuracy, -1.0)));
+        REQUIRE(std::isnan(fastmath::apply(Function::Log10, accuracy, nan)));
+        REQUIRE(fastmath::apply(Function::Log10, accuracy, 1.0) == 0.0);
+        REQUIRE(std::signbit(fastmath::apply(Function::Sin, accuracy, -0.0)));
+        REQUIRE(std::signbit(fastmath::apply(Function::Tan, accuracy, -0.0)));
+        REQUIRE(fastmath::apply(Function::Cos, accuracy, 0.0) == 1.0);
+        REQUIRE(std::isnan(fastmath::apply(Function::Sin, accuracy, inf)));
+        // Past 2^20 the C library takes over
+        REQUIRE(fastmath::apply(Function::Sin, accuracy, 1e22) == std::sin(1e22));
+    }
+    REQUIRE(fastmath::find("cos") == Function::Cos);
+    REQUIRE_FALSE(fastmath::find("atan"));
+    REQUIRE(fastmath::parseAccuracy("fast") == Accuracy::Fast);
+    REQUIRE_FALSE(fastmath::parseAccuracy("exact"));
+}
+
+TEST_CASE("FastMath: the accuracy option selects kernels for programs and the interpreter") {
+    Evaluator eval;
+    auto options = eval.compileOptions();
+    options.accuracy = Accuracy::Fast;
+    eval.setCompileOptions(options);
+
+    Lexer lexer("exp(x) * sin(x) + log(x)");
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    auto program = eval.compile(*ast, { "x" });
+    REQUIRE(program.accuracy() == Accuracy::Fast);
+
+    std::vector<double> xs(1000), ys(xs.size());
+    std::vector<float> xf(xs.size()), yf(xs.size());
+    for (size_t i = 0; i < xs.size(); ++i) {
+        xs[i] = 0.01 + 0.013 * static_cast<double>(i);
+        xf[i] = static_cast<float>(xs[i]);
+    }
+    const double* columns[] = { xs.data() };
+    program.runBatch<double>(columns, ys.data(), xs.size());
+    const float* floatColumns[] = { xf.data() };
+    program.runBatch<float>(floatColumns, yf.data(), xf.size());
+    for (size_t i = 0; i < xs.size(); i += 37) {
+        double x = xs[i];
+        double kernels = fastmath::apply(Function::Exp, Accuracy::Fast, x) * fastmath::apply(Function::Sin, Accuracy::Fast, x)
+            + fastmath::apply(Function::Log, Accuracy::Fast, x);
+        REQUIRE(ys[i] == kernels);
+        eval.setVariable("x", x);
+        REQUIRE(eval.evaluate(*ast) == kernels);
+        double exact = std::exp(x) * std::sin(x) + std::log(x);
+        REQUIRE(std::fabs(ys[i] - exact) <= 1e-7 * std::max(1.0, std::fabs(exact)));
+        REQUIRE(std::fabs(yf[i] - exact) <= 1e-5 * std::max(1.0, std::fabs(exact)));
+    }
+
+    // Domain errors are unchanged, and a guard still turns them into NaN
+    const double negative[] = { -1.0 };
+    REQUIRE_THROWS_WITH(program.run(std::span(negative)), "log requires positive argument");
+    Lexer guardedLexer("if(x > 0, log(x), 0)");
+    Parser guardedParser(guardedLexer.tokenize());
+    auto guardedAst = guardedParser.parseExpression();
+    auto guarded = eval.compile(*guardedAst, { "x" });
+    const double mixed[] = { -1.0, 1.0, 10.0 };
+    double out[3];
+    const double* mixedColumns[] = { mixed };
+    guarded.runBatch<double>(mixedColumns, out, 3);
+    REQUIRE(out[0] == 0.0);
+    REQUIRE(out[2] == fastmath::apply(Function::Log, Accuracy::Fast, 10.0));
+
+    // Arrays go through the kernels a whole array at a time
+    Lexer arrayLexer("sin(linspace(0, 3, 7))");
+    Parser arrayParser(arrayLexer.tokenize());
+    auto arrayAst = arrayParser.parseExpression();
+    auto values = std::get<Array>(eval.evaluateValue(*arrayAst));
+    REQUIRE(values[3] == fastmath::apply(Function::Sin, Accuracy::Fast, 1.5));
+
+    options.accuracy = Accuracy::Strict;
+    eval.setCompileOptions(options);
+    eval.setVariable("x", 2.0);
+    REQUIRE(eval.evaluate(*ast) == std::exp(2.0) * std::sin(2.0) + std::log(2.0));
+    REQUIRE(eval.compile(*ast, { "x" }).accuracy() == Accuracy::Strict);
+}
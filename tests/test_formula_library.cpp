@@ -0,0 +1,133 @@
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "FormulaLibrary.h"
+#include "Lexer.h"
+#include "Parser.h"
+
+namespace {
+    // A library file under /tmp, removed when the test ends
+    struct TempLibrary {
+        std::string path;
+
+        explicit TempLibrary(const std::string& name)
+            : path{ "/tmp/mathcore_" + name + "_" + std::to_string(::getpid()) + ".txt" } {
+        }
+        ~TempLibrary() { std::remove(path.c_str()); }
+
+        void write(const std::string& text) const {
+            // Replace rather than truncate, as editors do, so readers of the old file never see half of it
+            std::string staging = path + ".new";
+            std::ofstream(staging) << text;
+            std::rename(staging.c_str(), path.c_str());
+        }
+    };
+}
+
+TEST_CASE("FormulaLibrary: loads definitions and calls compiled functions") {
+    TempLibrary file("load");
+    file.write("# rates\n\nrate = 0.5\nscale(x) = x * rate\nsquare(x) = x^2 + offset\noffset = 1\n");
+    FormulaLibrary library(file.path);
+    REQUIRE(library.version() == 1);
+    REQUIRE(library.call("scale", 4.0) == 2.0);
+    REQUIRE(library.call("square", 3.0) == 10.0); // offset is defined after square
+    REQUIRE_THROWS_WITH(library.call("missing", 1.0), "Undefined function: missing");
+
+    auto snapshot = library.read();
+    Lexer lexer("scale(y) + rate");
+    Parser parser(lexer.tokenize());
+    auto program = snapshot->compile(*parser.parseExpression(), { "y" });
+    double y = 6.0;
+    REQUIRE(program.run(std::span(&y, 1)) == 3.5);
+}
+
+TEST_CASE("FormulaLibrary: a failed reload keeps the previous snapshot") {
+    TempLibrary file("failed");
+    file.write("f(x) = x + 1\n");
+    FormulaLibrary library(file.path);
+
+    file.write("f(x) = x + 2\n1 + 2\n");
+    REQUIRE_FALSE(library.reload());
+    REQUIRE(library.lastError() == file.path + ":2: expected a definition");
+    REQUIRE(library.call("f", 1.0) == 2.0);
+    REQUIRE(library.version() == 1);
+
+    file.write("f(x) = x + 2\n");
+    REQUIRE(library.reload());
+    REQUIRE(library.call("f", 1.0) == 3.0);
+    REQUIRE(library.version() == 2);
+
+    REQUIRE_THROWS(FormulaLibrary(file.path + ".absent"));
+}
+
+TEST_CASE("FormulaLibrary: a read guard pins its snapshot across reloads") {
+    TempLibrary file("pinned");
+    file.write("f(x) = x * 10\n");
+    FormulaLibrary library(file.path);
+    {
+        auto pinned = library.read();
+        file.write("f(x) = x * 20\n");
+        REQUIRE(library.reload());
+        REQUIRE(library.call("f", 1.0) == 20.0);
+        REQUIRE(pinned->call("f", 1.0) == 10.0);
+        REQUIRE(library.retiredCount() == 1);
+    }
+    // Reclaimed at the next swap once the guard is gone
+    REQUIRE(library.reload());
+    REQUIRE(library.retiredCount() == 0);
+}
+
+TEST_CASE("FormulaLibrary: readers see whole snapshots while a writer reloads") {
+    TempLibrary file("concurrent");
+    file.write("k = 0\nf(x) = x + k\ng(x) = x - k\n");
+    FormulaLibrary library(file.path);
+
+    std::atomic<bool> done{};
+    std::atomic<size_t> torn{};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&] {
+            while (!done.load()) {
+                auto snapshot = library.read();
+                // Both functions come from the same file version, so they always cancel
+                if (snapshot->call("f", 1.0) + snapshot->call("g", 1.0) != 2.0
+                    || snapshot->call("f", 0.0) != static_cast<double>(snapshot->version - 1)) {
+                    ++torn;
+                }
+            }
+        });
+    }
+    for (int version = 1; version < 100; ++version) {
+        file.write("k = " + std::to_string(version) + "\nf(x) = x + k\ng(x) = x - k\n");
+        REQUIRE(library.reload());
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    REQUIRE(torn == 0);
+    REQUIRE(library.version() == 100);
+    REQUIRE(library.reload());
+    REQUIRE(library.retiredCount() == 0);
+}
+
+TEST_CASE("FormulaLibrary: watch() reloads when the file is replaced") {
+    TempLibrary file("watched");
+    file.write("f(x) = x\n");
+    FormulaLibrary library(file.path);
+    library.watch();
+
+    file.write("f(x) = 2 * x\n");
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (library.version() == 1 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    REQUIRE(library.version() == 2);
+    REQUIRE(library.call("f", 4.0) == 8.0);
+}
@@ -2,6 +2,7 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
 #include <cstdint>
+#include <vector>
 #include "Lexer.h"
 
 TEST_CASE("Decimal numbers and leading dots") {
@@ -205,3 +206,51 @@ TEST_CASE("Invalid double dot number") {
     Lexer lexer("1..2");
     REQUIRE_THROWS_AS(lexer.tokenize(), std::runtime_error);
 }
+
+TEST_CASE("Token positions are offsets into the original text") {
+    Lexer lexer("  foo(x1.5e2 ,  -yy)! ");
+    auto tokens = lexer.tokenize();
+    std::vector<size_t> positions;
+    for (const auto& token : tokens) {
+        positions.push_back(token.m_position);
+    }
+    // foo ( x 1.5e2 , - yy ) !
+    REQUIRE(positions == std::vector<size_t>{ 2, 5, 6, 7, 13, 16, 17, 19, 20 });
+}
+
+TEST_CASE("Comparison and logical operators") {
+    Lexer pairs("a <= b != 3! && c > d || x == 1 < 2");
+    auto tokens = pairs.tokenize();
+    REQUIRE(tokens.size() == 16);
+    REQUIRE(tokens[1].getValue<OperatorType>() == OperatorType::LessEqual);
+    REQUIRE(tokens[3].getValue<OperatorType>() == OperatorType::NotEqual);
+    REQUIRE(tokens[5].getValue<OperatorType>() == OperatorType::Factorial);
+    REQUIRE(tokens[6].getValue<OperatorType>() == OperatorType::And);
+    REQUIRE(tokens[8].getValue<OperatorType>() == OperatorType::Greater);
+    REQUIRE(tokens[10].getValue<OperatorType>() == OperatorType::Or);
+    REQUIRE(tokens[12].getValue<OperatorType>() == OperatorType::Equal);
+    REQUIRE(tokens[14].getValue<OperatorType>() == OperatorType::Less);
+    REQUIRE(tokens[12].m_position == 27);
+
+    Lexer single("a & b");
+    REQUIRE_THROWS_WITH(single.tokenize(), "Expected '&&' at position 2");
+}
+
+TEST_CASE("Two-character operators need adjacent characters") {
+    auto operators = [](const std::string& text) {
+        std::vector<OperatorType> ops;
+        for (const auto& token : Lexer(text).tokenize()) {
+            if (token.m_tType == TokenType::Operator) {
+                ops.push_back(token.getValue<OperatorType>());
+            }
+        }
+        return ops;
+    };
+    const std::vector<OperatorType> factorialEqual = { OperatorType::Factorial, OperatorType::Equal };
+    REQUIRE(operators("3! == 6") == factorialEqual);
+    REQUIRE(operators("3!==6") == factorialEqual);
+    REQUIRE(operators("a < = b") == std::vector<OperatorType>{ OperatorType::Less, OperatorType::Assignment });
+    REQUIRE(operators("a ! = b") == std::vector<OperatorType>{ OperatorType::Factorial, OperatorType::Assignment });
+    REQUIRE(operators("a != b") == std::vector<OperatorType>{ OperatorType::NotEqual });
+    REQUIRE_THROWS_WITH(Lexer("a & & b").tokenize(), "Expected '&&' at position 2");
+}
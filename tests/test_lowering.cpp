@@ -0,0 +1,173 @@
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "Lexer.h"
+#include "Parser.h"
+#include "Evaluator.h"
+
+namespace {
+    std::unique_ptr<ASTNode> parse(const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return parser.parseExpression();
+    }
+
+    // Distance in representable doubles; both zeros are 0 and NaNs only match NaNs
+    uint64_t ulpDistance(double a, double b) {
+        if (std::isnan(a) || std::isnan(b)) {
+            return std::isnan(a) && std::isnan(b) ? 0 : std::numeric_limits<uint64_t>::max();
+        }
+        auto ordered = [](double x) {
+            auto bits = std::bit_cast<int64_t>(x);
+            return bits < 0 ? std::numeric_limits<int64_t>::min() - bits : bits;
+        };
+        int64_t l = ordered(a);
+        int64_t r = ordered(b);
+        return l > r ? static_cast<uint64_t>(l) - static_cast<uint64_t>(r) : static_cast<uint64_t>(r) - static_cast<uint64_t>(l);
+    }
+
+    // Special values plus a log-uniform spread of magnitudes of both signs
+    std::vector<double> sampleInputs() {
+        std::vector<double> values = {
+            0.0, -0.0, 1.0, -1.0, 0.5, 2.0, 3.0, -3.0, 1e-300, -1e-300, 1e300, -1e300,
+            std::numeric_limits<double>::denorm_min(), std::numeric_limits<double>::max(),
+            std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+            std::numeric_limits<double>::quiet_NaN(),
+        };
+        std::mt19937_64 rng(42);
+        std::uniform_real_distribution<double> exponent(-40.0, 40.0);
+        for (int i = 0; i < 300; ++i) {
+            double magnitude = std::pow(10.0, exponent(rng));
+            values.push_back(i % 2 ? magnitude : -magnitude);
+        }
+        return values;
+    }
+}
+
+TEST_CASE("Lowering: differential corpus against the interpreter") {
+    struct Case {
+        const char* text;
+        uint64_t maxUlps;
+    };
+    const Case corpus[] = {
+        { "x^0", 0 }, { "x^1", 0 }, { "x^2", 1 }, { "x^3", 3 }, { "x^4", 3 }, { "x^5", 5 },
+        { "x^7", 7 }, { "x^8", 7 }, { "x^13", 13 }, { "x^16", 15 }, { "x^17", 0 },
+        { "x^-1", 1 }, { "x^-2", 0 }, { "x^0.5", 1 }, { "x^1.5", 0 },
+        { "x / 4", 0 }, { "x / 0.125", 0 }, { "x / -1024", 0 }, { "x / 3", 0 }, { "x / 0", 0 },
+        { "y / 2^-130", 0 }, { "(x + y)^2 / 2", 1 }, { "x^2 + y^3", 4 }, { "(x / 8)^0.5 * y^-1", 2 },
+    };
+    const auto inputs = sampleInputs();
+    const double ys[] = { 0.75, -2.5, 1e-10 };
+
+    for (const auto& [text, expandedUlps] : corpus) {
+        // Without expandPowers every rewrite is exact
+        for (bool expand : { false, true }) {
+            INFO(text << (expand ? " with" : " without") << " expandPowers");
+            uint64_t maxUlps = expand ? expandedUlps : 0;
+            auto ast = parse(text);
+            Evaluator eval;
+            eval.setCompileOptions({ .expandPowers = expand });
+            auto program = eval.compile(*ast, { "x", "y" });
+            for (double y : ys) {
+                for (double x : inputs) {
+                    INFO("x = " << x << ", y = " << y);
+                    eval.setVariable("x", x);
+                    eval.setVariable("y", y);
+                    std::vector<double> row = { x, y };
+                    bool interpreterThrew = false;
+                    double expected = 0;
+                    try {
+                        expected = eval.evaluate(*ast);
+                    }
+                    catch (const std::runtime_error&) {
+                        interpreterThrew = true;
+                    }
+                    if (interpreterThrew) {
+                        REQUIRE_THROWS(program.run(row));
+                        continue;
+                    }
+                    double actual = program.run(row);
+                    REQUIRE(ulpDistance(actual, expected) <= maxUlps);
+                    if (expected == 0 && maxUlps == 0) {
+                        REQUIRE(std::signbit(actual) == std::signbit(expected));
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Lowering: rewrites are reported and replace calls") {
+    Evaluator eval;
+    auto ast = parse("x^3 + x / 2 + x^0.5 + x^2.5 + x / 10");
+    // Only the exact rewrites by default: the powers stay calls to std::pow, as in the interpreter
+    auto exact = eval.compile(*ast, { "x" });
+    REQUIRE(exact.optimizationStats().powersExpanded == 0);
+    REQUIRE(exact.optimizationStats().squareRoots == 0);
+    REQUIRE(exact.optimizationStats().divisionsByConstant == 1);
+    REQUIRE(std::count_if(exact.code().begin(), exact.code().end(),
+        [](const Instruction& ins) { return ins.m_op == OpCode::Power; }) == 3);
+
+    eval.setCompileOptions({ .expandPowers = true });
+    auto program = eval.compile(*ast, { "x" });
+    const auto& stats = program.optimizationStats();
+    REQUIRE(stats.powersExpanded == 1);
+    REQUIRE(stats.squareRoots == 1);
+    REQUIRE(stats.divisionsByConstant == 1);
+    REQUIRE(stats.fmaContractions == 0);
+
+    auto count = [&](OpCode op) {
+        return std::count_if(program.code().begin(), program.code().end(), [op](const Instruction& ins) { return ins.m_op == op; });
+    };
+    REQUIRE(count(OpCode::Power) == 1);  // x^2.5
+    REQUIRE(count(OpCode::Divide) == 1); // x / 10 isn't exact as a multiplication
+    REQUIRE(count(OpCode::PowHalf) == 1);
+
+    // x^2 is the same value as x*x, so both share one multiplication
+    auto shared = eval.compile(*parse("x^2 + x*x"), { "x" });
+    REQUIRE(std::count_if(shared.code().begin(), shared.code().end(),
+        [](const Instruction& ins) { return ins.m_op == OpCode::Multiply; }) == 1);
+}
+
+TEST_CASE("Lowering: unused arguments still report domain errors") {
+    Evaluator eval;
+    eval.evaluate(*parse("f(t) = 5"));
+    auto program = eval.compile(*parse("f(sqrt(x)) + f(x * 2)"), { "x" });
+    REQUIRE(program.optimizationStats().deadInstructions == 2); // x * 2 and its constant
+    std::vector<double> row = { -1.0 };
+    REQUIRE_THROWS_WITH(program.run(row), "sqrt requires non-negative argument");
+    REQUIRE_THROWS_WITH(eval.evaluate(*parse("f(sqrt(-1))")), "sqrt requires non-negative argument");
+}
+
+TEST_CASE("Lowering: fused multiply-add is opt-in") {
+    Evaluator eval;
+    auto ast = parse("x * y + 1 - (x * y + z)");
+    auto plain = eval.compile(*ast, { "x", "y", "z" });
+    REQUIRE(plain.optimizationStats().fmaContractions == 0);
+
+    eval.setCompileOptions({ .contractFma = true });
+    auto fused = eval.compile(*ast, { "x", "y", "z" });
+    REQUIRE(fused.optimizationStats().fmaContractions == 2);
+    REQUIRE(fused.optimizationStats().deadInstructions == 1); // The product both additions consumed
+
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> value(-10.0, 10.0);
+    for (int i = 0; i < 200; ++i) {
+        double x = value(rng);
+        double y = value(rng);
+        double z = value(rng);
+        std::vector<double> row = { x, y, z };
+        REQUIRE(fused.run(row) == std::fma(x, y, 1.0) - std::fma(x, y, z));
+        REQUIRE(plain.run(row) == (x * y + 1.0) - (x * y + z));
+    }
+
+    // Reduction bodies are compiled with the evaluator's options too
+    REQUIRE(eval.evaluate(*parse("sum(i, 1, 100, i * 0.1 + 1)")) == eval.evaluate(*parse("sum(i, 1, 100, 1 + 0.1 * i)")));
+}
@@ -0,0 +1,47 @@
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+#include "MemoCache.h"
+
+TEST_CASE("MemoCache: stores and finds results by exact bits") {
+    MemoCache cache;
+    cache.reset(1, 64);
+    std::vector<double> positiveZero = { 0.0 };
+    std::vector<double> negativeZero = { -0.0 };
+    cache.insert(positiveZero, 1.0);
+
+    double result = 0;
+    REQUIRE(cache.lookup(positiveZero, result));
+    REQUIRE(result == 1.0);
+    REQUIRE_FALSE(cache.lookup(negativeZero, result));
+    REQUIRE(cache.stats().hits == 1);
+    REQUIRE(cache.stats().misses == 1);
+}
+
+TEST_CASE("MemoCache: stays bounded under many distinct keys") {
+    MemoCache cache;
+    cache.reset(2, 100);
+    for (int i = 0; i < 10000; ++i) {
+        std::vector<double> args = { static_cast<double>(i), 0.5 };
+        cache.insert(args, i * 2.0);
+    }
+    REQUIRE(cache.stats().entries <= 128);
+    REQUIRE(cache.stats().evictions > 0);
+
+    std::vector<double> last = { 9999.0, 0.5 };
+    double result = 0;
+    REQUIRE(cache.lookup(last, result));
+    REQUIRE(result == 19998.0);
+}
+
+TEST_CASE("MemoCache: clear drops entries but keeps statistics") {
+    MemoCache cache;
+    cache.reset(1);
+    std::vector<double> args = { 3.0 };
+    double result = 0;
+    cache.insert(args, 9.0);
+    REQUIRE(cache.lookup(args, result));
+    cache.clear();
+    REQUIRE_FALSE(cache.lookup(args, result));
+    REQUIRE(cache.stats().hits == 1);
+    REQUIRE(cache.stats().entries == 0);
+}
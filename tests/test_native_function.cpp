@@ -0,0 +1,204 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+
+namespace {
+    std::unique_ptr<ASTNode> parse(const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return parser.parseExpression();
+    }
+
+    double evaluate(Evaluator& eval, const std::string& text) {
+        return eval.evaluate(*parse(text));
+    }
+
+    // Discount factor exp(-r t), counting how it is called
+    struct Counted {
+        std::shared_ptr<std::atomic<int>> scalarCalls = std::make_shared<std::atomic<int>>();
+        std::shared_ptr<std::atomic<int>> batchRows = std::make_shared<std::atomic<int>>();
+
+        NativeFunction function(bool withBatch = true) const {
+            NativeFunction f;
+            f.minArity = f.maxArity = 2;
+            f.scalar = [calls = scalarCalls](std::span<const double> args) {
+                ++*calls;
+                return std::exp(-args[0] * args[1]);
+            };
+            if (withBatch) {
+                f.batch = [rows = batchRows](std::span<const double* const> args, double* out, size_t count) {
+                    *rows += static_cast<int>(count);
+                    for (size_t i = 0; i < count; ++i) {
+                        out[i] = std::exp(-args[0][i] * args[1][i]);
+                    }
+                };
+            }
+            return f;
+        }
+    };
+
+    NativeFunction total() {
+        NativeFunction f;
+        f.minArity = 0;
+        f.maxArity = NativeFunction::s_variadic;
+        f.scalar = [](std::span<const double> args) {
+            double sum = 0;
+            for (double x : args) sum += x;
+            return sum;
+        };
+        return f;
+    }
+}
+
+TEST_CASE("Native functions are called like built-ins") {
+    Evaluator eval;
+    Counted counted;
+    eval.registerFunction("df", counted.function());
+    eval.registerFunction("total", total());
+
+    REQUIRE(evaluate(eval, "df(0.05, 2)") == Catch::Approx(std::exp(-0.1)));
+    REQUIRE(evaluate(eval, "total()") == 0.0);
+    REQUIRE(evaluate(eval, "total(1, 2, 3, 4, 5, 6, 7, 8, 9, 10)") == 55.0);
+    evaluate(eval, "pv(t) = 100 * df(0.05, t)");
+    REQUIRE(evaluate(eval, "pv(1)") == Catch::Approx(100 * std::exp(-0.05)));
+
+    REQUIRE_THROWS_WITH(evaluate(eval, "df(1)"), "df expects two arguments");
+    NativeFunction range = total();
+    range.minArity = 1;
+    range.maxArity = 3;
+    eval.registerFunction("some", range);
+    REQUIRE_THROWS_WITH(evaluate(eval, "some()"), "some expects 1 to 3 arguments");
+
+    REQUIRE_THROWS_WITH(eval.registerFunction("sin", total()), "Cannot replace built-in function: sin");
+    REQUIRE_THROWS_WITH(eval.registerFunction("pv", total()), "Function already defined by a formula: pv");
+    REQUIRE_THROWS_WITH(eval.registerFunction("empty", NativeFunction{}), "Native function needs a scalar implementation: empty");
+    REQUIRE_THROWS_WITH(evaluate(eval, "df(x) = x"), "Cannot redefine native function: df");
+}
+
+TEST_CASE("Compiled programs fold, share and batch native calls") {
+    Evaluator eval;
+    Counted counted;
+    eval.registerFunction("df", counted.function());
+
+    SECTION("Calls on constants are folded") {
+        auto program = eval.compile(*parse("df(0.5, 2) * x"), { "x" });
+        REQUIRE(program.optimizationStats().foldedCalls == 1);
+        REQUIRE(std::none_of(program.code().begin(), program.code().end(),
+            [](const Instruction& ins) { return ins.m_op == OpCode::Call; }));
+        double x = 3.0;
+        REQUIRE(program.run(std::span(&x, 1)) == Catch::Approx(3 * std::exp(-1.0)));
+    }
+
+    SECTION("Identical pure calls are computed once, whole blocks at a time") {
+        auto program = eval.compile(*parse("df(r, t) + 2 * df(r, t)"), { "r", "t" });
+        REQUIRE(std::count_if(program.code().begin(), program.code().end(),
+            [](const Instruction& ins) { return ins.m_op == OpCode::Call; }) == 1);
+        std::vector<double> r(1000, 0.01);
+        std::vector<double> t(1000);
+        std::vector<double> out(1000);
+        for (size_t i = 0; i < t.size(); ++i) {
+            t[i] = static_cast<double>(i);
+        }
+        const double* inputs[] = { r.data(), t.data() };
+        program.runBatch(std::span(inputs), out.data(), out.size());
+        REQUIRE(*counted.batchRows == 1000);
+        REQUIRE(*counted.scalarCalls == 0);
+        REQUIRE(out[700] == Catch::Approx(3 * std::exp(-7.0)));
+
+        // Float programs convert through the scalar implementation
+        auto narrow = eval.compile(*parse("df(0.01, t)"), { "t" });
+        float time = 700.0f;
+        REQUIRE(narrow.run<float>(std::span(&time, 1)) == Catch::Approx(std::exp(-7.0)).epsilon(1e-6));
+        REQUIRE(*counted.scalarCalls == 1);
+    }
+
+    SECTION("Range reductions run compiled through the batch variant") {
+        REQUIRE(evaluate(eval, "sum(i, 1, 100000, df(0.00001, i))")
+            == Catch::Approx((std::exp(-0.00001) - std::exp(-1.00001)) / (1 - std::exp(-0.00001))));
+        REQUIRE(*counted.batchRows == 100000);
+    }
+}
+
+TEST_CASE("Impure native functions are never shared, folded or memoized") {
+    Evaluator eval;
+    auto counter = std::make_shared<int>(0);
+    NativeFunction tick;
+    tick.minArity = tick.maxArity = 0;
+    tick.pure = false;
+    tick.scalar = [counter](std::span<const double>) { return static_cast<double>(++*counter); };
+    eval.registerFunction("tick", tick);
+
+    auto program = eval.compile(*parse("tick() - tick()"));
+    REQUIRE_FALSE(program.pure());
+    REQUIRE(program.optimizationStats().foldedCalls == 0);
+    REQUIRE(program.run({}) == -1.0);
+
+    // Serial and in row order, even over a range large enough to go parallel
+    *counter = 0;
+    REQUIRE(evaluate(eval, "sum(i, 1, 100000, tick())") == 0.0 + 100000.0 * 100001.0 / 2);
+
+    eval.setMemoization(true);
+    evaluate(eval, "f(x) = x + tick()");
+    evaluate(eval, "f(1)");
+    evaluate(eval, "f(1)");
+    REQUIRE(eval.memoStats("f").hits == 0);
+
+    NativeFunction twice = Counted{}.function(false);
+    eval.registerFunction("df", twice);
+    evaluate(eval, "g(x) = df(x, 2)");
+    evaluate(eval, "g(1)");
+    evaluate(eval, "g(1)");
+    REQUIRE(eval.memoStats("g").hits == 1);
+
+    // Re-registering as impure drops the cached analysis
+    twice.pure = false;
+    eval.registerFunction("df", twice);
+    evaluate(eval, "g(1)");
+    evaluate(eval, "g(1)");
+    REQUIRE(eval.memoStats("g").hits == 1); // No new hits
+}
+
+TEST_CASE("Mutually recursive functions reaching an impure native are not memoized") {
+    Evaluator eval;
+    auto counter = std::make_shared<int>(0);
+    NativeFunction tick;
+    tick.minArity = tick.maxArity = 0;
+    tick.pure = false;
+    tick.scalar = [counter](std::span<const double>) { return static_cast<double>(++*counter); };
+    eval.registerFunction("tick", tick);
+
+    eval.setMemoization(true);
+    evaluate(eval, "f(x) = if(x > 0, g(x - 1), tick())");
+    evaluate(eval, "g(x) = f(x)");
+    // f is analysed first, so g is analysed while f's analysis is still in progress
+    REQUIRE(evaluate(eval, "f(2)") == 1.0);
+    REQUIRE(evaluate(eval, "g(1)") == 2.0);
+    REQUIRE(evaluate(eval, "g(1)") == 3.0);
+    REQUIRE(eval.memoStats("f").hits == 0);
+    REQUIRE(eval.memoStats("g").hits == 0);
+}
+
+TEST_CASE("Native functions apply elementwise to arrays") {
+    Evaluator eval;
+    Counted counted;
+    eval.registerFunction("df", counted.function());
+    auto values = std::get<Array>(eval.evaluateValue(*parse("df(0.5, range(0, 1000))")));
+    REQUIRE(values.size() == 1000);
+    REQUIRE(values[999] == Catch::Approx(std::exp(-499.5)));
+    REQUIRE(*counted.batchRows == 1000);
+    REQUIRE(*counted.scalarCalls == 0);
+
+    Counted scalarOnly;
+    eval.registerFunction("slow", scalarOnly.function(false));
+    auto slow = std::get<Array>(eval.evaluateValue(*parse("slow([1, 2, 3], 1)")));
+    REQUIRE(slow[2] == Catch::Approx(std::exp(-3.0)));
+    REQUIRE(*scalarOnly.scalarCalls == 3);
+}
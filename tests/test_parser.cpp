@@ -1,5 +1,6 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
+#include "Lexer.h"
 #include "Parser.h"
 #include "Token.h"
 #include "AST.h"
@@ -320,4 +321,140 @@ TEST_CASE("Parser: Invalid operator as unary (3*+)") {
 
     Parser parser(tokens);
     REQUIRE_THROWS_AS(parser.parseExpression(), std::runtime_error);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Parser: Left-associative chain becomes one n-ary node (1-2-3)") {
+    std::vector<Token> tokens = {
+        Token(1.0),
+        Token(OperatorType::Subtract),
+        Token(2.0),
+        Token(OperatorType::Subtract),
+        Token(3.0)
+    };
+
+    Parser parser(tokens);
+    auto ast = parser.parseExpression();
+
+    REQUIRE(ast->m_type == NodeType::Operator);
+    REQUIRE(ast->getValue<OperatorType>() == OperatorType::Subtract);
+    REQUIRE(ast->m_children.size() == 3);
+    REQUIRE(ast->m_children[0]->getValue<double>() == Catch::Approx(1.0));
+    REQUIRE(ast->m_children[2]->getValue<double>() == Catch::Approx(3.0));
+}
+
+TEST_CASE("Parser: Power is right-associative (2^3^2)") {
+    std::vector<Token> tokens = {
+        Token(2.0),
+        Token(OperatorType::Power),
+        Token(3.0),
+        Token(OperatorType::Power),
+        Token(2.0)
+    };
+
+    Parser parser(tokens);
+    auto ast = parser.parseExpression();
+
+    REQUIRE(ast->getValue<OperatorType>() == OperatorType::Power);
+    REQUIRE(ast->m_children.size() == 2);
+    REQUIRE(ast->m_children[0]->m_type == NodeType::Number);
+    REQUIRE(ast->m_children[1]->m_type == NodeType::Operator);
+    REQUIRE(ast->m_children[1]->getValue<OperatorType>() == OperatorType::Power);
+}
+
+TEST_CASE("Parser: Binary minus after factorial (3!-1)") {
+    std::vector<Token> tokens = {
+        Token(3.0),
+        Token(OperatorType::Factorial),
+        Token(OperatorType::Subtract),
+        Token(1.0)
+    };
+
+    Parser parser(tokens);
+    auto ast = parser.parseExpression();
+
+    REQUIRE(ast->getValue<OperatorType>() == OperatorType::Subtract);
+    REQUIRE(ast->m_children[0]->getValue<OperatorType>() == OperatorType::Factorial);
+}
+
+TEST_CASE("Parser: One million terms parse into a shallow tree") {
+    const size_t terms = 1000000;
+    std::vector<Token> tokens;
+    tokens.reserve(2 * terms);
+    for (size_t i = 0; i < terms; ++i) {
+        if (i > 0) tokens.emplace_back(OperatorType::Add);
+        tokens.emplace_back(1.0);
+    }
+
+    Parser parser(tokens);
+    auto ast = parser.parseExpression();
+
+    REQUIRE(ast->getValue<OperatorType>() == OperatorType::Add);
+    REQUIRE(ast->m_children.size() == terms);
+}
+
+TEST_CASE("Parser: Nesting beyond the limit is reported") {
+    std::vector<Token> tokens;
+    for (int i = 0; i < 50; ++i) tokens.emplace_back(TokenType::Parenthesis, '(');
+    tokens.emplace_back(1.0);
+    for (int i = 0; i < 50; ++i) tokens.emplace_back(TokenType::Parenthesis, ')');
+
+    Parser shallow(tokens, 10);
+    REQUIRE_THROWS_AS(shallow.parseExpression(), std::runtime_error);
+
+    Parser deep(tokens, 100);
+    REQUIRE(deep.parseExpression()->getValue<double>() == Catch::Approx(1.0));
+}
+
+TEST_CASE("Parser: Trailing tokens are rejected (1 2)") {
+    std::vector<Token> tokens = {
+        Token(1.0),
+        Token(2.0)
+    };
+
+    Parser parser(tokens);
+    REQUIRE_THROWS_AS(parser.parseExpression(), std::runtime_error);
+}
+
+TEST_CASE("Parser: Unmatched closing parenthesis (1+2))") {
+    std::vector<Token> tokens = {
+        Token(1.0),
+        Token(OperatorType::Add),
+        Token(2.0),
+        Token(TokenType::Parenthesis, ')')
+    };
+
+    Parser parser(tokens);
+    REQUIRE_THROWS_AS(parser.parseExpression(), std::runtime_error);
+}
+
+TEST_CASE("Parser: Comparisons bind looser than arithmetic, && tighter than || (a+1<b || c && d)") {
+    Lexer lexer("a + 1 < b || c && d == 2");
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+
+    REQUIRE(ast->getValue<OperatorType>() == OperatorType::Or);
+    const auto& less = *ast->m_children[0];
+    REQUIRE(less.getValue<OperatorType>() == OperatorType::Less);
+    REQUIRE(less.m_children[0]->getValue<OperatorType>() == OperatorType::Add);
+    const auto& conjunction = *ast->m_children[1];
+    REQUIRE(conjunction.getValue<OperatorType>() == OperatorType::And);
+    REQUIRE(conjunction.m_children[1]->getValue<OperatorType>() == OperatorType::Equal);
+}
+
+TEST_CASE("Parser: Comparison chains stay binary, logical chains become n-ary") {
+    Lexer lexer("1 < 2 < 3");
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    REQUIRE(ast->m_children.size() == 2);
+    REQUIRE(ast->m_children[0]->getValue<OperatorType>() == OperatorType::Less);
+
+    Lexer chain("a && b && c && d");
+    Parser chainParser(chain.tokenize());
+    REQUIRE(chainParser.parseExpression()->m_children.size() == 4);
+
+    Lexer assignment("x = y >= 2");
+    Parser assignmentParser(assignment.tokenize());
+    auto assign = assignmentParser.parseExpression();
+    REQUIRE(assign->getValue<OperatorType>() == OperatorType::Assignment);
+    REQUIRE(assign->m_children[1]->getValue<OperatorType>() == OperatorType::GreaterEqual);
+}
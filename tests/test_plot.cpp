@@ -0,0 +1,123 @@
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Plot.h"
+
+namespace {
+    std::unique_ptr<ASTNode> parse(const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return parser.parseExpression();
+    }
+
+    // Largest gap between f and the polyline through the samples, on a dense grid
+    double interpolationError(const std::vector<double>& xs, const std::vector<double>& ys, double (*f)(double)) {
+        double worst = 0;
+        const int dense = 200000;
+        for (int k = 0; k <= dense; ++k) {
+            double x = xs.front() + (xs.back() - xs.front()) * k / dense;
+            size_t i = std::min<size_t>(std::upper_bound(xs.begin(), xs.end(), x) - xs.begin(), xs.size() - 1);
+            i = std::max<size_t>(i, 1);
+            double t = (x - xs[i - 1]) / (xs[i] - xs[i - 1]);
+            worst = std::max(worst, std::abs(f(x) - (ys[i - 1] + t * (ys[i] - ys[i - 1]))));
+        }
+        return worst;
+    }
+
+    double front(double x) {
+        return std::tanh(200.0 * (x - 0.3)) + 0.2 * std::sin(3.0 * x);
+    }
+}
+
+TEST_CASE("Plot: refinement stays within budget and evaluates in batches") {
+    size_t calls = 0;
+    size_t evaluations = 0;
+    BatchFunction f = [&](std::span<const double> points, std::span<double> results) {
+        ++calls;
+        evaluations += points.size();
+        for (size_t i = 0; i < points.size(); ++i) {
+            results[i] = front(points[i]);
+        }
+    };
+    auto curve = sampleAdaptive(f, -1.0, 1.0, { .maxPoints = 300 });
+    REQUIRE(curve.x.size() == curve.y.size());
+    REQUIRE(curve.x.size() <= 300);
+    REQUIRE(evaluations == curve.x.size());
+    REQUIRE(calls == curve.rounds + 1);
+    REQUIRE(curve.x.front() == -1.0);
+    REQUIRE(curve.x.back() == 1.0);
+    REQUIRE(std::is_sorted(curve.x.begin(), curve.x.end()));
+    REQUIRE(std::adjacent_find(curve.x.begin(), curve.x.end()) == curve.x.end());
+}
+
+TEST_CASE("Plot: adaptive samples match a ten times denser uniform grid") {
+    BatchFunction f = [](std::span<const double> points, std::span<double> results) {
+        for (size_t i = 0; i < points.size(); ++i) {
+            results[i] = front(points[i]);
+        }
+    };
+    auto curve = sampleAdaptive(f, -1.0, 1.0, { .maxPoints = 400 });
+    double adaptiveError = interpolationError(curve.x, curve.y, front);
+
+    size_t uniformCount = 10 * curve.x.size();
+    std::vector<double> xs(uniformCount), ys(uniformCount);
+    for (size_t i = 0; i < uniformCount; ++i) {
+        xs[i] = -1.0 + 2.0 * static_cast<double>(i) / static_cast<double>(uniformCount - 1);
+        ys[i] = front(xs[i]);
+    }
+    double uniformError = interpolationError(xs, ys, front);
+    INFO("adaptive " << curve.x.size() << " points: " << adaptiveError << ", uniform " << uniformCount << ": " << uniformError);
+    REQUIRE(adaptiveError < 0.01);
+    REQUIRE(adaptiveError <= uniformError);
+}
+
+TEST_CASE("Plot: domain edges are located and failures become gaps") {
+    Evaluator eval;
+    auto curve = plot(eval, *parse("sqrt(x) + log(x + 2)"), "x", -1.0, 1.0, { .maxPoints = 200 });
+    double lastUndefined = -1.0;
+    double firstDefined = 1.0;
+    for (size_t i = 0; i < curve.x.size(); ++i) {
+        if (std::isnan(curve.y[i])) {
+            lastUndefined = std::max(lastUndefined, curve.x[i]);
+        }
+        else {
+            firstDefined = std::min(firstDefined, curve.x[i]);
+        }
+    }
+    REQUIRE(lastUndefined < 0.0);
+    REQUIRE(firstDefined >= 0.0);
+    REQUIRE(firstDefined - lastUndefined < 1e-6);
+
+    // Reductions can't be compiled; they are sampled through the interpreter
+    auto interpreted = plot(eval, *parse("sum(i, 1, 3, x^i)"), "x", 0.0, 1.0, { .maxPoints = 50 });
+    REQUIRE(interpreted.y.back() == 3.0);
+}
+
+TEST_CASE("Plot: CSV and binary output") {
+    SampledCurve curve{ { 0.0, 0.5, 1.0 }, { 1.0, std::nan(""), 0.25 } };
+
+    std::ostringstream csv;
+    writeCsv(csv, curve);
+    REQUIRE(csv.str() == "x,y\n0,1\n0.5,nan\n1,0.25\n");
+
+    std::ostringstream binary;
+    writeBinary(binary, curve);
+    std::string bytes = binary.str();
+    REQUIRE(bytes.size() == 16 + 6 * sizeof(double));
+    REQUIRE(bytes.substr(0, 8) == "MCPLOT01");
+    uint64_t count;
+    std::memcpy(&count, bytes.data() + 8, sizeof(count));
+    REQUIRE(count == 3);
+    double y2;
+    std::memcpy(&y2, bytes.data() + 16 + 5 * sizeof(double), sizeof(y2));
+    REQUIRE(y2 == 0.25);
+}
@@ -0,0 +1,105 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Lexer.h"
+#include "Parser.h"
+#include "Evaluator.h"
+
+namespace {
+    std::unique_ptr<ASTNode> parse(const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return parser.parseExpression();
+    }
+
+    // c0 + c1*x + ... + c20*x^20 with alternating, decaying coefficients
+    std::string generatedPolynomial() {
+        std::string text = "1";
+        for (int k = 1; k <= 20; ++k) {
+            text += (k % 2 ? " - " : " + ") + std::to_string(1.0 / (k + 1)) + " * x^" + std::to_string(k);
+        }
+        return text;
+    }
+
+    size_t countOps(const Program& program, OpCode op) {
+        return std::count_if(program.code().begin(), program.code().end(), [op](const Instruction& ins) { return ins.m_op == op; });
+    }
+}
+
+TEST_CASE("Polynomial: long polynomials collapse into one instruction") {
+    Evaluator eval;
+    auto ast = parse(generatedPolynomial());
+    auto termwise = eval.compile(*ast, { "x" });
+    REQUIRE(termwise.optimizationStats().polynomials == 0);
+
+    for (auto scheme : { PolynomialScheme::Horner, PolynomialScheme::Estrin }) {
+        eval.setCompileOptions({ .polynomials = scheme });
+        auto program = eval.compile(*ast, { "x" });
+        REQUIRE(program.optimizationStats().polynomials == 1);
+        REQUIRE(program.code().size() == 2); // Input, then the polynomial
+        REQUIRE(countOps(program, scheme == PolynomialScheme::Horner ? OpCode::Horner : OpCode::Estrin) == 1);
+
+        std::vector<double> xs(1000), collapsed(1000), reference(1000);
+        for (size_t i = 0; i < xs.size(); ++i) {
+            xs[i] = -1.5 + 3.0 * static_cast<double>(i) / static_cast<double>(xs.size());
+        }
+        const double* columns[] = { xs.data() };
+        program.runBatch(columns, collapsed.data(), xs.size());
+        termwise.runBatch(columns, reference.data(), xs.size());
+        for (size_t i = 0; i < xs.size(); ++i) {
+            REQUIRE(collapsed[i] == Catch::Approx(reference[i]).epsilon(1e-12));
+            std::vector<double> row = { xs[i] };
+            REQUIRE(program.run(row) == collapsed[i]); // Same scheme for single rows and blocks
+        }
+    }
+}
+
+TEST_CASE("Polynomial: terms are collected algebraically") {
+    Evaluator eval;
+    eval.setCompileOptions({ .polynomials = PolynomialScheme::Horner });
+    eval.evaluate(*parse("k = 3"));
+    eval.evaluate(*parse("sq(t) = t * t"));
+    struct Case {
+        const char* text;
+        double x;
+        double expected;
+    };
+    const Case cases[] = {
+        { "(x + 1)^3 - x^3", 2.0, 19.0 },           // 3x^2 + 3x + 1
+        { "-(x - k) * (x + k) / 2 + x^2", 5.0, 17.0 },  // Globals are coefficients
+        { "2^3 * x^2 + x * 4 - 1 + x", 0.5, 3.5 },
+        { "sq(x + 1) + sq(x) * x", 2.0, 17.0 },     // Inlined bodies see the parameter's register
+    };
+    for (const auto& [text, x, expected] : cases) {
+        INFO(text);
+        auto program = eval.compile(*parse(text), { "x" });
+        std::vector<double> row = { x };
+        REQUIRE(program.run(row) == Catch::Approx(expected));
+    }
+
+    // Small polynomials and anything with a second variable are left to the other lowerings
+    REQUIRE(eval.compile(*parse("x^2 + 1"), { "x" }).optimizationStats().polynomials == 0);
+    auto mixed = eval.compile(*parse("x^3 + 2 * x^2 + x * y + sin(x^2 - 3 * x + 2)"), { "x", "y" });
+    REQUIRE(mixed.optimizationStats().polynomials == 1); // Only the argument of sin
+}
+
+TEST_CASE("Polynomial: rational functions keep their division") {
+    Evaluator eval;
+    eval.setCompileOptions({ .polynomials = PolynomialScheme::Estrin });
+    auto program = eval.compile(*parse("(x^3 + 2 * x + 1) / (x^2 - 1)"), { "x" });
+    REQUIRE(program.optimizationStats().polynomials == 2);
+    REQUIRE(countOps(program, OpCode::Divide) == 1);
+
+    std::vector<double> row = { 3.0 };
+    REQUIRE(program.run(row) == Catch::Approx(34.0 / 8.0));
+    row = { 1.0 };
+    REQUIRE_THROWS_WITH(program.run(row), "Division by zero");
+
+    // Division by a constant is folded into the coefficients, by zero it isn't
+    REQUIRE(eval.compile(*parse("(x^2 + x + 1) / 4"), { "x" }).code().size() == 2);
+    REQUIRE_THROWS_WITH(eval.compile(*parse("(x^2 + x + 1) / 0"), { "x" }).run(row), "Division by zero");
+}
@@ -0,0 +1,105 @@
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Profiler.h"
+
+namespace {
+    std::unique_ptr<ASTNode> parse(const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return parser.parseExpression();
+    }
+
+    const ProfileEntry* find(const std::vector<ProfileEntry>& entries, const std::string& label) {
+        auto it = std::find_if(entries.begin(), entries.end(), [&](const ProfileEntry& e) { return e.label == label; });
+        return it == entries.end() ? nullptr : &*it;
+    }
+}
+
+TEST_CASE("Profiler: nodes are labelled with their source offsets") {
+    Evaluator evaluator;
+    Profiler profiler;
+    evaluator.setProfiler(&profiler);
+    evaluator.evaluate(*parse("1 + sqrt(16) * 2"));
+
+    auto entries = profiler.entries();
+    REQUIRE(entries.size() == 6);
+    for (const char* label : { "+@2", "1@0", "*@13", "sqrt@4", "16@9", "2@15" }) {
+        INFO(label);
+        REQUIRE(find(entries, label) != nullptr);
+        REQUIRE(find(entries, label)->calls == 1);
+    }
+    for (const auto& entry : entries) {
+        REQUIRE(entry.inclusiveNanos >= entry.exclusiveNanos);
+    }
+    REQUIRE(find(entries, "+@2")->inclusiveNanos >= find(entries, "*@13")->inclusiveNanos);
+}
+
+TEST_CASE("Profiler: user function bodies are attributed to the function") {
+    Evaluator evaluator;
+    evaluator.evaluate(*parse("f(t) = t * t")); // Body offsets refer to this text
+    Profiler profiler;
+    evaluator.setProfiler(&profiler);
+    evaluator.evaluate(*parse("f(2) + f(3)"));
+    evaluator.setProfiler(nullptr);
+    evaluator.evaluate(*parse("f(4)"));
+
+    auto entries = profiler.entries();
+    REQUIRE(find(entries, "f@0")->calls == 1);
+    REQUIRE(find(entries, "f@7")->calls == 1);
+    REQUIRE(find(entries, "f:*@9")->calls == 2);
+    REQUIRE(find(entries, "f:t@7")->calls == 2);
+    REQUIRE(find(entries, "f:t@11")->calls == 2);
+
+    std::ostringstream folded;
+    profiler.writeCollapsed(folded);
+    REQUIRE(folded.str().find("+@5;f@7;f:*@9;f:t@11 ") != std::string::npos);
+    std::string line;
+    std::istringstream lines(folded.str());
+    while (std::getline(lines, line)) {
+        REQUIRE(line.find(' ') == line.rfind(' '));
+        REQUIRE(std::stoull(line.substr(line.find(' ') + 1)) > 0);
+    }
+}
+
+TEST_CASE("Profiler: compiled reduction bodies report per-instruction times") {
+    Evaluator evaluator;
+    Profiler profiler;
+    evaluator.setProfiler(&profiler);
+    double value = evaluator.evaluate(*parse("sum(i, 1, 1000, i * i + 1)"));
+    REQUIRE(value == 333834500.0);
+
+    auto entries = profiler.entries();
+    REQUIRE(find(entries, "sum@0") != nullptr);
+    REQUIRE(find(entries, "Multiply@18")->calls == 1000);
+    REQUIRE(find(entries, "Add@22")->calls == 1000);
+    REQUIRE(find(entries, "sum@0")->inclusiveNanos >= find(entries, "Multiply@18")->inclusiveNanos);
+
+    evaluator.setProfiler(nullptr);
+    evaluator.evaluate(*parse("g(t) = 2 * t"));
+    evaluator.setProfiler(&profiler);
+    profiler.clear();
+    evaluator.evaluate(*parse("sum(i, 1, 10, g(i) + 1)"));
+    entries = profiler.entries();
+    REQUIRE(find(entries, "g:Multiply@9")->calls == 10); // Inlined bodies keep their function's name
+
+    profiler.clear();
+    REQUIRE(profiler.entries().empty());
+}
+
+TEST_CASE("Profiler: frames stay balanced when evaluation fails") {
+    Evaluator evaluator;
+    Profiler profiler;
+    evaluator.setProfiler(&profiler);
+    REQUIRE_THROWS(evaluator.evaluate(*parse("1 + 2 / 0")));
+    evaluator.evaluate(*parse("3"));
+    std::ostringstream folded;
+    profiler.writeCollapsed(folded);
+    REQUIRE(folded.str().find("\n3@0 ") != std::string::npos);
+}
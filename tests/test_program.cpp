@@ -0,0 +1,282 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "Lexer.h"
+#include "Parser.h"
+#include "Evaluator.h"
+
+TEST_CASE("Program: compiled result matches the interpreter") {
+    Evaluator eval;
+    const char* expressions[] = {
+        "1 + 2 * 3 - 4 / 8",
+        "2 ^ 10 \\ 3 + 17 % 5",
+        "-sin(pi / 6) + cos(0) * atan2(1, 1)",
+        "sqrt(16) + log(e) + log10(1000) + exp(0)",
+        "min(4, 2, 8) + max(1, 9, 3) + abs(-2) + floor(2.7) + ceil(2.2) + round(2.5)",
+        "5! + factorial(3)",
+    };
+    for (const char* text : expressions) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        auto ast = parser.parseExpression();
+        auto program = eval.compile(*ast);
+        REQUIRE(program.run({}) == eval.evaluate(*ast));
+    }
+}
+
+TEST_CASE("Program: user functions are inlined") {
+    Evaluator eval;
+    Lexer lexer1("f(x) = x^2 + 1");
+    Parser parser1(lexer1.tokenize());
+    auto definition = parser1.parseExpression();
+    eval.evaluate(*definition);
+
+    Lexer lexer2("f(f(y)) * 2");
+    Parser parser2(lexer2.tokenize());
+    auto ast = parser2.parseExpression();
+    auto program = eval.compile(*ast, { "y" });
+    std::vector<double> input = { 2.0 };
+    REQUIRE(program.run(input) == Catch::Approx(52.0));
+}
+
+TEST_CASE("Program: batch evaluation over columns") {
+    Evaluator eval;
+    Lexer lexer("a * b + sqrt(a)");
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    auto program = eval.compile(*ast, { "a", "b" });
+
+    const size_t rows = 1000;
+    std::vector<double> a(rows), b(rows), out(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        a[i] = static_cast<double>(i);
+        b[i] = 0.5 * static_cast<double>(i);
+    }
+    const double* columns[] = { a.data(), b.data() };
+    program.runBatch(columns, out.data(), rows);
+    for (size_t i = 0; i < rows; i += 97) {
+        REQUIRE(out[i] == Catch::Approx(a[i] * b[i] + std::sqrt(a[i])));
+    }
+}
+
+TEST_CASE("Program: registers are reused") {
+    Evaluator eval;
+    Lexer lexer("((((x+1)*2+3)*4+5)*6+7)*8");
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    auto program = eval.compile(*ast, { "x" });
+    REQUIRE(program.registerCount() < program.code().size());
+}
+
+TEST_CASE("Program: domain errors are reported") {
+    Evaluator eval;
+    Lexer lexer("1 / x");
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    auto program = eval.compile(*ast, { "x" });
+    std::vector<double> zero = { 0.0 };
+    REQUIRE_THROWS_AS(program.run(zero), std::runtime_error);
+}
+
+TEST_CASE("Program: rows with integers past 2^53 are detected on request") {
+    Evaluator eval;
+    Lexer lexer("x * x + 1");
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    auto program = eval.compile(*ast, { "x" });
+    auto run = [&program](std::vector<double> column) {
+        auto workspace = program.workspace<double>();
+        workspace.checkIntegers = true;
+        const double* columns[] = { column.data() };
+        std::vector<double> out(column.size());
+        double* outputs[] = { out.data() };
+        program.runBatch<double>(columns, outputs, column.size(), workspace);
+        return workspace.roundedIntegers;
+    };
+    REQUIRE_FALSE(run({ 1.0, 94906265.0, -94906265.0 })); // Squares below 2^53
+    REQUIRE(run({ 1.0, 2.0, 94906267.0 }));
+    REQUIRE_FALSE(run({ 1e10 }));       // 1e20 is past int64, where the interpreter uses double
+    auto workspace = program.workspace<double>();
+    const double* columns[] = { nullptr };
+    double big = 94906267.0;
+    columns[0] = &big;
+    double out;
+    double* outputs[] = { &out };
+    program.runBatch<double>(columns, outputs, 1, workspace);
+    REQUIRE_FALSE(workspace.roundedIntegers); // Only checked when asked for
+}
+
+TEST_CASE("Program: undefined variables fail to compile") {
+    Evaluator eval;
+    Lexer lexer("x + z");
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    REQUIRE_THROWS_AS(eval.compile(*ast, { "x" }), std::runtime_error);
+}
+
+TEST_CASE("Program: float32 batch stays within single-precision error bounds") {
+    Evaluator eval;
+    Lexer lexer("exp(-r * t) * sqrt(t) + sin(r) / (1 + t^2)");
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    auto program = eval.compile(*ast, { "r", "t" });
+
+    const size_t rows = 2000;
+    std::vector<double> r(rows), t(rows), expected(rows);
+    std::vector<float> rf(rows), tf(rows), actual(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        r[i] = 0.01 + 0.1 * static_cast<double>(i % 50);
+        t[i] = 0.25 + 0.01 * static_cast<double>(i);
+        rf[i] = static_cast<float>(r[i]);
+        tf[i] = static_cast<float>(t[i]);
+    }
+    const double* columns[] = { r.data(), t.data() };
+    const float* floatColumns[] = { rf.data(), tf.data() };
+    program.runBatch(columns, expected.data(), rows);
+    program.runBatch<float>(floatColumns, actual.data(), rows);
+
+    for (size_t i = 0; i < rows; ++i) {
+        // A handful of operations, each within half an ulp plus input rounding
+        REQUIRE(std::abs(actual[i] - expected[i]) <= 1e-5 * std::abs(expected[i]) + 1e-6);
+    }
+}
+
+TEST_CASE("Program: extended precision keeps bits double would lose") {
+    Evaluator eval;
+    Lexer lexer("(1 + x) - 1");
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    auto program = eval.compile(*ast, { "x" });
+
+    std::vector<double> tiny = { std::ldexp(1.0, -60) };
+    REQUIRE(program.run(tiny) == 0.0);
+
+    std::vector<long double> tinyExtended = { std::ldexp(1.0L, -60) };
+    if constexpr (std::numeric_limits<long double>::digits > 60) {
+        REQUIRE(program.run<long double>(tinyExtended) == tinyExtended[0]);
+    }
+    else {
+        REQUIRE(program.run<long double>(tinyExtended) == 0.0L);
+    }
+}
+
+TEST_CASE("Program: every precision agrees on a sample expression") {
+    Evaluator eval;
+    Lexer lexer("nCr(10, 4) + gamma(4.5) - log10(x) * atan2(x, 2)");
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    auto program = eval.compile(*ast, { "x" });
+
+    std::vector<double> input = { 3.0 };
+    std::vector<float> inputFloat = { 3.0f };
+    std::vector<long double> inputExtended = { 3.0L };
+    double reference = program.run(input);
+    REQUIRE(program.run<float>(inputFloat) == Catch::Approx(reference).epsilon(1e-6));
+    REQUIRE(static_cast<double>(program.run<long double>(inputExtended)) == Catch::Approx(reference).epsilon(1e-15));
+}
+
+TEST_CASE("Program: fused formulas share common subexpressions") {
+    Evaluator eval;
+    const char* formulas[] = {
+        "s * exp(-r * t)",
+        "k * exp(-r * t)",
+        "(s - k) * exp(-r * t) + t * r",
+    };
+    std::vector<std::unique_ptr<ASTNode>> asts;
+    std::vector<const ASTNode*> roots;
+    size_t separateSize = 0;
+    for (const char* text : formulas) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        asts.push_back(parser.parseExpression());
+        roots.push_back(asts.back().get());
+        separateSize += eval.compile(*asts.back(), { "s", "k", "r", "t" }).code().size();
+    }
+    auto fused = eval.compile(roots, { "s", "k", "r", "t" });
+    REQUIRE(fused.outputCount() == 3);
+    REQUIRE(fused.code().size() < separateSize);
+
+    const size_t rows = 600;
+    std::vector<double> s(rows), k(rows), r(rows), t(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        s[i] = 100.0 + static_cast<double>(i);
+        k[i] = 105.0;
+        r[i] = 0.01 * static_cast<double>(i % 7);
+        t[i] = 0.25 + 0.001 * static_cast<double>(i);
+    }
+    const double* columns[] = { s.data(), k.data(), r.data(), t.data() };
+    std::vector<std::vector<double>> out(3, std::vector<double>(rows));
+    double* outputs[] = { out[0].data(), out[1].data(), out[2].data() };
+    fused.runBatch<double>(columns, outputs, rows);
+
+    for (size_t f = 0; f < roots.size(); ++f) {
+        auto single = eval.compile(*roots[f], { "s", "k", "r", "t" });
+        std::vector<double> expected(rows);
+        single.runBatch(columns, expected.data(), rows);
+        REQUIRE(out[f] == expected);
+    }
+    std::vector<double> row = { 1.0, 2.0, 3.0, 4.0 };
+    REQUIRE_THROWS(fused.run(row));
+}
+
+TEST_CASE("Program: conditions lower to masks and selects") {
+    Evaluator eval;
+    auto compile = [&eval](const std::string& text) {
+        Lexer lexer(text);
+        Parser parser(lexer.tokenize());
+        return eval.compile(*parser.parseExpression(), { "x" });
+    };
+
+    auto piecewise = compile("if(x < 0, -x, if(x <= 1, x^2, 2*x - 1)) + (x > 10 || x == -5)");
+    std::vector<double> x = { -5, -0.5, 0, 0.5, 1, 3, 11, std::nan("") };
+    std::vector<double> out(x.size());
+    const double* column = x.data();
+    piecewise.runBatch(std::span(&column, 1), out.data(), x.size());
+    std::vector<double> expected = { 6, 0.5, 0, 0.25, 1, 5, 22, 0 };
+    for (size_t i = 0; i + 1 < x.size(); ++i) {
+        REQUIRE(out[i] == expected[i]);
+    }
+    REQUIRE(std::isnan(out.back()));
+    REQUIRE(std::none_of(piecewise.code().begin(), piecewise.code().end(),
+        [](const Instruction& ins) { return ins.m_guard != Instruction::s_unguarded; }));
+
+    SECTION("Domain errors count only in rows that take the branch") {
+        auto guarded = compile("if(x > 0, log(x), 0) + (x == 0 || 1 / x > 0)");
+        std::vector<double> values(1000);
+        for (size_t i = 0; i < values.size(); ++i) {
+            values[i] = static_cast<double>(i) - 500.0;
+        }
+        std::vector<double> results(values.size());
+        const double* input = values.data();
+        guarded.runBatch(std::span(&input, 1), results.data(), values.size());
+        REQUIRE(results[0] == 0.0);
+        REQUIRE(results[500] == 1.0);
+        REQUIRE(results[999] == Catch::Approx(std::log(499.0) + 1));
+
+        // The same instruction outside the condition still fails
+        auto unguarded = compile("if(x > 0, log(x), 0) + log(x)");
+        REQUIRE_THROWS_WITH(unguarded.runBatch(std::span(&input, 1), results.data(), values.size()),
+            "log requires positive argument");
+        auto nested = compile("if(x > -10, if(x < 0, sqrt(-x), sqrt(x)), sqrt(x))");
+        REQUIRE_THROWS_WITH(nested.runBatch(std::span(&input, 1), results.data(), values.size()),
+            "sqrt requires non-negative argument");
+        double row = -4;
+        REQUIRE(nested.run(std::span(&row, 1)) == 2.0);
+    }
+
+    SECTION("Constant conditions compile only the branch taken") {
+        auto folded = compile("if(1, x, sum(i, 1, 3, i))");
+        REQUIRE(folded.code().size() == 1);
+    }
+
+    SECTION("Recursive functions stay interpreted") {
+        Lexer lexer("fact(n) = if(n <= 1, 1, n * fact(n - 1))");
+        Parser parser(lexer.tokenize());
+        eval.evaluate(*parser.parseExpression());
+        REQUIRE_THROWS_WITH(compile("fact(x)"), "Recursive functions cannot be compiled: fact");
+    }
+}
@@ -0,0 +1,166 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Lexer.h"
+#include "Parser.h"
+#include "Evaluator.h"
+#include "Random.h"
+#include "Sheet.h"
+#include "ThreadPool.h"
+
+static std::unique_ptr<ASTNode> parse(const std::string& text) {
+    Lexer lexer(text);
+    Parser parser(lexer.tokenize());
+    return parser.parseExpression();
+}
+
+static double evaluate(Evaluator& eval, const std::string& text) {
+    return eval.evaluate(*parse(text));
+}
+
+TEST_CASE("Random: Philox4x32-10 matches the published known-answer tests") {
+    using Block = std::array<uint32_t, 4>;
+    REQUIRE(rng::philox({ 0, 0, 0, 0 }, { 0, 0 }) == Block{ 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 });
+    REQUIRE(rng::philox({ 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff }, { 0xffffffff, 0xffffffff })
+        == Block{ 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd });
+    REQUIRE(rng::philox({ 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 }, { 0xa4093822, 0x299f31d0 })
+        == Block{ 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 });
+}
+
+TEST_CASE("Random: batches give every row the value drawn for it alone") {
+    for (auto distribution : { rng::Distribution::Uniform, rng::Distribution::Normal }) {
+        std::vector<double> batch(1000);
+        rng::fill(distribution, 42, 77, 3, batch.data(), batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            REQUIRE(batch[i] == rng::draw(distribution, 42, 77 + i, 3));
+        }
+    }
+    REQUIRE(rng::draw(rng::Distribution::Uniform, 42, 5, 0) != rng::draw(rng::Distribution::Uniform, 43, 5, 0));
+    REQUIRE(rng::draw(rng::Distribution::Uniform, 42, 5, 0) != rng::draw(rng::Distribution::Uniform, 42, 6, 0));
+    REQUIRE(rng::draw(rng::Distribution::Uniform, 42, 5, 0) != rng::draw(rng::Distribution::Uniform, 42, 5, 1));
+}
+
+TEST_CASE("Random: uniform and normal values have the expected moments") {
+    constexpr size_t rows = 200000;
+    std::vector<double> values(rows);
+    rng::fill(rng::Distribution::Uniform, 1, 0, 0, values.data(), rows);
+    REQUIRE(*std::min_element(values.begin(), values.end()) >= 0.0);
+    REQUIRE(*std::max_element(values.begin(), values.end()) < 1.0);
+    double mean = 0, square = 0;
+    for (double v : values) {
+        mean += v / rows;
+        square += v * v / rows;
+    }
+    REQUIRE(mean == Catch::Approx(0.5).margin(0.005));
+    REQUIRE(square - mean * mean == Catch::Approx(1.0 / 12).margin(0.002));
+
+    rng::fill(rng::Distribution::Normal, 1, 0, 0, values.data(), rows);
+    mean = square = 0;
+    size_t beyondTwo = 0;
+    for (double v : values) {
+        REQUIRE(std::isfinite(v));
+        mean += v / rows;
+        square += v * v / rows;
+        beyondTwo += std::abs(v) > 2;
+    }
+    REQUIRE(mean == Catch::Approx(0.0).margin(0.01));
+    REQUIRE(square == Catch::Approx(1.0).margin(0.02));
+    REQUIRE(static_cast<double>(beyondTwo) / rows == Catch::Approx(0.0455).margin(0.003));
+}
+
+TEST_CASE("Random: compiled programs draw per row and per call") {
+    Evaluator eval;
+    auto options = eval.compileOptions();
+    options.seed = 9;
+    eval.setCompileOptions(options);
+    auto program = eval.compile(*parse("rand() - rand() + 0 * x"), { "x" });
+    REQUIRE(program.randomSites() == 2);
+    REQUIRE(program.seed() == 9);
+
+    constexpr size_t rows = 1000;
+    std::vector<double> x(rows), whole(rows), pieces(rows);
+    const double* column = x.data();
+    program.runBatch<double>({ &column, 1 }, whole.data(), rows);
+    // The two calls are not merged into one value
+    REQUIRE(std::count(whole.begin(), whole.end(), 0.0) == 0);
+    // Split at odd places, the rows keep their values
+    auto workspace = program.workspace<double>(100);
+    for (size_t first : { 0, 333, 700 }) {
+        size_t count = first == 700 ? rows - first : first == 0 ? 333 : 367;
+        const double* offset = x.data() + first;
+        double* out = pieces.data() + first;
+        workspace.firstRow = first;
+        program.runBatch<double>({ &offset, 1 }, { &out, 1 }, count, workspace);
+    }
+    REQUIRE(pieces == whole);
+    double single;
+    workspace.firstRow = 500;
+    program.run<double>(std::span(x.data(), 1), std::span(&single, 1), workspace);
+    REQUIRE(single == whole[500]);
+    // Other precisions round the same draws
+    std::vector<float> narrowInputs(rows), narrow(rows);
+    const float* narrowColumn = narrowInputs.data();
+    program.runBatch<float>({ &narrowColumn, 1 }, narrow.data(), rows);
+    REQUIRE(narrow[123] == Catch::Approx(whole[123]).margin(1e-6));
+
+    auto ranged = eval.compile(*parse("rand(10, 20) + randn(100, 0.001)"));
+    double value = ranged.run({});
+    REQUIRE(value >= 109.9);
+    REQUIRE(value < 120.1);
+    REQUIRE_THROWS_WITH(eval.compile(*parse("rand(1)")), "rand expects zero or two arguments");
+}
+
+TEST_CASE("Random: reductions replay from the seed") {
+    Evaluator eval;
+    eval.setSeed(2024);
+    double first = evaluate(eval, "sum(i, 1, 100000, randn())");
+    double second = evaluate(eval, "sum(i, 1, 100000, randn())");
+    REQUIRE(first != second); // The second reduction continues from the rows the first drew
+    REQUIRE(std::abs(first) < 2000);
+
+    eval.setSeed(2024);
+    REQUIRE(evaluate(eval, "sum(i, 1, 100000, randn())") == first);
+
+    // A body the compiler can't handle is interpreted row by row; the inner sums it runs
+    // each draw rows of their own
+    Evaluator nested;
+    nested.setSeed(7);
+    double mean = evaluate(nested, "sum(i, 1, 200, sum(j, 1, 100, rand())) / 20000");
+    REQUIRE(mean == Catch::Approx(0.5).margin(0.01));
+    nested.setSeed(7);
+    REQUIRE(evaluate(nested, "sum(i, 1, 200, sum(j, 1, 100, rand())) / 20000") == mean);
+}
+
+TEST_CASE("Random: the interpreter draws a new value per call and never memoizes them") {
+    Evaluator eval;
+    eval.setMemoization(true);
+    evaluate(eval, "noise(x) = x + rand()");
+    double a = evaluate(eval, "noise(1)");
+    double b = evaluate(eval, "noise(1)");
+    REQUIRE(a != b);
+    REQUIRE(a >= 1.0);
+    REQUIRE(a < 2.0);
+
+    eval.setSeed(0);
+    double replay = evaluate(eval, "noise(1)");
+    REQUIRE(replay == a);
+    REQUIRE(evaluate(eval, "randn(5, 0)") == 5.0);
+    REQUIRE_THROWS_WITH(evaluate(eval, "randn(1, 2, 3)"), "randn expects zero or two arguments");
+}
+
+TEST_CASE("Random: sheets give the same values serially and in parallel") {
+    Sheet sheet;
+    for (int i = 0; i < 16; ++i) {
+        sheet.add("cell" + std::string(1, static_cast<char>('a' + i)) + " = rand()");
+    }
+    Evaluator serialEval, parallelEval;
+    ThreadPool pool(4);
+    auto serial = sheet.evaluate(serialEval);
+    auto parallel = sheet.evaluate(parallelEval, &pool);
+    REQUIRE(serial == parallel);
+    REQUIRE(std::adjacent_find(serial.begin(), serial.end()) == serial.end());
+}
@@ -0,0 +1,86 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <cmath>
+#include "Reduction.h"
+#include "ThreadPool.h"
+
+namespace {
+    void harmonic(std::span<const double> points, std::span<double> results) {
+        for (size_t i = 0; i < points.size(); ++i) {
+            results[i] = 1.0 / points[i];
+        }
+    }
+}
+
+TEST_CASE("Reduction: result does not depend on thread count") {
+    ThreadPool single(1);
+    ThreadPool several(4);
+    double sequential = reduceRange(ReductionKind::Sum, 1, 1000000, harmonic);
+    double oneThread = reduceRange(ReductionKind::Sum, 1, 1000000, harmonic, &single);
+    double fourThreads = reduceRange(ReductionKind::Sum, 1, 1000000, harmonic, &several);
+
+    REQUIRE(sequential == oneThread);
+    REQUIRE(sequential == fourThreads);
+    REQUIRE(sequential == Catch::Approx(14.392726722865723631).epsilon(1e-14));
+}
+
+TEST_CASE("Reduction: compensated summation keeps small terms") {
+    auto f = [](std::span<const double> points, std::span<double> results) {
+        for (size_t i = 0; i < points.size(); ++i) {
+            results[i] = points[i] == 1 ? 1e16 : 1.0;
+        }
+    };
+    REQUIRE(reduceRange(ReductionKind::Sum, 1, 1001, f) == 1e16 + 1000.0);
+}
+
+TEST_CASE("Reduction: product over a range") {
+    auto f = [](std::span<const double> points, std::span<double> results) {
+        std::copy(points.begin(), points.end(), results.begin());
+    };
+    REQUIRE(reduceRange(ReductionKind::Product, 1, 10, f) == Catch::Approx(3628800.0));
+    REQUIRE(reduceRange(ReductionKind::Product, 3, 2, f) == 1.0);
+}
+
+TEST_CASE("Reduction: Gauss-Kronrod integration") {
+    auto gaussian = [](std::span<const double> points, std::span<double> results) {
+        for (size_t i = 0; i < points.size(); ++i) {
+            results[i] = std::exp(-points[i] * points[i]);
+        }
+    };
+    auto result = integrate(gaussian, -10, 10);
+    REQUIRE(result.converged);
+    REQUIRE(result.value == Catch::Approx(std::sqrt(3.14159265358979323846)).epsilon(1e-12));
+    REQUIRE(result.error < 1e-9);
+
+    auto reversed = integrate(gaussian, 10, -10);
+    REQUIRE(reversed.value == Catch::Approx(-result.value));
+}
+
+TEST_CASE("Reduction: integration refines around a kink") {
+    auto absolute = [](std::span<const double> points, std::span<double> results) {
+        for (size_t i = 0; i < points.size(); ++i) {
+            results[i] = std::abs(points[i] - 0.3);
+        }
+    };
+    auto result = integrate(absolute, 0, 1);
+    REQUIRE(result.converged);
+    REQUIRE(result.value == Catch::Approx(0.29).epsilon(1e-10));
+    REQUIRE(result.evaluations > 15);
+}
+
+TEST_CASE("Reduction: infinite bounds are rejected") {
+    REQUIRE_THROWS_AS(integrate(harmonic, 1, INFINITY), std::runtime_error);
+}
+
+TEST_CASE("ThreadPool: rethrows the lowest failing index") {
+    ThreadPool pool(4);
+    try {
+        pool.parallelFor(100, [](size_t i) {
+            if (i % 10 == 7) throw std::runtime_error(std::to_string(i));
+            });
+        FAIL("Expected an exception");
+    }
+    catch (const std::runtime_error& e) {
+        REQUIRE(std::string(e.what()) == "7");
+    }
+}
@@ -0,0 +1,181 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "Lexer.h"
+#include "Parser.h"
+#include "Columnar.h"
+#include "Evaluator.h"
+#include "Scan.h"
+#include "ThreadPool.h"
+
+static std::unique_ptr<ASTNode> parse(const std::string& text) {
+    Lexer lexer(text);
+    Parser parser(lexer.tokenize());
+    return parser.parseExpression();
+}
+
+// The formula driven row by row from outside, with prev(y) and lag(x, k) as variables
+static std::vector<double> interpretRows(Evaluator& eval, const std::string& text, const std::vector<double>& x, double initial) {
+    auto formula = parse(text);
+    std::vector<double> result;
+    std::unordered_map<std::string, double> vars;
+    double previous = initial;
+    for (size_t i = 0; i < x.size(); ++i) {
+        vars["x"] = x[i];
+        vars["previous"] = previous;
+        vars["lagged"] = i >= 2 ? x[i - 2] : NAN;
+        previous = eval.evaluate(*formula, &vars);
+        result.push_back(previous);
+    }
+    return result;
+}
+
+static std::vector<double> series(size_t rows) {
+    std::vector<double> x(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        x[i] = std::sin(0.001 * static_cast<double>(i)) + 0.5 * std::cos(0.37 * static_cast<double>(i));
+    }
+    return x;
+}
+
+TEST_CASE("Scan: recurrences agree with evaluating row by row") {
+    struct Case {
+        const char* scanned;
+        const char* interpreted;
+        bool linear;
+    };
+    const Case cases[] = {
+        { "0.1 * x + (1 - 0.1) * prev(y)", "0.1 * x + (1 - 0.1) * previous", true },
+        { "prev(y) * 1.0001 + x", "previous * 1.0001 + x", true },
+        { "-(prev(y) - x) / 2 + 3 * x / 4", "-(previous - x) / 2 + 3 * x / 4", true },
+        { "prev(y) / 2 + if(lag(x, 2) > 0, lag(x, 2), 1)", "previous / 2 + if(lagged > 0, lagged, 1)", true },
+        { "x", "x", true },
+        { "max(prev(y), x)", "max(previous, x)", false },
+        { "if(prev(y) > 0, sqrt(prev(y)) + exp(x), x * x)", "if(previous > 0, sqrt(previous) + exp(x), x * x)", false },
+        { "prev(y) * prev(y) * 0.5 + sin(x) * cos(x)", "previous * previous * 0.5 + sin(x) * cos(x)", false },
+    };
+    Evaluator eval;
+    auto x = series(10000);
+    const double* columns[] = { x.data() };
+    for (const auto& c : cases) {
+        Scan scan(eval, *parse(c.scanned), { "x" }, "y");
+        INFO(c.scanned);
+        REQUIRE(scan.linear() == c.linear);
+        std::vector<double> scanned(x.size());
+        scan.run(columns, scanned.data(), x.size(), 0.25);
+        auto expected = interpretRows(eval, c.interpreted, x, 0.25);
+        for (size_t i = 0; i < x.size(); ++i) {
+            REQUIRE(scanned[i] == Catch::Approx(expected[i]).epsilon(1e-12).margin(1e-12));
+        }
+    }
+}
+
+TEST_CASE("Scan: lag reads earlier rows and is NaN before the first") {
+    Evaluator eval;
+    std::vector<double> x = { 1, 2, 4, 8, 16 };
+    const double* columns[] = { x.data() };
+    Scan scan(eval, *parse("x - lag(x, 1) + 0 * lag(x, 3)"), { "x" }, "d");
+    std::vector<double> d(x.size());
+    scan.run(columns, d.data(), x.size());
+    REQUIRE(std::isnan(d[0]));
+    REQUIRE(std::isnan(d[2]));
+    REQUIRE(d[3] == 4.0);
+    REQUIRE(d[4] == 8.0);
+
+    REQUIRE_THROWS_WITH(Scan(eval, *parse("lag(z, 1)"), { "x" }, "y"), "lag takes an input column and a whole number of rows: lag(x, 1)");
+    REQUIRE_THROWS_WITH(Scan(eval, *parse("lag(x, 0.5)"), { "x" }, "y"), "lag takes an input column and a whole number of rows: lag(x, 1)");
+    REQUIRE_THROWS_WITH(Scan(eval, *parse("prev(x)"), { "x" }, "y"), "prev takes the scan's output: prev(y)");
+    REQUIRE_THROWS_WITH(eval.evaluate(*parse("prev(y)")), "prev can only be used in a scan");
+}
+
+TEST_CASE("Scan: linear recurrences give the same bits on any number of threads") {
+    Evaluator eval;
+    // Long enough for several chunks, with growth that would overflow without the decay
+    auto x = series(300000);
+    const double* columns[] = { x.data() };
+    Scan scan(eval, *parse("1.00001 * prev(y) * (1 - 0.00002) + x / 1000"), { "x" }, "y");
+    REQUIRE(scan.linear());
+    std::vector<double> serial(x.size()), parallel(x.size()), small(x.size());
+    scan.run(columns, serial.data(), x.size(), 3.0);
+    scan.run(columns, parallel.data(), x.size(), 3.0, &ThreadPool::shared());
+    ThreadPool two(2);
+    scan.run(columns, small.data(), x.size(), 3.0, &two);
+    REQUIRE(serial == parallel);
+    REQUIRE(serial == small);
+
+    // Chunks after the first start from composed maps, which round differently from
+    // stepping through every row, but only in the last bits of values of order 1..100
+    auto expected = interpretRows(eval, "1.00001 * previous * (1 - 0.00002) + x / 1000", x, 3.0);
+    for (size_t i = 0; i < x.size(); i += 997) {
+        REQUIRE(serial[i] == Catch::Approx(expected[i]).epsilon(1e-10).margin(1e-10));
+    }
+}
+
+TEST_CASE("Scan: failures surface as they do in programs") {
+    Evaluator eval;
+    std::vector<double> x = { 4, 1, -1 };
+    const double* columns[] = { x.data() };
+    Scan root(eval, *parse("sqrt(x) + 0 * prev(y) * prev(y)"), { "x" }, "y");
+    std::vector<double> out(x.size());
+    REQUIRE_THROWS_WITH(root.run(columns, out.data(), x.size()), "sqrt requires non-negative argument");
+
+    // A branch the row doesn't take can't fail it
+    Scan guarded(eval, *parse("if(x > 0, log(x) + prev(y), prev(y) * prev(y))"), { "x" }, "y");
+    guarded.run(columns, out.data(), x.size(), 2.0);
+    REQUIRE(out[0] == Catch::Approx(std::log(4.0) + 2));
+    REQUIRE(out[1] == out[0]);
+    REQUIRE(out[2] == out[0] * out[0]);
+}
+
+TEST_CASE("Scan: columnar files are read in place and written chunk by chunk") {
+    struct TempFile {
+        std::string path;
+        explicit TempFile(const std::string& name)
+            : path{ "/tmp/mathcore_" + name + "_" + std::to_string(::getpid()) + ".cols" } {
+        }
+        ~TempFile() { std::remove(path.c_str()); }
+    };
+    Evaluator eval;
+    // Several chunks of a linear recurrence, and int64 columns read and unread
+    const size_t rows = 150000;
+    auto x = series(rows);
+    std::vector<int64_t> k(rows), unused(rows, -1);
+    std::vector<double> kAsDouble(rows), unusedAsDouble(rows, -1.0);
+    for (size_t i = 0; i < rows; ++i) {
+        k[i] = static_cast<int64_t>(i % 1000);
+        kAsDouble[i] = static_cast<double>(k[i]);
+    }
+    TempFile in("scan_in"), out("scan_out");
+    {
+        ColumnWriter writer(in.path, { { "k", ColumnType::Int64 }, { "unused", ColumnType::Int64 }, { "x", ColumnType::Float64 } }, rows);
+        writer.write(0, 0, std::span<const int64_t>(k));
+        writer.write(1, 0, std::span<const int64_t>(unused));
+        writer.write(2, 0, std::span<const double>(x));
+        writer.close();
+    }
+    ColumnFile input(in.path);
+    const double* columns[] = { kAsDouble.data(), unusedAsDouble.data(), x.data() };
+    for (const char* formula : { "0.5 * prev(y) + k / 1000 + x", "max(prev(y), 0) * 0.5 + if(k > 2, lag(k, 2), x)" }) {
+        Scan scan(eval, *parse(formula), { "k", "unused", "x" }, "y");
+        std::vector<double> expected(rows);
+        scan.run(columns, expected.data(), rows, 1.0, &ThreadPool::shared());
+        {
+            ColumnWriter writer(out.path, { { "y", ColumnType::Float64 } }, rows);
+            scan.run(input, writer, 0, 1.0, &ThreadPool::shared());
+            writer.close();
+        }
+        ColumnFile result(out.path);
+        auto written = result.doubles(0);
+        REQUIRE(std::vector<double>(written.begin(), written.end()) == expected);
+    }
+    ColumnWriter wrongRows(out.path, { { "y", ColumnType::Float64 } }, rows - 1);
+    Scan scan(eval, *parse("prev(y) + x"), { "x" }, "y");
+    REQUIRE_THROWS_AS(scan.run(input, wrongRows, 0), std::invalid_argument);
+}
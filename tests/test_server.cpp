@@ -0,0 +1,151 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "Client.h"
+#include "Server.h"
+
+namespace {
+    // Runs a server on its own thread for the lifetime of the fixture
+    struct RunningServer {
+        Server server;
+        std::thread loop;
+
+        explicit RunningServer(const std::string& address, uint64_t maxSteps = 0)
+            : server{ address, 2 }
+            , loop{ [this, maxSteps] {
+                server.setRequestLimits(maxSteps, {});
+                server.run();
+            } } {
+        }
+        ~RunningServer() {
+            server.stop();
+            loop.join();
+        }
+    };
+
+    std::string socketAddress() {
+        return "unix:/tmp/mathcore-test-" + std::to_string(::getpid()) + ".sock";
+    }
+}
+
+TEST_CASE("Server: define and evaluate within a session") {
+    RunningServer running(socketAddress());
+    Client client(socketAddress());
+    REQUIRE(client.define("x = 4") == 4.0);
+    client.define("f(t) = t^2 + x");
+    REQUIRE(client.evaluate("f(3) + x") == Catch::Approx(17.0));
+
+    REQUIRE_THROWS_WITH(client.evaluate("y + 1"), "Undefined variable: y");
+    REQUIRE_THROWS_WITH(client.define("2 + 2"), "Define expects an assignment");
+    REQUIRE(client.evaluate("x") == 4.0); // The session survives errors
+}
+
+TEST_CASE("Server: requests over the step limit fail without ending the session") {
+    RunningServer running(socketAddress(), 10000);
+    Client client(socketAddress());
+    client.define("f(t) = t + 1");
+    REQUIRE(client.evaluate("f(f(f(1)))") == 4.0);
+    REQUIRE_THROWS_WITH(client.evaluate("sum(i, 1, 1000000, i)"), "Evaluation step limit exceeded");
+    REQUIRE(client.evaluate("f(1)") == 2.0);
+}
+
+TEST_CASE("Server: sessions are isolated") {
+    RunningServer running(socketAddress());
+    Client first(socketAddress());
+    Client second(socketAddress());
+    first.define("a = 1");
+    second.define("a = 2");
+    REQUIRE(first.evaluate("a") == 1.0);
+    REQUIRE(second.evaluate("a") == 2.0);
+}
+
+TEST_CASE("Server: batch evaluation over TCP") {
+    RunningServer running("tcp:0");
+    REQUIRE(running.server.port() != 0);
+    Client client("tcp:" + std::to_string(running.server.port()));
+    client.define("k = 2");
+
+    std::vector<std::vector<double>> columns(2, std::vector<double>(1000));
+    for (size_t i = 0; i < 1000; ++i) {
+        columns[0][i] = static_cast<double>(i);
+        columns[1][i] = 0.5;
+    }
+    for (int repeat = 0; repeat < 2; ++repeat) { // The second request reuses the compiled program
+        auto results = client.batch({ "x", "y" }, { "k * x + y", "sqrt(x) * exp(-y)" }, columns);
+        REQUIRE(results.size() == 2);
+        for (size_t i = 0; i < 1000; i += 111) {
+            REQUIRE(results[0][i] == 2.0 * columns[0][i] + 0.5);
+            REQUIRE(results[1][i] == Catch::Approx(std::sqrt(columns[0][i]) * std::exp(-0.5)));
+        }
+    }
+    // Redefinition invalidates the cached program
+    client.define("k = 3");
+    auto results = client.batch({ "x", "y" }, { "k * x + y" }, columns);
+    REQUIRE(results[0][10] == 30.5);
+    REQUIRE_THROWS_WITH(client.batch({ "x", "y" }, { "sqrt(x - 10)" }, columns), "sqrt requires non-negative argument");
+}
+
+TEST_CASE("Server: batches are bounded by the message size and the request limits") {
+    RunningServer running(socketAddress(), 100000);
+    Client client(socketAddress());
+
+    // No inputs and 2^32 - 1 rows: a tiny request whose results couldn't be sent back
+    std::string payload(1, static_cast<char>(protocol::RequestType::Batch));
+    protocol::putU32(payload, UINT32_MAX);
+    protocol::putU32(payload, 0);
+    protocol::putU32(payload, 1);
+    protocol::putString(payload, "1");
+    REQUIRE_THROWS_WITH(client.request(payload), "Batch results would exceed the maximum message size");
+    // A count larger than the message could hold is refused before anything is allocated
+    std::string names(1, static_cast<char>(protocol::RequestType::Batch));
+    protocol::putU32(names, 1);
+    protocol::putU32(names, UINT32_MAX);
+    REQUIRE_THROWS_WITH(client.request(names), "Truncated message");
+
+    // A valid request whose two result columns together pass the frame limit
+    std::vector<std::vector<double>> columns(1, std::vector<double>(protocol::s_maxPayload / 16, 1.0));
+    REQUIRE_THROWS_WITH(client.batch({ "x" }, { "x", "x + 1" }, columns), "Batch results would exceed the maximum message size");
+
+    // One step per instruction and row
+    columns[0].resize(1000);
+    REQUIRE(client.batch({ "x" }, { "x * 2 + 1" }, columns)[0][999] == 3.0);
+    columns[0].resize(100000);
+    REQUIRE_THROWS_WITH(client.batch({ "x" }, { "x * 2 + 1" }, columns), "Evaluation step limit exceeded");
+    REQUIRE(client.evaluate("1 + 1") == 2.0);
+}
+
+TEST_CASE("Server: concurrent clients and latency stats") {
+    RunningServer running(socketAddress());
+    const size_t clients = 4;
+    const size_t requests = 200;
+    std::vector<std::thread> threads;
+    std::vector<int> mismatches(clients);
+    for (size_t c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c] {
+            Client client(socketAddress());
+            client.define("k = " + std::to_string(c));
+            for (size_t i = 0; i < requests; ++i) {
+                if (client.evaluate("k * 1000 + " + std::to_string(i)) != static_cast<double>(c * 1000 + i)) {
+                    ++mismatches[c];
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (int count : mismatches) {
+        REQUIRE(count == 0);
+    }
+
+    Client client(socketAddress());
+    auto stats = client.stats();
+    REQUIRE(stats.requests == clients * (requests + 1));
+    REQUIRE(stats.p50Micros > 0.0);
+    REQUIRE(stats.p99Micros >= stats.p50Micros);
+}
@@ -0,0 +1,170 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "Lexer.h"
+#include "Parser.h"
+#include "Evaluator.h"
+#include "Sheet.h"
+#include "ThreadPool.h"
+
+// Identifiers are letters only, so cells are named by spelling out their coordinates
+static std::string cellName(int layer, int col) {
+    std::string name = "c";
+    name += static_cast<char>('a' + layer % 26);
+    name += static_cast<char>('a' + col / 26);
+    name += static_cast<char>('a' + col % 26);
+    return name;
+}
+
+static double valueOf(Evaluator& eval, const std::string& name) {
+    Lexer lexer(name);
+    Parser parser(lexer.tokenize());
+    auto ast = parser.parseExpression();
+    return eval.evaluate(*ast);
+}
+
+TEST_CASE("Sheet: cells are evaluated in dependency order") {
+    Evaluator eval;
+    Sheet sheet;
+    sheet.add("total = net + tax");
+    sheet.add("tax = net * rate");
+    sheet.add("");
+    sheet.add("net = 200");
+    sheet.add("rate = 0.25");
+    auto values = sheet.evaluate(eval);
+    REQUIRE(values == std::vector<double>{ 250.0, 50.0, 200.0, 0.25 });
+    REQUIRE(valueOf(eval, "total") == Catch::Approx(250.0));
+
+    auto waves = sheet.schedule(eval);
+    REQUIRE(waves.size() == 3);
+    REQUIRE(waves[0] == std::vector<size_t>{ 2, 3 });
+    REQUIRE(waves[1] == std::vector<size_t>{ 1 });
+    REQUIRE(waves[2] == std::vector<size_t>{ 0 });
+}
+
+TEST_CASE("Sheet: circular references are reported") {
+    Evaluator eval;
+    Sheet sheet;
+    sheet.add("a = c + 1");
+    sheet.add("b = a * 2");
+    sheet.add("c = b - 3");
+    sheet.add("d = 4");
+    REQUIRE_THROWS_WITH(sheet.schedule(eval), "Circular reference: a -> c -> b -> a");
+
+    Sheet self;
+    self.add("x = x + 1");
+    REQUIRE_THROWS_WITH(self.evaluate(eval), "Circular reference: x -> x");
+}
+
+TEST_CASE("Sheet: dependencies through user functions and reductions") {
+    Evaluator eval;
+    Sheet sheet;
+    sheet.add("scaled = f(3)");
+    sheet.add("f(x) = x * k");
+    sheet.add("k = sum(i, 1, n, i)");
+    sheet.add("n = 4");
+    sheet.add("i = 100");
+    sheet.evaluate(eval);
+    REQUIRE(valueOf(eval, "k") == Catch::Approx(10.0));
+    REQUIRE(valueOf(eval, "scaled") == Catch::Approx(30.0));
+
+    // The reduction index is bound, so k does not wait for the cell named i
+    auto waves = sheet.schedule(eval);
+    REQUIRE(waves[0] == std::vector<size_t>{ 2, 3 });
+}
+
+TEST_CASE("Sheet: invalid lines are rejected") {
+    Sheet sheet;
+    REQUIRE_THROWS(sheet.add("1 + 2"));
+    sheet.add("a = 1");
+    REQUIRE_THROWS_WITH(sheet.add("a = 2"), "Variable defined twice in sheet: a");
+    REQUIRE_THROWS(sheet.add("b = (c = 2) + 1"));
+
+    Evaluator eval;
+    Sheet failing;
+    failing.add("x = 1 / zero");
+    failing.add("zero = 0");
+    REQUIRE_THROWS_WITH(failing.evaluate(eval), "x: Division by zero");
+    REQUIRE(valueOf(eval, "zero") == 0.0);
+}
+
+TEST_CASE("Sheet: parallel evaluation matches sequential evaluation") {
+    // A wide, layered sheet: every cell of a layer reads two cells of the layer before
+    std::vector<std::string> lines;
+    const int layers = 20;
+    const int width = 64;
+    for (int layer = layers - 1; layer >= 0; --layer) {
+        for (int col = 0; col < width; ++col) {
+            std::string name = cellName(layer, col);
+            if (layer == 0) {
+                lines.push_back(name + " = " + std::to_string(col) + " * 0.1 + 1");
+                continue;
+            }
+            lines.push_back(name + " = sin(" + cellName(layer - 1, col) + ") * 1.5 + sqrt(abs(" +
+                cellName(layer - 1, (col * 7 + 3) % width) + ")) / " + std::to_string(layer));
+        }
+    }
+
+    Sheet sheet;
+    for (const auto& line : lines) {
+        sheet.add(line);
+    }
+
+    // Reference: the interpreter, one assignment at a time in dependency order
+    Evaluator sequential;
+    for (const auto& wave : sheet.schedule(sequential)) {
+        for (size_t cell : wave) {
+            Lexer lexer(lines[cell]);
+            Parser parser(lexer.tokenize());
+            auto ast = parser.parseExpression();
+            sequential.evaluate(*ast);
+        }
+    }
+    Evaluator parallel;
+    ThreadPool pool(4);
+    sheet.evaluate(parallel, &pool);
+
+    REQUIRE(sheet.schedule(parallel).size() == layers);
+    for (size_t cell = 0; cell < sheet.size(); ++cell) {
+        REQUIRE(valueOf(parallel, sheet.name(cell)) == valueOf(sequential, sheet.name(cell)));
+    }
+}
+
+TEST_CASE("Sheet: compiled cells round powers like the interpreter") {
+    const std::vector<std::string> lines = {
+        "base = 0.7", "seventh = base^7", "mixed = seventh^3 + base^-1 + base^2 * 3^0.5", "cube = 1.1^3",
+    };
+    Sheet sheet;
+    Evaluator sequential;
+    for (const auto& line : lines) {
+        sheet.add(line);
+        valueOf(sequential, line);
+    }
+    Evaluator eval;
+    auto values = sheet.evaluate(eval);
+    for (size_t cell = 0; cell < sheet.size(); ++cell) {
+        INFO(lines[cell]);
+        REQUIRE(values[cell] == valueOf(sequential, sheet.name(cell)));
+    }
+    REQUIRE(values[1] == std::pow(0.7, 7.0));
+}
+
+TEST_CASE("Sheet: cells with integers past 2^53 match sequential evaluation") {
+    Sheet sheet;
+    sheet.add("big = 2^53");
+    sheet.add("odd = (big + 1) % 2");
+    sheet.add("small = (2^40 + 1) % 2");
+    sheet.add("product = (3037000499 * 3037000499) % 1000");
+    sheet.add("total = sum(i, 1, 3, (big + i) % 2)");
+    Evaluator eval;
+    auto values = sheet.evaluate(eval);
+    Evaluator sequential;
+    valueOf(sequential, "big = 2^53");
+    REQUIRE(values[1] == valueOf(sequential, "(big + 1) % 2"));
+    REQUIRE(values[1] == 1.0);
+    REQUIRE(values[2] == 1.0);
+    REQUIRE(values[3] == valueOf(sequential, "(3037000499 * 3037000499) % 1000"));
+    REQUIRE(values[4] == 2.0);
+}
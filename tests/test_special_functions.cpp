@@ -0,0 +1,92 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "SpecialFunctions.h"
+
+TEST_CASE("Special: factorial table matches a running product") {
+    double product = 1.0;
+    for (size_t n = 0; n <= 170; ++n) {
+        if (n > 0) product *= static_cast<double>(n);
+        REQUIRE(special::factorial(static_cast<double>(n)) == product);
+    }
+    REQUIRE(std::isinf(special::factorial(171)));
+    REQUIRE(std::isinf(special::factorial(1000)));
+    REQUIRE_THROWS_AS(special::factorial(-1), std::runtime_error);
+    REQUIRE_THROWS_AS(special::factorial(0.5), std::runtime_error);
+}
+
+TEST_CASE("Special: gamma against the standard library") {
+    for (double x = -4.75; x < 170; x += 0.37) {
+        REQUIRE(special::gamma(x) == Catch::Approx(std::tgamma(x)).epsilon(1e-12));
+    }
+    REQUIRE(special::gamma(5) == 24.0);
+    REQUIRE_THROWS_AS(special::gamma(-3), std::runtime_error);
+}
+
+TEST_CASE("Special: lgamma against the standard library") {
+    for (double x = -4.75; x < 1e6; x = x < 200 ? x + 0.37 : x * 1.7) {
+        REQUIRE(special::lgamma(x) == Catch::Approx(std::lgamma(x)).epsilon(1e-12).margin(1e-13));
+    }
+    REQUIRE_THROWS_AS(special::lgamma(0), std::runtime_error);
+}
+
+TEST_CASE("Special: combinatorics") {
+    REQUIRE(special::nCr(10, 0) == 1.0);
+    REQUIRE(special::nCr(10, 10) == 1.0);
+    REQUIRE(special::nCr(5, 7) == 0.0);
+    REQUIRE(special::nCr(50, 25) == 126410606437752.0);
+    REQUIRE(special::nPr(5, 5) == 120.0);
+    // Past 170! the direct formula would be inf / inf
+    REQUIRE(special::nCr(1000, 3) == 166167000.0);
+    REQUIRE(special::nPr(200, 2) == 39800.0);
+    REQUIRE(special::nCr(1000, 500) == Catch::Approx(2.702882409454365e299).epsilon(1e-10));
+    REQUIRE_THROWS_AS(special::nCr(5.5, 2), std::runtime_error);
+    REQUIRE(special::lfact(0) == 0.0);
+}
+
+TEST_CASE("Special: combinatorics are exact integers up to 2^53") {
+    // Pascal's triangle, saturating in uint64 so anything past 2^53 is known to be past it,
+    // alongside a double copy for the results that can only be approximated
+    constexpr uint64_t limit = uint64_t{ 1 } << 53;
+    constexpr uint64_t saturated = std::numeric_limits<uint64_t>::max();
+    constexpr size_t maxK = 170;
+    std::vector<uint64_t> exact(maxK + 1, 0);
+    std::vector<double> approximate(maxK + 1, 0.0);
+    exact[0] = 1;
+    approximate[0] = 1.0;
+    size_t mismatches = 0;
+    for (uint64_t n = 0; n <= 3000; ++n) {
+        if (n > 0) {
+            for (size_t k = std::min<uint64_t>(n, maxK); k > 0; --k) {
+                exact[k] = exact[k] > saturated - exact[k - 1] ? saturated : exact[k] + exact[k - 1];
+                approximate[k] += approximate[k - 1];
+            }
+        }
+        // Every k while n! is finite, then the small k the log-space formula used to round badly
+        size_t lastK = n <= 170 ? n : 8;
+        uint64_t kFactorial = 1;
+        for (size_t k = 0; k <= lastK; ++k) {
+            if (k > 0) kFactorial *= k;
+            auto nd = static_cast<double>(n);
+            auto kd = static_cast<double>(k);
+            if (exact[k] <= limit) {
+                mismatches += special::nCr(nd, kd) != static_cast<double>(exact[k]);
+            }
+            else {
+                REQUIRE(special::nCr(nd, kd) == Catch::Approx(approximate[k]).epsilon(1e-9));
+            }
+            // k! is exact in uint64 up to 20!, and past that the permutations are past 2^53
+            if (k <= 20 && exact[k] <= limit / kFactorial) {
+                mismatches += special::nPr(nd, kd) != static_cast<double>(exact[k] * kFactorial);
+            }
+        }
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(special::nCr(55, 24) == 2488589544741300.0);
+    REQUIRE(special::nPr(55, 9) == 2307336935904000.0);
+    REQUIRE(special::nCr(172, 8) == 16104878212995.0);
+}
@@ -0,0 +1,89 @@
+// Load generator for `cmdCalc --serve`: several clients, each sending requests
+// back to back, then client-side and server-side latency percentiles.
+#include "Client.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double percentile(std::vector<double>& samples, double p) {
+        auto rank = static_cast<size_t>(p * static_cast<double>(samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+        return samples[rank];
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: cmdCalcLoad unix:PATH|tcp:PORT [clients=4] [requests=10000] [batchRows=0]\n";
+        return 1;
+    }
+    std::string address = argv[1];
+    size_t clients = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4;
+    size_t requests = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 10000;
+    size_t batchRows = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 0;
+
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<std::string> errors(clients);
+    auto begin = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c] {
+            try {
+                Client client(address);
+                client.define("k = " + std::to_string(c + 1));
+                std::vector<std::vector<double>> columns(1, std::vector<double>(batchRows));
+                for (size_t row = 0; row < batchRows; ++row) {
+                    columns[0][row] = static_cast<double>(row) * 0.01;
+                }
+                latencies[c].reserve(requests);
+                for (size_t i = 0; i < requests; ++i) {
+                    auto start = Clock::now();
+                    if (batchRows > 0) {
+                        client.batch({ "x" }, { "k * sin(x) + sqrt(x)", "exp(-x) * k" }, columns);
+                    }
+                    else {
+                        client.evaluate("k * sin(" + std::to_string(i % 100) + ") + sqrt(2)");
+                    }
+                    latencies[c].push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+                }
+            }
+            catch (const std::exception& e) {
+                errors[c] = e.what();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    for (size_t c = 0; c < clients; ++c) {
+        if (!errors[c].empty()) {
+            std::cerr << "client " << c << ": " << errors[c] << '\n';
+            return 1;
+        }
+    }
+    std::vector<double> all;
+    for (const auto& samples : latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    if (all.empty()) {
+        return 0;
+    }
+    std::cout << all.size() << " requests in " << seconds << " s ("
+        << static_cast<double>(all.size()) / seconds << " req/s)\n";
+    std::cout << "client latency: p50 " << percentile(all, 0.50) << " us, p99 " << percentile(all, 0.99) << " us\n";
+
+    Client client(address);
+    auto server = client.stats();
+    std::cout << "server latency: p50 " << server.p50Micros << " us, p99 " << server.p99Micros
+        << " us over " << server.requests << " requests\n";
+    return 0;
+}